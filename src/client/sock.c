@@ -414,6 +414,9 @@ sdb_client_rpc(sdb_client_t *client,
 	uint32_t rcode = 0;
 	ssize_t status;
 
+	/* start of a chunked result, if any */
+	size_t chunks_offset = SIZE_MAX;
+
 	if (! buf)
 		return -1;
 
@@ -442,18 +445,42 @@ sdb_client_rpc(sdb_client_t *client,
 
 		if (rcode == SDB_CONNECTION_LOG) {
 			uint32_t prio = 0;
-			if (sdb_proto_unmarshal_int32(SDB_STRBUF_STR(buf), &prio) < 0) {
+			if (sdb_proto_unmarshal_int32(sdb_strbuf_string(buf) + offset,
+						sdb_strbuf_len(buf) - offset, &prio) < 0) {
 				sdb_log(SDB_LOG_WARNING, "client: Received a LOG message "
 						"with invalid or missing priority");
 				prio = (uint32_t)SDB_LOG_ERR;
 			}
+			else
+				sdb_strbuf_skip(buf, offset, sizeof(prio));
 			sdb_log((int)prio, "client: %s", sdb_strbuf_string(buf) + offset);
 			sdb_strbuf_skip(buf, offset, sdb_strbuf_len(buf) - offset);
 			continue;
 		}
+
+		if (chunks_offset != SIZE_MAX) {
+			if ((rcode == SDB_CONNECTION_DATA_CHUNK)
+					|| (rcode == SDB_CONNECTION_DATA)) {
+				/* strip the result type repeated in each part */
+				sdb_strbuf_skip(buf, offset, sizeof(uint32_t));
+			}
+			else {
+				/* discard the partial result */
+				sdb_strbuf_skip(buf, chunks_offset, offset - chunks_offset);
+				chunks_offset = SIZE_MAX;
+			}
+		}
+
+		if (rcode == SDB_CONNECTION_DATA_CHUNK) {
+			if (chunks_offset == SIZE_MAX)
+				chunks_offset = offset;
+			continue;
+		}
 		break;
 	}
 
+	if (chunks_offset != SIZE_MAX)
+		status = (ssize_t)(sdb_strbuf_len(buf) - chunks_offset);
 	if (code)
 		*code = rcode;
 	return status;
@@ -473,6 +500,22 @@ sdb_client_send(sdb_client_t *client,
 	return client->write(client, buf, sizeof(buf));
 } /* sdb_client_send */
 
+ssize_t
+sdb_client_send_query(sdb_client_t *client, uint32_t chunk_size,
+		uint32_t query_len, const char *query)
+{
+	char buf[sizeof(uint32_t) + query_len];
+
+	if (! chunk_size)
+		return sdb_client_send(client, SDB_CONNECTION_QUERY, query_len, query);
+
+	sdb_proto_marshal_int32(buf, sizeof(buf), chunk_size);
+	if (query_len)
+		memcpy(buf + sizeof(uint32_t), query, query_len);
+	return sdb_client_send(client, SDB_CONNECTION_QUERY_CHUNKED,
+			(uint32_t)sizeof(buf), buf);
+} /* sdb_client_send_query */
+
 ssize_t
 sdb_client_recv(sdb_client_t *client,
 		uint32_t *code, sdb_strbuf_t *buf)
@@ -35,10 +35,14 @@
 #include "core/memstore.h"
 #include "core/store.h"
 #include "utils/avltree.h"
+#include "utils/hashtable.h"
+#include "utils/strbuf.h"
 
 #include <sys/types.h>
 #include <regex.h>
 
+#include <pthread.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -47,6 +51,19 @@ extern "C" {
  * core types
  */
 
+typedef struct attr_index attr_index_t;
+typedef struct trigram_index trigram_index_t;
+typedef struct store_view store_view_t;
+
+/* set of backend IDs (see below) */
+typedef struct {
+	/* the first 64 backends */
+	uint64_t bits;
+	/* further backends; ext[0] holds the number of words following it */
+	uint64_t *ext;
+} backend_set_t;
+#define BACKEND_SET_INIT { 0, NULL }
+
 struct sdb_memstore_obj {
 	sdb_object_t super;
 #define _name super.name
@@ -57,8 +74,7 @@ struct sdb_memstore_obj {
 	/* common meta information */
 	sdb_time_t last_update;
 	sdb_time_t interval; /* moving average */
-	char **backends;
-	size_t backends_num;
+	backend_set_t backends;
 	sdb_memstore_obj_t *parent;
 };
 #define STORE_OBJ(obj) ((sdb_memstore_obj_t *)(obj))
@@ -72,10 +88,14 @@ typedef struct {
 #define ATTR(obj) ((attr_t *)(obj))
 #define CONST_ATTR(obj) ((const attr_t *)(obj))
 
+/* Child objects are kept in AVL trees for ordered iteration and in hash
+ * tables for fast lookups by name; both always contain the same objects. */
+
 typedef struct {
 	sdb_memstore_obj_t super;
 
 	sdb_avltree_t *attributes;
+	sdb_hashtable_t *attributes_idx;
 } service_t;
 #define SVC(obj) ((service_t *)(obj))
 #define CONST_SVC(obj) ((const service_t *)(obj))
@@ -89,6 +109,7 @@ typedef struct {
 	sdb_memstore_obj_t super;
 
 	sdb_avltree_t *attributes;
+	sdb_hashtable_t *attributes_idx;
 
 	metric_store_t *stores;
 	size_t stores_num;
@@ -101,14 +122,366 @@ typedef struct {
 	sdb_avltree_t *services;
 	sdb_avltree_t *metrics;
 	sdb_avltree_t *attributes;
+	sdb_hashtable_t *services_idx;
+	sdb_hashtable_t *metrics_idx;
+	sdb_hashtable_t *attributes_idx;
+
+	/* store epoch at which this version of the host was created; hosts
+	 * visible to a pinned view are copied before modifying them */
+	uint64_t epoch;
+	/* next old version released along with the same view */
+	sdb_memstore_obj_t *next_retired;
 } host_t;
 #define HOST(obj) ((host_t *)(obj))
 #define CONST_HOST(obj) ((const host_t *)(obj))
 
+/* number of locks shared by all hosts */
+#define HOST_LOCKS_NUM 32
+
+struct sdb_memstore {
+	sdb_object_t super;
+
+	/* hosts are the top-level entries and
+	 * reference everything else */
+	sdb_avltree_t *hosts;
+	sdb_hashtable_t *hosts_idx;
+
+	/* The host_lock is held for reading by all users of the store and
+	 * for writing only when replacing the indexes. Writers additionally
+	 * hold the host lock selected by the name of the host they update;
+	 * readers requiring a consistent state hold all host locks. */
+	pthread_rwlock_t host_lock;
+	pthread_mutex_t host_locks[HOST_LOCKS_NUM];
+
+	/* serializes expiry runs; name of the host to continue with */
+	pthread_mutex_t expire_lock;
+	char *expire_next;
+
+	/* optional indexes of attribute values and of the trigrams of names
+	 * and selected attribute values (updated by writers concurrently) */
+	attr_index_t *attr_index;
+	trigram_index_t *trigram_index;
+
+	/* pinned views (newest first) and the current epoch; modified is set
+	 * when changing the store after creating the newest view (protected
+	 * by view_lock) */
+	pthread_mutex_t view_lock;
+	store_view_t *views;
+	uint64_t epoch;
+	bool modified;
+
+	/* number of threads used for full scans (protected by view_lock) */
+	size_t scan_threads;
+};
+
 /* shortcuts for accessing service/host attributes */
 #define _last_update super.last_update
 #define _interval super.interval
 
+/*
+ * store views:
+ * A view pins a consistent, read-only version of the store. While any view
+ * is pinned, writers replace hosts visible to it with a copy before
+ * modifying them and keep old versions around until all views which might
+ * refer to them have been released. Objects looked up while pinning a view
+ * may thus be accessed without holding the store's host_lock until the view
+ * is released.
+ *
+ * Views act as epochs of a reclamation scheme: hosts which have been
+ * replaced or removed are retired to the newest view and passed on to the
+ * next older view when releasing it. They are freed once no older view
+ * remains, that is, once no reader may still access them.
+ */
+
+struct store_view {
+	uint64_t epoch;
+	size_t pins;
+
+	/* all hosts at the time the view was created (without references);
+	 * only available if requested when pinning the view */
+	sdb_object_t **hosts;
+	size_t hosts_num;
+
+	/* old versions of hosts replaced while this was the newest view */
+	sdb_memstore_obj_t *retired;
+
+	store_view_t *older;
+	store_view_t *newer;
+};
+
+/*
+ * sdb_memstore_view_pin:
+ * Pin a view of the current version of the store. Views are shared between
+ * readers as long as the store does not change. If 'hosts' is true, the
+ * view provides a list of all hosts. All host locks have to be held while
+ * pinning the view (see sdb_memstore_lock_all) but may be released
+ * afterwards.
+ *
+ * Returns:
+ *  - the pinned view on success
+ *  - NULL else
+ */
+store_view_t *
+sdb_memstore_view_pin(sdb_memstore_t *store, bool hosts);
+
+/*
+ * sdb_memstore_view_try_pin:
+ * Pin the newest view without holding any of the store's locks. This only
+ * succeeds if the store has not changed since creating the view (and if
+ * the view provides a list of all hosts, if requested).
+ *
+ * Returns:
+ *  - the pinned view on success
+ *  - NULL else; use sdb_memstore_view_pin instead
+ */
+store_view_t *
+sdb_memstore_view_try_pin(sdb_memstore_t *store, bool hosts);
+
+/*
+ * sdb_memstore_view_release:
+ * Release a view, freeing any old versions of objects which are no longer
+ * visible to any other view. The store's locks do not have to be held.
+ */
+void
+sdb_memstore_view_release(sdb_memstore_t *store, store_view_t *view);
+
+/*
+ * sdb_memstore_lock_all, sdb_memstore_unlock_all:
+ * Acquire (release) the store's host_lock for reading and all host locks,
+ * excluding all writers while accessing the store.
+ */
+void
+sdb_memstore_lock_all(sdb_memstore_t *store);
+void
+sdb_memstore_unlock_all(sdb_memstore_t *store);
+
+/*
+ * backends:
+ * Backend names are registered once for the lifetime of the process and
+ * identified by small, non-negative integers afterwards. Names are matched
+ * ignoring case. The registry is process-global: all stores share the same
+ * IDs and destroying a store does not release any of them.
+ */
+
+/*
+ * sdb_memstore_backend_id:
+ * Look up the ID of a backend, registering the backend first if 'create' is
+ * true.
+ *
+ * Returns:
+ *  - the ID on success
+ *  - a negative value if the backend is unknown or on error
+ */
+int
+sdb_memstore_backend_id(const char *name, bool create);
+
+/*
+ * sdb_memstore_backend_name:
+ * Returns the name of the backend with the specified ID or NULL if there is
+ * no such backend. The name remains valid for the lifetime of the process.
+ */
+const char *
+sdb_memstore_backend_name(int id);
+
+/*
+ * sdb_memstore_backends_add, sdb_memstore_backends_has:
+ * Add a backend ID to a set or check if it's part of it.
+ */
+int
+sdb_memstore_backends_add(backend_set_t *set, int id);
+bool
+sdb_memstore_backends_has(const backend_set_t *set, int id);
+
+/*
+ * sdb_memstore_backends_names:
+ * Store the names of up to 'len' backends of the set in 'names', ordered by
+ * their IDs.
+ *
+ * Returns:
+ *  - the number of backends in the set
+ */
+size_t
+sdb_memstore_backends_names(const backend_set_t *set,
+		const char **names, size_t len);
+
+/*
+ * sdb_memstore_backends_copy, sdb_memstore_backends_clear:
+ * Copy a set of backends or remove all backends from it, releasing any
+ * memory used by it.
+ */
+int
+sdb_memstore_backends_copy(backend_set_t *dst, const backend_set_t *src);
+void
+sdb_memstore_backends_clear(backend_set_t *set);
+
+/*
+ * persistence
+ */
+
+/* record types; objects use their respective store type */
+#define RECORD_END 0
+
+/* size of a record header: type, payload length, checksum */
+#define RECORD_HEADER_LEN (3 * sizeof(uint32_t))
+
+/* buffer collecting encoded records */
+typedef struct {
+	sdb_strbuf_t *buf;
+	sdb_strbuf_t *payload; /* scratch space */
+	size_t records;
+} record_buf_t;
+
+/*
+ * sdb_memstore_record_writer:
+ * A store writer encoding all objects as records. It expects a wrapper
+ * object of a record buffer as its user-data argument and appends a record
+ * to the buffer for each object.
+ */
+extern sdb_store_writer_t sdb_memstore_record_writer;
+
+/*
+ * sdb_memstore_load_records:
+ * Decode all records from the specified memory area and store the objects in
+ * the specified store. Loading stops at the end of the data, at an end
+ * record, or at the first invalid or incomplete record. The number of bytes
+ * consumed is returned in 'consumed'. Objects which cannot be stored do not
+ * abort loading.
+ *
+ * Returns:
+ *  - the number of loaded records on success
+ *  - a negative value if storing any of the objects failed
+ */
+ssize_t
+sdb_memstore_load_records(sdb_memstore_t *store, const char *data,
+		size_t len, size_t *consumed);
+
+/*
+ * indexes
+ */
+
+/* Plan for selecting candidate objects from the indexes: EQ and IN nodes
+ * select all objects having one of the specified values for an attribute
+ * from the attribute index, REGEX nodes select all objects whose name (or
+ * attribute value) includes all of the specified trigrams from the trigram
+ * index, AND and OR nodes combine the candidates of their operands. */
+typedef struct index_plan index_plan_t;
+struct index_plan {
+	/* MATCHER_EQ, MATCHER_IN, MATCHER_REGEX, MATCHER_AND, or MATCHER_OR */
+	int type;
+
+	/* EQ, IN, REGEX */
+	char *key; /* attribute key; NULL for names (REGEX only) */
+	char **values; /* see sdb_memstore_attr_index_value; or trigrams */
+	size_t values_num;
+	bool arrays; /* include all objects with array values */
+
+	/* AND, OR */
+	index_plan_t *left;
+	index_plan_t *right;
+};
+
+/*
+ * sdb_memstore_attr_index_value:
+ * Format a value for use as an index key. Values which compare as equal
+ * (case-insensitive) are formatted the same way (with the exception of
+ * decimals, which may not be looked up in the index). Returns a newly
+ * allocated string or NULL for NULL values or on error.
+ */
+char *
+sdb_memstore_attr_index_value(const sdb_data_t *value);
+
+attr_index_t *
+sdb_memstore_attr_index_create(void);
+void
+sdb_memstore_attr_index_destroy(attr_index_t *idx);
+
+/*
+ * sdb_memstore_attr_index_add, sdb_memstore_attr_index_remove:
+ * Add an attribute with its current value to the index or remove it. The
+ * index refers to the attribute's parent object without holding a
+ * reference; the lock of the attribute's host has to be held.
+ */
+int
+sdb_memstore_attr_index_add(attr_index_t *idx, sdb_memstore_obj_t *attr);
+void
+sdb_memstore_attr_index_remove(attr_index_t *idx, sdb_memstore_obj_t *attr);
+
+/*
+ * sdb_memstore_trigram_index_create:
+ * Create a trigram index of the names of hosts, services, and metrics and
+ * of the values of the attributes with the specified keys.
+ */
+trigram_index_t *
+sdb_memstore_trigram_index_create(const char * const *keys, size_t keys_num);
+void
+sdb_memstore_trigram_index_destroy(trigram_index_t *idx);
+
+/*
+ * sdb_memstore_trigram_index_add, sdb_memstore_trigram_index_remove:
+ * Add a host, service, metric, or attribute to the trigram index or remove
+ * it. Attributes are ignored unless selected when creating the index. The
+ * lock of the object's host has to be held.
+ */
+int
+sdb_memstore_trigram_index_add(trigram_index_t *idx, sdb_memstore_obj_t *obj);
+void
+sdb_memstore_trigram_index_remove(trigram_index_t *idx,
+		sdb_memstore_obj_t *obj);
+
+/*
+ * sdb_memstore_scan_indexed:
+ * Like sdb_memstore_scan but only evaluate the candidates selected by the
+ * specified plan. Objects are reported in the same order as a full scan.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a positive value if the store does not maintain the required indexes
+ *  - a negative value else
+ */
+int
+sdb_memstore_scan_indexed(sdb_memstore_t *store, int type,
+		index_plan_t *plan, sdb_memstore_matcher_t *m,
+		sdb_memstore_matcher_t *filter,
+		sdb_memstore_lookup_cb cb, void *user_data);
+
+/*
+ * name lookups
+ */
+
+/* Plan for selecting candidate hosts by name: either a list of names
+ * (sorted and distinct, ignoring case like the host tree) or a range of
+ * names. For services and metrics, all children of the selected hosts are
+ * candidates. */
+typedef struct {
+	bool range;
+
+	/* list */
+	char **names;
+	size_t names_num;
+
+	/* range; NULL bounds are unbounded */
+	char *lower;
+	char *upper;
+	bool lower_incl;
+	bool upper_incl;
+} name_plan_t;
+
+/*
+ * sdb_memstore_scan_names:
+ * Like sdb_memstore_scan but only evaluate the hosts selected by the
+ * specified plan (or their children). Hosts are looked up from the host tree
+ * directly. Objects are reported in the same order as a full scan.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_memstore_scan_names(sdb_memstore_t *store, int type,
+		const name_plan_t *plan, sdb_memstore_matcher_t *m,
+		sdb_memstore_matcher_t *filter,
+		sdb_memstore_lookup_cb cb, void *user_data);
+
 /*
  * querying
  */
@@ -118,6 +491,11 @@ struct sdb_memstore_query {
 	sdb_ast_node_t *ast;
 	sdb_memstore_matcher_t *matcher;
 	sdb_memstore_matcher_t *filter;
+
+	/* index lookup for the matcher, if possible */
+	index_plan_t *plan;
+	/* host name lookup for the matcher, if possible */
+	name_plan_t *names;
 };
 #define QUERY(m) ((sdb_memstore_query_t *)(m))
 
@@ -153,6 +531,38 @@ struct sdb_memstore_expr {
 		: ((e)->type > 0) ? SDB_DATA_OP_TO_STRING((e)->type) \
 		: "<unknown>")
 
+/*
+ * borrowed values:
+ * Matching objects only reads values, so they do not have to be copied. A
+ * borrowed value points into an expression or a stored object and remains
+ * valid as long as neither of them changes, that is, while the object is
+ * part of a pinned view or while holding the lock of its host. Borrowed
+ * values must not be modified or freed. Values which cannot be borrowed are
+ * copied and marked as owned; the caller has to free those.
+ */
+
+/*
+ * sdb_memstore_get_field_borrowed, sdb_memstore_get_attr_borrowed:
+ * Like sdb_memstore_get_field and sdb_memstore_get_attr but borrow the
+ * value if possible. Attribute values are always borrowed.
+ */
+int
+sdb_memstore_get_field_borrowed(sdb_memstore_obj_t *obj, int field,
+		sdb_data_t *res, bool *owned);
+int
+sdb_memstore_get_attr_borrowed(sdb_memstore_obj_t *obj, const char *name,
+		sdb_data_t *res, sdb_memstore_matcher_t *filter);
+
+/*
+ * sdb_memstore_expr_eval_borrowed:
+ * Like sdb_memstore_expr_eval but borrow constants, fields, and attribute
+ * values if possible. The results of operators are always owned.
+ */
+int
+sdb_memstore_expr_eval_borrowed(sdb_memstore_expr_t *expr,
+		sdb_memstore_obj_t *obj, sdb_data_t *res, bool *owned,
+		sdb_memstore_matcher_t *filter);
+
 /*
  * matchers
  */
@@ -184,6 +594,9 @@ enum {
 
 	/* a generic query */
 	MATCHER_QUERY,
+
+	/* a compiled matcher; see sdb_memstore_matcher_compile */
+	MATCHER_PROGRAM,
 };
 
 #define MATCHER_SYM(t) \
@@ -205,6 +618,7 @@ enum {
 		: ((t) == MATCHER_REGEX) ? "=~" \
 		: ((t) == MATCHER_NREGEX) ? "!~" \
 		: ((t) == MATCHER_QUERY) ? "QUERY" \
+		: ((t) == MATCHER_PROGRAM) ? "PROGRAM" \
 		: "UNKNOWN")
 
 /* matcher base type */
@@ -258,6 +672,21 @@ typedef struct {
 } unary_matcher_t;
 #define UNARY_M(m) ((unary_matcher_t *)(m))
 
+/*
+ * sdb_memstore_matcher_compile:
+ * Compile a matcher into a flat program which evaluates the matcher without
+ * walking the matcher tree. Values are kept in a fixed set of registers and
+ * logical operators are evaluated lazily using jumps. The program holds a
+ * reference to the matcher and matches the same objects.
+ *
+ * Returns:
+ *  - a new matcher on success
+ *  - NULL if the matcher cannot be compiled or on error; the original
+ *    matcher may be used instead
+ */
+sdb_memstore_matcher_t *
+sdb_memstore_matcher_compile(sdb_memstore_matcher_t *m);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -34,9 +34,11 @@
 #include "core/plugin.h"
 #include "utils/avltree.h"
 #include "utils/error.h"
+#include "utils/intern.h"
 
 #include <assert.h>
 
+#include <ctype.h>
 #include <errno.h>
 
 #include <stdio.h>
@@ -50,27 +52,20 @@
  * private types
  */
 
-struct sdb_memstore {
-	sdb_object_t super;
-
-	/* hosts are the top-level entries and
-	 * reference everything else */
-	sdb_avltree_t *hosts;
-	pthread_rwlock_t host_lock;
-};
-
 /* internal representation of a to-be-stored object */
 typedef struct {
 	sdb_memstore_obj_t *parent;
 	sdb_avltree_t *parent_tree;
+	sdb_hashtable_t *parent_idx;
 	int type;
 	const char *name;
 	sdb_time_t last_update;
 	sdb_time_t interval;
 	const char * const *backends;
 	size_t backends_num;
+	trigram_index_t *trigrams; /* index new objects if set */
 } store_obj_t;
-#define STORE_OBJ_INIT { NULL, NULL, 0, NULL, 0, 0, NULL, 0 }
+#define STORE_OBJ_INIT { NULL, NULL, NULL, 0, NULL, 0, 0, NULL, 0, NULL }
 
 static sdb_type_t host_type;
 static sdb_type_t service_type;
@@ -80,9 +75,12 @@ static sdb_type_t attribute_type;
 static int
 store_init(sdb_object_t *obj, va_list __attribute__((unused)) ap)
 {
+	size_t i;
 	int err;
 	if (! (SDB_MEMSTORE(obj)->hosts = sdb_avltree_create()))
 		return -1;
+	if (! (SDB_MEMSTORE(obj)->hosts_idx = sdb_hashtable_create()))
+		return -1;
 	if ((err = pthread_rwlock_init(&SDB_MEMSTORE(obj)->host_lock,
 					/* attr = */ NULL))) {
 		char errbuf[128];
@@ -90,12 +88,25 @@ store_init(sdb_object_t *obj, va_list __attribute__((unused)) ap)
 				sdb_strerror(err, errbuf, sizeof(errbuf)));
 		return -1;
 	}
+	for (i = 0; i < HOST_LOCKS_NUM; ++i)
+		pthread_mutex_init(&SDB_MEMSTORE(obj)->host_locks[i],
+				/* attr = */ NULL);
+	pthread_mutex_init(&SDB_MEMSTORE(obj)->expire_lock, /* attr = */ NULL);
+	SDB_MEMSTORE(obj)->expire_next = NULL;
+	SDB_MEMSTORE(obj)->attr_index = NULL;
+	SDB_MEMSTORE(obj)->trigram_index = NULL;
+	pthread_mutex_init(&SDB_MEMSTORE(obj)->view_lock, /* attr = */ NULL);
+	SDB_MEMSTORE(obj)->views = NULL;
+	SDB_MEMSTORE(obj)->epoch = 0;
+	SDB_MEMSTORE(obj)->modified = 0;
+	SDB_MEMSTORE(obj)->scan_threads = 1;
 	return 0;
 } /* store_init */
 
 static void
 store_destroy(sdb_object_t *obj)
 {
+	size_t i;
 	int err;
 	if ((err = pthread_rwlock_destroy(&SDB_MEMSTORE(obj)->host_lock))) {
 		char errbuf[128];
@@ -103,6 +114,23 @@ store_destroy(sdb_object_t *obj)
 				sdb_strerror(err, errbuf, sizeof(errbuf)));
 		return;
 	}
+	for (i = 0; i < HOST_LOCKS_NUM; ++i)
+		pthread_mutex_destroy(&SDB_MEMSTORE(obj)->host_locks[i]);
+	pthread_mutex_destroy(&SDB_MEMSTORE(obj)->expire_lock);
+	/* views hold a reference to the store */
+	assert(! SDB_MEMSTORE(obj)->views);
+	pthread_mutex_destroy(&SDB_MEMSTORE(obj)->view_lock);
+	if (SDB_MEMSTORE(obj)->expire_next)
+		free(SDB_MEMSTORE(obj)->expire_next);
+	SDB_MEMSTORE(obj)->expire_next = NULL;
+
+	sdb_memstore_attr_index_destroy(SDB_MEMSTORE(obj)->attr_index);
+	SDB_MEMSTORE(obj)->attr_index = NULL;
+	sdb_memstore_trigram_index_destroy(SDB_MEMSTORE(obj)->trigram_index);
+	SDB_MEMSTORE(obj)->trigram_index = NULL;
+
+	sdb_hashtable_destroy(SDB_MEMSTORE(obj)->hosts_idx);
+	SDB_MEMSTORE(obj)->hosts_idx = NULL;
 	sdb_avltree_destroy(SDB_MEMSTORE(obj)->hosts);
 	SDB_MEMSTORE(obj)->hosts = NULL;
 } /* store_destroy */
@@ -119,13 +147,12 @@ static void
 store_obj_destroy(sdb_object_t *obj)
 {
 	sdb_memstore_obj_t *sobj = STORE_OBJ(obj);
-	size_t i;
 
-	for (i = 0; i < sobj->backends_num; ++i)
-		free(sobj->backends[i]);
-	free(sobj->backends);
-	sobj->backends = NULL;
-	sobj->backends_num = 0;
+	/* names are interned */
+	sdb_intern_release(obj->name);
+	obj->name = NULL;
+
+	sdb_memstore_backends_clear(&sobj->backends);
 
 	// We don't currently keep an extra reference for parent objects to
 	// avoid circular self-references which are not handled correctly by
@@ -153,6 +180,16 @@ host_init(sdb_object_t *obj, va_list ap)
 	sobj->attributes = sdb_avltree_create();
 	if (! sobj->attributes)
 		return -1;
+
+	sobj->services_idx = sdb_hashtable_create();
+	if (! sobj->services_idx)
+		return -1;
+	sobj->metrics_idx = sdb_hashtable_create();
+	if (! sobj->metrics_idx)
+		return -1;
+	sobj->attributes_idx = sdb_hashtable_create();
+	if (! sobj->attributes_idx)
+		return -1;
 	return 0;
 } /* host_init */
 
@@ -170,6 +207,13 @@ host_destroy(sdb_object_t *obj)
 		sdb_avltree_destroy(sobj->metrics);
 	if (sobj->attributes)
 		sdb_avltree_destroy(sobj->attributes);
+
+	if (sobj->services_idx)
+		sdb_hashtable_destroy(sobj->services_idx);
+	if (sobj->metrics_idx)
+		sdb_hashtable_destroy(sobj->metrics_idx);
+	if (sobj->attributes_idx)
+		sdb_hashtable_destroy(sobj->attributes_idx);
 } /* host_destroy */
 
 static int
@@ -186,6 +230,9 @@ service_init(sdb_object_t *obj, va_list ap)
 	sobj->attributes = sdb_avltree_create();
 	if (! sobj->attributes)
 		return -1;
+	sobj->attributes_idx = sdb_hashtable_create();
+	if (! sobj->attributes_idx)
+		return -1;
 	return 0;
 } /* service_init */
 
@@ -199,6 +246,8 @@ service_destroy(sdb_object_t *obj)
 
 	if (sobj->attributes)
 		sdb_avltree_destroy(sobj->attributes);
+	if (sobj->attributes_idx)
+		sdb_hashtable_destroy(sobj->attributes_idx);
 } /* service_destroy */
 
 static int
@@ -215,6 +264,9 @@ metric_init(sdb_object_t *obj, va_list ap)
 	sobj->attributes = sdb_avltree_create();
 	if (! sobj->attributes)
 		return -1;
+	sobj->attributes_idx = sdb_hashtable_create();
+	if (! sobj->attributes_idx)
+		return -1;
 
 	sobj->stores = NULL;
 	sobj->stores_num = 0;
@@ -232,6 +284,8 @@ metric_destroy(sdb_object_t *obj)
 
 	if (sobj->attributes)
 		sdb_avltree_destroy(sobj->attributes);
+	if (sobj->attributes_idx)
+		sdb_hashtable_destroy(sobj->attributes_idx);
 
 	for (i = 0; i < sobj->stores_num; ++i) {
 		if (sobj->stores[i].type)
@@ -245,6 +299,58 @@ metric_destroy(sdb_object_t *obj)
 	sobj->stores_num = 0;
 } /* metric_destroy */
 
+/* Short string values of attributes are interned since many of them are
+ * shared by lots of objects (think of operating system names or versions).
+ * Longer values (think of descriptions) are rarely shared and would only
+ * fill up the intern table, so they are copied instead. */
+#define INTERN_VALUE_MAX_LEN 64
+
+static bool
+value_interned(const char *str)
+{
+	size_t i;
+
+	for (i = 0; i <= INTERN_VALUE_MAX_LEN; ++i)
+		if (! str[i])
+			return 1;
+	return 0;
+} /* value_interned */
+
+static void
+attr_clear_value(attr_t *attr)
+{
+	if ((attr->value.type == SDB_TYPE_STRING) && attr->value.data.string
+			&& value_interned(attr->value.data.string)) {
+		sdb_intern_release(attr->value.data.string);
+		attr->value = SDB_DATA_NULL;
+	}
+	else
+		sdb_data_free_datum(&attr->value);
+} /* attr_clear_value */
+
+static int
+attr_set_value(attr_t *attr, const sdb_data_t *value)
+{
+	char *str = NULL;
+
+	if ((value->type != SDB_TYPE_STRING) || (! value->data.string)
+			|| (! value_interned(value->data.string))) {
+		sdb_data_t tmp = SDB_DATA_INIT;
+		if (sdb_data_copy(&tmp, value))
+			return -1;
+		attr_clear_value(attr);
+		attr->value = tmp;
+		return 0;
+	}
+
+	if (! (str = sdb_intern(value->data.string)))
+		return -1;
+	attr_clear_value(attr);
+	attr->value.type = SDB_TYPE_STRING;
+	attr->value.data.string = str;
+	return 0;
+} /* attr_set_value */
+
 static int
 attr_init(sdb_object_t *obj, va_list ap)
 {
@@ -258,7 +364,7 @@ attr_init(sdb_object_t *obj, va_list ap)
 	value = va_arg(ap, const sdb_data_t *);
 
 	if (value)
-		if (sdb_data_copy(&ATTR(obj)->value, value))
+		if (attr_set_value(ATTR(obj), value))
 			return -1;
 	return 0;
 } /* attr_init */
@@ -269,7 +375,7 @@ attr_destroy(sdb_object_t *obj)
 	assert(obj);
 
 	store_obj_destroy(obj);
-	sdb_data_free_datum(&ATTR(obj)->value);
+	attr_clear_value(ATTR(obj));
 } /* attr_destroy */
 
 static sdb_type_t store_type = {
@@ -306,72 +412,133 @@ static sdb_type_t attribute_type = {
  * private helper functions
  */
 
+/* Stored objects are allocated from a slab per type, shared by all stores.
+ * If a slab cannot be created, objects fall back to malloc. */
+static pthread_once_t slabs_once = PTHREAD_ONCE_INIT;
+static sdb_slab_t *host_slab = NULL;
+static sdb_slab_t *service_slab = NULL;
+static sdb_slab_t *metric_slab = NULL;
+static sdb_slab_t *attribute_slab = NULL;
+
+static void
+slabs_init(void)
+{
+	host_slab = sdb_slab_create();
+	service_slab = sdb_slab_create();
+	metric_slab = sdb_slab_create();
+	attribute_slab = sdb_slab_create();
+} /* slabs_init */
+
+static sdb_memstore_obj_t *
+obj_create(const char *name, int type, const sdb_data_t *value)
+{
+	sdb_object_t *obj;
+
+	pthread_once(&slabs_once, slabs_init);
+
+	/* the name is interned rather than stored inline */
+	if (type == SDB_HOST)
+		obj = sdb_object_create_slab(host_slab, NULL, host_type, type);
+	else if (type == SDB_SERVICE)
+		obj = sdb_object_create_slab(service_slab, NULL,
+				service_type, type);
+	else if (type == SDB_METRIC)
+		obj = sdb_object_create_slab(metric_slab, NULL, metric_type, type);
+	else
+		obj = sdb_object_create_slab(attribute_slab, NULL,
+				attribute_type, type, value);
+
+	if (obj && (! (obj->name = sdb_intern(name)))) {
+		sdb_object_deref(obj);
+		return NULL;
+	}
+	return STORE_OBJ(obj);
+} /* obj_create */
+
 static int
 record_backends(sdb_memstore_obj_t *obj,
 		const char * const *backends, size_t backends_num)
 {
-	char **tmp;
 	size_t i;
 
 	for (i = 0; i < backends_num; i++) {
-		bool found = 0;
-		size_t j;
-
-		for (j = 0; j < obj->backends_num; ++j) {
-			if (!strcasecmp(obj->backends[j], backends[i])) {
-				found = 1;
-				break;
-			}
-		}
-		if (found)
-			continue;
-
-		tmp = realloc(obj->backends,
-				(obj->backends_num + 1) * sizeof(*obj->backends));
-		if (! tmp)
-			return -1;
-
-		obj->backends = tmp;
-		obj->backends[obj->backends_num] = strdup(backends[i]);
-		if (! obj->backends[obj->backends_num])
+		int id = sdb_memstore_backend_id(backends[i], /* create = */ 1);
+		if ((id < 0) || sdb_memstore_backends_add(&obj->backends, id))
 			return -1;
-
-		++obj->backends_num;
 	}
 	return 0;
 } /* record_backends */
 
+/* Copy the names of an object's backends into an array datum. */
+static int
+backends_to_data(const backend_set_t *set, sdb_data_t *res)
+{
+	const char *buf[16];
+	const char **names = buf;
+	sdb_data_t tmp = SDB_DATA_INIT;
+	size_t n;
+	int status;
+
+	n = sdb_memstore_backends_names(set, buf, SDB_STATIC_ARRAY_LEN(buf));
+	if (n > SDB_STATIC_ARRAY_LEN(buf)) {
+		if (! (names = calloc(n, sizeof(*names))))
+			return -1;
+		n = sdb_memstore_backends_names(set, names, n);
+	}
+
+	tmp.type = SDB_TYPE_ARRAY | SDB_TYPE_STRING;
+	tmp.data.array.length = n;
+	tmp.data.array.values = n ? names : NULL;
+	status = sdb_data_copy(res, &tmp);
+
+	if (names != buf)
+		free(names);
+	return status;
+} /* backends_to_data */
+
 static int
 store_obj(store_obj_t *obj, sdb_memstore_obj_t **updated_obj)
 {
 	sdb_memstore_obj_t *old, *new;
+	bool created = 0;
 	int status = 0;
 
-	assert(obj->parent_tree);
+	assert(obj->parent_tree && obj->parent_idx);
 
-	old = STORE_OBJ(sdb_avltree_lookup(obj->parent_tree, obj->name));
+	old = STORE_OBJ(sdb_hashtable_lookup(obj->parent_idx, obj->name));
 	if (old) {
 		new = old;
 		sdb_object_deref(SDB_OBJ(old));
-	}
-	else {
-		if (obj->type == SDB_ATTRIBUTE) {
-			/* the value will be updated by the caller */
-			new = STORE_OBJ(sdb_object_create(obj->name, attribute_type,
-						obj->type, NULL));
+
+		if (old->last_update >= obj->last_update) {
+			if (old->last_update > obj->last_update)
+				sdb_log(SDB_LOG_DEBUG, "memstore: Cannot update %s '%s' - "
+						"value too old (%"PRIsdbTIME" < %"PRIsdbTIME")",
+						SDB_STORE_TYPE_TO_NAME(obj->type), obj->name,
+						obj->last_update, old->last_update);
+			return 1;
 		}
-		else {
-			sdb_type_t t;
-			t = obj->type == SDB_HOST
-				? host_type
-				: obj->type == SDB_SERVICE
-					? service_type
-					: metric_type;
-			new = STORE_OBJ(sdb_object_create(obj->name, t, obj->type));
+
+		if (! obj->interval) {
+			/* moving average of the time between updates */
+			obj->interval = obj->last_update - old->last_update;
+			if (old->interval)
+				obj->interval = (sdb_time_t)((0.9 * (double)old->interval)
+						+ (0.1 * (double)obj->interval));
 		}
+	}
+	else {
+		/* the value of attributes will be updated by the caller */
+		new = obj_create(obj->name, obj->type, NULL);
 
 		if (new) {
 			status = sdb_avltree_insert(obj->parent_tree, SDB_OBJ(new));
+			if (! status) {
+				status = sdb_hashtable_insert(obj->parent_idx, SDB_OBJ(new));
+				if (status)
+					sdb_avltree_remove(obj->parent_tree, obj->name);
+			}
+			created = (status == 0);
 
 			/* pass control to the tree or destroy in case of an error */
 			sdb_object_deref(SDB_OBJ(new));
@@ -400,6 +567,11 @@ store_obj(store_obj_t *obj, sdb_memstore_obj_t **updated_obj)
 		new->parent = obj->parent;
 	}
 
+	/* names never change; attribute values are indexed by the caller */
+	if (created && obj->trigrams && (obj->type != SDB_ATTRIBUTE))
+		if (sdb_memstore_trigram_index_add(obj->trigrams, new))
+			status = -1;
+
 	if (updated_obj)
 		*updated_obj = new;
 
@@ -486,7 +658,21 @@ store_metric_stores(metric_t *metric, sdb_store_metric_t *m)
 	return 0;
 } /* store_metric_stores */
 
-/* The store's host_lock has to be acquired before calling this function. */
+/* Get the lock protecting the host with the specified name. */
+static pthread_mutex_t *
+get_host_lock(sdb_memstore_t *st, const char *name)
+{
+	/* FNV-1a of the case-folded name */
+	uint32_t h = 2166136261U;
+
+	for ( ; *name; ++name) {
+		h ^= (uint32_t)tolower((unsigned char)*name);
+		h *= 16777619U;
+	}
+	return &st->host_locks[h % HOST_LOCKS_NUM];
+} /* get_host_lock */
+
+/* The host's lock has to be acquired before calling this function. */
 static sdb_avltree_t *
 get_host_children(host_t *host, int type)
 {
@@ -505,6 +691,21 @@ get_host_children(host_t *host, int type)
 		return host->services;
 } /* get_host_children */
 
+static sdb_hashtable_t *
+get_host_index(host_t *host, int type)
+{
+	if (! host)
+		return NULL;
+
+	if (type == SDB_ATTRIBUTE)
+		return host->attributes_idx;
+	else if (type == SDB_METRIC)
+		return host->metrics_idx;
+	else if (type == SDB_SERVICE)
+		return host->services_idx;
+	return NULL;
+} /* get_host_index */
+
 static sdb_avltree_t *
 get_obj_attrs(sdb_memstore_obj_t *obj)
 {
@@ -517,229 +718,1254 @@ get_obj_attrs(sdb_memstore_obj_t *obj)
 	return NULL;
 } /* get_obj_attrs */
 
+static sdb_hashtable_t *
+get_obj_attrs_index(sdb_memstore_obj_t *obj)
+{
+	if (obj->type == SDB_HOST)
+		return HOST(obj)->attributes_idx;
+	else if (obj->type == SDB_SERVICE)
+		return SVC(obj)->attributes_idx;
+	else if (obj->type == SDB_METRIC)
+		return METRIC(obj)->attributes_idx;
+	return NULL;
+} /* get_obj_attrs_index */
+
+/* Get all trees of child objects of an object and their indexes. */
+static void
+get_obj_children(sdb_memstore_obj_t *obj,
+		sdb_avltree_t *children[3], sdb_hashtable_t *indexes[3])
+{
+	if (obj->type == SDB_HOST) {
+		children[0] = HOST(obj)->services;
+		children[1] = HOST(obj)->metrics;
+		children[2] = HOST(obj)->attributes;
+		indexes[0] = HOST(obj)->services_idx;
+		indexes[1] = HOST(obj)->metrics_idx;
+		indexes[2] = HOST(obj)->attributes_idx;
+		return;
+	}
+	children[0] = get_obj_attrs(obj);
+	indexes[0] = get_obj_attrs_index(obj);
+	children[1] = children[2] = NULL;
+	indexes[1] = indexes[2] = NULL;
+} /* get_obj_children */
+
 /*
- * store writer API
+ * indexes
  */
 
+typedef int (*index_cb)(sdb_memstore_obj_t *, void *);
+
 static int
-store_attribute(sdb_store_attribute_t *attr, sdb_object_t *user_data)
+index_tree(sdb_avltree_t *tree, index_cb cb, void *idx);
+
+/* Call the callback for an object and all of its children. */
+static int
+index_obj(sdb_memstore_obj_t *obj, index_cb cb, void *idx)
 {
-	sdb_memstore_t *st = SDB_MEMSTORE(user_data);
-	store_obj_t obj = STORE_OBJ_INIT;
-	sdb_memstore_obj_t *new = NULL;
-	const char *hostname;
-	host_t *host;
+	int status = cb(obj, idx);
+
+	if ((! status) && (obj->type == SDB_HOST)) {
+		status = index_tree(HOST(obj)->services, cb, idx);
+		if (! status)
+			status = index_tree(HOST(obj)->metrics, cb, idx);
+	}
+	if ((! status) && (obj->type != SDB_ATTRIBUTE))
+		status = index_tree(get_obj_attrs(obj), cb, idx);
+	return status;
+} /* index_obj */
 
-	sdb_avltree_t *children = NULL;
+/* Call the callback for all objects of a tree and their children. */
+static int
+index_tree(sdb_avltree_t *tree, index_cb cb, void *idx)
+{
+	sdb_avltree_iter_t *iter;
 	int status = 0;
 
-	if ((! attr) || (! attr->parent) || (! attr->key))
+	if (! sdb_avltree_size(tree))
+		return 0;
+	if (! (iter = sdb_avltree_get_iter(tree)))
 		return -1;
 
-	hostname = attr->hostname;
-	if (attr->parent_type == SDB_HOST)
-		hostname = attr->parent;
-	if (! hostname)
-		return -1;
+	while ((! status) && sdb_avltree_iter_has_next(iter))
+		status = index_obj(STORE_OBJ(sdb_avltree_iter_get_next(iter)),
+				cb, idx);
+	sdb_avltree_iter_destroy(iter);
+	return status;
+} /* index_tree */
 
-	pthread_rwlock_wrlock(&st->host_lock);
-	host = HOST(sdb_avltree_lookup(st->hosts, hostname));
-	if (! host) {
-		sdb_log(SDB_LOG_ERR, "memstore: Failed to store attribute '%s' - "
-				"host '%s' not found", attr->key, hostname);
-		status = -1;
-	}
+static int
+index_attr(sdb_memstore_obj_t *obj, void *idx)
+{
+	if (obj->type != SDB_ATTRIBUTE)
+		return 0;
+	return sdb_memstore_attr_index_add(idx, obj);
+} /* index_attr */
 
-	switch (attr->parent_type) {
-	case SDB_HOST:
-		obj.parent = STORE_OBJ(host);
-		obj.parent_tree = get_host_children(host, SDB_ATTRIBUTE);
-		break;
-	case SDB_SERVICE:
-	case SDB_METRIC:
-		children = get_host_children(host, attr->parent_type);
-		break;
-	default:
+static int
+index_trigrams(sdb_memstore_obj_t *obj, void *idx)
+{
+	return sdb_memstore_trigram_index_add(idx, obj);
+} /* index_trigrams */
+
+static int
+unindex_attr(sdb_memstore_obj_t *obj, void *idx)
+{
+	if (obj->type == SDB_ATTRIBUTE)
+		sdb_memstore_attr_index_remove(idx, obj);
+	return 0;
+} /* unindex_attr */
+
+static int
+unindex_trigrams(sdb_memstore_obj_t *obj, void *idx)
+{
+	sdb_memstore_trigram_index_remove(idx, obj);
+	return 0;
+} /* unindex_trigrams */
+
+/*
+ * store views
+ */
+
+/* Create a copy of an object including all of its children. Unchanged
+ * children cannot be shared between versions of a host since each of them
+ * refers to its parent: readers follow that reference to access the fields
+ * of a service's or metric's host and to group objects by host, and it is
+ * not reference counted. Writers thus copy each host at most once per pinned
+ * view (see host_writable). */
+static sdb_memstore_obj_t *
+clone_obj(sdb_memstore_obj_t *obj, sdb_memstore_obj_t *parent)
+{
+	sdb_memstore_obj_t *copy;
+	sdb_avltree_t *children[3], *copy_children[3];
+	sdb_hashtable_t *indexes[3], *copy_indexes[3];
+	int status = 0;
+	size_t i;
+
+	copy = obj_create(SDB_OBJ(obj)->name, obj->type,
+			obj->type == SDB_ATTRIBUTE ? &ATTR(obj)->value : NULL);
+	if (! copy)
+		return NULL;
+
+	copy->last_update = obj->last_update;
+	copy->interval = obj->interval;
+	copy->parent = parent;
+	if (sdb_memstore_backends_copy(&copy->backends, &obj->backends))
 		status = -1;
-		break;
+
+	if (obj->type == SDB_METRIC) {
+		for (i = 0; (! status) && (i < METRIC(obj)->stores_num); ++i) {
+			metric_store_t *s = METRIC(obj)->stores + i;
+			sdb_metric_store_t store = { s->type, s->id, NULL, 0 };
+			status = store_metric_add_store(METRIC(copy), &store,
+					s->last_update);
+		}
 	}
 
-	if (children) {
-		obj.parent = STORE_OBJ(sdb_avltree_lookup(children, attr->parent));
-		if (! obj.parent) {
-			sdb_log(SDB_LOG_ERR, "memstore: Failed to store attribute '%s' - "
-					"%s '%s/%s' not found", attr->key,
-					SDB_STORE_TYPE_TO_NAME(attr->parent_type),
-					attr->hostname, attr->parent);
+	get_obj_children(obj, children, indexes);
+	get_obj_children(copy, copy_children, copy_indexes);
+	for (i = 0; (! status) && (i < SDB_STATIC_ARRAY_LEN(children)); ++i) {
+		sdb_avltree_iter_t *iter;
+
+		if (! sdb_avltree_size(children[i]))
+			continue;
+		if (! (iter = sdb_avltree_get_iter(children[i]))) {
 			status = -1;
+			break;
 		}
-		else
-			obj.parent_tree = attr->parent_type == SDB_SERVICE
-				? SVC(obj.parent)->attributes
-				: METRIC(obj.parent)->attributes;
-	}
 
-	obj.type = SDB_ATTRIBUTE;
-	obj.name = attr->key;
-	obj.last_update = attr->last_update;
-	obj.interval = attr->interval;
-	obj.backends = attr->backends;
-	obj.backends_num = attr->backends_num;
-	if (! status)
-		status = store_obj(&obj, &new);
+		while ((! status) && sdb_avltree_iter_has_next(iter)) {
+			sdb_memstore_obj_t *child;
 
-	if (! status) {
-		assert(new);
-		/* update the value if it changed */
-		if (sdb_data_cmp(&ATTR(new)->value, &attr->value))
-			if (sdb_data_copy(&ATTR(new)->value, &attr->value))
+			child = clone_obj(STORE_OBJ(sdb_avltree_iter_get_next(iter)),
+					copy);
+			if (! child) {
+				status = -1;
+				break;
+			}
+			if (sdb_avltree_insert(copy_children[i], SDB_OBJ(child))
+					|| sdb_hashtable_insert(copy_indexes[i], SDB_OBJ(child)))
 				status = -1;
+			sdb_object_deref(SDB_OBJ(child));
+		}
+		sdb_avltree_iter_destroy(iter);
 	}
 
-	if (obj.parent != STORE_OBJ(host))
-		sdb_object_deref(SDB_OBJ(obj.parent));
-	sdb_object_deref(SDB_OBJ(host));
-	pthread_rwlock_unlock(&st->host_lock);
-
-	return status;
-} /* store_attribute */
+	if (status) {
+		sdb_object_deref(SDB_OBJ(copy));
+		return NULL;
+	}
+	return copy;
+} /* clone_obj */
 
-static int
-store_host(sdb_store_host_t *host, sdb_object_t *user_data)
+/* Check whether a host might be visible to any pinned view. The host's lock
+ * has to be held. */
+static bool
+host_pinned(sdb_memstore_t *st, host_t *host)
 {
-	sdb_memstore_t *st = SDB_MEMSTORE(user_data);
-	store_obj_t obj = { NULL, st->hosts, SDB_HOST, NULL, 0, 0, NULL, 0 };
-	int status = 0;
-
-	if ((! host) || (! host->name))
-		return -1;
+	bool pinned;
 
-	obj.name = host->name;
-	obj.last_update = host->last_update;
-	obj.interval = host->interval;
-	obj.backends = host->backends;
-	obj.backends_num = host->backends_num;
-	pthread_rwlock_wrlock(&st->host_lock);
-	status = store_obj(&obj, NULL);
-	pthread_rwlock_unlock(&st->host_lock);
-
-	return status;
-} /* store_host */
+	pthread_mutex_lock(&st->view_lock);
+	pinned = st->views && (host->epoch < st->views->epoch);
+	pthread_mutex_unlock(&st->view_lock);
+	return pinned;
+} /* host_pinned */
 
-static int
-store_service(sdb_store_service_t *service, sdb_object_t *user_data)
+/* Mark the store as modified such that new readers won't share any of the
+ * existing views. */
+static void
+store_modified(sdb_memstore_t *st)
 {
-	sdb_memstore_t *st = SDB_MEMSTORE(user_data);
-	store_obj_t obj = STORE_OBJ_INIT;
-	host_t *host;
+	pthread_mutex_lock(&st->view_lock);
+	st->modified = 1;
+	pthread_mutex_unlock(&st->view_lock);
+} /* store_modified */
 
-	int status = 0;
+/* Release an old version of a host once no view refers to it anymore. This
+ * consumes the caller's reference. */
+static void
+retire_host(sdb_memstore_t *st, host_t *host)
+{
+	pthread_mutex_lock(&st->view_lock);
+	if (st->views && (host->epoch < st->views->epoch)) {
+		host->next_retired = st->views->retired;
+		st->views->retired = STORE_OBJ(host);
+		host = NULL;
+	}
+	pthread_mutex_unlock(&st->view_lock);
+	sdb_object_deref(SDB_OBJ(host));
+} /* retire_host */
+
+/* Return a version of the host which may be modified, replacing the host
+ * with a copy if it might be visible to any pinned view. The copy belongs to
+ * the current epoch such that further updates modify it in place until the
+ * next view gets pinned. This consumes the caller's reference of the host
+ * and returns a new reference or NULL on error. The host's lock has to be
+ * held. */
+static host_t *
+host_writable(sdb_memstore_t *st, host_t *host)
+{
+	sdb_memstore_obj_t *copy;
+	const char *name;
 
-	if ((! service) || (! service->hostname) || (! service->name))
-		return -1;
+	if ((! host) || (! host_pinned(st, host)))
+		return host;
 
-	pthread_rwlock_wrlock(&st->host_lock);
-	host = HOST(sdb_avltree_lookup(st->hosts, service->hostname));
-	obj.parent = STORE_OBJ(host);
-	obj.parent_tree = get_host_children(host, SDB_SERVICE);
-	obj.type = SDB_SERVICE;
-	if (! obj.parent_tree) {
-		sdb_log(SDB_LOG_ERR, "memstore: Failed to store service '%s' - "
-				"host '%s' not found", service->name, service->hostname);
-		status = -1;
+	store_modified(st);
+	name = SDB_OBJ(host)->name;
+	copy = clone_obj(STORE_OBJ(host), NULL);
+	if (! copy) {
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to copy host '%s'", name);
+		sdb_object_deref(SDB_OBJ(host));
+		return NULL;
+	}
+	/* readers may only see this version after pinning a new view */
+	HOST(copy)->epoch = st->epoch;
+
+	index_obj(STORE_OBJ(host), unindex_attr, st->attr_index);
+	index_obj(STORE_OBJ(host), unindex_trigrams, st->trigram_index);
+
+	/* the caller's reference keeps the name valid */
+	sdb_hashtable_remove(st->hosts_idx, name);
+	sdb_avltree_remove(st->hosts, name);
+	if (sdb_avltree_insert(st->hosts, SDB_OBJ(copy))
+			|| sdb_hashtable_insert(st->hosts_idx, SDB_OBJ(copy))) {
+		/* restore the old version */
+		sdb_hashtable_remove(st->hosts_idx, name);
+		sdb_avltree_remove(st->hosts, name);
+		sdb_avltree_insert(st->hosts, SDB_OBJ(host));
+		sdb_hashtable_insert(st->hosts_idx, SDB_OBJ(host));
+		sdb_object_deref(SDB_OBJ(copy));
+		copy = STORE_OBJ(host);
+		host = NULL;
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to replace host '%s'",
+				SDB_OBJ(copy)->name);
 	}
 
-	obj.name = service->name;
-	obj.last_update = service->last_update;
-	obj.interval = service->interval;
-	obj.backends = service->backends;
-	obj.backends_num = service->backends_num;
-	if (! status)
-		status = store_obj(&obj, NULL);
+	if (st->attr_index
+			&& index_obj(copy, index_attr, st->attr_index))
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to index attributes of "
+				"host '%s'", SDB_OBJ(copy)->name);
+	if (st->trigram_index
+			&& index_obj(copy, index_trigrams, st->trigram_index))
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to index trigrams of "
+				"host '%s'", SDB_OBJ(copy)->name);
 
-	sdb_object_deref(SDB_OBJ(host));
-	pthread_rwlock_unlock(&st->host_lock);
-	return status;
-} /* store_service */
+	if (! host) {
+		/* release the caller's reference to the old version */
+		sdb_object_deref(SDB_OBJ(copy));
+		return NULL;
+	}
+	retire_host(st, host);
+	return HOST(copy);
+} /* host_writable */
 
 static int
-store_metric(sdb_store_metric_t *metric, sdb_object_t *user_data)
+view_get_hosts(sdb_memstore_t *store, store_view_t *view)
 {
-	sdb_memstore_t *st = SDB_MEMSTORE(user_data);
-	store_obj_t obj = STORE_OBJ_INIT;
-	sdb_memstore_obj_t *new = NULL;
-	host_t *host;
-
-	int status = 0;
-	size_t i;
+	sdb_avltree_iter_t *iter;
 
-	if ((! metric) || (! metric->hostname) || (! metric->name))
+	/* hosts are kept alive by the store or the view's retired list */
+	view->hosts = calloc(sdb_avltree_size(store->hosts) + 1,
+			sizeof(*view->hosts));
+	iter = sdb_avltree_get_iter(store->hosts);
+	if ((! view->hosts) || (! iter)) {
+		sdb_avltree_iter_destroy(iter);
+		if (view->hosts)
+			free(view->hosts);
+		view->hosts = NULL;
 		return -1;
+	}
 
-	for (i = 0; i < metric->stores_num; ++i)
+	while (sdb_avltree_iter_has_next(iter))
+		view->hosts[view->hosts_num++] = sdb_avltree_iter_get_next(iter);
+	sdb_avltree_iter_destroy(iter);
+	return 0;
+} /* view_get_hosts */
+
+store_view_t *
+sdb_memstore_view_pin(sdb_memstore_t *store, bool hosts)
+{
+	store_view_t *view;
+
+	if (! store)
+		return NULL;
+
+	pthread_mutex_lock(&store->view_lock);
+	view = store->views;
+	if ((! view) || store->modified) {
+		if (! (view = calloc(1, sizeof(*view)))) {
+			pthread_mutex_unlock(&store->view_lock);
+			return NULL;
+		}
+		view->epoch = ++store->epoch;
+		view->older = store->views;
+		if (store->views)
+			store->views->newer = view;
+		store->views = view;
+		store->modified = 0;
+		sdb_object_ref(SDB_OBJ(store));
+	}
+	++view->pins;
+
+	if (hosts && (! view->hosts) && view_get_hosts(store, view)) {
+		pthread_mutex_unlock(&store->view_lock);
+		sdb_memstore_view_release(store, view);
+		return NULL;
+	}
+	pthread_mutex_unlock(&store->view_lock);
+	return view;
+} /* sdb_memstore_view_pin */
+
+void
+sdb_memstore_lock_all(sdb_memstore_t *store)
+{
+	size_t i;
+
+	pthread_rwlock_rdlock(&store->host_lock);
+	for (i = 0; i < HOST_LOCKS_NUM; ++i)
+		pthread_mutex_lock(&store->host_locks[i]);
+} /* sdb_memstore_lock_all */
+
+void
+sdb_memstore_unlock_all(sdb_memstore_t *store)
+{
+	size_t i;
+
+	for (i = HOST_LOCKS_NUM; i > 0; --i)
+		pthread_mutex_unlock(&store->host_locks[i - 1]);
+	pthread_rwlock_unlock(&store->host_lock);
+} /* sdb_memstore_unlock_all */
+
+store_view_t *
+sdb_memstore_view_try_pin(sdb_memstore_t *store, bool hosts)
+{
+	store_view_t *view;
+
+	if (! store)
+		return NULL;
+
+	/* writers mark the store as modified before copying any host of a
+	 * pinned view and before releasing the lock of any host they changed */
+	pthread_mutex_lock(&store->view_lock);
+	view = store->views;
+	if (view && (! store->modified) && ((! hosts) || view->hosts))
+		++view->pins;
+	else
+		view = NULL;
+	pthread_mutex_unlock(&store->view_lock);
+	return view;
+} /* sdb_memstore_view_try_pin */
+
+void
+sdb_memstore_view_release(sdb_memstore_t *store, store_view_t *view)
+{
+	sdb_memstore_obj_t *retired = NULL;
+
+	if ((! store) || (! view))
+		return;
+
+	pthread_mutex_lock(&store->view_lock);
+	assert(view->pins);
+	if (--view->pins) {
+		pthread_mutex_unlock(&store->view_lock);
+		return;
+	}
+
+	if (view->newer)
+		view->newer->older = view->older;
+	else {
+		store->views = view->older;
+		/* the store might have changed since creating the older view */
+		store->modified = 1;
+	}
+	if (view->older)
+		view->older->newer = view->newer;
+
+	/* older views may still refer to the retired hosts */
+	if (view->older && view->retired) {
+		sdb_memstore_obj_t *last = view->retired;
+		while (HOST(last)->next_retired)
+			last = HOST(last)->next_retired;
+		HOST(last)->next_retired = view->older->retired;
+		view->older->retired = view->retired;
+	}
+	else
+		retired = view->retired;
+	pthread_mutex_unlock(&store->view_lock);
+
+	while (retired) {
+		sdb_memstore_obj_t *next = HOST(retired)->next_retired;
+		HOST(retired)->next_retired = NULL;
+		sdb_object_deref(SDB_OBJ(retired));
+		retired = next;
+	}
+
+	if (view->hosts)
+		free(view->hosts);
+	free(view);
+	sdb_object_deref(SDB_OBJ(store));
+} /* sdb_memstore_view_release */
+
+/*
+ * store writer API
+ */
+
+static const char *
+entry_hostname(const sdb_store_batch_entry_t *e)
+{
+	switch (e->type) {
+	case SDB_HOST:
+		return e->obj.host.name;
+	case SDB_SERVICE:
+		return e->obj.service.hostname;
+	case SDB_METRIC:
+		return e->obj.metric.hostname;
+	case SDB_ATTRIBUTE:
+		if (e->obj.attribute.parent_type == SDB_HOST)
+			return e->obj.attribute.parent;
+		return e->obj.attribute.hostname;
+	}
+	return NULL;
+} /* entry_hostname */
+
+/* Check whether an update would be rejected since the object has been
+ * updated more recently already. The host's lock has to be held. */
+static bool
+entry_outdated(host_t *host, const sdb_store_batch_entry_t *e)
+{
+	sdb_memstore_obj_t *obj = NULL, *parent = NULL;
+	sdb_time_t last_update = 0;
+	bool outdated;
+
+	switch (e->type) {
+	case SDB_HOST:
+		obj = STORE_OBJ(host);
+		sdb_object_ref(SDB_OBJ(obj));
+		last_update = e->obj.host.last_update;
+		break;
+	case SDB_SERVICE:
+		obj = sdb_memstore_get_child(STORE_OBJ(host), SDB_SERVICE,
+				e->obj.service.name);
+		last_update = e->obj.service.last_update;
+		break;
+	case SDB_METRIC:
+		obj = sdb_memstore_get_child(STORE_OBJ(host), SDB_METRIC,
+				e->obj.metric.name);
+		last_update = e->obj.metric.last_update;
+		break;
+	case SDB_ATTRIBUTE:
+		if (e->obj.attribute.parent_type == SDB_HOST) {
+			parent = STORE_OBJ(host);
+			sdb_object_ref(SDB_OBJ(parent));
+		}
+		else
+			parent = sdb_memstore_get_child(STORE_OBJ(host),
+					e->obj.attribute.parent_type, e->obj.attribute.parent);
+		obj = sdb_memstore_get_child(parent, SDB_ATTRIBUTE,
+				e->obj.attribute.key);
+		last_update = e->obj.attribute.last_update;
+		sdb_object_deref(SDB_OBJ(parent));
+		break;
+	}
+
+	outdated = obj && (obj->last_update >= last_update);
+	sdb_object_deref(SDB_OBJ(obj));
+	return outdated;
+} /* entry_outdated */
+
+/* The host's lock has to be acquired before calling the following
+ * functions. The parent host (if any) has to be looked up by the caller. */
+
+static int
+store_attribute_locked(sdb_memstore_t *st, host_t *host,
+		sdb_store_attribute_t *attr)
+{
+	store_obj_t obj = STORE_OBJ_INIT;
+	sdb_memstore_obj_t *new = NULL;
+
+	sdb_hashtable_t *children = NULL;
+	int status = 0;
+
+	if ((! attr->parent) || (! attr->key))
+		return -1;
+
+	if (! host) {
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to store attribute '%s' - "
+				"host '%s' not found", attr->key,
+				attr->parent_type == SDB_HOST ? attr->parent : attr->hostname);
+		return -1;
+	}
+
+	switch (attr->parent_type) {
+	case SDB_HOST:
+		obj.parent = STORE_OBJ(host);
+		obj.parent_tree = get_host_children(host, SDB_ATTRIBUTE);
+		obj.parent_idx = get_host_index(host, SDB_ATTRIBUTE);
+		break;
+	case SDB_SERVICE:
+	case SDB_METRIC:
+		children = get_host_index(host, attr->parent_type);
+		break;
+	default:
+		status = -1;
+		break;
+	}
+
+	if (children) {
+		obj.parent = STORE_OBJ(sdb_hashtable_lookup(children, attr->parent));
+		if (! obj.parent) {
+			sdb_log(SDB_LOG_ERR, "memstore: Failed to store attribute '%s' - "
+					"%s '%s/%s' not found", attr->key,
+					SDB_STORE_TYPE_TO_NAME(attr->parent_type),
+					attr->hostname, attr->parent);
+			status = -1;
+		}
+		else {
+			obj.parent_tree = get_obj_attrs(obj.parent);
+			obj.parent_idx = get_obj_attrs_index(obj.parent);
+		}
+	}
+
+	obj.type = SDB_ATTRIBUTE;
+	obj.name = attr->key;
+	obj.last_update = attr->last_update;
+	obj.interval = attr->interval;
+	obj.backends = attr->backends;
+	obj.backends_num = attr->backends_num;
+	if (! status)
+		status = store_obj(&obj, &new);
+
+	if (! status) {
+		assert(new);
+		/* update the value (and its index entries) if it changed */
+		if (sdb_data_cmp(&ATTR(new)->value, &attr->value)) {
+			sdb_memstore_attr_index_remove(st->attr_index, new);
+			sdb_memstore_trigram_index_remove(st->trigram_index, new);
+			if (attr_set_value(ATTR(new), &attr->value))
+				status = -1;
+			if (st->attr_index
+					&& sdb_memstore_attr_index_add(st->attr_index, new))
+				status = -1;
+			if (st->trigram_index
+					&& sdb_memstore_trigram_index_add(st->trigram_index, new))
+				status = -1;
+		}
+	}
+
+	if (obj.parent != STORE_OBJ(host))
+		sdb_object_deref(SDB_OBJ(obj.parent));
+	return status;
+} /* store_attribute_locked */
+
+static int
+store_host_locked(sdb_memstore_t *st, sdb_store_host_t *host)
+{
+	store_obj_t obj = {
+		NULL, st->hosts, st->hosts_idx, SDB_HOST, NULL, 0, 0, NULL, 0,
+		st->trigram_index,
+	};
+	sdb_memstore_obj_t *new = NULL;
+	int status;
+
+	if (! host->name)
+		return -1;
+
+	obj.name = host->name;
+	obj.last_update = host->last_update;
+	obj.interval = host->interval;
+	obj.backends = host->backends;
+	obj.backends_num = host->backends_num;
+	status = store_obj(&obj, &new);
+
+	/* existing hosts have been made writable by the caller */
+	if (! status)
+		HOST(new)->epoch = st->epoch;
+	return status;
+} /* store_host_locked */
+
+static int
+store_service_locked(sdb_memstore_t *st, host_t *host,
+		sdb_store_service_t *service)
+{
+	store_obj_t obj = STORE_OBJ_INIT;
+
+	if ((! service->hostname) || (! service->name))
+		return -1;
+
+	obj.parent = STORE_OBJ(host);
+	obj.parent_tree = get_host_children(host, SDB_SERVICE);
+	obj.parent_idx = get_host_index(host, SDB_SERVICE);
+	obj.type = SDB_SERVICE;
+	obj.trigrams = st->trigram_index;
+	if (! obj.parent_tree) {
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to store service '%s' - "
+				"host '%s' not found", service->name, service->hostname);
+		return -1;
+	}
+
+	obj.name = service->name;
+	obj.last_update = service->last_update;
+	obj.interval = service->interval;
+	obj.backends = service->backends;
+	obj.backends_num = service->backends_num;
+	return store_obj(&obj, NULL);
+} /* store_service_locked */
+
+static int
+store_metric_locked(sdb_memstore_t *st, host_t *host,
+		sdb_store_metric_t *metric)
+{
+	store_obj_t obj = STORE_OBJ_INIT;
+	sdb_memstore_obj_t *new = NULL;
+
+	int status;
+	size_t i;
+
+	if ((! metric->hostname) || (! metric->name))
+		return -1;
+
+	for (i = 0; i < metric->stores_num; ++i)
 		if ((metric->stores[i].type == NULL) || (metric->stores[i].id == NULL))
 			return -1;
 
-	pthread_rwlock_wrlock(&st->host_lock);
-	host = HOST(sdb_avltree_lookup(st->hosts, metric->hostname));
-	obj.parent = STORE_OBJ(host);
-	obj.parent_tree = get_host_children(host, SDB_METRIC);
-	obj.type = SDB_METRIC;
-	if (! obj.parent_tree) {
-		sdb_log(SDB_LOG_ERR, "memstore: Failed to store metric '%s' - "
-				"host '%s' not found", metric->name, metric->hostname);
-		status = -1;
+	obj.parent = STORE_OBJ(host);
+	obj.parent_tree = get_host_children(host, SDB_METRIC);
+	obj.parent_idx = get_host_index(host, SDB_METRIC);
+	obj.type = SDB_METRIC;
+	obj.trigrams = st->trigram_index;
+	if (! obj.parent_tree) {
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to store metric '%s' - "
+				"host '%s' not found", metric->name, metric->hostname);
+		return -1;
+	}
+
+	obj.name = metric->name;
+	obj.last_update = metric->last_update;
+	obj.interval = metric->interval;
+	obj.backends = metric->backends;
+	obj.backends_num = metric->backends_num;
+	status = store_obj(&obj, &new);
+	if (status)
+		return status;
+
+	assert(new);
+	if (store_metric_stores(METRIC(new), metric))
+		return -1;
+	return 0;
+} /* store_metric_locked */
+
+static int
+store_batch(sdb_store_batch_t *batch, sdb_object_t *user_data)
+{
+	sdb_memstore_t *st = SDB_MEMSTORE(user_data);
+	pthread_mutex_t *lock = NULL;
+	host_t *host = NULL;
+	bool writable = 0, modified = 0;
+
+	int status = 0;
+	size_t i;
+
+	if (! batch)
+		return -1;
+
+	/* updates of different hosts may run concurrently */
+	pthread_rwlock_rdlock(&st->host_lock);
+	for (i = 0; i < batch->entries_num; ++i) {
+		sdb_store_batch_entry_t *e = batch->entries + i;
+		const char *hostname = entry_hostname(e);
+		int s = -1;
+
+		if (! hostname) {
+			status = -1;
+			continue;
+		}
+
+		if (get_host_lock(st, hostname) != lock) {
+			/* views may only be pinned while holding all host locks, so
+			 * marking the store before releasing the lock is sufficient */
+			if (modified)
+				store_modified(st);
+			modified = 0;
+			if (lock)
+				pthread_mutex_unlock(lock);
+			lock = get_host_lock(st, hostname);
+			pthread_mutex_lock(lock);
+		}
+
+		/* consecutive entries usually belong to the same host */
+		if ((! host) || strcasecmp(SDB_OBJ(host)->name, hostname)) {
+			sdb_object_deref(SDB_OBJ(host));
+			host = HOST(sdb_hashtable_lookup(st->hosts_idx, hostname));
+			writable = (! host) || (! host_pinned(st, host));
+		}
+
+		/* don't copy hosts visible to a view unless they change; outdated
+		 * updates are rejected below without modifying the host */
+		if ((! writable) && (! entry_outdated(host, e))) {
+			if (! (host = host_writable(st, host))) {
+				status = -1;
+				continue;
+			}
+			writable = 1;
+		}
+
+		if (e->type == SDB_HOST)
+			s = store_host_locked(st, &e->obj.host);
+		else if (e->type == SDB_SERVICE)
+			s = store_service_locked(st, host, &e->obj.service);
+		else if (e->type == SDB_METRIC)
+			s = store_metric_locked(st, host, &e->obj.metric);
+		else if (e->type == SDB_ATTRIBUTE)
+			s = store_attribute_locked(st, host, &e->obj.attribute);
+
+		/* outdated updates are rejected without changing anything while
+		 * failed updates might have been applied partially */
+		if (s <= 0)
+			modified = 1;
+		if (((s > 0) && (status >= 0)) || (s < 0))
+			status = s;
+	}
+	sdb_object_deref(SDB_OBJ(host));
+	if (modified)
+		store_modified(st);
+	if (lock)
+		pthread_mutex_unlock(lock);
+	pthread_rwlock_unlock(&st->host_lock);
+	return status;
+} /* store_batch */
+
+static int
+store_attribute(sdb_store_attribute_t *attr, sdb_object_t *user_data)
+{
+	sdb_store_batch_entry_t e;
+	sdb_store_batch_t batch = { &e, 1 };
+
+	if (! attr)
+		return -1;
+
+	e.type = SDB_ATTRIBUTE;
+	e.obj.attribute = *attr;
+	return store_batch(&batch, user_data);
+} /* store_attribute */
+
+static int
+store_host(sdb_store_host_t *host, sdb_object_t *user_data)
+{
+	sdb_store_batch_entry_t e;
+	sdb_store_batch_t batch = { &e, 1 };
+
+	if (! host)
+		return -1;
+
+	e.type = SDB_HOST;
+	e.obj.host = *host;
+	return store_batch(&batch, user_data);
+} /* store_host */
+
+static int
+store_service(sdb_store_service_t *service, sdb_object_t *user_data)
+{
+	sdb_store_batch_entry_t e;
+	sdb_store_batch_t batch = { &e, 1 };
+
+	if (! service)
+		return -1;
+
+	e.type = SDB_SERVICE;
+	e.obj.service = *service;
+	return store_batch(&batch, user_data);
+} /* store_service */
+
+static int
+store_metric(sdb_store_metric_t *metric, sdb_object_t *user_data)
+{
+	sdb_store_batch_entry_t e;
+	sdb_store_batch_t batch = { &e, 1 };
+
+	if (! metric)
+		return -1;
+
+	e.type = SDB_METRIC;
+	e.obj.metric = *metric;
+	return store_batch(&batch, user_data);
+} /* store_metric */
+
+sdb_store_writer_t sdb_memstore_writer = {
+	store_host, store_service, store_metric, store_attribute, store_batch,
+	/* flags = */ SDB_STORE_WRITER_UPSERT,
+};
+
+/*
+ * store query API
+ */
+
+static sdb_object_t *
+prepare_query(sdb_ast_node_t *ast,
+		sdb_strbuf_t __attribute__((unused)) *errbuf,
+		sdb_object_t __attribute__((unused)) *user_data)
+{
+	return SDB_OBJ(sdb_memstore_query_prepare(ast));
+} /* prepare_query */
+
+static int
+execute_query(sdb_object_t *q,
+		sdb_store_writer_t *w, sdb_object_t *wd, sdb_strbuf_t *errbuf,
+		sdb_object_t *user_data)
+{
+	return sdb_memstore_query_execute(SDB_MEMSTORE(user_data),
+			QUERY(q), w, wd, errbuf);
+} /* execute_query */
+
+sdb_store_reader_t sdb_memstore_reader = {
+	prepare_query, execute_query,
+};
+
+/*
+ * expiry
+ */
+
+typedef struct {
+	sdb_time_t now;
+	double factor;
+	sdb_time_t ttl;
+	attr_index_t *attr_index;
+	trigram_index_t *trigram_index;
+	size_t removed;
+} expire_t;
+
+static bool
+obj_expired(sdb_memstore_obj_t *obj, expire_t *e)
+{
+	sdb_time_t age;
+
+	if (obj->last_update >= e->now)
+		return 0;
+	age = e->now - obj->last_update;
+
+	if (e->ttl && (age > e->ttl))
+		return 1;
+	if ((e->factor > 0.0) && obj->interval
+			&& ((double)age > e->factor * (double)obj->interval))
+		return 1;
+	return 0;
+} /* obj_expired */
+
+static int
+expire_obj(sdb_memstore_obj_t *obj, expire_t *e);
+
+/* Remove all expired objects from the specified tree and its index. */
+static int
+expire_tree(sdb_avltree_t *tree, sdb_hashtable_t *idx, expire_t *e)
+{
+	sdb_avltree_iter_t *iter;
+	sdb_object_t **expired;
+	size_t expired_num = 0, i;
+	int status = 0;
+
+	if (! sdb_avltree_size(tree))
+		return 0;
+
+	/* removing objects invalidates the iterator */
+	expired = calloc(sdb_avltree_size(tree), sizeof(*expired));
+	iter = sdb_avltree_get_iter(tree);
+	if ((! expired) || (! iter)) {
+		if (expired)
+			free(expired);
+		sdb_avltree_iter_destroy(iter);
+		return -1;
+	}
+
+	while (sdb_avltree_iter_has_next(iter)) {
+		sdb_object_t *obj = sdb_avltree_iter_get_next(iter);
+		int check = expire_obj(STORE_OBJ(obj), e);
+
+		if (check < 0)
+			status = -1;
+		else if (check > 0)
+			expired[expired_num++] = obj;
+	}
+	sdb_avltree_iter_destroy(iter);
+
+	for (i = 0; i < expired_num; ++i) {
+		if (STORE_OBJ(expired[i])->type == SDB_ATTRIBUTE)
+			sdb_memstore_attr_index_remove(e->attr_index,
+					STORE_OBJ(expired[i]));
+		sdb_memstore_trigram_index_remove(e->trigram_index,
+				STORE_OBJ(expired[i]));
+		/* the tree holds another reference, keeping the name valid */
+		sdb_hashtable_remove(idx, expired[i]->name);
+		if (! sdb_avltree_remove(tree, expired[i]->name))
+			++e->removed;
+	}
+	free(expired);
+	return status;
+} /* expire_tree */
+
+/* Remove all expired children of an object and check whether the object
+ * itself has expired. Objects with any remaining children are kept. */
+static int
+expire_obj(sdb_memstore_obj_t *obj, expire_t *e)
+{
+	sdb_avltree_t *children[3];
+	sdb_hashtable_t *indexes[3];
+	bool keep = 0;
+	int status = 0;
+	size_t i;
+
+	get_obj_children(obj, children, indexes);
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(children); ++i) {
+		if (expire_tree(children[i], indexes[i], e))
+			status = -1;
+		if (sdb_avltree_size(children[i]))
+			keep = 1;
+	}
+
+	if (status)
+		return status;
+	if (keep)
+		return 0;
+	return obj_expired(obj, e);
+} /* expire_obj */
+
+/* Check whether an object or any of its children has expired without
+ * removing anything. */
+static bool
+expire_check(sdb_memstore_obj_t *obj, expire_t *e)
+{
+	sdb_avltree_t *children[3];
+	sdb_hashtable_t *indexes[3];
+	bool expired = obj_expired(obj, e);
+	size_t i;
+
+	get_obj_children(obj, children, indexes);
+	for (i = 0; (! expired) && (i < SDB_STATIC_ARRAY_LEN(children)); ++i) {
+		sdb_avltree_iter_t *iter;
+
+		if (! sdb_avltree_size(children[i]))
+			continue;
+		/* assume the worst if we're out of memory */
+		if (! (iter = sdb_avltree_get_iter(children[i])))
+			return 1;
+		while ((! expired) && sdb_avltree_iter_has_next(iter))
+			expired = expire_check(STORE_OBJ(sdb_avltree_iter_get_next(iter)),
+					e);
+		sdb_avltree_iter_destroy(iter);
+	}
+	return expired;
+} /* expire_check */
+
+/*
+ * scanning
+ */
+
+/* Evaluate a host or all of its children of the specified type. */
+static int
+scan_host(sdb_memstore_obj_t *host, int type,
+		sdb_memstore_matcher_t *m, sdb_memstore_matcher_t *filter,
+		sdb_memstore_lookup_cb cb, void *user_data)
+{
+	sdb_avltree_iter_t *iter = NULL;
+	int status = 0;
+
+	if (! sdb_memstore_matcher_matches(filter, host, NULL))
+		return 0;
+
+	if (type == SDB_SERVICE)
+		iter = sdb_avltree_get_iter(HOST(host)->services);
+	else if (type == SDB_METRIC)
+		iter = sdb_avltree_get_iter(HOST(host)->metrics);
+
+	if (iter) {
+		while (sdb_avltree_iter_has_next(iter)) {
+			sdb_memstore_obj_t *obj;
+			obj = STORE_OBJ(sdb_avltree_iter_get_next(iter));
+			assert(obj);
+
+			if (sdb_memstore_matcher_matches(m, obj, filter)) {
+				if (cb(obj, filter, user_data)) {
+					sdb_log(SDB_LOG_ERR, "memstore: Callback returned "
+							"an error while scanning");
+					status = -1;
+					break;
+				}
+			}
+		}
+	}
+	else if (sdb_memstore_matcher_matches(m, host, filter)) {
+		if (cb(host, filter, user_data)) {
+			sdb_log(SDB_LOG_ERR, "memstore: Callback returned "
+					"an error while scanning");
+			status = -1;
+		}
+	}
+
+	sdb_avltree_iter_destroy(iter);
+	return status;
+} /* scan_host */
+
+static bool
+name_in_range(const name_plan_t *plan, const char *name)
+{
+	int cmp;
+
+	if (plan->lower) {
+		cmp = strcasecmp(name, plan->lower);
+		if ((cmp < 0) || ((! cmp) && (! plan->lower_incl)))
+			return 0;
+	}
+	if (plan->upper) {
+		cmp = strcasecmp(name, plan->upper);
+		if ((cmp > 0) || ((! cmp) && (! plan->upper_incl)))
+			return 0;
+	}
+	return 1;
+} /* name_in_range */
+
+/* Look up the hosts selected by a name plan in order. The lookup does not
+ * take references; all host locks have to be held. */
+static int
+lookup_hosts(sdb_memstore_t *store, const name_plan_t *plan,
+		sdb_memstore_obj_t ***hosts, size_t *hosts_num)
+{
+	sdb_avltree_iter_t *iter;
+	size_t size = 0, i;
+
+	*hosts = NULL;
+	*hosts_num = 0;
+
+	if (! plan->range) {
+		if (! plan->names_num)
+			return 0;
+		if (! (*hosts = calloc(plan->names_num, sizeof(**hosts))))
+			return -1;
+		for (i = 0; i < plan->names_num; ++i) {
+			sdb_object_t *host = sdb_avltree_lookup(store->hosts,
+					plan->names[i]);
+
+			if (! host)
+				continue;
+			/* the tree holds another reference */
+			sdb_object_deref(host);
+			(*hosts)[(*hosts_num)++] = STORE_OBJ(host);
+		}
+		return 0;
 	}
 
-	obj.name = metric->name;
-	obj.last_update = metric->last_update;
-	obj.interval = metric->interval;
-	obj.backends = metric->backends;
-	obj.backends_num = metric->backends_num;
-	if (! status)
-		status = store_obj(&obj, &new);
-	sdb_object_deref(SDB_OBJ(host));
+	if (! sdb_avltree_size(store->hosts))
+		return 0;
+	if (! (iter = sdb_avltree_get_iter_from(store->hosts, plan->lower)))
+		return -1;
+	while (sdb_avltree_iter_has_next(iter)) {
+		sdb_object_t *host = sdb_avltree_iter_get_next(iter);
 
-	if (status) {
-		pthread_rwlock_unlock(&st->host_lock);
-		return status;
+		if (! name_in_range(plan, host->name)) {
+			/* skip hosts equal to an exclusive lower bound */
+			if (plan->lower && (! strcasecmp(host->name, plan->lower)))
+				continue;
+			break;
+		}
+
+		if (*hosts_num == size) {
+			sdb_memstore_obj_t **tmp;
+
+			size = size ? 2 * size : 16;
+			if (! (tmp = realloc(*hosts, size * sizeof(**hosts)))) {
+				sdb_avltree_iter_destroy(iter);
+				return -1;
+			}
+			*hosts = tmp;
+		}
+		(*hosts)[(*hosts_num)++] = STORE_OBJ(host);
 	}
+	sdb_avltree_iter_destroy(iter);
+	return 0;
+} /* lookup_hosts */
 
-	assert(new);
-	if (store_metric_stores(METRIC(new), metric))
-		status = -1;
-	pthread_rwlock_unlock(&st->host_lock);
-	return status;
-} /* store_metric */
+/* Parallel scans split the hosts into more partitions than threads to
+ * balance the load; each partition includes a minimum number of hosts to
+ * make up for the overhead. */
+#define SCAN_PARTITIONS_PER_THREAD 4
+#define SCAN_PARTITION_MIN_HOSTS 64
 
-sdb_store_writer_t sdb_memstore_writer = {
-	store_host, store_service, store_metric, store_attribute,
-};
+typedef struct {
+	sdb_object_t **hosts;
+	size_t hosts_num;
 
-/*
- * store query API
- */
+	/* matching objects in scan order */
+	sdb_memstore_obj_t **objs;
+	size_t objs_num;
+	size_t objs_size;
+	int status;
+} scan_partition_t;
 
-static sdb_object_t *
-prepare_query(sdb_ast_node_t *ast,
-		sdb_strbuf_t __attribute__((unused)) *errbuf,
-		sdb_object_t __attribute__((unused)) *user_data)
+typedef struct {
+	int type;
+	sdb_memstore_matcher_t *m;
+	sdb_memstore_matcher_t *filter;
+
+	pthread_mutex_t lock;
+	scan_partition_t *parts;
+	size_t parts_num;
+	size_t next;
+} parallel_scan_t;
+
+static int
+collect_obj(sdb_memstore_obj_t *obj,
+		sdb_memstore_matcher_t __attribute__((unused)) *filter,
+		void *user_data)
 {
-	return SDB_OBJ(sdb_memstore_query_prepare(ast));
-} /* prepare_query */
+	scan_partition_t *part = user_data;
+
+	if (part->objs_num == part->objs_size) {
+		size_t size = part->objs_size ? 2 * part->objs_size : 64;
+		sdb_memstore_obj_t **tmp;
+
+		if (! (tmp = realloc(part->objs, size * sizeof(*tmp))))
+			return -1;
+		part->objs = tmp;
+		part->objs_size = size;
+	}
+	part->objs[part->objs_num++] = obj;
+	return 0;
+} /* collect_obj */
+
+/* Evaluate partitions until none is left. */
+static void *
+scan_worker(void *arg)
+{
+	parallel_scan_t *scan = arg;
+
+	while (42) {
+		scan_partition_t *part = NULL;
+		size_t i;
+
+		pthread_mutex_lock(&scan->lock);
+		if (scan->next < scan->parts_num)
+			part = scan->parts + scan->next++;
+		pthread_mutex_unlock(&scan->lock);
+		if (! part)
+			break;
+
+		for (i = 0; (! part->status) && (i < part->hosts_num); ++i)
+			part->status = scan_host(STORE_OBJ(part->hosts[i]), scan->type,
+					scan->m, scan->filter, collect_obj, part);
+	}
+	return NULL;
+} /* scan_worker */
 
+/* Evaluate the hosts of a view using multiple threads, collecting the
+ * matching objects of each partition, and pass them on to the callback in
+ * scan order. */
 static int
-execute_query(sdb_object_t *q,
-		sdb_store_writer_t *w, sdb_object_t *wd, sdb_strbuf_t *errbuf,
-		sdb_object_t *user_data)
+scan_parallel(store_view_t *view, size_t threads, int type,
+		sdb_memstore_matcher_t *m, sdb_memstore_matcher_t *filter,
+		sdb_memstore_lookup_cb cb, void *user_data)
 {
-	return sdb_memstore_query_execute(SDB_MEMSTORE(user_data),
-			QUERY(q), w, wd, errbuf);
-} /* execute_query */
+	parallel_scan_t scan = { type, m, filter,
+		PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0 };
+	pthread_t *tids;
+	size_t tids_num = 0, i, j;
+	int status = 0;
 
-sdb_store_reader_t sdb_memstore_reader = {
-	prepare_query, execute_query,
-};
+	scan.parts_num = threads * SCAN_PARTITIONS_PER_THREAD;
+	if (scan.parts_num > view->hosts_num / SCAN_PARTITION_MIN_HOSTS)
+		scan.parts_num = view->hosts_num / SCAN_PARTITION_MIN_HOSTS;
+	if (threads > scan.parts_num)
+		threads = scan.parts_num;
+	assert(threads > 1);
+
+	scan.parts = calloc(scan.parts_num, sizeof(*scan.parts));
+	tids = calloc(threads - 1, sizeof(*tids));
+	if ((! scan.parts) || (! tids)) {
+		if (scan.parts)
+			free(scan.parts);
+		if (tids)
+			free(tids);
+		return -1;
+	}
+
+	for (i = 0; i < scan.parts_num; ++i) {
+		size_t start = i * view->hosts_num / scan.parts_num;
+		size_t end = (i + 1) * view->hosts_num / scan.parts_num;
+
+		scan.parts[i].hosts = view->hosts + start;
+		scan.parts[i].hosts_num = end - start;
+	}
+
+	/* the current thread acts as the first worker; if any of the others
+	 * cannot be started, the remaining ones do all the work */
+	for (i = 0; i < threads - 1; ++i) {
+		if (pthread_create(&tids[i], /* attr = */ NULL,
+					scan_worker, /* arg = */ &scan))
+			break;
+		++tids_num;
+	}
+	scan_worker(&scan);
+	for (i = 0; i < tids_num; ++i)
+		pthread_join(tids[i], NULL);
+	free(tids);
+
+	for (i = 0; i < scan.parts_num; ++i) {
+		scan_partition_t *part = scan.parts + i;
+
+		if (part->status)
+			status = -1;
+		for (j = 0; (! status) && (j < part->objs_num); ++j) {
+			if (cb(part->objs[j], filter, user_data)) {
+				sdb_log(SDB_LOG_ERR, "memstore: Callback returned "
+						"an error while scanning");
+				status = -1;
+			}
+		}
+		if (part->objs)
+			free(part->objs);
+	}
+	free(scan.parts);
+	pthread_mutex_destroy(&scan.lock);
+	return status;
+} /* scan_parallel */
 
 /*
  * public API
@@ -751,6 +1977,79 @@ sdb_memstore_create(void)
 	return SDB_MEMSTORE(sdb_object_create("memstore", store_type));
 } /* sdb_memstore_create */
 
+int
+sdb_memstore_index_attributes(sdb_memstore_t *store)
+{
+	attr_index_t *idx;
+	int status = 0;
+
+	if (! store)
+		return -1;
+
+	pthread_rwlock_wrlock(&store->host_lock);
+	if (store->attr_index) {
+		pthread_rwlock_unlock(&store->host_lock);
+		return 0;
+	}
+
+	/* index the existing attributes of all hosts, services, and metrics */
+	if (! (idx = sdb_memstore_attr_index_create()))
+		status = -1;
+	if (! status)
+		status = index_tree(store->hosts, index_attr, idx);
+
+	if (status) {
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to build attribute index");
+		sdb_memstore_attr_index_destroy(idx);
+	}
+	else
+		store->attr_index = idx;
+	pthread_rwlock_unlock(&store->host_lock);
+	return status;
+} /* sdb_memstore_index_attributes */
+
+int
+sdb_memstore_index_trigrams(sdb_memstore_t *store,
+		const char * const *keys, size_t keys_num)
+{
+	trigram_index_t *idx;
+	int status = 0;
+
+	if ((! store) || (keys_num && (! keys)))
+		return -1;
+
+	/* build the new index before replacing the old one */
+	if (! (idx = sdb_memstore_trigram_index_create(keys, keys_num)))
+		status = -1;
+
+	pthread_rwlock_wrlock(&store->host_lock);
+	if (! status)
+		status = index_tree(store->hosts, index_trigrams, idx);
+
+	if (status) {
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to build trigram index");
+		sdb_memstore_trigram_index_destroy(idx);
+	}
+	else {
+		sdb_memstore_trigram_index_destroy(store->trigram_index);
+		store->trigram_index = idx;
+	}
+	pthread_rwlock_unlock(&store->host_lock);
+	return status;
+} /* sdb_memstore_index_trigrams */
+
+int
+sdb_memstore_scan_threads(sdb_memstore_t *store, size_t threads)
+{
+	if ((! store) || (! threads))
+		return -1;
+
+	pthread_mutex_lock(&store->view_lock);
+	store->scan_threads = threads;
+	pthread_mutex_unlock(&store->view_lock);
+	return 0;
+} /* sdb_memstore_scan_threads */
+
 int
 sdb_memstore_host(sdb_memstore_t *store, const char *name,
 		sdb_time_t last_update, sdb_time_t interval)
@@ -780,13 +2079,12 @@ sdb_memstore_metric(sdb_memstore_t *store, const char *hostname, const char *nam
 		hostname, name, /* stores */ NULL, 0,
 		last_update, interval, NULL, 0,
 	};
+	sdb_metric_store_t s = { NULL, NULL, NULL, 0 };
 	if (metric_store) {
-		metric.stores = &(const sdb_metric_store_t){
-			metric_store->type,
-			metric_store->id,
-			NULL,
-			metric_store->last_update,
-		};
+		s.type = metric_store->type;
+		s.id = metric_store->id;
+		s.last_update = metric_store->last_update;
+		metric.stores = &s;
 		metric.stores_num = 1;
 	}
 	return store_metric(&metric, SDB_OBJ(store));
@@ -845,7 +2143,7 @@ sdb_memstore_get_host(sdb_memstore_t *store, const char *name)
 	if ((! store) || (! name))
 		return NULL;
 
-	host = HOST(sdb_avltree_lookup(store->hosts, name));
+	host = HOST(sdb_hashtable_lookup(store->hosts_idx, name));
 	if (! host)
 		return NULL;
 
@@ -855,18 +2153,18 @@ sdb_memstore_get_host(sdb_memstore_t *store, const char *name)
 sdb_memstore_obj_t *
 sdb_memstore_get_child(sdb_memstore_obj_t *obj, int type, const char *name)
 {
-	sdb_avltree_t *children = NULL;
+	sdb_hashtable_t *children = NULL;
 
 	if ((! obj) || (! name))
 		return NULL;
 
 	if (type & SDB_ATTRIBUTE)
-		children = get_obj_attrs(obj);
+		children = get_obj_attrs_index(obj);
 	else if (obj->type == SDB_HOST)
-		children = get_host_children(HOST(obj), type);
+		children = get_host_index(HOST(obj), type);
 	if (! children)
 		return NULL;
-	return STORE_OBJ(sdb_avltree_lookup(children, name));
+	return STORE_OBJ(sdb_hashtable_lookup(children, name));
 } /* sdb_memstore_get_child */
 
 int
@@ -899,10 +2197,7 @@ sdb_memstore_get_field(sdb_memstore_obj_t *obj, int field, sdb_data_t *res)
 		case SDB_FIELD_BACKEND:
 			if (! res)
 				return 0;
-			tmp.type = SDB_TYPE_ARRAY | SDB_TYPE_STRING;
-			tmp.data.array.length = obj->backends_num;
-			tmp.data.array.values = obj->backends;
-			return sdb_data_copy(res, &tmp);
+			return backends_to_data(&obj->backends, res);
 		case SDB_FIELD_VALUE:
 			if (obj->type != SDB_ATTRIBUTE)
 				return -1;
@@ -934,7 +2229,7 @@ sdb_memstore_get_attr(sdb_memstore_obj_t *obj, const char *name, sdb_data_t *res
 	if ((! obj) || (! name))
 		return -1;
 
-	attr = STORE_OBJ(sdb_avltree_lookup(get_obj_attrs(obj), name));
+	attr = STORE_OBJ(sdb_hashtable_lookup(get_obj_attrs_index(obj), name));
 	if (! attr)
 		return -1;
 	if (filter && (! sdb_memstore_matcher_matches(filter, attr, NULL))) {
@@ -949,12 +2244,66 @@ sdb_memstore_get_attr(sdb_memstore_obj_t *obj, const char *name, sdb_data_t *res
 	return 0;
 } /* sdb_memstore_get_attr */
 
+int
+sdb_memstore_get_field_borrowed(sdb_memstore_obj_t *obj, int field,
+		sdb_data_t *res, bool *owned)
+{
+	sdb_data_t tmp = SDB_DATA_INIT;
+	int status;
+
+	*owned = 0;
+	if (! obj)
+		return -1;
+
+	if (field == SDB_FIELD_NAME) {
+		res->type = SDB_TYPE_STRING;
+		res->data.string = SDB_OBJ(obj)->name;
+		return 0;
+	}
+	if ((field == SDB_FIELD_VALUE) && (obj->type == SDB_ATTRIBUTE)) {
+		*res = ATTR(obj)->value;
+		return 0;
+	}
+
+	/* scalars and values which have to be assembled first */
+	status = sdb_memstore_get_field(obj, field, &tmp);
+	if (! status) {
+		*res = tmp;
+		*owned = 1;
+	}
+	return status;
+} /* sdb_memstore_get_field_borrowed */
+
+int
+sdb_memstore_get_attr_borrowed(sdb_memstore_obj_t *obj, const char *name,
+		sdb_data_t *res, sdb_memstore_matcher_t *filter)
+{
+	sdb_memstore_obj_t *attr;
+	int status = 0;
+
+	if ((! obj) || (! name))
+		return -1;
+
+	attr = STORE_OBJ(sdb_hashtable_lookup(get_obj_attrs_index(obj), name));
+	if (! attr)
+		return -1;
+	if (filter && (! sdb_memstore_matcher_matches(filter, attr, NULL)))
+		status = -1;
+	else
+		*res = ATTR(attr)->value;
+
+	/* the attribute is referenced by its parent */
+	sdb_object_deref(SDB_OBJ(attr));
+	return status;
+} /* sdb_memstore_get_attr_borrowed */
+
 int
 sdb_memstore_scan(sdb_memstore_t *store, int type,
 		sdb_memstore_matcher_t *m, sdb_memstore_matcher_t *filter,
 		sdb_memstore_lookup_cb cb, void *user_data)
 {
-	sdb_avltree_iter_t *host_iter = NULL;
+	store_view_t *view;
+	size_t threads, i;
 	int status = 0;
 
 	if ((! store) || (! cb))
@@ -965,67 +2314,186 @@ sdb_memstore_scan(sdb_memstore_t *store, int type,
 		return -1;
 	}
 
-	pthread_rwlock_rdlock(&store->host_lock);
-	host_iter = sdb_avltree_get_iter(store->hosts);
-	if (! host_iter)
+	/* the view is consistent without holding the lock while scanning */
+	if (! (view = sdb_memstore_view_try_pin(store, /* hosts = */ 1))) {
+		sdb_memstore_lock_all(store);
+		view = sdb_memstore_view_pin(store, /* hosts = */ 1);
+		sdb_memstore_unlock_all(store);
+	}
+	if (! view)
+		return -1;
+
+	pthread_mutex_lock(&store->view_lock);
+	threads = store->scan_threads;
+	pthread_mutex_unlock(&store->view_lock);
+
+	if ((threads > 1)
+			&& (view->hosts_num >= 2 * SCAN_PARTITION_MIN_HOSTS))
+		status = scan_parallel(view, threads, type, m, filter,
+				cb, user_data);
+	else
+		for (i = 0; (! status) && (i < view->hosts_num); ++i)
+			status = scan_host(STORE_OBJ(view->hosts[i]), type, m, filter,
+					cb, user_data);
+
+	sdb_memstore_view_release(store, view);
+	return status;
+} /* sdb_memstore_scan */
+
+int
+sdb_memstore_scan_names(sdb_memstore_t *store, int type,
+		const name_plan_t *plan, sdb_memstore_matcher_t *m,
+		sdb_memstore_matcher_t *filter,
+		sdb_memstore_lookup_cb cb, void *user_data)
+{
+	store_view_t *view = NULL;
+	sdb_memstore_obj_t **hosts = NULL;
+	size_t hosts_num = 0, i;
+	int status;
+
+	if ((! store) || (! plan) || (! cb))
+		return -1;
+	if ((type != SDB_HOST) && (type != SDB_SERVICE) && (type != SDB_METRIC))
+		return -1;
+
+	/* the host tree is consistent while excluding all writers */
+	sdb_memstore_lock_all(store);
+	status = lookup_hosts(store, plan, &hosts, &hosts_num);
+	/* keep the hosts alive and unchanged while evaluating them */
+	if ((! status) && hosts_num && (! (view = sdb_memstore_view_pin(store,
+						/* hosts = */ 0))))
 		status = -1;
+	sdb_memstore_unlock_all(store);
 
-	/* has_next returns false if the iterator is NULL */
-	while (sdb_avltree_iter_has_next(host_iter)) {
-		sdb_memstore_obj_t *host;
-		sdb_avltree_iter_t *iter = NULL;
+	for (i = 0; (! status) && (i < hosts_num); ++i)
+		status = scan_host(hosts[i], type, m, filter, cb, user_data);
 
-		host = STORE_OBJ(sdb_avltree_iter_get_next(host_iter));
-		assert(host);
+	sdb_memstore_view_release(store, view);
+	if (hosts)
+		free(hosts);
+	return status;
+} /* sdb_memstore_scan_names */
 
-		if (! sdb_memstore_matcher_matches(filter, host, NULL))
-			continue;
+ssize_t
+sdb_memstore_expire(sdb_memstore_t *store, sdb_time_t now,
+		double factor, sdb_time_t ttl, size_t max_hosts)
+{
+	expire_t e = { now, factor, ttl, NULL, NULL, 0 };
 
-		if (type == SDB_SERVICE)
-			iter = sdb_avltree_get_iter(HOST(host)->services);
-		else if (type == SDB_METRIC)
-			iter = sdb_avltree_get_iter(HOST(host)->metrics);
-
-		if (iter) {
-			while (sdb_avltree_iter_has_next(iter)) {
-				sdb_memstore_obj_t *obj;
-				obj = STORE_OBJ(sdb_avltree_iter_get_next(iter));
-				assert(obj);
-
-				if (sdb_memstore_matcher_matches(m, obj, filter)) {
-					if (cb(obj, filter, user_data)) {
-						sdb_log(SDB_LOG_ERR, "memstore: Callback returned "
-								"an error while scanning");
-						status = -1;
-						break;
-					}
-				}
+	sdb_avltree_iter_t *iter;
+	sdb_object_t **hosts = NULL;
+	size_t hosts_num = 0, i;
+	sdb_object_t *next;
+	int status = 0;
+
+	if (! store)
+		return -1;
+	if ((factor <= 0.0) && (! ttl))
+		return 0;
+
+	pthread_mutex_lock(&store->expire_lock);
+
+	/* pick the next batch of hosts, continuing where the last run stopped */
+	sdb_memstore_lock_all(store);
+	if (! max_hosts) {
+		if (store->expire_next)
+			free(store->expire_next);
+		store->expire_next = NULL;
+	}
+	if ((! max_hosts) || (max_hosts > sdb_avltree_size(store->hosts)))
+		max_hosts = sdb_avltree_size(store->hosts);
+	if (max_hosts)
+		hosts = calloc(max_hosts, sizeof(*hosts));
+	iter = sdb_avltree_get_iter_from(store->hosts, store->expire_next);
+	if ((max_hosts && (! hosts)) || (! iter)) {
+		sdb_memstore_unlock_all(store);
+		pthread_mutex_unlock(&store->expire_lock);
+		sdb_avltree_iter_destroy(iter);
+		if (hosts)
+			free(hosts);
+		return -1;
+	}
+
+	while ((hosts_num < max_hosts) && sdb_avltree_iter_has_next(iter)) {
+		hosts[hosts_num] = sdb_avltree_iter_get_next(iter);
+		sdb_object_ref(hosts[hosts_num]);
+		++hosts_num;
+	}
+
+	if (store->expire_next)
+		free(store->expire_next);
+	store->expire_next = NULL;
+	/* start over on the next run if we're done or out of memory */
+	next = sdb_avltree_iter_peek_next(iter);
+	if (next)
+		store->expire_next = strdup(next->name);
+	sdb_avltree_iter_destroy(iter);
+	sdb_memstore_unlock_all(store);
+
+	/* lock each host separately to let updates through in between */
+	for (i = 0; i < hosts_num; ++i) {
+		pthread_mutex_t *lock = get_host_lock(store, hosts[i]->name);
+		host_t *host;
+		int check;
+
+		pthread_rwlock_rdlock(&store->host_lock);
+		pthread_mutex_lock(lock);
+		e.attr_index = store->attr_index;
+		e.trigram_index = store->trigram_index;
+
+		/* the host might have been replaced by a new version meanwhile */
+		host = HOST(sdb_hashtable_lookup(store->hosts_idx, hosts[i]->name));
+		if (host && host_pinned(store, host)) {
+			/* don't copy hosts visible to a view unless they change */
+			if (expire_check(STORE_OBJ(host), &e)) {
+				if (! (host = host_writable(store, host)))
+					status = -1;
 			}
-		}
-		else if (sdb_memstore_matcher_matches(m, host, filter)) {
-			if (cb(host, filter, user_data)) {
-				sdb_log(SDB_LOG_ERR, "memstore: Callback returned "
-						"an error while scanning");
-				status = -1;
+			else {
+				sdb_object_deref(SDB_OBJ(host));
+				host = NULL;
 			}
 		}
 
-		sdb_avltree_iter_destroy(iter);
-		if (status)
-			break;
+		check = host ? expire_obj(STORE_OBJ(host), &e) : 0;
+		if (check < 0)
+			status = -1;
+		else if (check > 0) {
+			sdb_memstore_trigram_index_remove(store->trigram_index,
+					STORE_OBJ(host));
+			/* our reference keeps the name valid */
+			sdb_hashtable_remove(store->hosts_idx, SDB_OBJ(host)->name);
+			if (! sdb_avltree_remove(store->hosts, SDB_OBJ(host)->name))
+				++e.removed;
+		}
+		pthread_mutex_unlock(lock);
+		pthread_rwlock_unlock(&store->host_lock);
+
+		/* removed hosts might still be visible to a view */
+		if (host && (check > 0))
+			retire_host(store, host);
+		else
+			sdb_object_deref(SDB_OBJ(host));
+		sdb_object_deref(hosts[i]);
 	}
 
-	sdb_avltree_iter_destroy(host_iter);
-	pthread_rwlock_unlock(&store->host_lock);
-	return status;
-} /* sdb_memstore_scan */
+	pthread_mutex_unlock(&store->expire_lock);
+	if (hosts)
+		free(hosts);
 
-int
-sdb_memstore_emit(sdb_memstore_obj_t *obj, sdb_store_writer_t *w, sdb_object_t *wd)
-{
-	if ((! obj) || (! w))
-		return -1;
+	if (status) {
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to check some objects "
+				"for expiry");
+		return status;
+	}
+	return (ssize_t)e.removed;
+} /* sdb_memstore_expire */
 
+static int
+emit_obj(sdb_memstore_obj_t *obj,
+		const char * const *backends, size_t backends_num,
+		sdb_store_writer_t *w, sdb_object_t *wd)
+{
 	switch (obj->type) {
 	case SDB_HOST:
 		{
@@ -1033,8 +2501,8 @@ sdb_memstore_emit(sdb_memstore_obj_t *obj, sdb_store_writer_t *w, sdb_object_t *
 				obj->_name,
 				obj->last_update,
 				obj->interval,
-				(const char * const *)obj->backends,
-				obj->backends_num,
+				backends,
+				backends_num,
 			};
 			if (! w->store_host)
 				return -1;
@@ -1047,8 +2515,8 @@ sdb_memstore_emit(sdb_memstore_obj_t *obj, sdb_store_writer_t *w, sdb_object_t *
 				obj->_name,
 				obj->last_update,
 				obj->interval,
-				(const char * const *)obj->backends,
-				obj->backends_num,
+				backends,
+				backends_num,
 			};
 			if (! w->store_service)
 				return -1;
@@ -1064,14 +2532,15 @@ sdb_memstore_emit(sdb_memstore_obj_t *obj, sdb_store_writer_t *w, sdb_object_t *
 				METRIC(obj)->stores_num,
 				obj->last_update,
 				obj->interval,
-				(const char * const *)obj->backends,
-				obj->backends_num,
+				backends,
+				backends_num,
 			};
 			size_t i;
 
 			for (i = 0; i < METRIC(obj)->stores_num; ++i) {
 				metric_stores[i].type = METRIC(obj)->stores[i].type;
 				metric_stores[i].id = METRIC(obj)->stores[i].id;
+				metric_stores[i].info = NULL;
 				metric_stores[i].last_update = METRIC(obj)->stores[i].last_update;
 			}
 
@@ -1089,8 +2558,8 @@ sdb_memstore_emit(sdb_memstore_obj_t *obj, sdb_store_writer_t *w, sdb_object_t *
 				ATTR(obj)->value,
 				obj->last_update,
 				obj->interval,
-				(const char * const *)obj->backends,
-				obj->backends_num,
+				backends,
+				backends_num,
 			};
 			if (obj->parent && (obj->parent->type != SDB_HOST)
 					&& obj->parent->parent)
@@ -1102,6 +2571,33 @@ sdb_memstore_emit(sdb_memstore_obj_t *obj, sdb_store_writer_t *w, sdb_object_t *
 	}
 
 	return -1;
+} /* emit_obj */
+
+int
+sdb_memstore_emit(sdb_memstore_obj_t *obj, sdb_store_writer_t *w, sdb_object_t *wd)
+{
+	const char *buf[16];
+	const char **backends = buf;
+	size_t n;
+	int status;
+
+	if ((! obj) || (! w))
+		return -1;
+
+	/* resolve backend IDs to names */
+	n = sdb_memstore_backends_names(&obj->backends,
+			buf, SDB_STATIC_ARRAY_LEN(buf));
+	if (n > SDB_STATIC_ARRAY_LEN(buf)) {
+		if (! (backends = calloc(n, sizeof(*backends))))
+			return -1;
+		n = sdb_memstore_backends_names(&obj->backends, backends, n);
+	}
+
+	status = emit_obj(obj, backends, n, w, wd);
+
+	if (backends != buf)
+		free(backends);
+	return status;
 } /* sdb_memstore_emit */
 
 int
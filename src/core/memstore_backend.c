@@ -0,0 +1,283 @@
+/*
+ * SysDB - src/core/memstore_backend.c
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#	include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "sysdb.h"
+#include "core/memstore-private.h"
+#include "utils/error.h"
+
+#include <assert.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+/*
+ * private data types
+ */
+
+typedef struct {
+	sdb_object_t super;
+	int id;
+} backend_t;
+#define BACKEND(obj) ((backend_t *)(obj))
+
+/* The registry maps (case-insensitive) names to IDs; 'names' maps IDs back
+ * to names. It is global to the process and shared by all stores, since
+ * objects (and matchers evaluating them) have to map IDs to names without
+ * knowing their store. Backends are never removed, not even when all stores
+ * are gone, as objects may outlive their store. The registry only grows
+ * with the number of distinct backend (plugin) names, no matter how many
+ * stores use them. */
+static pthread_rwlock_t registry_lock = PTHREAD_RWLOCK_INITIALIZER;
+static sdb_hashtable_t *registry = NULL;
+static const char **names = NULL;
+static size_t names_num = 0;
+
+#define WORD_BITS 64
+#define BIT(id) ((uint64_t)1 << ((size_t)(id) % WORD_BITS))
+
+/*
+ * private helper functions
+ */
+
+/* The registry lock has to be held by the caller. */
+static int
+lookup(const char *name)
+{
+	sdb_object_t *obj;
+	int id;
+
+	if (! registry)
+		return -1;
+	if (! (obj = sdb_hashtable_lookup(registry, name)))
+		return -1;
+	id = BACKEND(obj)->id;
+	sdb_object_deref(obj);
+	return id;
+} /* lookup */
+
+/* The registry lock has to be held for writing by the caller. */
+static int
+add_backend(const char *name)
+{
+	sdb_object_t *obj;
+	const char **tmp;
+	int id;
+
+	if ((! registry) && (! (registry = sdb_hashtable_create())))
+		return -1;
+	if (names_num >= INT_MAX)
+		return -1;
+
+	tmp = realloc(names, (names_num + 1) * sizeof(*names));
+	if (! tmp)
+		return -1;
+	names = tmp;
+
+	if (! (obj = sdb_object_create_T(name, backend_t)))
+		return -1;
+	id = (int)names_num;
+	BACKEND(obj)->id = id;
+	if (sdb_hashtable_insert(registry, obj)) {
+		sdb_object_deref(obj);
+		return -1;
+	}
+
+	/* the registry owns the object from now on */
+	names[names_num++] = obj->name;
+	sdb_object_deref(obj);
+	return id;
+} /* add_backend */
+
+static uint64_t
+get_word(const backend_set_t *set, size_t i)
+{
+	if (! i)
+		return set->bits;
+	if ((! set->ext) || (i > set->ext[0]))
+		return 0;
+	return set->ext[i];
+} /* get_word */
+
+static size_t
+num_words(const backend_set_t *set)
+{
+	return set->ext ? 1 + (size_t)set->ext[0] : 1;
+} /* num_words */
+
+/*
+ * private API
+ */
+
+int
+sdb_memstore_backend_id(const char *name, bool create)
+{
+	int id;
+
+	if (! name)
+		return -1;
+
+	pthread_rwlock_rdlock(&registry_lock);
+	id = lookup(name);
+	pthread_rwlock_unlock(&registry_lock);
+	if ((id >= 0) || (! create))
+		return id;
+
+	pthread_rwlock_wrlock(&registry_lock);
+	/* someone else might have registered it in the meantime */
+	if ((id = lookup(name)) < 0)
+		id = add_backend(name);
+	pthread_rwlock_unlock(&registry_lock);
+
+	if (id < 0) {
+		char errbuf[1024];
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to register backend '%s': %s",
+				name, sdb_strerror(errno, errbuf, sizeof(errbuf)));
+	}
+	return id;
+} /* sdb_memstore_backend_id */
+
+const char *
+sdb_memstore_backend_name(int id)
+{
+	const char *name = NULL;
+
+	if (id < 0)
+		return NULL;
+
+	pthread_rwlock_rdlock(&registry_lock);
+	if ((size_t)id < names_num)
+		name = names[id];
+	pthread_rwlock_unlock(&registry_lock);
+	return name;
+} /* sdb_memstore_backend_name */
+
+int
+sdb_memstore_backends_add(backend_set_t *set, int id)
+{
+	size_t w;
+
+	if ((! set) || (id < 0))
+		return -1;
+
+	w = (size_t)id / WORD_BITS;
+	if (! w) {
+		set->bits |= BIT(id);
+		return 0;
+	}
+
+	if ((! set->ext) || (w > set->ext[0])) {
+		size_t old = set->ext ? (size_t)set->ext[0] : 0;
+		uint64_t *tmp = realloc(set->ext, (w + 1) * sizeof(*tmp));
+
+		if (! tmp)
+			return -1;
+		memset(tmp + old + 1, 0, (w - old) * sizeof(*tmp));
+		tmp[0] = w;
+		set->ext = tmp;
+	}
+	set->ext[w] |= BIT(id);
+	return 0;
+} /* sdb_memstore_backends_add */
+
+bool
+sdb_memstore_backends_has(const backend_set_t *set, int id)
+{
+	if ((! set) || (id < 0))
+		return 0;
+	return (get_word(set, (size_t)id / WORD_BITS) & BIT(id)) != 0;
+} /* sdb_memstore_backends_has */
+
+size_t
+sdb_memstore_backends_names(const backend_set_t *set,
+		const char **dst, size_t len)
+{
+	size_t n = 0, i, j;
+
+	if (! set)
+		return 0;
+
+	pthread_rwlock_rdlock(&registry_lock);
+	for (i = 0; i < num_words(set); ++i) {
+		uint64_t word = get_word(set, i);
+
+		for (j = 0; word && (j < WORD_BITS); ++j, word >>= 1) {
+			size_t id = i * WORD_BITS + j;
+
+			if (! (word & 1))
+				continue;
+			assert(id < names_num);
+			if (dst && (n < len))
+				dst[n] = names[id];
+			++n;
+		}
+	}
+	pthread_rwlock_unlock(&registry_lock);
+	return n;
+} /* sdb_memstore_backends_names */
+
+int
+sdb_memstore_backends_copy(backend_set_t *dst, const backend_set_t *src)
+{
+	uint64_t *ext = NULL;
+
+	if ((! dst) || (! src))
+		return -1;
+
+	if (src->ext) {
+		size_t size = num_words(src) * sizeof(*ext);
+		if (! (ext = malloc(size)))
+			return -1;
+		memcpy(ext, src->ext, size);
+	}
+
+	sdb_memstore_backends_clear(dst);
+	dst->bits = src->bits;
+	dst->ext = ext;
+	return 0;
+} /* sdb_memstore_backends_copy */
+
+void
+sdb_memstore_backends_clear(backend_set_t *set)
+{
+	if (! set)
+		return;
+	if (set->ext)
+		free(set->ext);
+	set->bits = 0;
+	set->ext = NULL;
+} /* sdb_memstore_backends_clear */
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
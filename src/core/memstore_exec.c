@@ -90,14 +90,26 @@ exec_fetch(sdb_memstore_t *store,
 		const char *name, bool full, sdb_memstore_matcher_t *filter)
 {
 	sdb_memstore_obj_t *host, *p = NULL, *obj;
+	store_view_t *view;
 	int status = 0;
 
 	if (type == SDB_HOST)
 		hostname = name;
 
+	/* the view keeps the objects unchanged while serializing them */
+	sdb_memstore_lock_all(store);
+	view = sdb_memstore_view_pin(store, /* hosts = */ 0);
 	host = sdb_memstore_get_host(store, hostname);
+	sdb_memstore_unlock_all(store);
+
+	if (! view) {
+		sdb_strbuf_sprintf(errbuf, "Out of memory");
+		sdb_object_deref(SDB_OBJ(host));
+		return -1;
+	}
 	if ((! host)
 			|| (filter && (! sdb_memstore_matcher_matches(filter, host, NULL)))) {
+		sdb_memstore_view_release(store, view);
 		sdb_strbuf_sprintf(errbuf, "Failed to fetch %s %s: "
 				"host %s not found", SDB_STORE_TYPE_TO_NAME(type),
 				name, hostname);
@@ -149,6 +161,8 @@ exec_fetch(sdb_memstore_t *store,
 		}
 	}
 
+	sdb_memstore_view_release(store, view);
+
 	if (host != obj)
 		sdb_object_deref(SDB_OBJ(host));
 	if (p != obj)
@@ -180,11 +194,25 @@ exec_list(sdb_memstore_t *store,
 static int
 exec_lookup(sdb_memstore_t *store,
 		sdb_store_writer_t *w, sdb_object_t *wd, sdb_strbuf_t *errbuf,
-		int type, sdb_memstore_matcher_t *m, sdb_memstore_matcher_t *filter)
+		int type, sdb_memstore_matcher_t *m, sdb_memstore_matcher_t *filter,
+		index_plan_t *plan, name_plan_t *names)
 {
 	iter_t iter = { NULL, w, wd };
+	int status = 1;
+
+	/* looking up hosts by name is cheaper than any index */
+	if (names)
+		status = sdb_memstore_scan_names(store, type, names, m, filter,
+				lookup_tojson, &iter);
+	else if (plan)
+		status = sdb_memstore_scan_indexed(store, type, plan, m, filter,
+				lookup_tojson, &iter);
+	/* fall back to a full scan if the store is not indexed */
+	if (status > 0)
+		status = sdb_memstore_scan(store, type, m, filter,
+				lookup_tojson, &iter);
 
-	if (sdb_memstore_scan(store, type, m, filter, lookup_tojson, &iter)) {
+	if (status) {
 		sdb_log(SDB_LOG_ERR, "memstore: Failed to lookup %ss",
 				SDB_STORE_TYPE_TO_NAME(type));
 		sdb_strbuf_sprintf(errbuf, "Failed to lookup %ss",
@@ -226,7 +254,7 @@ sdb_memstore_query_execute(sdb_memstore_t *store, sdb_memstore_query_t *q,
 
 	case SDB_AST_TYPE_LOOKUP:
 		return exec_lookup(store, w, wd, errbuf, SDB_AST_LOOKUP(ast)->obj_type,
-				q->matcher, q->filter);
+				q->matcher, q->filter, q->plan, q->names);
 
 	default:
 		sdb_log(SDB_LOG_ERR, "memstore: Invalid query of type %s",
@@ -264,6 +264,77 @@ sdb_memstore_expr_eval(sdb_memstore_expr_t *expr, sdb_memstore_obj_t *obj,
 	return status;
 } /* sdb_memstore_expr_eval */
 
+int
+sdb_memstore_expr_eval_borrowed(sdb_memstore_expr_t *expr,
+		sdb_memstore_obj_t *obj, sdb_data_t *res, bool *owned,
+		sdb_memstore_matcher_t *filter)
+{
+	sdb_data_t v1 = SDB_DATA_INIT, v2 = SDB_DATA_INIT;
+	bool owned1 = 0, owned2 = 0;
+	int status = 0;
+
+	if ((! expr) || (! res) || (! owned))
+		return -1;
+
+	*owned = 0;
+	if (! expr->type) {
+		*res = expr->data;
+		return 0;
+	}
+
+	if (filter && obj && (! sdb_memstore_matcher_matches(filter, obj, NULL)))
+		obj = NULL; /* this object does not exist */
+
+	if (expr->type == FIELD_VALUE)
+		return sdb_memstore_get_field_borrowed(obj,
+				(int)expr->data.data.integer, res, owned);
+	else if (expr->type == ATTR_VALUE) {
+		status = sdb_memstore_get_attr_borrowed(obj,
+				expr->data.data.string, res, filter);
+		if ((status < 0) && obj) {
+			/* attribute does not exist => NULL */
+			status = 0;
+			res->type = SDB_TYPE_STRING;
+			res->data.string = NULL;
+		}
+		return status;
+	}
+	else if (expr->type == TYPED_EXPR) {
+		int typ = (int)expr->data.data.integer;
+		if (! obj)
+			return -1;
+		if (typ != obj->type) {
+			/* we support self-references and { service, metric } -> host */
+			if ((typ != SDB_HOST)
+					|| ((obj->type != SDB_SERVICE)
+						&& (obj->type != SDB_METRIC)))
+				return -1;
+			obj = obj->parent;
+		}
+		return sdb_memstore_expr_eval_borrowed(expr->left, obj, res, owned,
+				filter);
+	}
+
+	if (sdb_memstore_expr_eval_borrowed(expr->left, obj, &v1, &owned1, filter))
+		return -1;
+	if (sdb_memstore_expr_eval_borrowed(expr->right, obj, &v2, &owned2,
+				filter)) {
+		if (owned1)
+			sdb_data_free_datum(&v1);
+		return -1;
+	}
+
+	if (sdb_data_expr_eval(expr->type, &v1, &v2, res))
+		status = -1;
+	else
+		*owned = 1;
+	if (owned1)
+		sdb_data_free_datum(&v1);
+	if (owned2)
+		sdb_data_free_datum(&v2);
+	return status;
+} /* sdb_memstore_expr_eval_borrowed */
+
 sdb_memstore_expr_iter_t *
 sdb_memstore_expr_iter(sdb_memstore_expr_t *expr, sdb_memstore_obj_t *obj,
 		sdb_memstore_matcher_t *filter)
@@ -317,11 +388,10 @@ sdb_memstore_expr_iter(sdb_memstore_expr_t *expr, sdb_memstore_obj_t *obj,
 		if (! obj)
 			return NULL;
 		if (expr->data.data.integer == SDB_FIELD_BACKEND) {
-			/* while scanning the store, we hold a read lock, so it's safe to
-			 * access the data without copying */
-			array.type = SDB_TYPE_ARRAY | SDB_TYPE_STRING;
-			array.data.array.length = obj->backends_num;
-			array.data.array.values = obj->backends;
+			/* backends are stored as IDs; resolve them to names */
+			if (sdb_memstore_get_field(obj, SDB_FIELD_BACKEND, &array))
+				return NULL;
+			free_array = 1;
 		}
 	}
 	else if (! expr->type) {
@@ -0,0 +1,875 @@
+/*
+ * SysDB - src/core/memstore_index.c
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#	include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "sysdb.h"
+#include "core/memstore-private.h"
+#include "utils/error.h"
+
+#include <assert.h>
+
+#include <ctype.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <pthread.h>
+
+/*
+ * private data types
+ */
+
+/* set of objects (not holding a reference) using open addressing with
+ * linear probing; the number of slots is a power of two */
+typedef struct {
+	sdb_memstore_obj_t **slots;
+	size_t slots_num;
+	size_t size;
+} objset_t;
+#define OBJSET_INIT { NULL, 0, 0 }
+
+/* all objects having the same attribute value or name trigram
+ * (the name of the object) */
+typedef struct {
+	sdb_object_t super;
+	objset_t objs;
+} index_value_t;
+#define VALUE(obj) ((index_value_t *)(obj))
+
+/* all values (or value trigrams) of an attribute (the name of the object) */
+typedef struct {
+	sdb_object_t super;
+	sdb_hashtable_t *values;
+	/* array values are matched element-wise by IN;
+	 * they are tracked separately in addition */
+	objset_t arrays;
+} index_key_t;
+#define KEY(obj) ((index_key_t *)(obj))
+
+/* Writers updating different hosts may update an index concurrently; readers
+ * exclude all writers by holding all host locks. */
+
+struct attr_index {
+	pthread_mutex_t lock;
+
+	/* attribute keys of hosts, services, and metrics */
+	sdb_hashtable_t *keys[3];
+};
+
+struct trigram_index {
+	pthread_mutex_t lock;
+
+	/* trigrams of the names of hosts, services, and metrics */
+	sdb_hashtable_t *names[3];
+	/* trigrams of the selected attributes' values of hosts, services, and
+	 * metrics by attribute key */
+	sdb_hashtable_t *attrs[3];
+	char **keys;
+	size_t keys_num;
+};
+
+/*
+ * object sets
+ */
+
+static size_t
+objset_slot(const objset_t *set, const sdb_memstore_obj_t *obj)
+{
+	uint64_t h = (uint64_t)(uintptr_t)obj;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (size_t)h & (set->slots_num - 1);
+} /* objset_slot */
+
+/* Returns the slot of the object or the empty slot it would be stored in. */
+static size_t
+objset_find(const objset_t *set, const sdb_memstore_obj_t *obj)
+{
+	size_t i = objset_slot(set, obj);
+
+	while (set->slots[i] && (set->slots[i] != obj))
+		i = (i + 1) & (set->slots_num - 1);
+	return i;
+} /* objset_find */
+
+static int
+objset_add(objset_t *set, sdb_memstore_obj_t *obj)
+{
+	size_t i;
+
+	if ((set->size + 1) * 4 > set->slots_num * 3) {
+		objset_t new = OBJSET_INIT;
+
+		new.slots_num = set->slots_num ? 2 * set->slots_num : 8;
+		new.slots = calloc(new.slots_num, sizeof(*new.slots));
+		if (! new.slots)
+			return -1;
+
+		for (i = 0; i < set->slots_num; ++i)
+			if (set->slots[i])
+				new.slots[objset_find(&new, set->slots[i])] = set->slots[i];
+		new.size = set->size;
+
+		if (set->slots)
+			free(set->slots);
+		*set = new;
+	}
+
+	i = objset_find(set, obj);
+	if (! set->slots[i]) {
+		set->slots[i] = obj;
+		++set->size;
+	}
+	return 0;
+} /* objset_add */
+
+static void
+objset_remove(objset_t *set, const sdb_memstore_obj_t *obj)
+{
+	size_t i, j;
+
+	if (! set->size)
+		return;
+	i = objset_find(set, obj);
+	if (! set->slots[i])
+		return;
+
+	/* backward-shift deletion keeps probe sequences intact */
+	set->slots[i] = NULL;
+	--set->size;
+	j = i;
+	while (42) {
+		size_t home;
+
+		j = (j + 1) & (set->slots_num - 1);
+		if (! set->slots[j])
+			break;
+
+		home = objset_slot(set, set->slots[j]);
+		if (((j - home) & (set->slots_num - 1))
+				>= ((j - i) & (set->slots_num - 1))) {
+			set->slots[i] = set->slots[j];
+			set->slots[j] = NULL;
+			i = j;
+		}
+	}
+} /* objset_remove */
+
+static int
+objset_merge(objset_t *dst, const objset_t *src)
+{
+	size_t i;
+
+	for (i = 0; i < src->slots_num; ++i)
+		if (src->slots[i] && objset_add(dst, src->slots[i]))
+			return -1;
+	return 0;
+} /* objset_merge */
+
+static void
+objset_destroy(objset_t *set)
+{
+	if (set->slots)
+		free(set->slots);
+	set->slots = NULL;
+	set->slots_num = set->size = 0;
+} /* objset_destroy */
+
+/*
+ * index entries
+ */
+
+static int
+key_init(sdb_object_t *obj, va_list __attribute__((unused)) ap)
+{
+	if (! (KEY(obj)->values = sdb_hashtable_create()))
+		return -1;
+	return 0;
+} /* key_init */
+
+static void
+key_destroy(sdb_object_t *obj)
+{
+	sdb_hashtable_destroy(KEY(obj)->values);
+	objset_destroy(&KEY(obj)->arrays);
+} /* key_destroy */
+
+static void
+value_destroy(sdb_object_t *obj)
+{
+	objset_destroy(&VALUE(obj)->objs);
+} /* value_destroy */
+
+static sdb_type_t key_type = {
+	/* size = */ sizeof(index_key_t),
+	/* init = */ key_init,
+	/* destroy = */ key_destroy,
+};
+
+static sdb_type_t value_type = {
+	/* size = */ sizeof(index_value_t),
+	/* init = */ NULL,
+	/* destroy = */ value_destroy,
+};
+
+/* Look up (and optionally create) the entry of an attribute key. */
+static index_key_t *
+get_key(sdb_hashtable_t *keys, const char *name, bool create)
+{
+	sdb_object_t *key = sdb_hashtable_lookup(keys, name);
+
+	if (key || (! create))
+		return KEY(key);
+
+	key = sdb_object_create(name, key_type);
+	if (key && sdb_hashtable_insert(keys, key)) {
+		sdb_object_deref(key);
+		return NULL;
+	}
+	return KEY(key);
+} /* get_key */
+
+static int
+postings_add(sdb_hashtable_t *postings, const char *name,
+		sdb_memstore_obj_t *obj)
+{
+	sdb_object_t *v = sdb_hashtable_lookup(postings, name);
+	int status = 0;
+
+	if (! v) {
+		v = sdb_object_create(name, value_type);
+		if ((! v) || sdb_hashtable_insert(postings, v))
+			status = -1;
+	}
+	if (! status)
+		status = objset_add(&VALUE(v)->objs, obj);
+	sdb_object_deref(v);
+	return status;
+} /* postings_add */
+
+static void
+postings_remove(sdb_hashtable_t *postings, const char *name,
+		sdb_memstore_obj_t *obj)
+{
+	sdb_object_t *v = sdb_hashtable_lookup(postings, name);
+
+	if (! v)
+		return;
+	objset_remove(&VALUE(v)->objs, obj);
+	if (! VALUE(v)->objs.size)
+		sdb_hashtable_remove(postings, name);
+	sdb_object_deref(v);
+} /* postings_remove */
+
+/* Returns the number of objects in a posting list. */
+static size_t
+postings_size(sdb_hashtable_t *postings, const char *name)
+{
+	sdb_object_t *v = sdb_hashtable_lookup(postings, name);
+	size_t n = 0;
+
+	if (v)
+		n = VALUE(v)->objs.size;
+	sdb_object_deref(v);
+	return n;
+} /* postings_size */
+
+/* Add (or remove) an object to (or from) the posting lists of all trigrams
+ * of the specified string. */
+static int
+trigrams_update(sdb_hashtable_t *postings, const char *str,
+		sdb_memstore_obj_t *obj, bool add)
+{
+	size_t len = strlen(str), i;
+	int status = 0;
+
+	for (i = 0; i + 3 <= len; ++i) {
+		char tri[4];
+		size_t j;
+
+		for (j = 0; j < 3; ++j)
+			tri[j] = (char)tolower((unsigned char)str[i + j]);
+		tri[3] = '\0';
+
+		if (! add)
+			postings_remove(postings, tri, obj);
+		else if (postings_add(postings, tri, obj))
+			status = -1;
+	}
+	return status;
+} /* trigrams_update */
+
+static sdb_hashtable_t *
+get_table(sdb_hashtable_t **tables, int type)
+{
+	if ((type < SDB_HOST) || (type > SDB_METRIC))
+		return NULL;
+	return tables[type - SDB_HOST];
+} /* get_table */
+
+static bool
+trigram_key_selected(trigram_index_t *idx, const char *key)
+{
+	size_t i;
+
+	for (i = 0; i < idx->keys_num; ++i)
+		if (! strcasecmp(idx->keys[i], key))
+			return 1;
+	return 0;
+} /* trigram_key_selected */
+
+/*
+ * scanning
+ */
+
+typedef struct {
+	attr_index_t *attrs;
+	trigram_index_t *trigrams;
+	int type;
+
+	objset_t result;
+} collect_t;
+
+/* Look up the posting lists of a probe; returns NULL if the required index
+ * is not available. */
+static sdb_hashtable_t *
+probe_postings(collect_t *c, index_plan_t *plan, index_key_t **key)
+{
+	sdb_hashtable_t *keys;
+
+	*key = NULL;
+	if (plan->type == MATCHER_REGEX) {
+		if (! c->trigrams)
+			return NULL;
+		if (! plan->key)
+			return get_table(c->trigrams->names, c->type);
+		if (! trigram_key_selected(c->trigrams, plan->key))
+			return NULL;
+		keys = get_table(c->trigrams->attrs, c->type);
+	}
+	else {
+		if (! c->attrs)
+			return NULL;
+		keys = get_table(c->attrs->keys, c->type);
+	}
+
+	/* an unknown key is usable but does not select any objects */
+	*key = get_key(keys, plan->key, /* create = */ 0);
+	return keys;
+} /* probe_postings */
+
+/* Returns the (maximum) number of candidates selected by a plan or SIZE_MAX
+ * if the plan cannot be used. */
+static size_t
+plan_estimate(collect_t *c, index_plan_t *plan)
+{
+	sdb_hashtable_t *postings;
+	index_key_t *key = NULL;
+	size_t n = 0, i, l, r;
+
+	if (plan->type == MATCHER_AND) {
+		l = plan_estimate(c, plan->left);
+		r = plan_estimate(c, plan->right);
+		return l < r ? l : r;
+	}
+	if (plan->type == MATCHER_OR) {
+		l = plan_estimate(c, plan->left);
+		r = plan_estimate(c, plan->right);
+		if ((l == SIZE_MAX) || (r == SIZE_MAX))
+			return SIZE_MAX;
+		return l + r;
+	}
+
+	if (! (postings = probe_postings(c, plan, &key)))
+		return SIZE_MAX;
+	if (plan->key) {
+		if (! key)
+			return 0;
+		postings = key->values;
+	}
+
+	if (plan->type == MATCHER_REGEX) {
+		/* all trigrams are required */
+		n = SIZE_MAX;
+		for (i = 0; i < plan->values_num; ++i) {
+			size_t m = postings_size(postings, plan->values[i]);
+			if (m < n)
+				n = m;
+		}
+	}
+	else {
+		for (i = 0; i < plan->values_num; ++i)
+			n += postings_size(postings, plan->values[i]);
+		if (plan->arrays)
+			n += key->arrays.size;
+	}
+	sdb_object_deref(SDB_OBJ(key));
+	return n;
+} /* plan_estimate */
+
+/* Collect all objects included in all posting lists of the trigrams. */
+static int
+collect_trigrams(collect_t *c, sdb_hashtable_t *postings, index_plan_t *plan)
+{
+	sdb_object_t **lists;
+	size_t shortest = 0, i, j;
+	int status = 0;
+
+	if (! plan->values_num)
+		return 0;
+	if (! (lists = calloc(plan->values_num, sizeof(*lists))))
+		return -1;
+
+	for (i = 0; i < plan->values_num; ++i) {
+		lists[i] = sdb_hashtable_lookup(postings, plan->values[i]);
+		if (! lists[i])
+			break;
+		if (VALUE(lists[i])->objs.size
+				< VALUE(lists[shortest])->objs.size)
+			shortest = i;
+	}
+
+	/* intersect all lists, starting with the shortest one */
+	if (i == plan->values_num) {
+		objset_t *candidates = &VALUE(lists[shortest])->objs;
+
+		for (i = 0; i < candidates->slots_num; ++i) {
+			sdb_memstore_obj_t *obj = candidates->slots[i];
+
+			if (! obj)
+				continue;
+			for (j = 0; j < plan->values_num; ++j) {
+				objset_t *set = &VALUE(lists[j])->objs;
+				if (! set->slots[objset_find(set, obj)])
+					break;
+			}
+			if ((j == plan->values_num) && objset_add(&c->result, obj))
+				status = -1;
+		}
+	}
+
+	for (i = 0; i < plan->values_num; ++i)
+		sdb_object_deref(lists[i]);
+	free(lists);
+	return status;
+} /* collect_trigrams */
+
+/* Collect a superset of all objects matching the plan. Conjunctions only
+ * need to be satisfied by one of their operands; the more selective one is
+ * used. */
+static int
+plan_collect(collect_t *c, index_plan_t *plan)
+{
+	sdb_hashtable_t *postings;
+	index_key_t *key = NULL;
+	int status = 0;
+	size_t i;
+
+	if (plan->type == MATCHER_AND) {
+		if (plan_estimate(c, plan->left) <= plan_estimate(c, plan->right))
+			return plan_collect(c, plan->left);
+		return plan_collect(c, plan->right);
+	}
+	if (plan->type == MATCHER_OR) {
+		if (plan_collect(c, plan->left))
+			return -1;
+		return plan_collect(c, plan->right);
+	}
+
+	if (! (postings = probe_postings(c, plan, &key)))
+		return -1;
+	if (plan->key) {
+		if (! key)
+			return 0;
+		postings = key->values;
+	}
+
+	if (plan->type == MATCHER_REGEX)
+		status = collect_trigrams(c, postings, plan);
+	else {
+		for (i = 0; i < plan->values_num; ++i) {
+			sdb_object_t *v = sdb_hashtable_lookup(postings,
+					plan->values[i]);
+			if (v && objset_merge(&c->result, &VALUE(v)->objs))
+				status = -1;
+			sdb_object_deref(v);
+		}
+		if (plan->arrays && objset_merge(&c->result, &key->arrays))
+			status = -1;
+	}
+	sdb_object_deref(SDB_OBJ(key));
+	return status;
+} /* plan_collect */
+
+/* order objects like a full scan does: by host name and object name */
+static int
+cmp_objs(const void *a, const void *b)
+{
+	const sdb_memstore_obj_t *o1 = *(sdb_memstore_obj_t * const *)a;
+	const sdb_memstore_obj_t *o2 = *(sdb_memstore_obj_t * const *)b;
+	int diff = 0;
+
+	/* names are interned, so equal pointers mean equal names */
+	if ((o1->type != SDB_HOST) && (o2->type != SDB_HOST)
+			&& (o1->parent->_name != o2->parent->_name))
+		diff = strcasecmp(o1->parent->_name, o2->parent->_name);
+	if (diff)
+		return diff;
+	if (o1->_name == o2->_name)
+		return 0;
+	return strcasecmp(o1->_name, o2->_name);
+} /* cmp_objs */
+
+/*
+ * private API
+ */
+
+char *
+sdb_memstore_attr_index_value(const sdb_data_t *value)
+{
+	size_t len;
+	char *str;
+
+	if (sdb_data_isnull(value))
+		return NULL;
+
+	len = sdb_data_strlen(value) + 1;
+	if (! (str = malloc(len)))
+		return NULL;
+	sdb_data_format(value, str, len, SDB_UNQUOTED);
+	return str;
+} /* sdb_memstore_attr_index_value */
+
+attr_index_t *
+sdb_memstore_attr_index_create(void)
+{
+	attr_index_t *idx;
+	size_t i;
+
+	idx = calloc(1, sizeof(*idx));
+	if (! idx)
+		return NULL;
+	pthread_mutex_init(&idx->lock, /* attr = */ NULL);
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(idx->keys); ++i) {
+		if (! (idx->keys[i] = sdb_hashtable_create())) {
+			sdb_memstore_attr_index_destroy(idx);
+			return NULL;
+		}
+	}
+	return idx;
+} /* sdb_memstore_attr_index_create */
+
+void
+sdb_memstore_attr_index_destroy(attr_index_t *idx)
+{
+	size_t i;
+
+	if (! idx)
+		return;
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(idx->keys); ++i)
+		sdb_hashtable_destroy(idx->keys[i]);
+	pthread_mutex_destroy(&idx->lock);
+	free(idx);
+} /* sdb_memstore_attr_index_destroy */
+
+int
+sdb_memstore_attr_index_add(attr_index_t *idx, sdb_memstore_obj_t *attr)
+{
+	sdb_hashtable_t *keys;
+	index_key_t *key;
+	char *str;
+	int status = 0;
+
+	if ((! idx) || (! attr) || (attr->type != SDB_ATTRIBUTE))
+		return -1;
+	if (! (keys = get_table(idx->keys, attr->parent->type)))
+		return -1;
+	/* NULL values never match */
+	if (sdb_data_isnull(&ATTR(attr)->value))
+		return 0;
+
+	if (! (str = sdb_memstore_attr_index_value(&ATTR(attr)->value)))
+		return -1;
+
+	pthread_mutex_lock(&idx->lock);
+	if (! (key = get_key(keys, attr->_name, /* create = */ 1)))
+		status = -1;
+	if (! status)
+		status = postings_add(key->values, str, attr->parent);
+	if ((! status) && (ATTR(attr)->value.type & SDB_TYPE_ARRAY))
+		status = objset_add(&key->arrays, attr->parent);
+	pthread_mutex_unlock(&idx->lock);
+
+	if (status)
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to index attribute '%s' "
+				"of %s '%s'", attr->_name,
+				SDB_STORE_TYPE_TO_NAME(attr->parent->type),
+				attr->parent->_name);
+	sdb_object_deref(SDB_OBJ(key));
+	free(str);
+	return status;
+} /* sdb_memstore_attr_index_add */
+
+void
+sdb_memstore_attr_index_remove(attr_index_t *idx, sdb_memstore_obj_t *attr)
+{
+	sdb_hashtable_t *keys;
+	index_key_t *key;
+	char *str;
+
+	if ((! idx) || (! attr) || (attr->type != SDB_ATTRIBUTE))
+		return;
+	if (! (keys = get_table(idx->keys, attr->parent->type)))
+		return;
+	if (sdb_data_isnull(&ATTR(attr)->value))
+		return;
+
+	pthread_mutex_lock(&idx->lock);
+	if (! (key = get_key(keys, attr->_name, /* create = */ 0))) {
+		pthread_mutex_unlock(&idx->lock);
+		return;
+	}
+
+	if (ATTR(attr)->value.type & SDB_TYPE_ARRAY)
+		objset_remove(&key->arrays, attr->parent);
+	if ((str = sdb_memstore_attr_index_value(&ATTR(attr)->value))) {
+		postings_remove(key->values, str, attr->parent);
+		free(str);
+	}
+	if ((! sdb_hashtable_size(key->values)) && (! key->arrays.size))
+		sdb_hashtable_remove(keys, attr->_name);
+	pthread_mutex_unlock(&idx->lock);
+	sdb_object_deref(SDB_OBJ(key));
+} /* sdb_memstore_attr_index_remove */
+
+trigram_index_t *
+sdb_memstore_trigram_index_create(const char * const *keys, size_t keys_num)
+{
+	trigram_index_t *idx;
+	size_t i;
+
+	idx = calloc(1, sizeof(*idx));
+	if (! idx)
+		return NULL;
+	pthread_mutex_init(&idx->lock, /* attr = */ NULL);
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(idx->names); ++i) {
+		idx->names[i] = sdb_hashtable_create();
+		idx->attrs[i] = sdb_hashtable_create();
+		if ((! idx->names[i]) || (! idx->attrs[i])) {
+			sdb_memstore_trigram_index_destroy(idx);
+			return NULL;
+		}
+	}
+
+	if (keys_num && (! (idx->keys = calloc(keys_num, sizeof(*idx->keys))))) {
+		sdb_memstore_trigram_index_destroy(idx);
+		return NULL;
+	}
+	for (i = 0; i < keys_num; ++i) {
+		if (! (idx->keys[idx->keys_num] = strdup(keys[i]))) {
+			sdb_memstore_trigram_index_destroy(idx);
+			return NULL;
+		}
+		++idx->keys_num;
+	}
+	return idx;
+} /* sdb_memstore_trigram_index_create */
+
+void
+sdb_memstore_trigram_index_destroy(trigram_index_t *idx)
+{
+	size_t i;
+
+	if (! idx)
+		return;
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(idx->names); ++i) {
+		sdb_hashtable_destroy(idx->names[i]);
+		sdb_hashtable_destroy(idx->attrs[i]);
+	}
+	for (i = 0; i < idx->keys_num; ++i)
+		free(idx->keys[i]);
+	if (idx->keys)
+		free(idx->keys);
+	pthread_mutex_destroy(&idx->lock);
+	free(idx);
+} /* sdb_memstore_trigram_index_destroy */
+
+/* Add or remove the name of a host, service, or metric or the value of a
+ * selected attribute. */
+static int
+trigram_index_update(trigram_index_t *idx, sdb_memstore_obj_t *obj,
+		bool add)
+{
+	sdb_hashtable_t *keys;
+	index_key_t *key;
+	char *str;
+	int status = 0;
+
+	if ((! idx) || (! obj))
+		return -1;
+
+	if (obj->type != SDB_ATTRIBUTE) {
+		sdb_hashtable_t *names = get_table(idx->names, obj->type);
+		if (! names)
+			return -1;
+		return trigrams_update(names, obj->_name, obj, add);
+	}
+
+	if (! trigram_key_selected(idx, obj->_name))
+		return 0;
+	if (! (keys = get_table(idx->attrs, obj->parent->type)))
+		return -1;
+	/* NULL values never match */
+	if (sdb_data_isnull(&ATTR(obj)->value))
+		return 0;
+	if (! (str = sdb_memstore_attr_index_value(&ATTR(obj)->value)))
+		return -1;
+
+	if (! (key = get_key(keys, obj->_name, /* create = */ add)))
+		status = add ? -1 : 0;
+	else {
+		status = trigrams_update(key->values, str, obj->parent, add);
+		if (! sdb_hashtable_size(key->values))
+			sdb_hashtable_remove(keys, obj->_name);
+	}
+	sdb_object_deref(SDB_OBJ(key));
+	free(str);
+	return status;
+} /* trigram_index_update */
+
+int
+sdb_memstore_trigram_index_add(trigram_index_t *idx, sdb_memstore_obj_t *obj)
+{
+	int status;
+
+	if (! idx)
+		return -1;
+	pthread_mutex_lock(&idx->lock);
+	status = trigram_index_update(idx, obj, /* add = */ 1);
+	pthread_mutex_unlock(&idx->lock);
+
+	if (status)
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to index trigrams of %s '%s'",
+				SDB_STORE_TYPE_TO_NAME(obj ? obj->type : 0),
+				obj ? obj->_name : "<NULL>");
+	return status;
+} /* sdb_memstore_trigram_index_add */
+
+void
+sdb_memstore_trigram_index_remove(trigram_index_t *idx,
+		sdb_memstore_obj_t *obj)
+{
+	if (! idx)
+		return;
+	pthread_mutex_lock(&idx->lock);
+	trigram_index_update(idx, obj, /* add = */ 0);
+	pthread_mutex_unlock(&idx->lock);
+} /* sdb_memstore_trigram_index_remove */
+
+int
+sdb_memstore_scan_indexed(sdb_memstore_t *store, int type,
+		index_plan_t *plan, sdb_memstore_matcher_t *m,
+		sdb_memstore_matcher_t *filter,
+		sdb_memstore_lookup_cb cb, void *user_data)
+{
+	collect_t c = { NULL, NULL, 0, OBJSET_INIT };
+	store_view_t *view = NULL;
+	sdb_memstore_obj_t **objs = NULL;
+	size_t objs_num = 0, i;
+	int status = 0;
+
+	if ((! store) || (! plan) || (! cb))
+		return -1;
+	if ((type != SDB_HOST) && (type != SDB_SERVICE) && (type != SDB_METRIC))
+		return -1;
+
+	/* the indexes are consistent while excluding all writers */
+	sdb_memstore_lock_all(store);
+	c.attrs = store->attr_index;
+	c.trigrams = store->trigram_index;
+	c.type = type;
+	if (plan_estimate(&c, plan) == SIZE_MAX) {
+		sdb_memstore_unlock_all(store);
+		return 1;
+	}
+
+	if (plan_collect(&c, plan))
+		status = -1;
+	if ((! status) && c.result.size) {
+		objs = calloc(c.result.size, sizeof(*objs));
+		if (! objs)
+			status = -1;
+	}
+	if ((! status) && objs) {
+		for (i = 0; i < c.result.slots_num; ++i)
+			if (c.result.slots[i])
+				objs[objs_num++] = c.result.slots[i];
+		assert(objs_num == c.result.size);
+		qsort(objs, objs_num, sizeof(*objs), cmp_objs);
+	}
+
+	/* keep the candidates alive and unchanged while evaluating them */
+	if ((! status) && objs_num && (! (view = sdb_memstore_view_pin(store,
+						/* hosts = */ 0))))
+		status = -1;
+	sdb_memstore_unlock_all(store);
+
+	for (i = 0; (! status) && (i < objs_num); ++i) {
+		sdb_memstore_obj_t *host = objs[i];
+
+		if (host->type != SDB_HOST)
+			host = host->parent;
+		if (! sdb_memstore_matcher_matches(filter, host, NULL))
+			continue;
+		/* the index only preselects candidates */
+		if (! sdb_memstore_matcher_matches(m, objs[i], filter))
+			continue;
+
+		if (cb(objs[i], filter, user_data)) {
+			sdb_log(SDB_LOG_ERR, "memstore: Callback returned "
+					"an error while scanning");
+			status = -1;
+		}
+	}
+
+	sdb_memstore_view_release(store, view);
+	if (objs)
+		free(objs);
+	objset_destroy(&c.result);
+	return status;
+} /* sdb_memstore_scan_indexed */
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
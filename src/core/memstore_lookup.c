@@ -41,48 +41,86 @@
 #include "utils/error.h"
 
 #include <assert.h>
+#include <ctype.h>
 
 #include <sys/types.h>
 #include <regex.h>
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <pthread.h>
 
 #include <limits.h>
 
+/* Evaluate two expressions, borrowing their values if possible. */
 static int
-expr_eval2(sdb_memstore_expr_t *e1, sdb_data_t *v1,
-		sdb_memstore_expr_t *e2, sdb_data_t *v2,
+expr_eval2(sdb_memstore_expr_t *e1, sdb_data_t *v1, bool *owned1,
+		sdb_memstore_expr_t *e2, sdb_data_t *v2, bool *owned2,
 		sdb_memstore_obj_t *obj, sdb_memstore_matcher_t *filter)
 {
-	if (e1->type) {
-		if (sdb_memstore_expr_eval(e1, obj, v1, filter))
-			return -1;
-	}
-	else
-		*v1 = e1->data;
-	if (e2->type) {
-		if (sdb_memstore_expr_eval(e2, obj, v2, filter)) {
-			if (e1->type)
-				sdb_data_free_datum(v1);
-			return -1;
-		}
+	if (sdb_memstore_expr_eval_borrowed(e1, obj, v1, owned1, filter))
+		return -1;
+	if (sdb_memstore_expr_eval_borrowed(e2, obj, v2, owned2, filter)) {
+		if (*owned1)
+			sdb_data_free_datum(v1);
+		return -1;
 	}
-	else
-		*v2 = e2->data;
 	return 0;
 } /* expr_eval2 */
 
 static void
-expr_free_datum2(sdb_memstore_expr_t *e1, sdb_data_t *v1,
-		sdb_memstore_expr_t *e2, sdb_data_t *v2)
+expr_free_datum2(sdb_data_t *v1, bool owned1, sdb_data_t *v2, bool owned2)
 {
-	if (e1->type)
+	if (owned1)
 		sdb_data_free_datum(v1);
-	if (e2->type)
+	if (owned2)
 		sdb_data_free_datum(v2);
 } /* expr_free_datum2 */
 
+static bool
+is_backend_field(const sdb_memstore_expr_t *e)
+{
+	return (e->type == FIELD_VALUE)
+		&& (e->data.data.integer == SDB_FIELD_BACKEND);
+} /* is_backend_field */
+
+static bool
+is_const_string(const sdb_memstore_expr_t *e)
+{
+	return (! e->type) && ((e->data.type & 0xff) == SDB_TYPE_STRING);
+} /* is_const_string */
+
+/* Check whether all backends named by a string or string array are recorded
+ * for the object. Objects store the IDs of their backends, so this is a bit
+ * test for each name. */
+static int
+match_backends(const sdb_data_t *value, sdb_memstore_obj_t *obj)
+{
+	char * const *names;
+	size_t len, i;
+
+	if (sdb_data_isnull(value))
+		return 0;
+
+	if (value->type & SDB_TYPE_ARRAY) {
+		names = value->data.array.values;
+		len = value->data.array.length;
+	}
+	else {
+		names = &value->data.string;
+		len = 1;
+	}
+
+	for (i = 0; i < len; ++i) {
+		int id = sdb_memstore_backend_id(names[i], /* create = */ 0);
+		if (! sdb_memstore_backends_has(&obj->backends, id))
+			return 0;
+	}
+	return 1;
+} /* match_backends */
+
 /*
  * matcher implementations
  */
@@ -119,36 +157,259 @@ match_cmp_value(int op, sdb_data_t *v1, sdb_data_t *v2, bool strcmp_fallback)
 	return 0;
 } /* match_cmp_value */
 
+/*
+ * regular expressions:
+ * Patterns which consist of a literal string, optionally anchored at the
+ * beginning or end, are matched using string comparison (ignoring case like
+ * all regexes do). Patterns which are not known in advance (e.g., attribute
+ * values) are compiled once and cached in the matcher. The cache is never
+ * purged; once it's full, further patterns are compiled for each use.
+ */
+
+enum {
+	LITERAL_NONE = 0,
+	LITERAL_SUBSTR, /* lit */
+	LITERAL_PREFIX, /* ^lit */
+	LITERAL_SUFFIX, /* lit$ */
+	LITERAL_EXACT,  /* ^lit$ */
+};
+
+typedef struct {
+	int type;
+	char *str;
+	size_t len;
+} regex_literal_t;
+
+typedef struct {
+	char *pattern;
+	regex_literal_t lit;
+	sdb_data_t re; /* unused for literals */
+} regex_entry_t;
+
+#define REGEX_CACHE_SIZE 16
+
+typedef struct {
+	cmp_matcher_t super;
+
+	/* literal constant pattern */
+	regex_literal_t lit;
+
+	pthread_rwlock_t lock;
+	regex_entry_t *cache;
+	size_t cache_num;
+} regex_matcher_t;
+#define REGEX_M(m) ((regex_matcher_t *)(m))
+
+/* Determine whether a pattern is a literal string, possibly anchored. */
 static int
-match_regex_value(int op, sdb_data_t *v, sdb_data_t *re)
+regex_literal(const char *pattern, regex_literal_t *lit)
+{
+	const char *str = pattern;
+	bool prefix = 0, suffix = 0;
+	size_t len = 0;
+
+	memset(lit, 0, sizeof(*lit));
+	if (! (lit->str = malloc(strlen(pattern) + 1)))
+		return -1;
+
+	if (*str == '^') {
+		prefix = 1;
+		++str;
+	}
+	while (*str) {
+		unsigned char c = (unsigned char)*str;
+
+		if (c == '\\') {
+			/* see regex_branch_to_plan in memstore_query.c */
+			c = (unsigned char)str[1];
+			if ((c >= 0x80) || (! ispunct(c)) || strchr("`'<>", c))
+				break;
+			str += 2;
+		}
+		else if ((c == '$') && (! str[1])) {
+			suffix = 1;
+			++str;
+			continue;
+		}
+		else if ((c >= 0x80) || strchr(".[]()*+?{}|^$", c))
+			break;
+		else
+			++str;
+		lit->str[len++] = (char)tolower(c);
+	}
+	lit->str[len] = '\0';
+
+	if (*str || (! len)) {
+		free(lit->str);
+		memset(lit, 0, sizeof(*lit));
+		return 0;
+	}
+
+	lit->len = len;
+	if (prefix && suffix)
+		lit->type = LITERAL_EXACT;
+	else if (prefix)
+		lit->type = LITERAL_PREFIX;
+	else if (suffix)
+		lit->type = LITERAL_SUFFIX;
+	else
+		lit->type = LITERAL_SUBSTR;
+	return 0;
+} /* regex_literal */
+
+static bool
+literal_matches(const regex_literal_t *lit, const char *str)
+{
+	size_t len = strlen(str), i;
+
+	switch (lit->type) {
+	case LITERAL_EXACT:
+		return (len == lit->len) && (! strcasecmp(str, lit->str));
+	case LITERAL_PREFIX:
+		return ! strncasecmp(str, lit->str, lit->len);
+	case LITERAL_SUFFIX:
+		return (len >= lit->len)
+			&& (! strcasecmp(str + len - lit->len, lit->str));
+	case LITERAL_SUBSTR:
+		for (i = 0; i + lit->len <= len; ++i)
+			if (! strncasecmp(str + i, lit->str, lit->len))
+				return 1;
+		return 0;
+	}
+	return 0;
+} /* literal_matches */
+
+static int
+regex_entry_init(regex_entry_t *e, const char *pattern)
+{
+	memset(e, 0, sizeof(*e));
+	if (regex_literal(pattern, &e->lit))
+		return -1;
+	if ((! e->lit.type)
+			&& sdb_data_parse(pattern, SDB_TYPE_REGEX, &e->re)) {
+		return -1;
+	}
+	if (! (e->pattern = strdup(pattern))) {
+		free(e->lit.str);
+		sdb_data_free_datum(&e->re);
+		return -1;
+	}
+	return 0;
+} /* regex_entry_init */
+
+static void
+regex_entry_destroy(regex_entry_t *e)
+{
+	free(e->pattern);
+	free(e->lit.str);
+	sdb_data_free_datum(&e->re);
+} /* regex_entry_destroy */
+
+/* Look up a pattern in the matcher's cache, compiling and adding it if
+ * necessary. If the cache is full, the pattern is compiled into 'tmp' which
+ * has to be destroyed by the caller. */
+static const regex_entry_t *
+regex_cache_get(regex_matcher_t *m, const char *pattern, regex_entry_t *tmp)
+{
+	const regex_entry_t *e = NULL;
+	size_t i;
+
+	pthread_rwlock_rdlock(&m->lock);
+	for (i = 0; i < m->cache_num; ++i) {
+		if (! strcmp(m->cache[i].pattern, pattern)) {
+			e = m->cache + i;
+			break;
+		}
+	}
+	pthread_rwlock_unlock(&m->lock);
+	if (e)
+		return e;
+
+	pthread_rwlock_wrlock(&m->lock);
+	for (i = 0; i < m->cache_num; ++i) {
+		if (! strcmp(m->cache[i].pattern, pattern)) {
+			pthread_rwlock_unlock(&m->lock);
+			return m->cache + i;
+		}
+	}
+
+	if ((! m->cache) && (m->cache = calloc(REGEX_CACHE_SIZE,
+					sizeof(*m->cache)))) {
+		m->cache_num = 0;
+	}
+	if (m->cache && (m->cache_num < REGEX_CACHE_SIZE)) {
+		if (! regex_entry_init(m->cache + m->cache_num, pattern))
+			e = m->cache + m->cache_num++;
+		pthread_rwlock_unlock(&m->lock);
+		return e;
+	}
+	pthread_rwlock_unlock(&m->lock);
+
+	if (regex_entry_init(tmp, pattern))
+		return NULL;
+	return tmp;
+} /* regex_cache_get */
+
+static int
+match_string(const regex_literal_t *lit, const regex_t *regex,
+		const char *str)
+{
+	if (lit && lit->type)
+		return literal_matches(lit, str);
+	return ! regexec(regex, str, 0, NULL, 0);
+} /* match_string */
+
+static int
+match_formatted(const regex_literal_t *lit, const regex_t *regex,
+		const sdb_data_t *v)
 {
 	char value[sdb_data_strlen(v) + 1];
+
+	if (! sdb_data_format(v, value, sizeof(value), SDB_UNQUOTED))
+		return 0;
+	return match_string(lit, regex, value);
+} /* match_formatted */
+
+static int
+match_regex_value(sdb_memstore_matcher_t *m, sdb_data_t *v, sdb_data_t *re)
+{
+	regex_entry_t tmp = { NULL, { 0, NULL, 0 }, SDB_DATA_INIT };
+	const regex_literal_t *lit = NULL;
+	const regex_t *regex = NULL;
 	int status = 0;
 
-	assert((op == MATCHER_REGEX)
-			|| (op == MATCHER_NREGEX));
+	assert((m->type == MATCHER_REGEX)
+			|| (m->type == MATCHER_NREGEX));
 
 	if (sdb_data_isnull(v) || sdb_data_isnull(re))
 		return 0;
 
 	if (re->type == SDB_TYPE_STRING) {
-		sdb_data_t tmp = SDB_DATA_INIT;
+		const regex_entry_t *e;
 
-		if (sdb_data_parse(re->data.string, SDB_TYPE_REGEX, &tmp))
+		e = regex_cache_get(REGEX_M(m), re->data.string, &tmp);
+		if (! e)
 			return 0;
-
-		sdb_data_free_datum(re);
-		*re = tmp;
+		lit = &e->lit;
+		regex = &e->re.data.re.regex;
+	}
+	else if (re->type == SDB_TYPE_REGEX) {
+		/* constant patterns have been analyzed when creating the matcher */
+		if (! CMP_M(m)->right->type)
+			lit = &REGEX_M(m)->lit;
+		regex = &re->data.re.regex;
 	}
-	else if (re->type != SDB_TYPE_REGEX)
+	else
 		return 0;
 
-	if (! sdb_data_format(v, value, sizeof(value), SDB_UNQUOTED))
-		status = 0;
-	else if (! regexec(&re->data.re.regex, value, 0, NULL, 0))
-		status = 1;
+	/* strings are formatted as-is unless they need escaping */
+	if ((v->type == SDB_TYPE_STRING) && (! strpbrk(v->data.string, "\\\"")))
+		status = match_string(lit, regex, v->data.string);
+	else
+		status = match_formatted(lit, regex, v);
 
-	if (op == MATCHER_NREGEX)
+	regex_entry_destroy(&tmp);
+	if (m->type == MATCHER_NREGEX)
 		return !status;
 	return status;
 } /* match_regex_value */
@@ -183,6 +444,30 @@ match_uop(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
 	return !sdb_memstore_matcher_matches(UOP_M(m)->op, obj, filter);
 } /* match_uop */
 
+/* Compare a value against the right hand side of a comparison matcher. */
+static int
+match_value(sdb_memstore_matcher_t *m, sdb_data_t *v,
+		sdb_memstore_obj_t *obj, sdb_memstore_matcher_t *filter)
+{
+	sdb_data_t right = SDB_DATA_INIT;
+	bool owned = 0;
+	int status;
+
+	if (sdb_memstore_expr_eval_borrowed(CMP_M(m)->right, obj, &right, &owned,
+				filter))
+		return 0;
+
+	if ((m->type == MATCHER_REGEX) || (m->type == MATCHER_NREGEX))
+		status = match_regex_value(m, v, &right);
+	else
+		status = match_cmp_value(m->type, v, &right,
+				CMP_M(m)->right->data_type < 0);
+
+	if (owned)
+		sdb_data_free_datum(&right);
+	return status;
+} /* match_value */
+
 /* iterate: ANY/ALL <iter> <cmp> <value> */
 static int
 match_iter(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
@@ -195,6 +480,13 @@ match_iter(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
 	assert((m->type == MATCHER_ANY) || (m->type == MATCHER_ALL));
 	assert((! CMP_M(ITER_M(m)->m)->left) && CMP_M(ITER_M(m)->m)->right);
 
+	/* ANY backend = <string> */
+	if (obj && (! all) && (ITER_M(m)->m->type == MATCHER_EQ)
+			&& is_backend_field(ITER_M(m)->iter)
+			&& is_const_string(CMP_M(ITER_M(m)->m)->right)
+			&& (! (CMP_M(ITER_M(m)->m)->right->data.type & SDB_TYPE_ARRAY)))
+		return match_backends(&CMP_M(ITER_M(m)->m)->right->data, obj);
+
 	iter = sdb_memstore_expr_iter(ITER_M(m)->iter, obj, filter);
 	if (! iter) {
 		sdb_log(SDB_LOG_WARNING, "memstore: Invalid iterator");
@@ -204,12 +496,9 @@ match_iter(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
 	status = all;
 	while (sdb_memstore_expr_iter_has_next(iter)) {
 		sdb_data_t v = sdb_memstore_expr_iter_get_next(iter);
-		sdb_memstore_expr_t expr = CONST_EXPR(v);
 		bool matches;
 
-		CMP_M(ITER_M(m)->m)->left = &expr;
-		matches = sdb_memstore_matcher_matches(ITER_M(m)->m, obj, filter);
-		CMP_M(ITER_M(m)->m)->left = NULL;
+		matches = match_value(ITER_M(m)->m, &v, obj, filter);
 		sdb_data_free_datum(&v);
 
 		if (matches) {
@@ -233,6 +522,7 @@ match_cmp(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
 	sdb_memstore_expr_t *e1 = CMP_M(m)->left;
 	sdb_memstore_expr_t *e2 = CMP_M(m)->right;
 	sdb_data_t v1 = SDB_DATA_INIT, v2 = SDB_DATA_INIT;
+	bool owned1 = 0, owned2 = 0;
 	int status;
 
 	assert((m->type == MATCHER_LT)
@@ -243,13 +533,13 @@ match_cmp(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
 			|| (m->type == MATCHER_GT));
 	assert(e1 && e2);
 
-	if (expr_eval2(e1, &v1, e2, &v2, obj, filter))
+	if (expr_eval2(e1, &v1, &owned1, e2, &v2, &owned2, obj, filter))
 		return 0;
 
 	status = match_cmp_value(m->type, &v1, &v2,
 			(e1->data_type) < 0 || (e2->data_type < 0));
 
-	expr_free_datum2(e1, &v1, e2, &v2);
+	expr_free_datum2(&v1, owned1, &v2, owned2);
 	return status;
 } /* match_cmp */
 
@@ -258,19 +548,23 @@ match_in(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
 		sdb_memstore_matcher_t *filter)
 {
 	sdb_data_t value = SDB_DATA_INIT, array = SDB_DATA_INIT;
+	bool owned1 = 0, owned2 = 0;
 	int status = 1;
 
 	assert(m->type == MATCHER_IN);
 	assert(CMP_M(m)->left && CMP_M(m)->right);
 
-	if (expr_eval2(CMP_M(m)->left, &value,
-				CMP_M(m)->right, &array, obj, filter))
-		status = 0;
+	if (obj && is_const_string(CMP_M(m)->left)
+			&& is_backend_field(CMP_M(m)->right))
+		return match_backends(&CMP_M(m)->left->data, obj);
+
+	if (expr_eval2(CMP_M(m)->left, &value, &owned1,
+				CMP_M(m)->right, &array, &owned2, obj, filter))
+		return 0;
 
-	if (status)
-		status = sdb_data_inarray(&value, &array);
+	status = sdb_data_inarray(&value, &array);
 
-	expr_free_datum2(CMP_M(m)->left, &value, CMP_M(m)->right, &array);
+	expr_free_datum2(&value, owned1, &array, owned2);
 	return status;
 } /* match_in */
 
@@ -279,18 +573,20 @@ match_regex(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
 		sdb_memstore_matcher_t *filter)
 {
 	sdb_data_t regex = SDB_DATA_INIT, v = SDB_DATA_INIT;
+	bool owned1 = 0, owned2 = 0;
 	int status = 0;
 
 	assert((m->type == MATCHER_REGEX)
 			|| (m->type == MATCHER_NREGEX));
 	assert(CMP_M(m)->left && CMP_M(m)->right);
 
-	if (expr_eval2(CMP_M(m)->left, &v, CMP_M(m)->right, &regex, obj, filter))
+	if (expr_eval2(CMP_M(m)->left, &v, &owned1,
+				CMP_M(m)->right, &regex, &owned2, obj, filter))
 		return 0;
 
-	status = match_regex_value(m->type, &v, &regex);
+	status = match_regex_value(m, &v, &regex);
 
-	expr_free_datum2(CMP_M(m)->left, &v, CMP_M(m)->right, &regex);
+	expr_free_datum2(&v, owned1, &regex, owned2);
 	return status;
 } /* match_regex */
 
@@ -299,20 +595,18 @@ match_unary(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
 		sdb_memstore_matcher_t *filter)
 {
 	sdb_data_t v = SDB_DATA_INIT;
+	bool owned = 0;
 	int status;
 
 	assert((m->type == MATCHER_ISNULL)
 			|| (m->type == MATCHER_ISTRUE)
 			|| (m->type == MATCHER_ISFALSE));
 
-	if (UNARY_M(m)->expr->type) {
-		/* TODO: this might hide real errors;
-		 * improve error reporting and propagation */
-		if (sdb_memstore_expr_eval(UNARY_M(m)->expr, obj, &v, filter))
-			return 1;
-	}
-	else
-		v = UNARY_M(m)->expr->data;
+	/* TODO: this might hide real errors;
+	 * improve error reporting and propagation */
+	if (sdb_memstore_expr_eval_borrowed(UNARY_M(m)->expr, obj, &v, &owned,
+				filter))
+		return 1;
 
 	if (m->type == MATCHER_ISNULL)
 		status = sdb_data_isnull(&v) ? 1 : 0;
@@ -324,11 +618,319 @@ match_unary(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
 			status = 0;
 	}
 
-	if (UNARY_M(m)->expr->type)
+	if (owned)
 		sdb_data_free_datum(&v);
 	return status;
 } /* match_unary */
 
+/*
+ * compiled matchers:
+ * A program is a flat array of instructions. Load instructions store a
+ * (borrowed, if possible) value in a register; comparisons consume their
+ * operand registers and set the result flag which is inspected by
+ * conditional jumps implementing lazy evaluation of AND and OR. The program
+ * ends with the final result in the flag. Operands (constants, expressions,
+ * matchers) are owned by the source matcher.
+ */
+
+enum {
+	PROG_END,
+	PROG_CONST,     /* r1 = constant 'arg' */
+	PROG_FIELD,     /* r1 = field 'type' */
+	PROG_ATTR,      /* r1 = value of attribute 'arg' */
+	PROG_EVAL,      /* r1 = value of expression 'arg' */
+	PROG_ARITH,     /* r1 = r1 <type> r2 */
+	PROG_CMP,       /* flag = r1 <type> r2 */
+	PROG_IN,        /* flag = r1 IN r2 */
+	PROG_REGEX,     /* flag = r1 <type> r2 using regex matcher 'arg' */
+	PROG_UNARY,     /* flag = r1 <type> */
+	PROG_BACKEND,   /* flag = object has all backends named by 'arg' */
+	PROG_MATCH,     /* flag = iterator matcher 'arg' matches */
+	PROG_NOT,       /* flag = ! flag */
+	PROG_JMP_FALSE, /* if (! flag) goto 'jump' */
+	PROG_JMP_TRUE,  /* if (flag) goto 'jump' */
+};
+
+/* the number of registers available to a program */
+#define PROG_REGS_NUM 16
+/* the maximum number of instructions of a program */
+#define PROG_LEN_MAX UINT16_MAX
+
+typedef struct {
+	uint8_t code;
+	uint8_t r1, r2;
+	bool fallback; /* compare string values on type mismatch */
+	uint16_t type; /* matcher, operator, or field type */
+	uint16_t jump;
+	void *arg;
+} prog_insn_t;
+
+typedef struct {
+	sdb_memstore_matcher_t super;
+
+	/* the source matcher owning all operands */
+	sdb_memstore_matcher_t *m;
+
+	prog_insn_t *code;
+	size_t code_len;
+} prog_matcher_t;
+#define PROG_M(m) ((prog_matcher_t *)(m))
+
+typedef struct {
+	sdb_data_t v;
+	bool owned;  /* the value has to be freed */
+	bool failed; /* the value could not be determined */
+} prog_reg_t;
+
+typedef struct {
+	prog_insn_t *code;
+	size_t len;
+	size_t size;
+} prog_compiler_t;
+
+static int
+emit(prog_compiler_t *c, int code, int type, int r1, int r2, void *arg)
+{
+	prog_insn_t *insn;
+
+	if (c->len >= PROG_LEN_MAX)
+		return -1;
+	if (c->len >= c->size) {
+		size_t size = c->size ? 2 * c->size : 16;
+		prog_insn_t *tmp = realloc(c->code, size * sizeof(*tmp));
+		if (! tmp)
+			return -1;
+		c->code = tmp;
+		c->size = size;
+	}
+
+	insn = c->code + c->len;
+	memset(insn, 0, sizeof(*insn));
+	insn->code = (uint8_t)code;
+	insn->type = (uint16_t)type;
+	insn->r1 = (uint8_t)r1;
+	insn->r2 = (uint8_t)r2;
+	insn->arg = arg;
+	return (int)c->len++;
+} /* emit */
+
+/* Compile an expression storing its value in register 'r'. */
+static int
+compile_expr(prog_compiler_t *c, sdb_memstore_expr_t *e, int r)
+{
+	if (r >= PROG_REGS_NUM)
+		return -1;
+
+	if (! e->type)
+		return emit(c, PROG_CONST, 0, r, 0, &e->data);
+	if (e->type == FIELD_VALUE)
+		return emit(c, PROG_FIELD, (int)e->data.data.integer, r, 0, NULL);
+	if (e->type == ATTR_VALUE)
+		return emit(c, PROG_ATTR, 0, r, 0, e->data.data.string);
+	if ((e->type > 0) && (r + 1 < PROG_REGS_NUM)) {
+		if ((compile_expr(c, e->left, r) < 0)
+				|| (compile_expr(c, e->right, r + 1) < 0))
+			return -1;
+		return emit(c, PROG_ARITH, e->type, r, r + 1, NULL);
+	}
+	/* typed expressions and anything nested too deeply */
+	return emit(c, PROG_EVAL, 0, r, 0, e);
+} /* compile_expr */
+
+static int
+compile_matcher(prog_compiler_t *c, sdb_memstore_matcher_t *m)
+{
+	int jump, status;
+
+	switch (m->type) {
+	case MATCHER_OR:
+	case MATCHER_AND:
+		if (compile_matcher(c, OP_M(m)->left) < 0)
+			return -1;
+		jump = emit(c, m->type == MATCHER_AND ? PROG_JMP_FALSE : PROG_JMP_TRUE,
+				0, 0, 0, NULL);
+		if ((jump < 0) || (compile_matcher(c, OP_M(m)->right) < 0))
+			return -1;
+		c->code[jump].jump = (uint16_t)c->len;
+		return 0;
+
+	case MATCHER_NOT:
+		if (compile_matcher(c, UOP_M(m)->op) < 0)
+			return -1;
+		return emit(c, PROG_NOT, 0, 0, 0, NULL);
+
+	case MATCHER_ANY:
+		if ((ITER_M(m)->m->type == MATCHER_EQ)
+				&& is_backend_field(ITER_M(m)->iter)
+				&& is_const_string(CMP_M(ITER_M(m)->m)->right)
+				&& (! (CMP_M(ITER_M(m)->m)->right->data.type & SDB_TYPE_ARRAY)))
+			return emit(c, PROG_BACKEND, 0, 0, 0,
+					&CMP_M(ITER_M(m)->m)->right->data);
+		return emit(c, PROG_MATCH, 0, 0, 0, m);
+	case MATCHER_ALL:
+		return emit(c, PROG_MATCH, 0, 0, 0, m);
+
+	case MATCHER_ISNULL:
+	case MATCHER_ISTRUE:
+	case MATCHER_ISFALSE:
+		if (compile_expr(c, UNARY_M(m)->expr, 0) < 0)
+			return -1;
+		return emit(c, PROG_UNARY, m->type, 0, 0, NULL);
+
+	case MATCHER_IN:
+		if (is_const_string(CMP_M(m)->left)
+				&& is_backend_field(CMP_M(m)->right))
+			return emit(c, PROG_BACKEND, 0, 0, 0, &CMP_M(m)->left->data);
+		/* fall through */
+	case MATCHER_LT:
+	case MATCHER_LE:
+	case MATCHER_EQ:
+	case MATCHER_NE:
+	case MATCHER_GE:
+	case MATCHER_GT:
+	case MATCHER_REGEX:
+	case MATCHER_NREGEX:
+		if ((compile_expr(c, CMP_M(m)->left, 0) < 0)
+				|| (compile_expr(c, CMP_M(m)->right, 1) < 0))
+			return -1;
+		if (m->type == MATCHER_IN)
+			status = emit(c, PROG_IN, m->type, 0, 1, NULL);
+		else if ((m->type == MATCHER_REGEX) || (m->type == MATCHER_NREGEX))
+			status = emit(c, PROG_REGEX, m->type, 0, 1, m);
+		else
+			status = emit(c, PROG_CMP, m->type, 0, 1, NULL);
+		if (status >= 0)
+			c->code[status].fallback = (CMP_M(m)->left->data_type < 0)
+				|| (CMP_M(m)->right->data_type < 0);
+		return status;
+	}
+	return -1;
+} /* compile_matcher */
+
+static void
+reg_release(prog_reg_t *reg)
+{
+	if (reg->owned)
+		sdb_data_free_datum(&reg->v);
+	reg->owned = 0;
+} /* reg_release */
+
+static int
+match_iter(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
+		sdb_memstore_matcher_t *filter);
+
+/* The filter has been applied to the object by the caller already. */
+static int
+match_prog(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
+		sdb_memstore_matcher_t *filter)
+{
+	const prog_insn_t *code = PROG_M(m)->code;
+	prog_reg_t regs[PROG_REGS_NUM];
+	size_t pc = 0;
+	bool flag = 0;
+
+	assert(m->type == MATCHER_PROGRAM);
+
+	while (42) {
+		const prog_insn_t *insn = code + pc++;
+		prog_reg_t *r1 = regs + insn->r1;
+		prog_reg_t *r2 = regs + insn->r2;
+		sdb_data_t tmp = SDB_DATA_INIT;
+
+		switch (insn->code) {
+		case PROG_END:
+			return flag;
+
+		case PROG_CONST:
+			r1->v = *(const sdb_data_t *)insn->arg;
+			r1->owned = r1->failed = 0;
+			break;
+		case PROG_FIELD:
+			r1->failed = sdb_memstore_get_field_borrowed(obj, insn->type,
+					&r1->v, &r1->owned) != 0;
+			break;
+		case PROG_ATTR:
+			if (sdb_memstore_get_attr_borrowed(obj, insn->arg,
+						&r1->v, filter) < 0) {
+				/* attribute does not exist => NULL */
+				r1->v.type = SDB_TYPE_STRING;
+				r1->v.data.string = NULL;
+			}
+			r1->owned = r1->failed = 0;
+			break;
+		case PROG_EVAL:
+			r1->failed = sdb_memstore_expr_eval_borrowed(insn->arg, obj,
+					&r1->v, &r1->owned, filter) != 0;
+			break;
+		case PROG_ARITH:
+			if ((! r1->failed) && (! r2->failed)
+					&& (! sdb_data_expr_eval(insn->type,
+							&r1->v, &r2->v, &tmp))) {
+				reg_release(r1);
+				r1->v = tmp;
+				r1->owned = 1;
+			}
+			else {
+				reg_release(r1);
+				r1->failed = 1;
+			}
+			reg_release(r2);
+			break;
+
+		case PROG_CMP:
+			flag = (! r1->failed) && (! r2->failed)
+				&& match_cmp_value(insn->type, &r1->v, &r2->v, insn->fallback);
+			reg_release(r1);
+			reg_release(r2);
+			break;
+		case PROG_IN:
+			flag = (! r1->failed) && (! r2->failed)
+				&& sdb_data_inarray(&r1->v, &r2->v);
+			reg_release(r1);
+			reg_release(r2);
+			break;
+		case PROG_REGEX:
+			flag = (! r1->failed) && (! r2->failed)
+				&& match_regex_value(insn->arg, &r1->v, &r2->v);
+			reg_release(r1);
+			reg_release(r2);
+			break;
+		case PROG_UNARY:
+			if (r1->failed)
+				flag = 1;
+			else if (insn->type == MATCHER_ISNULL)
+				flag = sdb_data_isnull(&r1->v);
+			else /* ISTRUE or ISFALSE */
+				flag = (r1->v.type == SDB_TYPE_BOOLEAN)
+					&& (r1->v.data.boolean == (insn->type == MATCHER_ISTRUE));
+			reg_release(r1);
+			break;
+
+		case PROG_BACKEND:
+			flag = match_backends(insn->arg, obj);
+			break;
+		case PROG_MATCH:
+			flag = match_iter(insn->arg, obj, filter);
+			break;
+
+		case PROG_NOT:
+			flag = ! flag;
+			break;
+		case PROG_JMP_FALSE:
+			if (! flag)
+				pc = insn->jump;
+			break;
+		case PROG_JMP_TRUE:
+			if (flag)
+				pc = insn->jump;
+			break;
+
+		default:
+			return 0;
+		}
+	}
+} /* match_prog */
+
 typedef int (*matcher_cb)(sdb_memstore_matcher_t *, sdb_memstore_obj_t *,
 		sdb_memstore_matcher_t *);
 
@@ -359,6 +961,7 @@ matchers[] = {
 	match_regex,
 
 	NULL, /* QUERY */
+	match_prog,
 };
 
 /*
@@ -435,6 +1038,35 @@ cmp_matcher_destroy(sdb_object_t *obj)
 	sdb_object_deref(SDB_OBJ(CMP_M(obj)->right));
 } /* cmp_matcher_destroy */
 
+static int
+regex_matcher_init(sdb_object_t *obj, va_list ap)
+{
+	sdb_memstore_expr_t *right;
+
+	/* the destructor expects the lock to be initialized */
+	pthread_rwlock_init(&REGEX_M(obj)->lock, /* attr = */ NULL);
+	if (cmp_matcher_init(obj, ap))
+		return -1;
+
+	right = CMP_M(obj)->right;
+	if ((! right->type) && (right->data.type == SDB_TYPE_REGEX))
+		return regex_literal(right->data.data.re.raw, &REGEX_M(obj)->lit);
+	return 0;
+} /* regex_matcher_init */
+
+static void
+regex_matcher_destroy(sdb_object_t *obj)
+{
+	size_t i;
+
+	for (i = 0; i < REGEX_M(obj)->cache_num; ++i)
+		regex_entry_destroy(REGEX_M(obj)->cache + i);
+	free(REGEX_M(obj)->cache);
+	free(REGEX_M(obj)->lit.str);
+	pthread_rwlock_destroy(&REGEX_M(obj)->lock);
+	cmp_matcher_destroy(obj);
+} /* regex_matcher_destroy */
+
 static int
 uop_matcher_init(sdb_object_t *obj, va_list ap)
 {
@@ -478,6 +1110,32 @@ unary_matcher_destroy(sdb_object_t *obj)
 	UNARY_M(obj)->expr = NULL;
 } /* unary_matcher_destroy */
 
+static int
+prog_matcher_init(sdb_object_t *obj, va_list ap)
+{
+	prog_compiler_t c = { NULL, 0, 0 };
+
+	M(obj)->type = MATCHER_PROGRAM;
+	PROG_M(obj)->m = va_arg(ap, sdb_memstore_matcher_t *);
+	sdb_object_ref(SDB_OBJ(PROG_M(obj)->m));
+
+	if ((compile_matcher(&c, PROG_M(obj)->m) < 0)
+			|| (emit(&c, PROG_END, 0, 0, 0, NULL) < 0)) {
+		free(c.code);
+		return -1;
+	}
+	PROG_M(obj)->code = c.code;
+	PROG_M(obj)->code_len = c.len;
+	return 0;
+} /* prog_matcher_init */
+
+static void
+prog_matcher_destroy(sdb_object_t *obj)
+{
+	sdb_object_deref(SDB_OBJ(PROG_M(obj)->m));
+	free(PROG_M(obj)->code);
+} /* prog_matcher_destroy */
+
 static sdb_type_t op_type = {
 	/* size = */ sizeof(op_matcher_t),
 	/* init = */ op_matcher_init,
@@ -502,12 +1160,24 @@ static sdb_type_t cmp_type = {
 	/* destroy = */ cmp_matcher_destroy,
 };
 
+static sdb_type_t regex_type = {
+	/* size = */ sizeof(regex_matcher_t),
+	/* init = */ regex_matcher_init,
+	/* destroy = */ regex_matcher_destroy,
+};
+
 static sdb_type_t unary_type = {
 	/* size = */ sizeof(unary_matcher_t),
 	/* init = */ unary_matcher_init,
 	/* destroy = */ unary_matcher_destroy,
 };
 
+static sdb_type_t prog_type = {
+	/* size = */ sizeof(prog_matcher_t),
+	/* init = */ prog_matcher_init,
+	/* destroy = */ prog_matcher_destroy,
+};
+
 /*
  * public API
  */
@@ -616,7 +1286,7 @@ sdb_memstore_regex_matcher(sdb_memstore_expr_t *left, sdb_memstore_expr_t *right
 			free(raw);
 		}
 	}
-	return M(sdb_object_create("regex-matcher", cmp_type,
+	return M(sdb_object_create("regex-matcher", regex_type,
 				MATCHER_REGEX, left, right));
 } /* sdb_memstore_regex_matcher */
 
@@ -671,6 +1341,18 @@ sdb_memstore_inv_matcher(sdb_memstore_matcher_t *m)
 	return M(sdb_object_create("inv-matcher", uop_type, MATCHER_NOT, m));
 } /* sdb_memstore_inv_matcher */
 
+sdb_memstore_matcher_t *
+sdb_memstore_matcher_compile(sdb_memstore_matcher_t *m)
+{
+	if (! m)
+		return NULL;
+	if (m->type == MATCHER_PROGRAM) {
+		sdb_object_ref(SDB_OBJ(m));
+		return m;
+	}
+	return M(sdb_object_create("program-matcher", prog_type, m));
+} /* sdb_memstore_matcher_compile */
+
 int
 sdb_memstore_matcher_matches(sdb_memstore_matcher_t *m, sdb_memstore_obj_t *obj,
 		sdb_memstore_matcher_t *filter)
@@ -32,6 +32,11 @@
 
 #include <assert.h>
 
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
 static sdb_memstore_matcher_t *
 node_to_matcher(sdb_ast_node_t *n);
 
@@ -270,6 +275,700 @@ node_to_matcher(sdb_ast_node_t *n)
 	return NULL;
 } /* node_to_matcher */
 
+/*
+ * attribute index plans
+ */
+
+static void
+plan_destroy(index_plan_t *plan)
+{
+	size_t i;
+
+	if (! plan)
+		return;
+
+	plan_destroy(plan->left);
+	plan_destroy(plan->right);
+	if (plan->key)
+		free(plan->key);
+	for (i = 0; i < plan->values_num; ++i)
+		free(plan->values[i]);
+	if (plan->values)
+		free(plan->values);
+	free(plan);
+} /* plan_destroy */
+
+/* Build a plan for comparing an attribute with a constant value. */
+static index_plan_t *
+cmp_to_plan(int type, const char *key, const sdb_data_t *value)
+{
+	index_plan_t *plan;
+	size_t len = 0, i;
+
+	/* equal decimals are not necessarily formatted the same way */
+	if ((value->type & 0xff) == SDB_TYPE_DECIMAL)
+		return NULL;
+
+	/* NULL never matches and IN only matches arrays; all other values
+	 * result in exactly one index key per element */
+	if (sdb_data_isnull(value))
+		len = 0;
+	else if (type == MATCHER_EQ)
+		len = 1;
+	else if (value->type & SDB_TYPE_ARRAY)
+		len = value->data.array.length;
+
+	plan = calloc(1, sizeof(*plan));
+	if (! plan)
+		return NULL;
+	plan->type = type;
+	plan->key = strdup(key);
+	if (len)
+		plan->values = calloc(len, sizeof(*plan->values));
+	if ((! plan->key) || (len && (! plan->values))) {
+		plan_destroy(plan);
+		return NULL;
+	}
+
+	for (i = 0; i < len; ++i) {
+		sdb_data_t v = *value;
+
+		if ((type == MATCHER_IN) && sdb_data_array_get(value, i, &v))
+			break;
+		if (! (plan->values[i] = sdb_memstore_attr_index_value(&v)))
+			break;
+		++plan->values_num;
+	}
+	if (plan->values_num != len) {
+		plan_destroy(plan);
+		return NULL;
+	}
+
+	/* array values match IN if all of their elements do */
+	plan->arrays = (type == MATCHER_IN) && (! sdb_data_isnull(value))
+		&& (value->type & SDB_TYPE_ARRAY);
+	return plan;
+} /* cmp_to_plan */
+
+/* Append the distinct trigrams of a (lower-case) literal string. */
+static int
+plan_add_trigrams(index_plan_t *plan, const char *str, size_t len)
+{
+	size_t i, j;
+
+	for (i = 0; i + 3 <= len; ++i) {
+		char **tmp;
+
+		for (j = 0; j < plan->values_num; ++j)
+			if (! strncmp(plan->values[j], str + i, 3))
+				break;
+		if (j < plan->values_num)
+			continue;
+
+		tmp = realloc(plan->values,
+				(plan->values_num + 1) * sizeof(*plan->values));
+		if (! tmp)
+			return -1;
+		plan->values = tmp;
+		if (! (plan->values[plan->values_num] = strndup(str + i, 3)))
+			return -1;
+		++plan->values_num;
+	}
+	return 0;
+} /* plan_add_trigrams */
+
+/* Returns the end of the bracket expression starting at 'str'. */
+static const char *
+skip_bracket(const char *str)
+{
+	++str;
+	if (*str == '^')
+		++str;
+	if (*str == ']')
+		++str;
+
+	while (*str && (*str != ']')) {
+		/* character classes, collating symbols, and equivalence classes */
+		if ((*str == '[') && str[1] && strchr(":.=", str[1])) {
+			char delim = str[1];
+			str += 2;
+			while (*str && (! ((*str == delim) && (str[1] == ']'))))
+				++str;
+			if (! *str)
+				return NULL;
+			str += 2;
+			continue;
+		}
+		++str;
+	}
+	return *str ? str + 1 : NULL;
+} /* skip_bracket */
+
+/* Returns the end of the group or bracket expression starting at 'str' or
+ * the position after the escape sequence or character at 'str'. */
+static const char *
+skip_atom(const char *str)
+{
+	int depth = 0;
+
+	if (*str == '[')
+		return skip_bracket(str);
+	if (*str == '\\')
+		return str[1] ? str + 2 : NULL;
+	if (*str != '(')
+		return str + 1;
+
+	while (*str) {
+		if ((*str == '[') || (*str == '\\')) {
+			if (! (str = skip_atom(str)))
+				return NULL;
+			continue;
+		}
+		if (*str == '(')
+			++depth;
+		else if ((*str == ')') && (! --depth))
+			return str + 1;
+		++str;
+	}
+	return NULL;
+} /* skip_atom */
+
+/* Build a plan for a branch of a POSIX extended regular expression (without
+ * top-level alternations) based on all literal strings which are required to
+ * be included in any match. Groups, bracket expressions, and optional
+ * characters are skipped. */
+static index_plan_t *
+regex_branch_to_plan(const char *key, const char *re, size_t len)
+{
+	const char *str = re, *end = re + len;
+	index_plan_t *plan;
+	size_t run_len = 0;
+	char *run;
+	int status = 0;
+
+	plan = calloc(1, sizeof(*plan));
+	run = malloc(len + 1);
+	if ((! plan) || (! run) || (key && (! (plan->key = strdup(key))))) {
+		plan_destroy(plan);
+		if (run)
+			free(run);
+		return NULL;
+	}
+	plan->type = MATCHER_REGEX;
+
+	while ((! status) && (str < end)) {
+		const char *next = skip_atom(str);
+		unsigned char c = (unsigned char)*str;
+		bool literal = 0;
+
+		if ((! next) || (next > end)) {
+			status = -1;
+			break;
+		}
+
+		if (c == '\\') {
+			/* escaped special characters are literals; GNU extensions
+			 * like \w or \< denote character classes or anchors */
+			c = (unsigned char)str[1];
+			literal = (c < 0x80) && ispunct(c) && (! strchr("`'<>", c));
+		}
+		else if (next == str + 1)
+			literal = (c < 0x80) && (! strchr(".^$*+?{}|()", c));
+
+		if (literal && (next < end) && strchr("*?{", *next)) {
+			/* optional characters may not be included in a match */
+			literal = 0;
+		}
+
+		if (literal) {
+			run[run_len++] = (char)tolower(c);
+			/* repetitions end the literal string */
+			if ((next < end) && (*next == '+')) {
+				status = plan_add_trigrams(plan, run, run_len);
+				run_len = 0;
+			}
+		}
+		else {
+			status = plan_add_trigrams(plan, run, run_len);
+			run_len = 0;
+		}
+
+		/* skip intervals */
+		if (*str == '{') {
+			next = memchr(str, '}', (size_t)(end - str));
+			if (! next)
+				status = -1;
+			else
+				++next;
+		}
+		str = next;
+	}
+	if (! status)
+		status = plan_add_trigrams(plan, run, run_len);
+	free(run);
+
+	if (status || (! plan->values_num)) {
+		plan_destroy(plan);
+		return NULL;
+	}
+	return plan;
+} /* regex_branch_to_plan */
+
+/* Build a plan for matching a regular expression against an attribute value
+ * or (if 'key' is NULL) a name. Returns NULL if the expression does not
+ * require any literal strings of at least three characters. */
+static index_plan_t *
+regex_to_plan(const char *key, const char *re)
+{
+	index_plan_t *plan = NULL, *branch, *or;
+	const char *str = re, *start = re;
+
+	while (42) {
+		if (*str && (*str != '|')) {
+			if (! (str = skip_atom(str))) {
+				plan_destroy(plan);
+				return NULL;
+			}
+			continue;
+		}
+
+		/* all branches have to use the index */
+		branch = regex_branch_to_plan(key, start, (size_t)(str - start));
+		if (! branch) {
+			plan_destroy(plan);
+			return NULL;
+		}
+		if (! plan)
+			plan = branch;
+		else {
+			if (! (or = calloc(1, sizeof(*or)))) {
+				plan_destroy(plan);
+				plan_destroy(branch);
+				return NULL;
+			}
+			or->type = MATCHER_OR;
+			or->left = plan;
+			or->right = branch;
+			plan = or;
+		}
+
+		if (! *str)
+			break;
+		start = ++str;
+	}
+	return plan;
+} /* regex_to_plan */
+
+/* Determine the candidates for a matcher from the indexes. The plan
+ * may select more objects than the matcher; it never misses any. Returns
+ * NULL if the index cannot be used. */
+static index_plan_t *
+matcher_to_plan(sdb_memstore_matcher_t *m)
+{
+	sdb_memstore_expr_t *attr, *value;
+	index_plan_t *plan, *left, *right;
+
+	if (! m)
+		return NULL;
+
+	if ((m->type == MATCHER_AND) || (m->type == MATCHER_OR)) {
+		left = matcher_to_plan(OP_M(m)->left);
+		right = matcher_to_plan(OP_M(m)->right);
+
+		/* either operand of a conjunction selects all candidates */
+		if ((m->type == MATCHER_AND) && ((! left) || (! right)))
+			return left ? left : right;
+
+		plan = NULL;
+		if (left && right)
+			plan = calloc(1, sizeof(*plan));
+		if (! plan) {
+			plan_destroy(left);
+			plan_destroy(right);
+			return NULL;
+		}
+		plan->type = m->type;
+		plan->left = left;
+		plan->right = right;
+		return plan;
+	}
+
+	if (m->type == MATCHER_REGEX) {
+		const char *key = NULL;
+
+		attr = CMP_M(m)->left;
+		value = CMP_M(m)->right;
+		if (attr->type == ATTR_VALUE)
+			key = attr->data.data.string;
+		else if ((attr->type != FIELD_VALUE)
+				|| (attr->data.data.integer != SDB_FIELD_NAME))
+			return NULL;
+
+		if ((value->type != 0) || sdb_data_isnull(&value->data))
+			return NULL;
+		if (value->data.type == SDB_TYPE_REGEX)
+			return regex_to_plan(key, value->data.data.re.raw);
+		if (value->data.type == SDB_TYPE_STRING)
+			return regex_to_plan(key, value->data.data.string);
+		return NULL;
+	}
+
+	if ((m->type != MATCHER_EQ) && (m->type != MATCHER_IN))
+		return NULL;
+
+	attr = CMP_M(m)->left;
+	value = CMP_M(m)->right;
+	if ((m->type == MATCHER_EQ) && (value->type == ATTR_VALUE)) {
+		attr = CMP_M(m)->right;
+		value = CMP_M(m)->left;
+	}
+	if ((attr->type != ATTR_VALUE) || (value->type != 0))
+		return NULL;
+	return cmp_to_plan(m->type, attr->data.data.string, &value->data);
+} /* matcher_to_plan */
+
+/*
+ * host name plans
+ */
+
+static void
+names_destroy(name_plan_t *plan)
+{
+	size_t i;
+
+	if (! plan)
+		return;
+
+	for (i = 0; i < plan->names_num; ++i)
+		free(plan->names[i]);
+	if (plan->names)
+		free(plan->names);
+	if (plan->lower)
+		free(plan->lower);
+	if (plan->upper)
+		free(plan->upper);
+	free(plan);
+} /* names_destroy */
+
+static int
+cmp_names(const void *a, const void *b)
+{
+	return strcasecmp(*(char * const *)a, *(char * const *)b);
+} /* cmp_names */
+
+/* Sort the names of a list and remove duplicates. */
+static void
+names_sort(name_plan_t *plan)
+{
+	size_t i, n = 0;
+
+	qsort(plan->names, plan->names_num, sizeof(*plan->names), cmp_names);
+	for (i = 0; i < plan->names_num; ++i) {
+		if (n && (! strcasecmp(plan->names[n - 1], plan->names[i])))
+			free(plan->names[i]);
+		else
+			plan->names[n++] = plan->names[i];
+	}
+	plan->names_num = n;
+} /* names_sort */
+
+static bool
+names_include(const name_plan_t *plan, const char *name)
+{
+	int cmp;
+
+	if (! plan->range)
+		return bsearch(&name, plan->names, plan->names_num,
+				sizeof(*plan->names), cmp_names) != NULL;
+
+	if (plan->lower) {
+		cmp = strcasecmp(name, plan->lower);
+		if ((cmp < 0) || ((! cmp) && (! plan->lower_incl)))
+			return 0;
+	}
+	if (plan->upper) {
+		cmp = strcasecmp(name, plan->upper);
+		if ((cmp > 0) || ((! cmp) && (! plan->upper_incl)))
+			return 0;
+	}
+	return 1;
+} /* names_include */
+
+/* Merge the bound 'other' into the bound 'b' (taking ownership), keeping
+ * the tighter of both (or the looser one if 'loose' is true). */
+static void
+bound_merge(char **b, bool *incl, char *other, bool other_incl,
+		bool upper, bool loose)
+{
+	int cmp;
+
+	/* positive if 'b' is tighter than 'other' */
+	if ((! *b) || (! other))
+		cmp = (*b != NULL) - (other != NULL);
+	else if (upper)
+		cmp = strcasecmp(other, *b);
+	else
+		cmp = strcasecmp(*b, other);
+
+	if (! cmp)
+		*incl = loose ? (*incl || other_incl) : (*incl && other_incl);
+	if (loose ? (cmp > 0) : (cmp < 0)) {
+		char *tmp = *b;
+		*b = other;
+		other = tmp;
+		*incl = other_incl;
+	}
+	if (other)
+		free(other);
+} /* bound_merge */
+
+/* Turn a (non-empty) list into the smallest range including all names. */
+static int
+names_to_range(name_plan_t *plan)
+{
+	size_t i;
+
+	assert(plan->names_num);
+	plan->range = 1;
+	plan->lower = plan->names[0];
+	plan->lower_incl = 1;
+	if (plan->names_num > 1) {
+		plan->upper = plan->names[plan->names_num - 1];
+		for (i = 1; i + 1 < plan->names_num; ++i)
+			free(plan->names[i]);
+	}
+	else
+		plan->upper = strdup(plan->lower);
+	plan->upper_incl = 1;
+
+	free(plan->names);
+	plan->names = NULL;
+	plan->names_num = 0;
+	return plan->upper ? 0 : -1;
+} /* names_to_range */
+
+/* Select all names included in both plans. */
+static name_plan_t *
+names_and(name_plan_t *left, name_plan_t *right)
+{
+	size_t i, n = 0;
+
+	if (left->range && (! right->range)) {
+		name_plan_t *tmp = left;
+		left = right;
+		right = tmp;
+	}
+
+	if (! left->range) {
+		for (i = 0; i < left->names_num; ++i) {
+			if (names_include(right, left->names[i]))
+				left->names[n++] = left->names[i];
+			else
+				free(left->names[i]);
+		}
+		left->names_num = n;
+	}
+	else {
+		bound_merge(&left->lower, &left->lower_incl,
+				right->lower, right->lower_incl, /* upper = */ 0, 0);
+		bound_merge(&left->upper, &left->upper_incl,
+				right->upper, right->upper_incl, /* upper = */ 1, 0);
+		right->lower = right->upper = NULL;
+	}
+	names_destroy(right);
+	return left;
+} /* names_and */
+
+/* Select all names included in either plan; the union of ranges is
+ * approximated by the smallest range including both. */
+static name_plan_t *
+names_or(name_plan_t *left, name_plan_t *right)
+{
+	char **tmp;
+
+	if ((! left->range) && (! left->names_num)) {
+		names_destroy(left);
+		return right;
+	}
+	if ((! right->range) && (! right->names_num)) {
+		names_destroy(right);
+		return left;
+	}
+
+	if ((! left->range) && (! right->range)) {
+		tmp = realloc(left->names, (left->names_num + right->names_num)
+				* sizeof(*left->names));
+		if (! tmp) {
+			names_destroy(left);
+			names_destroy(right);
+			return NULL;
+		}
+		left->names = tmp;
+		memcpy(left->names + left->names_num, right->names,
+				right->names_num * sizeof(*right->names));
+		left->names_num += right->names_num;
+		right->names_num = 0;
+		names_sort(left);
+	}
+	else {
+		if (((! left->range) && names_to_range(left))
+				|| ((! right->range) && names_to_range(right))) {
+			names_destroy(left);
+			names_destroy(right);
+			return NULL;
+		}
+		bound_merge(&left->lower, &left->lower_incl,
+				right->lower, right->lower_incl, /* upper = */ 0, 1);
+		bound_merge(&left->upper, &left->upper_incl,
+				right->upper, right->upper_incl, /* upper = */ 1, 1);
+		right->lower = right->upper = NULL;
+	}
+	names_destroy(right);
+	return left;
+} /* names_or */
+
+/* Returns true if the expression refers to the name of the host of objects
+ * of the specified type (or to the name of the object itself for hosts). */
+static bool
+is_host_name(int type, sdb_memstore_expr_t *e)
+{
+	if (e->type == TYPED_EXPR) {
+		if (e->data.data.integer != SDB_HOST)
+			return 0;
+		e = e->left;
+	}
+	else if (type != SDB_HOST)
+		return 0;
+	return (e->type == FIELD_VALUE)
+		&& (e->data.data.integer == SDB_FIELD_NAME);
+} /* is_host_name */
+
+/* Build a plan for comparing the host name with a constant value. */
+static name_plan_t *
+cmp_to_names(int type, const sdb_data_t *value)
+{
+	name_plan_t *plan;
+	size_t len = 1, i;
+
+	/* names only compare equal to strings */
+	if (type == MATCHER_IN) {
+		if (value->type != (SDB_TYPE_ARRAY | SDB_TYPE_STRING))
+			return NULL;
+		len = value->data.array.length;
+	}
+	else if ((value->type != SDB_TYPE_STRING) || (! value->data.string))
+		return NULL;
+
+	plan = calloc(1, sizeof(*plan));
+	if (! plan)
+		return NULL;
+
+	if ((type == MATCHER_EQ) || (type == MATCHER_IN)) {
+		if (len && (! (plan->names = calloc(len, sizeof(*plan->names))))) {
+			names_destroy(plan);
+			return NULL;
+		}
+		for (i = 0; i < len; ++i) {
+			const char *name = value->data.string;
+
+			if (type == MATCHER_IN)
+				name = ((char **)value->data.array.values)[i];
+			/* NULL elements never match */
+			if (! name)
+				continue;
+			if (! (plan->names[plan->names_num] = strdup(name))) {
+				names_destroy(plan);
+				return NULL;
+			}
+			++plan->names_num;
+		}
+		names_sort(plan);
+		return plan;
+	}
+
+	plan->range = 1;
+	if ((type == MATCHER_LT) || (type == MATCHER_LE)) {
+		plan->upper = strdup(value->data.string);
+		plan->upper_incl = type == MATCHER_LE;
+	}
+	else {
+		plan->lower = strdup(value->data.string);
+		plan->lower_incl = type == MATCHER_GE;
+	}
+	if ((! plan->lower) && (! plan->upper)) {
+		names_destroy(plan);
+		return NULL;
+	}
+	return plan;
+} /* cmp_to_names */
+
+/* Determine the candidate hosts for a matcher on objects of the specified
+ * type by name. The plan may select more hosts than the matcher; it never
+ * misses any. Returns NULL if the matcher does not restrict host names. */
+static name_plan_t *
+matcher_to_names(int type, sdb_memstore_matcher_t *m)
+{
+	sdb_memstore_expr_t *name, *value;
+	name_plan_t *left, *right;
+	int op;
+
+	if (! m)
+		return NULL;
+
+	if ((m->type == MATCHER_AND) || (m->type == MATCHER_OR)) {
+		left = matcher_to_names(type, OP_M(m)->left);
+		right = matcher_to_names(type, OP_M(m)->right);
+
+		if ((! left) || (! right)) {
+			/* either operand of a conjunction selects all candidates */
+			if (m->type == MATCHER_AND)
+				return left ? left : right;
+			names_destroy(left);
+			names_destroy(right);
+			return NULL;
+		}
+		if (m->type == MATCHER_AND)
+			return names_and(left, right);
+		return names_or(left, right);
+	}
+
+	op = m->type;
+	if ((op != MATCHER_EQ) && (op != MATCHER_IN) && (op != MATCHER_LT)
+			&& (op != MATCHER_LE) && (op != MATCHER_GE) && (op != MATCHER_GT))
+		return NULL;
+
+	name = CMP_M(m)->left;
+	value = CMP_M(m)->right;
+	if ((op != MATCHER_IN) && is_host_name(type, value)) {
+		name = CMP_M(m)->right;
+		value = CMP_M(m)->left;
+		/* 'x < name' is the same as 'name > x' */
+		if (op == MATCHER_LT)
+			op = MATCHER_GT;
+		else if (op == MATCHER_LE)
+			op = MATCHER_GE;
+		else if (op == MATCHER_GE)
+			op = MATCHER_LE;
+		else if (op == MATCHER_GT)
+			op = MATCHER_LT;
+	}
+	if ((! is_host_name(type, name)) || (value->type != 0))
+		return NULL;
+	return cmp_to_names(op, &value->data);
+} /* matcher_to_names */
+
+/* Replace a matcher by its compiled program, if possible. */
+static void
+compile(sdb_memstore_matcher_t **m)
+{
+	sdb_memstore_matcher_t *prog = sdb_memstore_matcher_compile(*m);
+
+	if (! prog)
+		return;
+	sdb_object_deref(SDB_OBJ(*m));
+	*m = prog;
+} /* compile */
+
 /*
  * query type
  */
@@ -309,11 +1008,16 @@ query_init(sdb_object_t *obj, va_list ap)
 		QUERY(obj)->matcher = node_to_matcher(matcher);
 		if (! QUERY(obj)->matcher)
 			return -1;
+		QUERY(obj)->plan = matcher_to_plan(QUERY(obj)->matcher);
+		QUERY(obj)->names = matcher_to_names(SDB_AST_LOOKUP(ast)->obj_type,
+				QUERY(obj)->matcher);
+		compile(&QUERY(obj)->matcher);
 	}
 	if (filter) {
 		QUERY(obj)->filter = node_to_matcher(filter);
 		if (! QUERY(obj)->filter)
 			return -1;
+		compile(&QUERY(obj)->filter);
 	}
 
 	return 0;
@@ -325,6 +1029,8 @@ query_destroy(sdb_object_t *obj)
 	sdb_object_deref(SDB_OBJ(QUERY(obj)->ast));
 	sdb_object_deref(SDB_OBJ(QUERY(obj)->matcher));
 	sdb_object_deref(SDB_OBJ(QUERY(obj)->filter));
+	plan_destroy(QUERY(obj)->plan);
+	names_destroy(QUERY(obj)->names);
 } /* query_destroy */
 
 static sdb_type_t query_type = {
@@ -0,0 +1,747 @@
+/*
+ * SysDB - src/core/memstore_snapshot.c
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * This module implements on-disk snapshots of an in-memory store and the
+ * record format shared with the write-ahead log.
+ *
+ * Each record consists of the record type, the length of the record's
+ * payload, and a checksum of the payload (all integers are stored in network
+ * byte-order) followed by the payload which describes a single stored object
+ * the same way as the respective store writer callback receives it.
+ *
+ * A snapshot file starts with a header (magic string, format version, time
+ * of creation) followed by the records of all objects in the order required
+ * for restoring the store, that is, each host is followed by all of its
+ * children and each child is followed by its attributes. The final record
+ * includes the number of preceding records; snapshots without it are
+ * considered incomplete and will be rejected.
+ */
+
+#if HAVE_CONFIG_H
+#	include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "core/memstore-private.h"
+#include "utils/error.h"
+#include "utils/proto.h"
+
+#include <errno.h>
+
+#include <arpa/inet.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#define SNAPSHOT_MAGIC "SDBSNAP"
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_HEADER_LEN (sizeof(SNAPSHOT_MAGIC) + 3 * sizeof(uint32_t))
+
+/* number of objects to load at once */
+#define LOAD_BATCH_SIZE 4096
+
+/* FNV-1a */
+static uint32_t
+checksum(const char *data, size_t len)
+{
+	uint32_t h = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < len; ++i) {
+		h ^= (unsigned char)data[i];
+		h *= 16777619U;
+	}
+	return h;
+} /* checksum */
+
+/*
+ * encoding
+ */
+
+static void
+put_u32(sdb_strbuf_t *buf, uint32_t v)
+{
+	v = htonl(v);
+	sdb_strbuf_memappend(buf, &v, sizeof(v));
+} /* put_u32 */
+
+static void
+put_time(sdb_strbuf_t *buf, sdb_time_t t)
+{
+	put_u32(buf, (uint32_t)(t >> 32));
+	put_u32(buf, (uint32_t)(t & 0xffffffff));
+} /* put_time */
+
+static void
+put_str(sdb_strbuf_t *buf, const char *s)
+{
+	if (! s)
+		s = "";
+	sdb_strbuf_memappend(buf, s, strlen(s) + 1);
+} /* put_str */
+
+static void
+put_common(sdb_strbuf_t *buf, sdb_time_t last_update, sdb_time_t interval,
+		const char * const *backends, size_t backends_num)
+{
+	size_t i;
+
+	put_time(buf, last_update);
+	put_time(buf, interval);
+	put_u32(buf, (uint32_t)backends_num);
+	for (i = 0; i < backends_num; ++i)
+		put_str(buf, backends[i]);
+} /* put_common */
+
+/* Append the payload collected in the scratch buffer as a record. */
+static int
+put_record(record_buf_t *rb, int type)
+{
+	const char *payload = sdb_strbuf_string(rb->payload);
+	size_t len = sdb_strbuf_len(rb->payload);
+
+	put_u32(rb->buf, (uint32_t)type);
+	put_u32(rb->buf, (uint32_t)len);
+	put_u32(rb->buf, checksum(payload, len));
+	sdb_strbuf_memappend(rb->buf, payload, len);
+	++rb->records;
+	return 0;
+} /* put_record */
+
+static int
+encode_host(sdb_store_host_t *host, sdb_object_t *user_data)
+{
+	record_buf_t *rb = SDB_OBJ_WRAPPER(user_data)->data;
+
+	sdb_strbuf_clear(rb->payload);
+	put_str(rb->payload, host->name);
+	put_common(rb->payload, host->last_update, host->interval,
+			host->backends, host->backends_num);
+	return put_record(rb, SDB_HOST);
+} /* encode_host */
+
+static int
+encode_service(sdb_store_service_t *service, sdb_object_t *user_data)
+{
+	record_buf_t *rb = SDB_OBJ_WRAPPER(user_data)->data;
+
+	sdb_strbuf_clear(rb->payload);
+	put_str(rb->payload, service->hostname);
+	put_str(rb->payload, service->name);
+	put_common(rb->payload, service->last_update, service->interval,
+			service->backends, service->backends_num);
+	return put_record(rb, SDB_SERVICE);
+} /* encode_service */
+
+static int
+encode_metric(sdb_store_metric_t *metric, sdb_object_t *user_data)
+{
+	record_buf_t *rb = SDB_OBJ_WRAPPER(user_data)->data;
+	size_t i;
+
+	sdb_strbuf_clear(rb->payload);
+	put_str(rb->payload, metric->hostname);
+	put_str(rb->payload, metric->name);
+	put_common(rb->payload, metric->last_update, metric->interval,
+			metric->backends, metric->backends_num);
+	put_u32(rb->payload, (uint32_t)metric->stores_num);
+	for (i = 0; i < metric->stores_num; ++i) {
+		put_str(rb->payload, metric->stores[i].type);
+		put_str(rb->payload, metric->stores[i].id);
+		put_time(rb->payload, metric->stores[i].last_update);
+	}
+	return put_record(rb, SDB_METRIC);
+} /* encode_metric */
+
+static int
+encode_attribute(sdb_store_attribute_t *attr, sdb_object_t *user_data)
+{
+	record_buf_t *rb = SDB_OBJ_WRAPPER(user_data)->data;
+	ssize_t len;
+
+	len = sdb_proto_marshal_data(NULL, 0, &attr->value);
+	if (len < 0)
+		return -1;
+
+	sdb_strbuf_clear(rb->payload);
+	put_str(rb->payload, attr->hostname);
+	put_u32(rb->payload, (uint32_t)attr->parent_type);
+	put_str(rb->payload, attr->parent);
+	put_str(rb->payload, attr->key);
+	put_common(rb->payload, attr->last_update, attr->interval,
+			attr->backends, attr->backends_num);
+	{
+		char tmp[len];
+		sdb_proto_marshal_data(tmp, sizeof(tmp), &attr->value);
+		sdb_strbuf_memappend(rb->payload, tmp, sizeof(tmp));
+	}
+	return put_record(rb, SDB_ATTRIBUTE);
+} /* encode_attribute */
+
+static int
+encode_batch(sdb_store_batch_t *batch, sdb_object_t *user_data)
+{
+	size_t i;
+	int status = 0;
+
+	for (i = 0; (i < batch->entries_num) && (! status); ++i) {
+		sdb_store_batch_entry_t *e = batch->entries + i;
+
+		if (e->type == SDB_HOST)
+			status = encode_host(&e->obj.host, user_data);
+		else if (e->type == SDB_SERVICE)
+			status = encode_service(&e->obj.service, user_data);
+		else if (e->type == SDB_METRIC)
+			status = encode_metric(&e->obj.metric, user_data);
+		else if (e->type == SDB_ATTRIBUTE)
+			status = encode_attribute(&e->obj.attribute, user_data);
+		else
+			status = -1;
+	}
+	return status;
+} /* encode_batch */
+
+sdb_store_writer_t sdb_memstore_record_writer = {
+	encode_host, encode_service, encode_metric, encode_attribute,
+	encode_batch, /* flags = */ 0,
+};
+
+/*
+ * decoding
+ */
+
+typedef struct {
+	const char *pos;
+	size_t left;
+} cursor_t;
+
+static int
+get_u32(cursor_t *c, uint32_t *v)
+{
+	if (c->left < sizeof(*v))
+		return -1;
+	memcpy(v, c->pos, sizeof(*v));
+	*v = ntohl(*v);
+	c->pos += sizeof(*v);
+	c->left -= sizeof(*v);
+	return 0;
+} /* get_u32 */
+
+static int
+get_time(cursor_t *c, sdb_time_t *t)
+{
+	uint32_t hi, lo;
+
+	if (get_u32(c, &hi) || get_u32(c, &lo))
+		return -1;
+	*t = ((sdb_time_t)hi << 32) | (sdb_time_t)lo;
+	return 0;
+} /* get_time */
+
+/* Strings are referenced in place. */
+static int
+get_str(cursor_t *c, const char **s)
+{
+	const char *end = memchr(c->pos, '\0', c->left);
+
+	if (! end)
+		return -1;
+	*s = c->pos;
+	c->left -= (size_t)(end - c->pos) + 1;
+	c->pos = end + 1;
+	return 0;
+} /* get_str */
+
+/* Read the next record header and verify the record's payload. */
+static int
+get_record(cursor_t *c, uint32_t *type, cursor_t *payload)
+{
+	uint32_t len, sum;
+
+	if (get_u32(c, type) || get_u32(c, &len) || get_u32(c, &sum))
+		return -1;
+	if ((len > c->left) || (checksum(c->pos, len) != sum))
+		return -1;
+
+	payload->pos = c->pos;
+	payload->left = len;
+	c->pos += len;
+	c->left -= len;
+	return 0;
+} /* get_record */
+
+typedef struct {
+	sdb_memstore_t *store;
+
+	sdb_store_batch_entry_t entries[LOAD_BATCH_SIZE];
+	size_t entries_num;
+
+	/* backends and metric stores of all entries; entries are pointed to
+	 * their respective elements once the batch is complete */
+	const char **backends;
+	size_t backends_num;
+	size_t backends_size;
+	sdb_metric_store_t *stores;
+	size_t stores_num;
+	size_t stores_size;
+	size_t backends_idx[LOAD_BATCH_SIZE];
+	size_t stores_idx[LOAD_BATCH_SIZE];
+} loader_t;
+
+static int
+loader_flush(loader_t *l)
+{
+	sdb_store_batch_t batch = { l->entries, l->entries_num };
+	size_t i;
+	int status;
+
+	if (! l->entries_num)
+		return 0;
+
+	for (i = 0; i < l->entries_num; ++i) {
+		sdb_store_batch_entry_t *e = l->entries + i;
+		const char * const *backends = l->backends + l->backends_idx[i];
+
+		if (e->type == SDB_HOST)
+			e->obj.host.backends = backends;
+		else if (e->type == SDB_SERVICE)
+			e->obj.service.backends = backends;
+		else if (e->type == SDB_METRIC) {
+			e->obj.metric.backends = backends;
+			e->obj.metric.stores = l->stores + l->stores_idx[i];
+		}
+		else if (e->type == SDB_ATTRIBUTE)
+			e->obj.attribute.backends = backends;
+	}
+
+	status = sdb_memstore_writer.store_batch(&batch, SDB_OBJ(l->store));
+
+	for (i = 0; i < l->entries_num; ++i)
+		if (l->entries[i].type == SDB_ATTRIBUTE)
+			sdb_data_free_datum(&l->entries[i].obj.attribute.value);
+	l->entries_num = 0;
+	l->backends_num = 0;
+	l->stores_num = 0;
+
+	/* objects which are newer in the store are not an error */
+	return status < 0 ? -1 : 0;
+} /* loader_flush */
+
+static int
+get_common(loader_t *l, cursor_t *c, sdb_time_t *last_update,
+		sdb_time_t *interval, size_t *backends_num)
+{
+	uint32_t n, i;
+
+	if (get_time(c, last_update) || get_time(c, interval)
+			|| get_u32(c, &n) || (n > c->left))
+		return -1;
+
+	if (l->backends_num + n > l->backends_size) {
+		size_t size = 2 * l->backends_size + n;
+		const char **tmp = realloc(l->backends, size * sizeof(*tmp));
+		if (! tmp)
+			return -1;
+		l->backends = tmp;
+		l->backends_size = size;
+	}
+
+	l->backends_idx[l->entries_num] = l->backends_num;
+	for (i = 0; i < n; ++i)
+		if (get_str(c, l->backends + l->backends_num++))
+			return -1;
+	*backends_num = n;
+	return 0;
+} /* get_common */
+
+static int
+get_stores(loader_t *l, cursor_t *c, size_t *num)
+{
+	uint32_t n, i;
+
+	if (get_u32(c, &n) || (n > c->left))
+		return -1;
+
+	if (l->stores_num + n > l->stores_size) {
+		size_t size = 2 * l->stores_size + n;
+		sdb_metric_store_t *tmp = realloc(l->stores, size * sizeof(*tmp));
+		if (! tmp)
+			return -1;
+		l->stores = tmp;
+		l->stores_size = size;
+	}
+
+	l->stores_idx[l->entries_num] = l->stores_num;
+	for (i = 0; i < n; ++i) {
+		sdb_metric_store_t *s = l->stores + l->stores_num++;
+		s->info = NULL;
+		if (get_str(c, &s->type) || get_str(c, &s->id)
+				|| get_time(c, &s->last_update))
+			return -1;
+	}
+	*num = n;
+	return 0;
+} /* get_stores */
+
+/* Decode a single record and add it to the current batch. */
+static int
+load_record(loader_t *l, uint32_t type, cursor_t *c)
+{
+	sdb_store_batch_entry_t *e = l->entries + l->entries_num;
+
+	memset(e, 0, sizeof(*e));
+	e->type = (int)type;
+
+	switch (type) {
+	case SDB_HOST:
+		{
+			sdb_store_host_t *h = &e->obj.host;
+			if (get_str(c, &h->name) || get_common(l, c, &h->last_update,
+						&h->interval, &h->backends_num))
+				return -1;
+		}
+		break;
+	case SDB_SERVICE:
+		{
+			sdb_store_service_t *s = &e->obj.service;
+			if (get_str(c, &s->hostname) || get_str(c, &s->name)
+					|| get_common(l, c, &s->last_update,
+						&s->interval, &s->backends_num))
+				return -1;
+		}
+		break;
+	case SDB_METRIC:
+		{
+			sdb_store_metric_t *m = &e->obj.metric;
+			if (get_str(c, &m->hostname) || get_str(c, &m->name)
+					|| get_common(l, c, &m->last_update,
+						&m->interval, &m->backends_num)
+					|| get_stores(l, c, &m->stores_num))
+				return -1;
+		}
+		break;
+	case SDB_ATTRIBUTE:
+		{
+			sdb_store_attribute_t *a = &e->obj.attribute;
+			uint32_t parent_type;
+
+			if (get_str(c, &a->hostname) || get_u32(c, &parent_type)
+					|| get_str(c, &a->parent) || get_str(c, &a->key)
+					|| get_common(l, c, &a->last_update,
+						&a->interval, &a->backends_num))
+				return -1;
+			if (! *a->hostname)
+				a->hostname = NULL;
+			a->parent_type = (int)parent_type;
+
+			if (sdb_proto_unmarshal_data(c->pos, c->left, &a->value) < 0)
+				return -1;
+		}
+		break;
+	default:
+		return -1;
+	}
+
+	++l->entries_num;
+	return 0;
+} /* load_record */
+
+ssize_t
+sdb_memstore_load_records(sdb_memstore_t *store, const char *data,
+		size_t len, size_t *consumed)
+{
+	loader_t *l;
+	cursor_t c = { data, len };
+	ssize_t records = 0;
+	int status = 0;
+
+	l = calloc(1, sizeof(*l));
+	if (! l)
+		return -1;
+	l->store = store;
+
+	while (c.left) {
+		cursor_t next = c, payload;
+		uint32_t type;
+
+		if (get_record(&next, &type, &payload) || (type == RECORD_END))
+			break;
+
+		/* keep going in case of errors to restore as much as possible */
+		if ((l->entries_num >= LOAD_BATCH_SIZE) && loader_flush(l))
+			status = -1;
+		if (load_record(l, type, &payload))
+			break;
+
+		c = next;
+		++records;
+	}
+	if (loader_flush(l))
+		status = -1;
+
+	free(l->backends);
+	free(l->stores);
+	free(l);
+
+	if (consumed)
+		*consumed = len - c.left;
+	return status ? -1 : records;
+} /* sdb_memstore_load_records */
+
+/*
+ * snapshots
+ */
+
+/* Check the header and the record structure of a snapshot. Returns the
+ * number of records. */
+static ssize_t
+snapshot_check(const char *data, size_t len)
+{
+	cursor_t c = { data, len };
+	uint32_t version, records = 0;
+
+	if ((len < SNAPSHOT_HEADER_LEN)
+			|| memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)))
+		return -1;
+	c.pos += sizeof(SNAPSHOT_MAGIC);
+	c.left -= sizeof(SNAPSHOT_MAGIC);
+
+	get_u32(&c, &version);
+	if (version != SNAPSHOT_VERSION)
+		return -1;
+	/* skip the time of creation */
+	c.pos += 2 * sizeof(uint32_t);
+	c.left -= 2 * sizeof(uint32_t);
+
+	while (1) {
+		cursor_t payload;
+		uint32_t type, expected;
+
+		if (get_record(&c, &type, &payload))
+			return -1;
+		if (type == RECORD_END) {
+			if (get_u32(&payload, &expected) || c.left)
+				return -1;
+			return expected == records ? (ssize_t)records : -1;
+		}
+		++records;
+	}
+	return -1;
+} /* snapshot_check */
+
+/* Flush the directory entry of 'filename' to disk, e.g., after renaming. */
+static int
+sync_dir(const char *filename)
+{
+	const char *sep = strrchr(filename, '/');
+	size_t len = sep ? (size_t)(sep - filename) : 0;
+	char dirname[len + 2];
+	int fd, status;
+
+	if (! sep)
+		strcpy(dirname, ".");
+	else if (! len)
+		strcpy(dirname, "/");
+	else {
+		strncpy(dirname, filename, len);
+		dirname[len] = '\0';
+	}
+
+	fd = open(dirname, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return -1;
+	status = fsync(fd);
+	close(fd);
+	return status;
+} /* sync_dir */
+
+int
+sdb_memstore_snapshot(sdb_memstore_t *store, const char *filename)
+{
+	store_view_t *view;
+	size_t i;
+
+	record_buf_t rb = { NULL, NULL, 0 };
+	sdb_object_wrapper_t obj = SDB_OBJECT_WRAPPER_STATIC(&rb);
+	char tmpname[filename ? strlen(filename) + 5 : 1];
+	FILE *fh;
+	int status = 0;
+
+	if ((! store) || (! filename))
+		return -1;
+
+	/* serialize a consistent view of the store without blocking writers */
+	if (! (view = sdb_memstore_view_try_pin(store, /* hosts = */ 1))) {
+		sdb_memstore_lock_all(store);
+		view = sdb_memstore_view_pin(store, /* hosts = */ 1);
+		sdb_memstore_unlock_all(store);
+	}
+	if (! view)
+		return -1;
+
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", filename);
+	fh = fopen(tmpname, "w");
+	if (! fh) {
+		char errbuf[1024];
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to open snapshot file %s: %s",
+				tmpname, sdb_strerror(errno, errbuf, sizeof(errbuf)));
+		status = -1;
+	}
+
+	rb.buf = sdb_strbuf_create(4096);
+	rb.payload = sdb_strbuf_create(1024);
+	if ((! rb.buf) || (! rb.payload))
+		status = -1;
+
+	if (! status) {
+		sdb_strbuf_memcpy(rb.buf, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+		put_u32(rb.buf, SNAPSHOT_VERSION);
+		put_time(rb.buf, sdb_gettime());
+	}
+
+	for (i = 0; (i < view->hosts_num) && (! status); ++i) {
+		status = sdb_memstore_emit_full(STORE_OBJ(view->hosts[i]),
+				/* filter = */ NULL, &sdb_memstore_record_writer,
+				SDB_OBJ(&obj));
+
+		if ((! status) && (fwrite(sdb_strbuf_string(rb.buf),
+						sdb_strbuf_len(rb.buf), 1, fh) != 1))
+			status = -1;
+		sdb_strbuf_clear(rb.buf);
+	}
+
+	if (! status) {
+		size_t records = rb.records;
+
+		sdb_strbuf_clear(rb.payload);
+		put_u32(rb.payload, (uint32_t)records);
+		put_record(&rb, RECORD_END);
+		rb.records = records;
+		if (fwrite(sdb_strbuf_string(rb.buf),
+					sdb_strbuf_len(rb.buf), 1, fh) != 1)
+			status = -1;
+	}
+
+	if ((! status) && (fflush(fh) || fsync(fileno(fh))))
+		status = -1;
+	if (fh && fclose(fh))
+		status = -1;
+
+	if (! status) {
+		/* the WAL may be truncated once the new snapshot is durable */
+		if (rename(tmpname, filename) || sync_dir(filename)) {
+			char errbuf[1024];
+			sdb_log(SDB_LOG_ERR, "memstore: Failed to replace snapshot "
+					"file %s: %s", filename,
+					sdb_strerror(errno, errbuf, sizeof(errbuf)));
+			status = -1;
+		}
+	}
+	else if (fh) {
+		char errbuf[1024];
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to write snapshot file %s: %s",
+				tmpname, sdb_strerror(errno, errbuf, sizeof(errbuf)));
+		unlink(tmpname);
+	}
+
+	sdb_memstore_view_release(store, view);
+	sdb_strbuf_destroy(rb.buf);
+	sdb_strbuf_destroy(rb.payload);
+
+	if (! status)
+		sdb_log(SDB_LOG_DEBUG, "memstore: Wrote snapshot of %zu object%s "
+				"to %s", rb.records, rb.records == 1 ? "" : "s", filename);
+	return status;
+} /* sdb_memstore_snapshot */
+
+int
+sdb_memstore_load(sdb_memstore_t *store, const char *filename)
+{
+	struct stat st;
+	char *data;
+	ssize_t records;
+	int fd;
+
+	if ((! store) || (! filename))
+		return -1;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		char errbuf[1024];
+		if (errno == ENOENT)
+			return 1;
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to open snapshot file %s: %s",
+				filename, sdb_strerror(errno, errbuf, sizeof(errbuf)));
+		return -1;
+	}
+	if (fstat(fd, &st) || (! st.st_size)) {
+		close(fd);
+		sdb_log(SDB_LOG_ERR, "memstore: Invalid snapshot file %s", filename);
+		return -1;
+	}
+
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		char errbuf[1024];
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to map snapshot file %s: %s",
+				filename, sdb_strerror(errno, errbuf, sizeof(errbuf)));
+		return -1;
+	}
+	madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	records = snapshot_check(data, (size_t)st.st_size);
+	if (records < 0) {
+		sdb_log(SDB_LOG_ERR, "memstore: Ignoring invalid or incomplete "
+				"snapshot file %s", filename);
+		munmap(data, (size_t)st.st_size);
+		return -1;
+	}
+
+	if (sdb_memstore_load_records(store, data + SNAPSHOT_HEADER_LEN,
+				(size_t)st.st_size - SNAPSHOT_HEADER_LEN, NULL) != records) {
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to load snapshot file %s",
+				filename);
+		munmap(data, (size_t)st.st_size);
+		return -1;
+	}
+	munmap(data, (size_t)st.st_size);
+
+	sdb_log(SDB_LOG_INFO, "memstore: Loaded %zd object%s from snapshot "
+			"file %s", records, records == 1 ? "" : "s", filename);
+	return 0;
+} /* sdb_memstore_load */
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
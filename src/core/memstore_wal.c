@@ -0,0 +1,477 @@
+/*
+ * SysDB - src/core/memstore_wal.c
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * This module implements a write-ahead log for an in-memory store.
+ *
+ * All updates accepted by the store are encoded as records (see
+ * memstore_snapshot.c) and collected in memory. Once enough data has been
+ * collected, or when explicitly requested, all pending records are appended
+ * to the log file and synced to disk at once (group commit). Pending records
+ * are swapped out before writing them, so new updates are not blocked while
+ * a commit is in progress.
+ *
+ * A checkpoint rotates the log file and writes a snapshot of the store. The
+ * previous log file is removed once the snapshot has been written
+ * successfully. Replaying records is idempotent as outdated updates are
+ * rejected by the store, so records may safely be included in both, a
+ * snapshot and a log file.
+ */
+
+#if HAVE_CONFIG_H
+#	include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "core/memstore-private.h"
+#include "utils/error.h"
+#include "utils/os.h"
+
+#include <errno.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#define WAL_MAGIC "SDBWAL"
+#define WAL_VERSION "1"
+#define WAL_HEADER_LEN (sizeof(WAL_MAGIC) + sizeof(WAL_VERSION))
+
+struct sdb_memstore_wal {
+	sdb_object_t super;
+
+	sdb_memstore_t *store;
+	char *oldname;
+	int fd;
+
+	/* commit once this many bytes are pending */
+	size_t batch_size;
+
+	/* pending records */
+	pthread_mutex_t lock;
+	record_buf_t pending;
+	sdb_object_wrapper_t pending_obj;
+
+	/* records being written; this lock serializes all commits */
+	pthread_mutex_t commit_lock;
+	sdb_strbuf_t *committing;
+};
+
+/*
+ * private helper functions
+ */
+
+/* Open a log file for appending, writing the header if it's a new file. */
+static int
+wal_open(const char *filename)
+{
+	struct stat st;
+	int fd;
+
+	fd = open(filename, O_WRONLY | O_APPEND | O_CREAT, 0640);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	if ((! st.st_size)
+			&& ((sdb_write(fd, sizeof(WAL_MAGIC), WAL_MAGIC) < 0)
+				|| (sdb_write(fd, sizeof(WAL_VERSION), WAL_VERSION) < 0)
+				|| fsync(fd))) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+} /* wal_open */
+
+/* Replay all records from the specified log file. If requested, the file is
+ * truncated after the last valid record. */
+static int
+wal_replay(sdb_memstore_t *store, const char *filename, bool repair)
+{
+	struct stat st;
+	char *data;
+	ssize_t records;
+	size_t len, consumed = 0;
+	int fd, status = 0;
+
+	fd = open(filename, repair ? O_RDWR : O_RDONLY);
+	if (fd < 0)
+		return errno == ENOENT ? 0 : -1;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	if (! st.st_size) {
+		close(fd);
+		return 0;
+	}
+
+	data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+	if (((size_t)st.st_size < WAL_HEADER_LEN)
+			|| memcmp(data, WAL_MAGIC, sizeof(WAL_MAGIC))
+			|| memcmp(data + sizeof(WAL_MAGIC), WAL_VERSION,
+				sizeof(WAL_VERSION))) {
+		sdb_log(SDB_LOG_ERR, "memstore: Invalid write-ahead log file %s",
+				filename);
+		munmap(data, (size_t)st.st_size);
+		close(fd);
+		return -1;
+	}
+
+	len = (size_t)st.st_size - WAL_HEADER_LEN;
+	records = sdb_memstore_load_records(store, data + WAL_HEADER_LEN,
+			len, &consumed);
+	munmap(data, (size_t)st.st_size);
+
+	if (records < 0) {
+		sdb_log(SDB_LOG_WARNING, "memstore: Failed to restore some objects "
+				"from write-ahead log file %s", filename);
+		status = -1;
+	}
+	else
+		sdb_log(SDB_LOG_INFO, "memstore: Replayed %zd record%s from "
+				"write-ahead log file %s", records,
+				records == 1 ? "" : "s", filename);
+
+	if (consumed < len) {
+		/* most likely, the last commit has been interrupted */
+		sdb_log(SDB_LOG_WARNING, "memstore: Ignoring %zu bytes of incomplete "
+				"records at the end of write-ahead log file %s",
+				len - consumed, filename);
+		if (repair
+				&& ftruncate(fd, (off_t)(WAL_HEADER_LEN + consumed))) {
+			char errbuf[1024];
+			sdb_log(SDB_LOG_ERR, "memstore: Failed to truncate write-ahead "
+					"log file %s: %s", filename,
+					sdb_strerror(errno, errbuf, sizeof(errbuf)));
+			status = -1;
+		}
+	}
+	close(fd);
+	return status;
+} /* wal_replay */
+
+/* Write all pending records to disk. The caller has to hold the commit
+ * lock. */
+static int
+wal_commit_locked(sdb_memstore_wal_t *wal)
+{
+	sdb_strbuf_t *tmp;
+	int status = 0;
+
+	pthread_mutex_lock(&wal->lock);
+	tmp = wal->pending.buf;
+	wal->pending.buf = wal->committing;
+	wal->committing = tmp;
+	pthread_mutex_unlock(&wal->lock);
+
+	if (! sdb_strbuf_len(wal->committing))
+		return 0;
+
+	if ((sdb_write(wal->fd, sdb_strbuf_len(wal->committing),
+					sdb_strbuf_string(wal->committing)) < 0)
+			|| fsync(wal->fd)) {
+		char errbuf[1024];
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to write to write-ahead "
+				"log file %s: %s", SDB_OBJ(wal)->name,
+				sdb_strerror(errno, errbuf, sizeof(errbuf)));
+		status = -1;
+	}
+	sdb_strbuf_clear(wal->committing);
+	return status;
+} /* wal_commit_locked */
+
+/* Finish appending a record: release the lock (held by the caller) and
+ * commit if enough data is pending. */
+static int
+wal_append_done(sdb_memstore_wal_t *wal, int status)
+{
+	bool commit = sdb_strbuf_len(wal->pending.buf) >= wal->batch_size;
+
+	pthread_mutex_unlock(&wal->lock);
+	if (status)
+		return status;
+	if (commit)
+		return sdb_memstore_wal_sync(wal);
+	return 0;
+} /* wal_append_done */
+
+/*
+ * store writer API
+ */
+
+static int
+wal_store_host(sdb_store_host_t *host, sdb_object_t *user_data)
+{
+	sdb_memstore_wal_t *wal = SDB_MEMSTORE_WAL(user_data);
+	int status;
+
+	status = sdb_memstore_writer.store_host(host, SDB_OBJ(wal->store));
+	if (status)
+		return status;
+
+	pthread_mutex_lock(&wal->lock);
+	status = sdb_memstore_record_writer.store_host(host,
+			SDB_OBJ(&wal->pending_obj));
+	return wal_append_done(wal, status);
+} /* wal_store_host */
+
+static int
+wal_store_service(sdb_store_service_t *service, sdb_object_t *user_data)
+{
+	sdb_memstore_wal_t *wal = SDB_MEMSTORE_WAL(user_data);
+	int status;
+
+	status = sdb_memstore_writer.store_service(service, SDB_OBJ(wal->store));
+	if (status)
+		return status;
+
+	pthread_mutex_lock(&wal->lock);
+	status = sdb_memstore_record_writer.store_service(service,
+			SDB_OBJ(&wal->pending_obj));
+	return wal_append_done(wal, status);
+} /* wal_store_service */
+
+static int
+wal_store_metric(sdb_store_metric_t *metric, sdb_object_t *user_data)
+{
+	sdb_memstore_wal_t *wal = SDB_MEMSTORE_WAL(user_data);
+	int status;
+
+	status = sdb_memstore_writer.store_metric(metric, SDB_OBJ(wal->store));
+	if (status)
+		return status;
+
+	pthread_mutex_lock(&wal->lock);
+	status = sdb_memstore_record_writer.store_metric(metric,
+			SDB_OBJ(&wal->pending_obj));
+	return wal_append_done(wal, status);
+} /* wal_store_metric */
+
+static int
+wal_store_attribute(sdb_store_attribute_t *attr, sdb_object_t *user_data)
+{
+	sdb_memstore_wal_t *wal = SDB_MEMSTORE_WAL(user_data);
+	int status;
+
+	status = sdb_memstore_writer.store_attribute(attr, SDB_OBJ(wal->store));
+	if (status)
+		return status;
+
+	pthread_mutex_lock(&wal->lock);
+	status = sdb_memstore_record_writer.store_attribute(attr,
+			SDB_OBJ(&wal->pending_obj));
+	return wal_append_done(wal, status);
+} /* wal_store_attribute */
+
+static int
+wal_store_batch(sdb_store_batch_t *batch, sdb_object_t *user_data)
+{
+	sdb_memstore_wal_t *wal = SDB_MEMSTORE_WAL(user_data);
+	int status, s;
+
+	/* the store continues with the remaining objects in case of errors and
+	 * does not report which objects have been updated, so the whole batch
+	 * is logged; replaying outdated records is a no-op */
+	status = sdb_memstore_writer.store_batch(batch, SDB_OBJ(wal->store));
+
+	pthread_mutex_lock(&wal->lock);
+	s = sdb_memstore_record_writer.store_batch(batch,
+			SDB_OBJ(&wal->pending_obj));
+	s = wal_append_done(wal, s);
+	return s ? s : status;
+} /* wal_store_batch */
+
+sdb_store_writer_t sdb_memstore_wal_writer = {
+	wal_store_host, wal_store_service, wal_store_metric,
+	wal_store_attribute, wal_store_batch,
+	/* flags = */ SDB_STORE_WRITER_UPSERT,
+};
+
+/*
+ * WAL object
+ */
+
+static int
+wal_init(sdb_object_t *obj, va_list ap)
+{
+	sdb_memstore_wal_t *wal = SDB_MEMSTORE_WAL(obj);
+	sdb_object_wrapper_t pending_obj = SDB_OBJECT_WRAPPER_STATIC(NULL);
+
+	wal->store = va_arg(ap, sdb_memstore_t *);
+	wal->batch_size = va_arg(ap, size_t);
+	wal->fd = -1;
+
+	pthread_mutex_init(&wal->lock, /* attr = */ NULL);
+	pthread_mutex_init(&wal->commit_lock, /* attr = */ NULL);
+
+	pending_obj.data = &wal->pending;
+	wal->pending_obj = pending_obj;
+
+	wal->oldname = malloc(strlen(SDB_OBJ(wal)->name) + 5);
+	wal->pending.buf = sdb_strbuf_create(4096);
+	wal->pending.payload = sdb_strbuf_create(1024);
+	wal->committing = sdb_strbuf_create(4096);
+	if ((! wal->oldname) || (! wal->pending.buf) || (! wal->pending.payload)
+			|| (! wal->committing))
+		return -1;
+	sprintf(wal->oldname, "%s.old", SDB_OBJ(wal)->name);
+
+	/* restore any updates not included in the latest snapshot */
+	wal_replay(wal->store, wal->oldname, /* repair = */ 0);
+	wal_replay(wal->store, SDB_OBJ(wal)->name, /* repair = */ 1);
+
+	wal->fd = wal_open(SDB_OBJ(wal)->name);
+	if (wal->fd < 0) {
+		char errbuf[1024];
+		sdb_log(SDB_LOG_ERR, "memstore: Failed to open write-ahead log "
+				"file %s: %s", SDB_OBJ(wal)->name,
+				sdb_strerror(errno, errbuf, sizeof(errbuf)));
+		return -1;
+	}
+
+	sdb_object_ref(SDB_OBJ(wal->store));
+	return 0;
+} /* wal_init */
+
+static void
+wal_destroy(sdb_object_t *obj)
+{
+	sdb_memstore_wal_t *wal = SDB_MEMSTORE_WAL(obj);
+
+	if (wal->fd >= 0) {
+		sdb_memstore_wal_sync(wal);
+		close(wal->fd);
+		sdb_object_deref(SDB_OBJ(wal->store));
+	}
+	pthread_mutex_destroy(&wal->lock);
+	pthread_mutex_destroy(&wal->commit_lock);
+
+	if (wal->oldname)
+		free(wal->oldname);
+	sdb_strbuf_destroy(wal->pending.buf);
+	sdb_strbuf_destroy(wal->pending.payload);
+	sdb_strbuf_destroy(wal->committing);
+} /* wal_destroy */
+
+static sdb_type_t wal_type = {
+	/* size = */ sizeof(sdb_memstore_wal_t),
+	/* init = */ wal_init,
+	/* destroy = */ wal_destroy,
+};
+
+/*
+ * public API
+ */
+
+sdb_memstore_wal_t *
+sdb_memstore_wal_create(sdb_memstore_t *store, const char *filename,
+		size_t batch_size)
+{
+	if ((! store) || (! filename))
+		return NULL;
+	return SDB_MEMSTORE_WAL(sdb_object_create(filename, wal_type,
+				store, batch_size));
+} /* sdb_memstore_wal_create */
+
+int
+sdb_memstore_wal_sync(sdb_memstore_wal_t *wal)
+{
+	int status;
+
+	if (! wal)
+		return -1;
+
+	pthread_mutex_lock(&wal->commit_lock);
+	status = wal_commit_locked(wal);
+	pthread_mutex_unlock(&wal->commit_lock);
+	return status;
+} /* sdb_memstore_wal_sync */
+
+int
+sdb_memstore_wal_checkpoint(sdb_memstore_wal_t *wal, const char *snapshot)
+{
+	int status;
+
+	if ((! wal) || (! snapshot))
+		return -1;
+
+	pthread_mutex_lock(&wal->commit_lock);
+	status = wal_commit_locked(wal);
+
+	/* if a previous checkpoint failed, the old log file is still around;
+	 * keep it and continue to use the current one in that case */
+	if ((! status) && (access(wal->oldname, F_OK) != 0)) {
+		int fd = -1;
+
+		if (! rename(SDB_OBJ(wal)->name, wal->oldname)) {
+			fd = wal_open(SDB_OBJ(wal)->name);
+			if (fd < 0)
+				rename(wal->oldname, SDB_OBJ(wal)->name);
+		}
+
+		if (fd < 0) {
+			char errbuf[1024];
+			sdb_log(SDB_LOG_ERR, "memstore: Failed to rotate write-ahead "
+					"log file %s: %s", SDB_OBJ(wal)->name,
+					sdb_strerror(errno, errbuf, sizeof(errbuf)));
+			status = -1;
+		}
+		else {
+			close(wal->fd);
+			wal->fd = fd;
+		}
+	}
+	pthread_mutex_unlock(&wal->commit_lock);
+
+	if (status)
+		return status;
+
+	/* all records in the old log file have been applied to the store */
+	status = sdb_memstore_snapshot(wal->store, snapshot);
+	if (! status)
+		unlink(wal->oldname);
+	return status;
+} /* sdb_memstore_wal_checkpoint */
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
@@ -37,6 +37,26 @@
 #include <string.h>
 #include <strings.h>
 
+/*
+ * Reference counts are updated atomically since objects are shared between
+ * threads. Releasing a reference has to make all previous changes to the
+ * object visible to the thread destroying it.
+ */
+#if defined(__ATOMIC_RELAXED)
+#	define REF_CNT_GET(obj) __atomic_load_n(&(obj)->ref_cnt, __ATOMIC_RELAXED)
+#	define REF_CNT_INC(obj) \
+		__atomic_add_fetch(&(obj)->ref_cnt, 1, __ATOMIC_RELAXED)
+#	define REF_CNT_DEC(obj) \
+		__atomic_sub_fetch(&(obj)->ref_cnt, 1, __ATOMIC_ACQ_REL)
+#else
+#	define REF_CNT_GET(obj) (*(volatile int *)&(obj)->ref_cnt)
+#	define REF_CNT_INC(obj) __sync_add_and_fetch(&(obj)->ref_cnt, 1)
+#	define REF_CNT_DEC(obj) __sync_sub_and_fetch(&(obj)->ref_cnt, 1)
+#endif
+
+/* object flags */
+#define OBJ_SLAB (1 << 0)
+
 /*
  * private types
  */
@@ -79,26 +99,34 @@ static sdb_type_t sdb_object_wrapper_type = {
  */
 
 sdb_object_t *
-sdb_object_vcreate(const char *name, sdb_type_t type, va_list ap)
+sdb_object_vcreate_slab(sdb_slab_t *slab, const char *name,
+		sdb_type_t type, va_list ap)
 {
 	sdb_object_t *obj;
+	size_t size;
 
 	if (type.size < sizeof(sdb_object_t))
 		return NULL;
 
-	obj = malloc(type.size);
+	/* store the name at the tail of the object */
+	size = type.size;
+	if (name)
+		size += strlen(name) + 1;
+
+	if (slab)
+		obj = sdb_slab_alloc(slab, size);
+	else
+		obj = malloc(size);
 	if (! obj)
 		return NULL;
 	memset(obj, 0, type.size);
 	obj->type = type;
+	if (slab)
+		obj->flags |= OBJ_SLAB;
 
 	if (name) {
-		obj->name = strdup(name);
-		if (! obj->name) {
-			obj->ref_cnt = 1;
-			sdb_object_deref(obj);
-			return NULL;
-		}
+		obj->name = (char *)obj + type.size;
+		strcpy(obj->name, name);
 	}
 
 	if (type.init) {
@@ -111,6 +139,12 @@ sdb_object_vcreate(const char *name, sdb_type_t type, va_list ap)
 
 	obj->ref_cnt = 1;
 	return obj;
+} /* sdb_object_vcreate_slab */
+
+sdb_object_t *
+sdb_object_vcreate(const char *name, sdb_type_t type, va_list ap)
+{
+	return sdb_object_vcreate_slab(NULL, name, type, ap);
 } /* sdb_object_vcreate */
 
 sdb_object_t *
@@ -125,6 +159,19 @@ sdb_object_create(const char *name, sdb_type_t type, ...)
 	return obj;
 } /* sdb_object_create */
 
+sdb_object_t *
+sdb_object_create_slab(sdb_slab_t *slab, const char *name,
+		sdb_type_t type, ...)
+{
+	sdb_object_t *obj;
+	va_list ap;
+
+	va_start(ap, type);
+	obj = sdb_object_vcreate_slab(slab, name, type, ap);
+	va_end(ap);
+	return obj;
+} /* sdb_object_create_slab */
+
 sdb_object_t *
 sdb_object_create_simple(const char *name, size_t size,
 		void (*destructor)(sdb_object_t *))
@@ -143,22 +190,28 @@ sdb_object_create_wrapper(const char *name,
 void
 sdb_object_deref(sdb_object_t *obj)
 {
+	int ref_cnt;
+
 	if (! obj)
 		return;
 
-	--obj->ref_cnt;
-	if (obj->ref_cnt > 0)
+	ref_cnt = REF_CNT_DEC(obj);
+	if (ref_cnt > 0)
 		return;
 
 	/* we'd access free'd memory in case ref_cnt < 0 */
-	assert(! obj->ref_cnt);
+	assert(! ref_cnt);
 
 	if (obj->type.destroy)
 		obj->type.destroy(obj);
 
-	if (obj->name)
+	/* names set up by sdb_object_create are part of the object */
+	if (obj->name && (obj->name != (char *)obj + obj->type.size))
 		free(obj->name);
-	free(obj);
+	if (obj->flags & OBJ_SLAB)
+		sdb_slab_free(obj);
+	else
+		free(obj);
 } /* sdb_object_deref */
 
 void
@@ -166,8 +219,8 @@ sdb_object_ref(sdb_object_t *obj)
 {
 	if (! obj)
 		return;
-	assert(obj->ref_cnt > 0);
-	++obj->ref_cnt;
+	assert(REF_CNT_GET(obj) > 0);
+	REF_CNT_INC(obj);
 } /* sdb_object_ref */
 
 int
@@ -0,0 +1,92 @@
+/*
+ * SysDB - src/core/plugin-private.h
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * private interface of the plugin module
+ */
+
+#ifndef SDB_CORE_PLUGIN_PRIVATE_H
+#define SDB_CORE_PLUGIN_PRIVATE_H 1
+
+#include "core/plugin.h"
+#include "core/time.h"
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * sdb_plugin_builtin_begin, sdb_plugin_builtin_end:
+ * Set up a plugin context named 'name' for the calling thread without
+ * loading a shared object. Callbacks registered before the matching call to
+ * sdb_plugin_builtin_end are associated with that context as if they had
+ * been registered by a loaded plugin; in particular, they are subject to
+ * the context's max_concurrency. This is meant for code linked into the
+ * daemon (and the test-suite).
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_plugin_builtin_begin(const char *name, const sdb_plugin_ctx_t *plugin_ctx);
+void
+sdb_plugin_builtin_end(void);
+
+/*
+ * sdb_plugin_sched_clock_t:
+ * The time source of the collector scheduler. Workers determine the current
+ * time using 'gettime' and wait for the next due collector using 'wait',
+ * which is called with the scheduler's lock held and has to return no later
+ * than at 'until' (as returned by 'gettime') or when 'cond' is signaled.
+ */
+typedef struct {
+	sdb_time_t (*gettime)(void);
+	void (*wait)(pthread_cond_t *cond, pthread_mutex_t *lock,
+			sdb_time_t until);
+} sdb_plugin_sched_clock_t;
+
+/*
+ * sdb_plugin_set_sched_clock:
+ * Replace the time source of the collector scheduler, allowing to run it
+ * against a virtual clock. A NULL clock restores the system clock. The
+ * clock must not be changed while any collector loop is running and it
+ * should be set before registering collectors, which are first due at the
+ * time of their registration.
+ */
+void
+sdb_plugin_set_sched_clock(const sdb_plugin_sched_clock_t *clock);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* ! SDB_CORE_PLUGIN_PRIVATE_H */
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
@@ -30,7 +30,7 @@
 #endif /* HAVE_CONFIG_H */
 
 #include "sysdb.h"
-#include "core/plugin.h"
+#include "core/plugin-private.h"
 #include "core/time.h"
 #include "utils/error.h"
 #include "utils/llist.h"
@@ -42,6 +42,7 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <unistd.h>
@@ -69,9 +70,13 @@ typedef struct {
 	 * in that it provides higher level information about how
 	 * the plugin is in use. */
 	size_t use_cnt;
+
+	/* number of currently running collector callbacks;
+	 * protected by the collector scheduler's lock */
+	size_t running;
 } ctx_t;
 #define CTX_INIT { SDB_OBJECT_INIT, \
-	SDB_PLUGIN_CTX_INIT, SDB_PLUGIN_INFO_INIT, NULL, 0 }
+	SDB_PLUGIN_CTX_INIT, SDB_PLUGIN_INFO_INIT, NULL, 0, 0 }
 
 #define CTX(obj) ((ctx_t *)(obj))
 
@@ -105,6 +110,7 @@ typedef struct {
 	sdb_store_writer_t impl;
 } writer_t;
 #define WRITER(obj) ((writer_t *)(obj))
+#define CONST_WRITER(obj) ((const writer_t *)(obj))
 
 typedef struct {
 	callback_t super; /* cb_callback will always be NULL */
@@ -160,6 +166,325 @@ static struct {
 	{ "store reader",       &reader_list },
 };
 
+/*
+ * hostname canonicalization cache:
+ * The results of running all cname callbacks are cached in a fixed number of
+ * shards, each protected by its own lock and bounded in size. The least
+ * recently used entry of a shard is evicted once it is full. Names which
+ * none of the callbacks changed are cached as negative entries using a
+ * separate TTL.
+ */
+
+#define CNAME_CACHE_SHARDS 16
+
+typedef struct cname_entry cname_entry_t;
+struct cname_entry {
+	cname_entry_t *hash_next;
+	cname_entry_t *lru_prev;
+	cname_entry_t *lru_next;
+
+	uint32_t hash;
+	sdb_time_t expires;
+
+	char *name;
+	/* NULL for negative entries */
+	char *cname;
+};
+
+typedef struct {
+	pthread_mutex_t lock;
+
+	cname_entry_t **buckets;
+	size_t buckets_num;
+	size_t entries_num;
+
+	/* most recently used entry first */
+	cname_entry_t *lru_head;
+	cname_entry_t *lru_tail;
+
+	/* settings */
+	size_t max_entries;
+	sdb_time_t ttl;
+	sdb_time_t negative_ttl;
+
+	/* incremented whenever the shard is flushed */
+	unsigned generation;
+
+	uint64_t hits;
+	uint64_t misses;
+} cname_shard_t;
+
+static cname_shard_t     cname_cache[CNAME_CACHE_SHARDS];
+static pthread_once_t    cname_cache_once = PTHREAD_ONCE_INIT;
+
+static uint32_t
+cname_hash(const char *name)
+{
+	/* FNV-1a */
+	uint32_t hash = 2166136261U;
+	for ( ; *name; ++name) {
+		hash ^= (uint32_t)(unsigned char)*name;
+		hash *= 16777619U;
+	}
+	return hash;
+} /* cname_hash */
+
+static void
+cname_shard_setup(size_t i, const sdb_plugin_cname_cache_opts_t *opts)
+{
+	cname_shard_t *shard = cname_cache + i;
+	size_t max_entries = opts->size / CNAME_CACHE_SHARDS;
+	size_t buckets_num = 1;
+
+	/* distribute the remainder such that the total size is exact */
+	if (i < opts->size % CNAME_CACHE_SHARDS)
+		++max_entries;
+	while (buckets_num < max_entries)
+		buckets_num <<= 1;
+
+	/* buckets are allocated on first use */
+	shard->buckets_num = buckets_num;
+	shard->max_entries = max_entries;
+	shard->ttl = opts->ttl;
+	shard->negative_ttl = opts->negative_ttl;
+} /* cname_shard_setup */
+
+static void
+cname_cache_init(void)
+{
+	sdb_plugin_cname_cache_opts_t opts = SDB_PLUGIN_CNAME_CACHE_OPTS_INIT;
+	size_t i;
+
+	for (i = 0; i < CNAME_CACHE_SHARDS; ++i) {
+		memset(cname_cache + i, 0, sizeof(cname_cache[i]));
+		pthread_mutex_init(&cname_cache[i].lock, /* attr = */ NULL);
+		cname_shard_setup(i, &opts);
+	}
+} /* cname_cache_init */
+
+static cname_shard_t *
+cname_shard(uint32_t hash)
+{
+	pthread_once(&cname_cache_once, cname_cache_init);
+	return cname_cache + (hash % CNAME_CACHE_SHARDS);
+} /* cname_shard */
+
+static cname_entry_t **
+cname_bucket(cname_shard_t *shard, uint32_t hash)
+{
+	/* the lower bits select the shard */
+	return shard->buckets
+		+ ((hash / CNAME_CACHE_SHARDS) & (shard->buckets_num - 1));
+} /* cname_bucket */
+
+static void
+cname_entry_destroy(cname_entry_t *e)
+{
+	if (! e)
+		return;
+	if (e->name)
+		free(e->name);
+	if (e->cname)
+		free(e->cname);
+	free(e);
+} /* cname_entry_destroy */
+
+/* the shard has to be locked by the caller */
+static cname_entry_t *
+cname_shard_find(cname_shard_t *shard, const char *name, uint32_t hash)
+{
+	cname_entry_t *e;
+
+	if (! shard->buckets)
+		return NULL;
+
+	for (e = *cname_bucket(shard, hash); e; e = e->hash_next)
+		if ((e->hash == hash) && (! strcmp(e->name, name)))
+			return e;
+	return NULL;
+} /* cname_shard_find */
+
+static void
+cname_lru_unlink(cname_shard_t *shard, cname_entry_t *e)
+{
+	if (e->lru_prev)
+		e->lru_prev->lru_next = e->lru_next;
+	else
+		shard->lru_head = e->lru_next;
+	if (e->lru_next)
+		e->lru_next->lru_prev = e->lru_prev;
+	else
+		shard->lru_tail = e->lru_prev;
+	e->lru_prev = e->lru_next = NULL;
+} /* cname_lru_unlink */
+
+static void
+cname_lru_push(cname_shard_t *shard, cname_entry_t *e)
+{
+	e->lru_prev = NULL;
+	e->lru_next = shard->lru_head;
+	if (shard->lru_head)
+		shard->lru_head->lru_prev = e;
+	else
+		shard->lru_tail = e;
+	shard->lru_head = e;
+} /* cname_lru_push */
+
+/* the shard has to be locked by the caller */
+static void
+cname_shard_remove(cname_shard_t *shard, cname_entry_t *e)
+{
+	cname_entry_t **ep;
+
+	for (ep = cname_bucket(shard, e->hash); *ep; ep = &(*ep)->hash_next) {
+		if (*ep == e) {
+			*ep = e->hash_next;
+			break;
+		}
+	}
+
+	cname_lru_unlink(shard, e);
+	cname_entry_destroy(e);
+	--shard->entries_num;
+} /* cname_shard_remove */
+
+/* the shard has to be locked by the caller */
+static void
+cname_shard_clear(cname_shard_t *shard)
+{
+	cname_entry_t *e = shard->lru_head;
+
+	while (e) {
+		cname_entry_t *next = e->lru_next;
+		cname_entry_destroy(e);
+		e = next;
+	}
+
+	if (shard->buckets)
+		free(shard->buckets);
+	shard->buckets = NULL;
+	shard->entries_num = 0;
+	shard->lru_head = shard->lru_tail = NULL;
+	++shard->generation;
+} /* cname_shard_clear */
+
+static void
+cname_cache_flush(void)
+{
+	size_t i;
+
+	pthread_once(&cname_cache_once, cname_cache_init);
+	for (i = 0; i < CNAME_CACHE_SHARDS; ++i) {
+		pthread_mutex_lock(&cname_cache[i].lock);
+		cname_shard_clear(cname_cache + i);
+		pthread_mutex_unlock(&cname_cache[i].lock);
+	}
+} /* cname_cache_flush */
+
+/*
+ * Look up the canonical name of 'name'. Returns 0 on a cache hit, in which
+ * case 'cname' is set to a copy of the cached canonical name (or NULL if the
+ * name is to be left unchanged). Else, 'generation' is set to a value to be
+ * passed to cname_cache_insert.
+ */
+static int
+cname_cache_lookup(const char *name, char **cname, unsigned *generation)
+{
+	uint32_t hash = cname_hash(name);
+	cname_shard_t *shard = cname_shard(hash);
+	sdb_time_t now = sdb_gettime();
+	cname_entry_t *e;
+	int status = -1;
+
+	pthread_mutex_lock(&shard->lock);
+	*generation = shard->generation;
+	if (! shard->max_entries) {
+		pthread_mutex_unlock(&shard->lock);
+		return -1;
+	}
+
+	e = cname_shard_find(shard, name, hash);
+	if (e && (e->expires <= now)) {
+		cname_shard_remove(shard, e);
+		e = NULL;
+	}
+
+	if (e) {
+		*cname = NULL;
+		if (e->cname)
+			*cname = strdup(e->cname);
+		if ((! e->cname) || *cname) {
+			cname_lru_unlink(shard, e);
+			cname_lru_push(shard, e);
+			status = 0;
+		}
+	}
+
+	if (status)
+		++shard->misses;
+	else
+		++shard->hits;
+	pthread_mutex_unlock(&shard->lock);
+	return status;
+} /* cname_cache_lookup */
+
+/*
+ * Cache the canonical name of 'name'; 'cname' may be NULL for negative
+ * entries. Nothing is cached if the shard was flushed since 'generation' was
+ * looked up, as the result might stem from outdated callbacks.
+ */
+static void
+cname_cache_insert(const char *name, const char *cname, unsigned generation)
+{
+	uint32_t hash = cname_hash(name);
+	cname_shard_t *shard = cname_shard(hash);
+	sdb_time_t now = sdb_gettime();
+	sdb_time_t ttl;
+	cname_entry_t *e;
+
+	pthread_mutex_lock(&shard->lock);
+	ttl = cname ? shard->ttl : shard->negative_ttl;
+	if ((! shard->max_entries) || (! ttl)
+			|| (shard->generation != generation)) {
+		pthread_mutex_unlock(&shard->lock);
+		return;
+	}
+
+	if (! shard->buckets) {
+		shard->buckets = calloc(shard->buckets_num, sizeof(*shard->buckets));
+		if (! shard->buckets) {
+			pthread_mutex_unlock(&shard->lock);
+			return;
+		}
+	}
+
+	e = cname_shard_find(shard, name, hash);
+	if (e)
+		cname_shard_remove(shard, e);
+	while (shard->entries_num >= shard->max_entries)
+		cname_shard_remove(shard, shard->lru_tail);
+
+	e = calloc(1, sizeof(*e));
+	if (e) {
+		e->name = strdup(name);
+		if (cname)
+			e->cname = strdup(cname);
+	}
+	if ((! e) || (! e->name) || (cname && (! e->cname))) {
+		pthread_mutex_unlock(&shard->lock);
+		cname_entry_destroy(e);
+		return;
+	}
+
+	e->hash = hash;
+	e->expires = now + ttl;
+	e->hash_next = *cname_bucket(shard, hash);
+	*cname_bucket(shard, hash) = e;
+	cname_lru_push(shard, e);
+	++shard->entries_num;
+	pthread_mutex_unlock(&shard->lock);
+} /* cname_cache_insert */
+
 /*
  * private helper functions
  */
@@ -196,19 +521,6 @@ ctx_key_init(void)
 	plugin_ctx_key_initialized = 1;
 } /* ctx_key_init */
 
-static int
-plugin_cmp_next_update(const sdb_object_t *a, const sdb_object_t *b)
-{
-	const collector_t *ccb1 = (const collector_t *)a;
-	const collector_t *ccb2 = (const collector_t *)b;
-
-	assert(ccb1 && ccb2);
-
-	return (ccb1->ccb_next_update > ccb2->ccb_next_update)
-		? 1 : (ccb1->ccb_next_update < ccb2->ccb_next_update)
-		? -1 : 0;
-} /* plugin_cmp_next_update */
-
 static int
 plugin_lookup_by_name(const sdb_object_t *obj, const void *id)
 {
@@ -234,6 +546,7 @@ static void
 plugin_unregister_by_name(const char *plugin_name)
 {
 	sdb_object_t *obj;
+	bool cname_changed = 0;
 	size_t i;
 
 	for (i = 0; i < SDB_STATIC_ARRAY_LEN(all_lists); ++i) {
@@ -253,9 +566,15 @@ plugin_unregister_by_name(const char *plugin_name)
 			sdb_log(SDB_LOG_INFO, "Unregistering %s callback '%s' (module %s)",
 					type, cb->super.name, cb->cb_ctx->info.plugin_name);
 			sdb_object_deref(SDB_OBJ(cb));
+
+			if (list == cname_list)
+				cname_changed = 1;
 		}
 	}
 
+	if (cname_changed)
+		cname_cache_flush();
+
 	obj = sdb_llist_search_by_name(all_plugins, plugin_name);
 	/* when called from sdb_plugin_reconfigure_finish, the object has already
 	 * been removed from the list */
@@ -339,6 +658,48 @@ query_store_attribute(sdb_store_attribute_t *attr, sdb_object_t *user_data)
 static sdb_store_writer_t query_writer = {
 	query_store_host, query_store_service,
 	query_store_metric, query_store_attribute,
+	/* store_batch = */ NULL, /* flags = */ 0,
+};
+
+/*
+ * prepared queries:
+ * A query prepared by a store reader along with a reference to the reader.
+ * The query may be executed as long as the reader remains registered.
+ */
+
+typedef struct {
+	sdb_object_t super;
+	reader_t *reader;
+	sdb_object_t *q;
+} prepared_query_t;
+#define PREPARED_QUERY(obj) ((prepared_query_t *)(obj))
+
+static int
+prepared_query_init(sdb_object_t *obj, va_list ap)
+{
+	prepared_query_t *pq = PREPARED_QUERY(obj);
+
+	pq->reader = va_arg(ap, reader_t *);
+	sdb_object_ref(SDB_OBJ(pq->reader));
+	/* take ownership of the reader's query object */
+	pq->q = va_arg(ap, sdb_object_t *);
+	return 0;
+} /* prepared_query_init */
+
+static void
+prepared_query_destroy(sdb_object_t *obj)
+{
+	prepared_query_t *pq = PREPARED_QUERY(obj);
+
+	sdb_object_deref(pq->q);
+	sdb_object_deref(SDB_OBJ(pq->reader));
+} /* prepared_query_destroy */
+
+static sdb_type_t prepared_query_type = {
+	sizeof(prepared_query_t),
+
+	prepared_query_init,
+	prepared_query_destroy
 };
 
 /*
@@ -811,6 +1172,7 @@ interval_fetcher_host(sdb_store_host_t *host, sdb_object_t *user_data)
 	interval_fetcher_t *lu = SDB_OBJ_WRAPPER(user_data)->data;
 	lu->obj_type = SDB_HOST;
 	lu->last_update = host->last_update;
+	lu->interval = host->interval;
 	return 0;
 } /* interval_fetcher_host */
 
@@ -820,6 +1182,7 @@ interval_fetcher_service(sdb_store_service_t *svc, sdb_object_t *user_data)
 	interval_fetcher_t *lu = SDB_OBJ_WRAPPER(user_data)->data;
 	lu->obj_type = SDB_SERVICE;
 	lu->last_update = svc->last_update;
+	lu->interval = svc->interval;
 	return 0;
 } /* interval_fetcher_service */
 
@@ -829,6 +1192,7 @@ interval_fetcher_metric(sdb_store_metric_t *metric, sdb_object_t *user_data)
 	interval_fetcher_t *lu = SDB_OBJ_WRAPPER(user_data)->data;
 	lu->obj_type = SDB_METRIC;
 	lu->last_update = metric->last_update;
+	lu->interval = metric->interval;
 	return 0;
 } /* interval_fetcher_metric */
 
@@ -838,14 +1202,24 @@ interval_fetcher_attr(sdb_store_attribute_t *attr, sdb_object_t *user_data)
 	interval_fetcher_t *lu = SDB_OBJ_WRAPPER(user_data)->data;
 	lu->obj_type = SDB_ATTRIBUTE;
 	lu->last_update = attr->last_update;
+	lu->interval = attr->interval;
 	return 0;
 } /* interval_fetcher_attr */
 
 static sdb_store_writer_t interval_fetcher = {
 	interval_fetcher_host, interval_fetcher_service,
 	interval_fetcher_metric, interval_fetcher_attr,
+	/* store_batch = */ NULL, /* flags = */ 0,
 };
 
+static int
+writer_needs_interval(const sdb_object_t *obj,
+		const void __attribute__((unused)) *user_data)
+{
+	/* return 0 (match) if the writer relies on the caller */
+	return (CONST_WRITER(obj)->impl.flags & SDB_STORE_WRITER_UPSERT) != 0;
+} /* writer_needs_interval */
+
 static int
 get_interval(int obj_type, const char *hostname,
 		int parent_type, const char *parent, const char *name,
@@ -863,6 +1237,13 @@ get_interval(int obj_type, const char *hostname,
 
 	assert(name);
 
+	if (! sdb_llist_search(writer_list, writer_needs_interval, NULL)) {
+		/* all writers determine the interval while storing the object,
+		 * avoiding a round-trip through the query interface */
+		*interval_out = 0;
+		return 0;
+	}
+
 	if (hostname)
 		strncpy(hn, hostname, sizeof(hn));
 	if (parent)
@@ -915,6 +1296,309 @@ get_backend(char **backends, size_t *backends_num)
 	*backends_num = 1;
 } /* get_backend */
 
+/*
+ * collector scheduler:
+ * Idle collectors are kept in a min-heap ordered by their next update. A
+ * pool of worker threads picks the earliest due collector whose plugin has
+ * not reached its concurrency limit, runs it, and puts it back into the
+ * heap. Waiting workers wake up at least once a second to check whether the
+ * loop should terminate.
+ */
+
+static void
+sched_timedwait(pthread_cond_t *cond, pthread_mutex_t *lock,
+		sdb_time_t until)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t)SDB_TIME_TO_SECS(until);
+	ts.tv_nsec = (long)(until % SECS_TO_SDB_TIME(1));
+	pthread_cond_timedwait(cond, lock, &ts);
+} /* sched_timedwait */
+
+/* time source of the scheduler; replaceable by the test-suite */
+static const sdb_plugin_sched_clock_t system_clock = {
+	sdb_gettime, sched_timedwait,
+};
+static sdb_plugin_sched_clock_t sched_clock = {
+	sdb_gettime, sched_timedwait,
+};
+
+typedef struct {
+	sdb_plugin_loop_t *loop;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	/* all collectors managed by the scheduler (holding a reference) */
+	collector_t **collectors;
+	size_t collectors_num;
+
+	/* min-heap of idle collectors */
+	collector_t **heap;
+	size_t heap_num;
+
+	/* temporary storage for sched_next */
+	collector_t **deferred;
+} scheduler_t;
+
+static void
+sched_swap(scheduler_t *s, size_t i, size_t j)
+{
+	collector_t *tmp = s->heap[i];
+	s->heap[i] = s->heap[j];
+	s->heap[j] = tmp;
+} /* sched_swap */
+
+/* the heap can hold all collectors, so this cannot fail */
+static void
+sched_push(scheduler_t *s, collector_t *ccb)
+{
+	size_t i = s->heap_num;
+
+	assert(s->heap_num < s->collectors_num);
+	s->heap[s->heap_num++] = ccb;
+
+	while (i > 0) {
+		size_t parent = (i - 1) / 2;
+		if (s->heap[parent]->ccb_next_update <= s->heap[i]->ccb_next_update)
+			break;
+		sched_swap(s, i, parent);
+		i = parent;
+	}
+} /* sched_push */
+
+static collector_t *
+sched_pop(scheduler_t *s)
+{
+	collector_t *top;
+	size_t i = 0;
+
+	if (! s->heap_num)
+		return NULL;
+
+	top = s->heap[0];
+	s->heap[0] = s->heap[--s->heap_num];
+
+	while (1) {
+		size_t l = 2 * i + 1, r = 2 * i + 2, min = i;
+
+		if ((l < s->heap_num) && (s->heap[l]->ccb_next_update
+					< s->heap[min]->ccb_next_update))
+			min = l;
+		if ((r < s->heap_num) && (s->heap[r]->ccb_next_update
+					< s->heap[min]->ccb_next_update))
+			min = r;
+		if (min == i)
+			break;
+		sched_swap(s, i, min);
+		i = min;
+	}
+	return top;
+} /* sched_pop */
+
+static bool
+sched_can_run(const collector_t *ccb)
+{
+	const ctx_t *ctx = ccb->ccb_ctx;
+
+	if ((! ctx) || (! ctx->public.max_concurrency))
+		return 1;
+	return ctx->running < ctx->public.max_concurrency;
+} /* sched_can_run */
+
+/* Remove and return the earliest collector which may be run without
+ * exceeding its plugin's concurrency limit. The scheduler has to be locked
+ * by the caller. */
+static collector_t *
+sched_next(scheduler_t *s)
+{
+	collector_t *ccb;
+	size_t deferred_num = 0, i;
+
+	while ((ccb = sched_pop(s)) && (! sched_can_run(ccb)))
+		s->deferred[deferred_num++] = ccb;
+	for (i = 0; i < deferred_num; ++i)
+		sched_push(s, s->deferred[i]);
+	return ccb;
+} /* sched_next */
+
+static sdb_time_t
+sched_jitter(const collector_t *ccb, const sdb_plugin_loop_t *loop,
+		unsigned *seed)
+{
+	sdb_time_t interval = ccb->ccb_interval;
+	sdb_time_t max = loop->max_jitter;
+	int r;
+
+	if (! interval)
+		interval = loop->default_interval;
+	if (interval && (interval < max))
+		max = interval;
+	if (! max)
+		return 0;
+
+	r = rand_r(seed);
+	return (sdb_time_t)((double)max * ((double)r / ((double)RAND_MAX + 1.0)));
+} /* sched_jitter */
+
+/* Run the specified collector and reschedule it. The scheduler has to be
+ * locked by the caller; the lock is released while running the callback. */
+static void
+sched_run(scheduler_t *s, collector_t *ccb)
+{
+	sdb_plugin_collector_cb callback;
+	ctx_t *old_ctx;
+
+	sdb_time_t interval, now;
+
+	if (ccb->ccb_ctx)
+		++ccb->ccb_ctx->running;
+	pthread_mutex_unlock(&s->lock);
+
+	callback = (sdb_plugin_collector_cb)ccb->ccb_callback;
+
+	old_ctx = ctx_set(ccb->ccb_ctx);
+	if (callback(ccb->ccb_user_data))
+		sdb_log(SDB_LOG_WARNING, "Collector '%s' failed; "
+				"retrying on its next update.", SDB_OBJ(ccb)->name);
+	ctx_set(old_ctx);
+
+	interval = ccb->ccb_interval;
+	if (! interval)
+		interval = s->loop->default_interval;
+
+	if (interval) {
+		ccb->ccb_next_update += interval;
+
+		if (! (now = sched_clock.gettime())) {
+			char errbuf[1024];
+			sdb_log(SDB_LOG_ERR, "Failed to determine current "
+					"time in collector main loop: %s",
+					sdb_strerror(errno, errbuf, sizeof(errbuf)));
+			now = ccb->ccb_next_update;
+		}
+
+		if (now > ccb->ccb_next_update) {
+			sdb_log(SDB_LOG_WARNING, "Plugin '%s' took too "
+					"long; skipping iterations to keep up.",
+					SDB_OBJ(ccb)->name);
+			ccb->ccb_next_update = now;
+		}
+	}
+	else
+		sdb_log(SDB_LOG_WARNING, "No interval configured "
+				"for plugin '%s'; skipping any further "
+				"iterations.", SDB_OBJ(ccb)->name);
+
+	pthread_mutex_lock(&s->lock);
+	if (ccb->ccb_ctx)
+		--ccb->ccb_ctx->running;
+	if (interval)
+		sched_push(s, ccb);
+	/* the plugin's concurrency limit might have blocked other collectors */
+	pthread_cond_broadcast(&s->cond);
+} /* sched_run */
+
+static void *
+sched_worker(void *arg)
+{
+	scheduler_t *s = arg;
+
+	pthread_mutex_lock(&s->lock);
+	while (s->loop->do_loop) {
+		collector_t *ccb = sched_next(s);
+		sdb_time_t now, wakeup;
+
+		if (! (now = sched_clock.gettime())) {
+			char errbuf[1024];
+			sdb_log(SDB_LOG_ERR, "Failed to determine current "
+					"time in collector main loop: %s",
+					sdb_strerror(errno, errbuf, sizeof(errbuf)));
+			if (ccb)
+				now = ccb->ccb_next_update;
+		}
+
+		if (ccb && (ccb->ccb_next_update <= now)) {
+			sched_run(s, ccb);
+			continue;
+		}
+
+		wakeup = now + SECS_TO_SDB_TIME(1);
+		if (ccb) {
+			if (ccb->ccb_next_update < wakeup)
+				wakeup = ccb->ccb_next_update;
+			sched_push(s, ccb);
+		}
+		sched_clock.wait(&s->cond, &s->lock, wakeup);
+	}
+	pthread_mutex_unlock(&s->lock);
+	return NULL;
+} /* sched_worker */
+
+static void
+sched_destroy(scheduler_t *s)
+{
+	size_t i;
+
+	for (i = 0; i < s->collectors_num; ++i)
+		sdb_object_deref(SDB_OBJ(s->collectors[i]));
+	if (s->collectors)
+		free(s->collectors);
+	if (s->heap)
+		free(s->heap);
+	if (s->deferred)
+		free(s->deferred);
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->lock);
+} /* sched_destroy */
+
+static int
+sched_init(scheduler_t *s, sdb_plugin_loop_t *loop)
+{
+	sdb_llist_iter_t *iter;
+	size_t len = sdb_llist_len(collector_list);
+	unsigned seed;
+	sdb_time_t now;
+
+	memset(s, 0, sizeof(*s));
+	s->loop = loop;
+	pthread_mutex_init(&s->lock, /* attr = */ NULL);
+	pthread_cond_init(&s->cond, /* attr = */ NULL);
+
+	s->collectors = calloc(len, sizeof(*s->collectors));
+	s->heap = calloc(len, sizeof(*s->heap));
+	s->deferred = calloc(len, sizeof(*s->deferred));
+	iter = sdb_llist_get_iter(collector_list);
+	if ((! s->collectors) || (! s->heap) || (! s->deferred) || (! iter)) {
+		sdb_llist_iter_destroy(iter);
+		sched_destroy(s);
+		return -1;
+	}
+
+	if (! (now = sched_clock.gettime())) {
+		char errbuf[1024];
+		sdb_log(SDB_LOG_ERR, "Failed to determine current "
+				"time in collector main loop: %s",
+				sdb_strerror(errno, errbuf, sizeof(errbuf)));
+	}
+	seed = (unsigned)now;
+
+	while (sdb_llist_iter_has_next(iter) && (s->collectors_num < len)) {
+		collector_t *ccb = CCB(sdb_llist_iter_get_next(iter));
+
+		sdb_object_ref(SDB_OBJ(ccb));
+		s->collectors[s->collectors_num++] = ccb;
+
+		/* spread the initial updates of all collectors */
+		if (ccb->ccb_next_update <= now)
+			ccb->ccb_next_update = now + sched_jitter(ccb, loop, &seed);
+		sched_push(s, ccb);
+	}
+	sdb_llist_iter_destroy(iter);
+	return 0;
+} /* sched_init */
+
 /*
  * public API
  */
@@ -963,22 +1647,54 @@ sdb_plugin_load(const char *basedir, const char *name,
 } /* sdb_plugin_load */
 
 int
-sdb_plugin_set_info(sdb_plugin_info_t *info, int type, ...)
+sdb_plugin_builtin_begin(const char *name, const sdb_plugin_ctx_t *plugin_ctx)
 {
-	va_list ap;
+	ctx_t *ctx;
 
-	if (! info)
+	if ((! name) || (! *name))
 		return -1;
 
-	va_start(ap, type);
+	if (ctx_get())
+		sdb_log(SDB_LOG_WARNING, "Discarding old plugin context");
 
-	switch (type) {
-		case SDB_PLUGIN_INFO_DESC:
-			{
-				char *desc = va_arg(ap, char *);
-				if (desc) {
-					if (info->description)
-						free(info->description);
+	ctx = ctx_create(name);
+	if (! ctx) {
+		sdb_log(SDB_LOG_ERR, "Failed to initialize plugin context");
+		return -1;
+	}
+
+	ctx->info.plugin_name = strdup(name);
+	if (plugin_ctx)
+		ctx->public = *plugin_ctx;
+
+	/* the current context and any registered callbacks own the context */
+	sdb_object_deref(SDB_OBJ(ctx));
+	return 0;
+} /* sdb_plugin_builtin_begin */
+
+void
+sdb_plugin_builtin_end(void)
+{
+	ctx_set(NULL);
+} /* sdb_plugin_builtin_end */
+
+int
+sdb_plugin_set_info(sdb_plugin_info_t *info, int type, ...)
+{
+	va_list ap;
+
+	if (! info)
+		return -1;
+
+	va_start(ap, type);
+
+	switch (type) {
+		case SDB_PLUGIN_INFO_DESC:
+			{
+				char *desc = va_arg(ap, char *);
+				if (desc) {
+					if (info->description)
+						free(info->description);
 					info->description = strdup(desc);
 				}
 			}
@@ -1070,9 +1786,14 @@ sdb_plugin_register_cname(const char *name, sdb_plugin_cname_cb callback,
 		sdb_object_t *user_data)
 {
 	char cb_name[1024];
-	return plugin_add_impl(&cname_list, callback_type, "cname",
+	int status;
+
+	status = plugin_add_impl(&cname_list, callback_type, "cname",
 			plugin_get_name(name, cb_name, sizeof(cb_name)),
 			callback, user_data);
+	if (! status)
+		cname_cache_flush();
+	return status;
 } /* sdb_plugin_register_cname */
 
 int
@@ -1111,7 +1832,7 @@ sdb_plugin_register_collector(const char *name, sdb_plugin_collector_cb callback
 		CCB(obj)->ccb_interval = ctx->public.interval;
 	}
 
-	if (! (CCB(obj)->ccb_next_update = sdb_gettime())) {
+	if (! (CCB(obj)->ccb_next_update = sched_clock.gettime())) {
 		char errbuf[1024];
 		sdb_log(SDB_LOG_ERR, "Failed to determine current time: %s",
 				sdb_strerror(errno, errbuf, sizeof(errbuf)));
@@ -1119,8 +1840,7 @@ sdb_plugin_register_collector(const char *name, sdb_plugin_collector_cb callback
 		return -1;
 	}
 
-	if (sdb_llist_insert_sorted(collector_list, obj,
-				plugin_cmp_next_update)) {
+	if (sdb_llist_append(collector_list, obj)) {
 		sdb_object_deref(obj);
 		return -1;
 	}
@@ -1180,6 +1900,7 @@ sdb_plugin_unregister_all(void)
 		sdb_log(SDB_LOG_INFO, "Unregistered %zu %s callback%s",
 				len, type, len == 1 ? "" : "s");
 	}
+	cname_cache_flush();
 } /* sdb_plugin_unregister_all */
 
 sdb_plugin_ctx_t
@@ -1354,6 +2075,7 @@ sdb_plugin_init_all(void)
 int
 sdb_plugin_shutdown_all(void)
 {
+	sdb_plugin_cname_cache_stats_t stats;
 	sdb_llist_iter_t *iter;
 	int ret = 0;
 
@@ -1378,13 +2100,29 @@ sdb_plugin_shutdown_all(void)
 		ctx_set(old_ctx);
 	}
 	sdb_llist_iter_destroy(iter);
+
+	sdb_plugin_cname_cache_stats(&stats);
+	if (stats.hits || stats.misses)
+		sdb_log(SDB_LOG_INFO, "cname cache: %"PRIu64" hits, "
+				"%"PRIu64" misses, %zu entries",
+				stats.hits, stats.misses, stats.entries);
 	return ret;
 } /* sdb_plugin_shutdown_all */
 
+void
+sdb_plugin_set_sched_clock(const sdb_plugin_sched_clock_t *clock)
+{
+	sched_clock = clock ? *clock : system_clock;
+} /* sdb_plugin_set_sched_clock */
+
 int
 sdb_plugin_collector_loop(sdb_plugin_loop_t *loop)
 {
-	if (! collector_list) {
+	scheduler_t sched;
+	pthread_t *threads;
+	size_t num_threads, i;
+
+	if (! sdb_llist_len(collector_list)) {
 		sdb_log(SDB_LOG_WARNING, "No collectors registered. "
 				"Quiting main loop.");
 		return -1;
@@ -1393,113 +2131,75 @@ sdb_plugin_collector_loop(sdb_plugin_loop_t *loop)
 	if (! loop)
 		return -1;
 
-	while (loop->do_loop) {
-		sdb_plugin_collector_cb callback;
-		ctx_t *old_ctx;
-
-		sdb_time_t interval, now;
-
-		sdb_object_t *obj = sdb_llist_shift(collector_list);
-		if (! obj)
-			return -1;
-
-		callback = (sdb_plugin_collector_cb)CCB(obj)->ccb_callback;
-
-		if (! (now = sdb_gettime())) {
-			char errbuf[1024];
-			sdb_log(SDB_LOG_ERR, "Failed to determine current "
-					"time in collector main loop: %s",
-					sdb_strerror(errno, errbuf, sizeof(errbuf)));
-			now = CCB(obj)->ccb_next_update;
-		}
-
-		if (now < CCB(obj)->ccb_next_update) {
-			interval = CCB(obj)->ccb_next_update - now;
-
-			errno = 0;
-			while (loop->do_loop && sdb_sleep(interval, &interval)) {
-				if (errno != EINTR) {
-					char errbuf[1024];
-					sdb_log(SDB_LOG_ERR, "Failed to sleep "
-							"in collector main loop: %s",
-							sdb_strerror(errno, errbuf, sizeof(errbuf)));
-					sdb_llist_insert_sorted(collector_list, obj,
-							plugin_cmp_next_update);
-					sdb_object_deref(obj);
-					return -1;
-				}
-				errno = 0;
-			}
-
-			if (! loop->do_loop) {
-				/* put back; don't worry about errors */
-				sdb_llist_insert_sorted(collector_list, obj,
-						plugin_cmp_next_update);
-				sdb_object_deref(obj);
-				return 0;
-			}
-		}
+	if (sched_init(&sched, loop)) {
+		sdb_log(SDB_LOG_ERR, "Failed to initialize collector scheduler");
+		return -1;
+	}
 
-		old_ctx = ctx_set(CCB(obj)->ccb_ctx);
-		if (callback(CCB(obj)->ccb_user_data)) {
-			/* XXX */
-		}
-		ctx_set(old_ctx);
+	/* there's no use in more threads than collectors */
+	num_threads = loop->num_threads;
+	if (num_threads > sched.collectors_num)
+		num_threads = sched.collectors_num;
+	if (! num_threads)
+		num_threads = 1;
 
-		interval = CCB(obj)->ccb_interval;
-		if (! interval)
-			interval = loop->default_interval;
-		if (! interval) {
-			sdb_log(SDB_LOG_WARNING, "No interval configured "
-					"for plugin '%s'; skipping any further "
-					"iterations.", obj->name);
-			sdb_object_deref(obj);
-			continue;
-		}
+	threads = calloc(num_threads, sizeof(*threads));
+	if (! threads) {
+		sched_destroy(&sched);
+		return -1;
+	}
 
-		CCB(obj)->ccb_next_update += interval;
+	sdb_log(SDB_LOG_INFO, "Starting %zu collector thread%s "
+			"managing %zu collector%s", num_threads,
+			num_threads == 1 ? "" : "s", sched.collectors_num,
+			sched.collectors_num == 1 ? "" : "s");
 
-		if (! (now = sdb_gettime())) {
+	/* the current thread acts as the first worker */
+	for (i = 1; i < num_threads; ++i) {
+		errno = 0;
+		if (pthread_create(&threads[i], /* attr = */ NULL,
+					sched_worker, /* arg = */ &sched)) {
 			char errbuf[1024];
-			sdb_log(SDB_LOG_ERR, "Failed to determine current "
-					"time in collector main loop: %s",
+			sdb_log(SDB_LOG_ERR, "Failed to create collector thread: %s",
 					sdb_strerror(errno, errbuf, sizeof(errbuf)));
-			now = CCB(obj)->ccb_next_update;
+			num_threads = i;
+			break;
 		}
+	}
 
-		if (now > CCB(obj)->ccb_next_update) {
-			sdb_log(SDB_LOG_WARNING, "Plugin '%s' took too "
-					"long; skipping iterations to keep up.",
-					obj->name);
-			CCB(obj)->ccb_next_update = now;
-		}
+	sched_worker(&sched);
 
-		if (sdb_llist_insert_sorted(collector_list, obj,
-					plugin_cmp_next_update)) {
-			sdb_log(SDB_LOG_ERR, "Failed to re-insert plugin '%s' into "
-					"collector list. Unable to further use the plugin.",
-					obj->name);
-			sdb_object_deref(obj);
-			return -1;
-		}
+	for (i = 1; i < num_threads; ++i)
+		pthread_join(threads[i], NULL);
 
-		/* pass control back to the list */
-		sdb_object_deref(obj);
-	}
+	free(threads);
+	sched_destroy(&sched);
 	return 0;
-} /* sdb_plugin_read_loop */
+} /* sdb_plugin_collector_loop */
 
 char *
 sdb_plugin_cname(char *hostname)
 {
 	sdb_llist_iter_t *iter;
+	unsigned generation = 0;
+	char *name, *cached = NULL;
 
 	if (! hostname)
 		return NULL;
 
-	if (! cname_list)
+	if (! sdb_llist_len(cname_list))
 		return hostname;
 
+	if (! cname_cache_lookup(hostname, &cached, &generation)) {
+		if (! cached)
+			return hostname;
+		free(hostname);
+		return cached;
+	}
+
+	/* the callbacks may free the original hostname */
+	name = strdup(hostname);
+
 	iter = sdb_llist_get_iter(cname_list);
 	while (sdb_llist_iter_has_next(iter)) {
 		sdb_plugin_cname_cb callback;
@@ -1517,9 +2217,52 @@ sdb_plugin_cname(char *hostname)
 		/* else: don't change hostname */
 	}
 	sdb_llist_iter_destroy(iter);
+
+	if (name) {
+		cname_cache_insert(name,
+				strcmp(name, hostname) ? hostname : NULL, generation);
+		free(name);
+	}
 	return hostname;
 } /* sdb_plugin_cname */
 
+int
+sdb_plugin_cname_cache_configure(const sdb_plugin_cname_cache_opts_t *opts)
+{
+	size_t i;
+
+	if (! opts)
+		return -1;
+
+	pthread_once(&cname_cache_once, cname_cache_init);
+	for (i = 0; i < CNAME_CACHE_SHARDS; ++i) {
+		pthread_mutex_lock(&cname_cache[i].lock);
+		cname_shard_clear(cname_cache + i);
+		cname_shard_setup(i, opts);
+		pthread_mutex_unlock(&cname_cache[i].lock);
+	}
+	return 0;
+} /* sdb_plugin_cname_cache_configure */
+
+void
+sdb_plugin_cname_cache_stats(sdb_plugin_cname_cache_stats_t *stats)
+{
+	size_t i;
+
+	if (! stats)
+		return;
+
+	memset(stats, 0, sizeof(*stats));
+	pthread_once(&cname_cache_once, cname_cache_init);
+	for (i = 0; i < CNAME_CACHE_SHARDS; ++i) {
+		pthread_mutex_lock(&cname_cache[i].lock);
+		stats->hits += cname_cache[i].hits;
+		stats->misses += cname_cache[i].misses;
+		stats->entries += cname_cache[i].entries_num;
+		pthread_mutex_unlock(&cname_cache[i].lock);
+	}
+} /* sdb_plugin_cname_cache_stats */
+
 int
 sdb_plugin_log(int prio, const char *msg)
 {
@@ -1662,23 +2405,16 @@ sdb_plugin_describe_timeseries(const char *type, const char *id)
 	return ts_info;
 } /* sdb_plugin_describe_timeseries */
 
-int
-sdb_plugin_query(sdb_ast_node_t *ast,
-		sdb_store_writer_t *w, sdb_object_t *wd,
-		sdb_query_opts_t *opts, sdb_strbuf_t *errbuf)
+sdb_object_t *
+sdb_plugin_prepare_query(sdb_ast_node_t *ast, sdb_strbuf_t *errbuf)
 {
-	query_writer_t qw = QUERY_WRITER_INIT(w, wd);
 	reader_t *reader;
-	sdb_object_t *q;
+	sdb_object_t *q, *pq;
 
 	size_t n = sdb_llist_len(reader_list);
-	int status = 0;
 
 	if (! ast)
-		return 0;
-
-	if (opts)
-		qw.opts = *opts;
+		return NULL;
 
 	if ((ast->type != SDB_AST_TYPE_FETCH)
 			&& (ast->type != SDB_AST_TYPE_LIST)
@@ -1687,7 +2423,7 @@ sdb_plugin_query(sdb_ast_node_t *ast,
 				SDB_AST_TYPE_TO_STRING(ast));
 		sdb_strbuf_sprintf(errbuf, "Cannot execute query of type %s",
 				SDB_AST_TYPE_TO_STRING(ast));
-		return -1;
+		return NULL;
 	}
 
 	if (n != 1) {
@@ -1696,21 +2432,87 @@ sdb_plugin_query(sdb_ast_node_t *ast,
 			: "Cannot execute query: no readers registered";
 		sdb_strbuf_sprintf(errbuf, "%s", msg);
 		sdb_log(SDB_LOG_ERR, "%s", msg);
-		return -1;
+		return NULL;
 	}
 
 	reader = READER(sdb_llist_get(reader_list, 0));
 	assert(reader);
 
 	q = reader->impl.prepare_query(ast, errbuf, reader->r_user_data);
-	if (q)
-		status = reader->impl.execute_query(q, &query_writer, SDB_OBJ(&qw),
-				errbuf, reader->r_user_data);
-	else
-		status = -1;
+	if (! q) {
+		sdb_object_deref(SDB_OBJ(reader));
+		return NULL;
+	}
 
-	sdb_object_deref(SDB_OBJ(q));
+	pq = sdb_object_create(SDB_OBJ(reader)->name, prepared_query_type,
+			reader, q);
+	if (! pq) {
+		sdb_strbuf_sprintf(errbuf, "Out of memory");
+		sdb_object_deref(q);
+	}
 	sdb_object_deref(SDB_OBJ(reader));
+	return pq;
+} /* sdb_plugin_prepare_query */
+
+bool
+sdb_plugin_query_is_valid(sdb_object_t *q)
+{
+	sdb_object_t *reader;
+	bool valid;
+
+	if ((! q) || (sdb_llist_len(reader_list) != 1))
+		return 0;
+
+	reader = sdb_llist_get(reader_list, 0);
+	valid = reader == SDB_OBJ(PREPARED_QUERY(q)->reader);
+	sdb_object_deref(reader);
+	return valid;
+} /* sdb_plugin_query_is_valid */
+
+int
+sdb_plugin_execute_query(sdb_object_t *q,
+		sdb_store_writer_t *w, sdb_object_t *wd,
+		sdb_query_opts_t *opts, sdb_strbuf_t *errbuf)
+{
+	query_writer_t qw = QUERY_WRITER_INIT(w, wd);
+	reader_t *reader;
+
+	if ((! q) || (! w))
+		return -1;
+
+	if (! sdb_plugin_query_is_valid(q)) {
+		sdb_strbuf_sprintf(errbuf, "Cannot execute query: "
+				"store reader '%s' is no longer registered", q->name);
+		sdb_log(SDB_LOG_ERR, "Cannot execute query: "
+				"store reader '%s' is no longer registered", q->name);
+		return -1;
+	}
+
+	if (opts)
+		qw.opts = *opts;
+
+	reader = PREPARED_QUERY(q)->reader;
+	return reader->impl.execute_query(PREPARED_QUERY(q)->q,
+			&query_writer, SDB_OBJ(&qw), errbuf, reader->r_user_data);
+} /* sdb_plugin_execute_query */
+
+int
+sdb_plugin_query(sdb_ast_node_t *ast,
+		sdb_store_writer_t *w, sdb_object_t *wd,
+		sdb_query_opts_t *opts, sdb_strbuf_t *errbuf)
+{
+	sdb_object_t *q;
+	int status;
+
+	if (! ast)
+		return 0;
+
+	q = sdb_plugin_prepare_query(ast, errbuf);
+	if (! q)
+		return -1;
+
+	status = sdb_plugin_execute_query(q, w, wd, opts, errbuf);
+	sdb_object_deref(q);
 	return status;
 } /* sdb_plugin_query */
 
@@ -2056,5 +2858,473 @@ sdb_plugin_store_metric_attribute(const char *hostname, const char *metric,
 	return status;
 } /* sdb_plugin_store_metric_attribute */
 
+/*
+ * batched store API
+ */
+
+struct sdb_plugin_batch {
+	sdb_object_t super;
+
+	sdb_store_batch_t batch;
+	size_t entries_size;
+
+	/* memory (names, metric stores) referenced by the entries */
+	void **allocs;
+	size_t allocs_num;
+	size_t allocs_size;
+
+	/* the most recently canonicalized host and its original name */
+	char *last_hostname;
+	char *last_cname;
+};
+
+static void
+batch_clear(sdb_plugin_batch_t *b)
+{
+	size_t i;
+
+	for (i = 0; i < b->batch.entries_num; ++i) {
+		sdb_store_batch_entry_t *e = b->batch.entries + i;
+		if (e->type == SDB_ATTRIBUTE)
+			sdb_data_free_datum(&e->obj.attribute.value);
+	}
+	b->batch.entries_num = 0;
+
+	for (i = 0; i < b->allocs_num; ++i)
+		free(b->allocs[i]);
+	b->allocs_num = 0;
+
+	b->last_hostname = b->last_cname = NULL;
+} /* batch_clear */
+
+static void
+plugin_batch_destroy(sdb_object_t *obj)
+{
+	sdb_plugin_batch_t *b = (sdb_plugin_batch_t *)obj;
+
+	batch_clear(b);
+	if (b->batch.entries)
+		free(b->batch.entries);
+	if (b->allocs)
+		free(b->allocs);
+} /* plugin_batch_destroy */
+
+static sdb_type_t batch_type = {
+	sizeof(sdb_plugin_batch_t),
+
+	/* init = */ NULL,
+	plugin_batch_destroy
+};
+
+/* Record dynamically allocated memory to be freed along with the batch's
+ * entries. On error, the memory is freed immediately. */
+static void *
+batch_own(sdb_plugin_batch_t *b, void *ptr)
+{
+	if (! ptr)
+		return NULL;
+
+	if (b->allocs_num >= b->allocs_size) {
+		size_t size = b->allocs_size ? 2 * b->allocs_size : 64;
+		void **tmp = realloc(b->allocs, size * sizeof(*tmp));
+
+		if (! tmp) {
+			free(ptr);
+			return NULL;
+		}
+		b->allocs = tmp;
+		b->allocs_size = size;
+	}
+	b->allocs[b->allocs_num] = ptr;
+	++b->allocs_num;
+	return ptr;
+} /* batch_own */
+
+static char *
+batch_strdup(sdb_plugin_batch_t *b, const char *s)
+{
+	return batch_own(b, strdup(s));
+} /* batch_strdup */
+
+/* Canonicalize the specified hostname, reusing the result of the previous
+ * call if the name did not change. */
+static char *
+batch_cname(sdb_plugin_batch_t *b, const char *hostname)
+{
+	char *name;
+
+	if (b->last_hostname && (! strcmp(b->last_hostname, hostname)))
+		return b->last_cname;
+
+	b->last_hostname = batch_strdup(b, hostname);
+	name = strdup(hostname);
+	if (name)
+		name = sdb_plugin_cname(name);
+	b->last_cname = batch_own(b, name);
+	if ((! b->last_hostname) || (! b->last_cname)) {
+		sdb_log(SDB_LOG_ERR, "Failed to canonicalize hostname '%s'", hostname);
+		b->last_hostname = b->last_cname = NULL;
+		return NULL;
+	}
+	return b->last_cname;
+} /* batch_cname */
+
+/* Returns a new (cleared) entry at the end of the batch. The caller has to
+ * increment entries_num once the entry has been fully initialized. */
+static sdb_store_batch_entry_t *
+batch_add(sdb_plugin_batch_t *b, int type)
+{
+	sdb_store_batch_entry_t *e;
+
+	if (b->batch.entries_num >= b->entries_size) {
+		size_t size = b->entries_size ? 2 * b->entries_size : 64;
+
+		e = realloc(b->batch.entries, size * sizeof(*e));
+		if (! e) {
+			sdb_log(SDB_LOG_ERR, "Failed to allocate batch entries");
+			return NULL;
+		}
+		b->batch.entries = e;
+		b->entries_size = size;
+	}
+
+	e = b->batch.entries + b->batch.entries_num;
+	memset(e, 0, sizeof(*e));
+	e->type = type;
+	return e;
+} /* batch_add */
+
+static int
+batch_attribute(sdb_plugin_batch_t *b, const char *hostname,
+		int parent_type, const char *parent, const char *key,
+		const sdb_data_t *value, sdb_time_t last_update)
+{
+	sdb_store_batch_entry_t *e;
+	char *cname;
+
+	if ((! b) || (! hostname) || (! key) || (! value))
+		return -1;
+
+	cname = batch_cname(b, hostname);
+	if (! cname)
+		return -1;
+	e = batch_add(b, SDB_ATTRIBUTE);
+	if (! e)
+		return -1;
+
+	e->obj.attribute.hostname = cname;
+	e->obj.attribute.parent_type = parent_type;
+	e->obj.attribute.parent = parent_type == SDB_HOST
+		? cname : batch_strdup(b, parent);
+	e->obj.attribute.key = batch_strdup(b, key);
+	e->obj.attribute.last_update = last_update ? last_update : sdb_gettime();
+	if ((! e->obj.attribute.parent) || (! e->obj.attribute.key)
+			|| sdb_data_copy(&e->obj.attribute.value, value)) {
+		sdb_log(SDB_LOG_ERR, "Failed to add attribute '%s' to batch", key);
+		return -1;
+	}
+
+	++b->batch.entries_num;
+	return 0;
+} /* batch_attribute */
+
+static void
+batch_entry_set_backends(sdb_store_batch_entry_t *e,
+		const char * const *backends, size_t backends_num)
+{
+	if (e->type == SDB_HOST) {
+		e->obj.host.backends = backends;
+		e->obj.host.backends_num = backends_num;
+	}
+	else if (e->type == SDB_SERVICE) {
+		e->obj.service.backends = backends;
+		e->obj.service.backends_num = backends_num;
+	}
+	else if (e->type == SDB_METRIC) {
+		e->obj.metric.backends = backends;
+		e->obj.metric.backends_num = backends_num;
+	}
+	else if (e->type == SDB_ATTRIBUTE) {
+		e->obj.attribute.backends = backends;
+		e->obj.attribute.backends_num = backends_num;
+	}
+} /* batch_entry_set_backends */
+
+/* Determine update intervals for writers which do not do that themselves.
+ * Outdated entries are dropped from the batch. Returns a positive value if
+ * any entry has been dropped. */
+static int
+batch_get_intervals(sdb_store_batch_t *batch)
+{
+	size_t i, n = 0;
+	int status = 0;
+
+	for (i = 0; i < batch->entries_num; ++i) {
+		sdb_store_batch_entry_t *e = batch->entries + i;
+		int s = 0;
+
+		if (e->type == SDB_HOST)
+			s = get_interval(SDB_HOST, NULL, -1, NULL, e->obj.host.name,
+					e->obj.host.last_update, &e->obj.host.interval);
+		else if (e->type == SDB_SERVICE)
+			s = get_interval(SDB_SERVICE, e->obj.service.hostname,
+					-1, NULL, e->obj.service.name,
+					e->obj.service.last_update, &e->obj.service.interval);
+		else if (e->type == SDB_METRIC)
+			s = get_interval(SDB_METRIC, e->obj.metric.hostname,
+					-1, NULL, e->obj.metric.name,
+					e->obj.metric.last_update, &e->obj.metric.interval);
+		else if (e->obj.attribute.parent_type == SDB_HOST)
+			s = get_interval(SDB_ATTRIBUTE, e->obj.attribute.hostname,
+					-1, NULL, e->obj.attribute.key,
+					e->obj.attribute.last_update, &e->obj.attribute.interval);
+		else
+			s = get_interval(SDB_ATTRIBUTE, e->obj.attribute.hostname,
+					e->obj.attribute.parent_type, e->obj.attribute.parent,
+					e->obj.attribute.key, e->obj.attribute.last_update,
+					&e->obj.attribute.interval);
+
+		if (s) {
+			if (e->type == SDB_ATTRIBUTE)
+				sdb_data_free_datum(&e->obj.attribute.value);
+			status = 1;
+			continue;
+		}
+		if (n != i)
+			batch->entries[n] = *e;
+		++n;
+	}
+	batch->entries_num = n;
+	return status;
+} /* batch_get_intervals */
+
+/* Fallback for writers not supporting batches. */
+static int
+batch_store_entries(sdb_store_writer_t *w,
+		sdb_store_batch_t *batch, sdb_object_t *user_data)
+{
+	int status = 0;
+	size_t i;
+
+	for (i = 0; i < batch->entries_num; ++i) {
+		sdb_store_batch_entry_t *e = batch->entries + i;
+		int s = -1;
+
+		if (e->type == SDB_HOST)
+			s = w->store_host(&e->obj.host, user_data);
+		else if (e->type == SDB_SERVICE)
+			s = w->store_service(&e->obj.service, user_data);
+		else if (e->type == SDB_METRIC)
+			s = w->store_metric(&e->obj.metric, user_data);
+		else if (e->type == SDB_ATTRIBUTE)
+			s = w->store_attribute(&e->obj.attribute, user_data);
+
+		if (((s > 0) && (status >= 0)) || (s < 0))
+			status = s;
+	}
+	return status;
+} /* batch_store_entries */
+
+sdb_plugin_batch_t *
+sdb_plugin_batch_create(void)
+{
+	return (sdb_plugin_batch_t *)sdb_object_create("batch", batch_type);
+} /* sdb_plugin_batch_create */
+
+int
+sdb_plugin_batch_host(sdb_plugin_batch_t *batch, const char *name,
+		sdb_time_t last_update)
+{
+	sdb_store_batch_entry_t *e;
+	char *cname;
+
+	if ((! batch) || (! name))
+		return -1;
+
+	cname = batch_cname(batch, name);
+	if (! cname)
+		return -1;
+	e = batch_add(batch, SDB_HOST);
+	if (! e)
+		return -1;
+
+	e->obj.host.name = cname;
+	e->obj.host.last_update = last_update ? last_update : sdb_gettime();
+	++batch->batch.entries_num;
+	return 0;
+} /* sdb_plugin_batch_host */
+
+int
+sdb_plugin_batch_service(sdb_plugin_batch_t *batch, const char *hostname,
+		const char *name, sdb_time_t last_update)
+{
+	sdb_store_batch_entry_t *e;
+	sdb_data_t d;
+	char *cname;
+
+	if ((! batch) || (! hostname) || (! name))
+		return -1;
+
+	cname = batch_cname(batch, hostname);
+	if (! cname)
+		return -1;
+	e = batch_add(batch, SDB_SERVICE);
+	if (! e)
+		return -1;
+
+	e->obj.service.hostname = cname;
+	e->obj.service.name = batch_strdup(batch, name);
+	e->obj.service.last_update = last_update ? last_update : sdb_gettime();
+	if (! e->obj.service.name) {
+		sdb_log(SDB_LOG_ERR, "strdup failed");
+		return -1;
+	}
+	last_update = e->obj.service.last_update;
+	++batch->batch.entries_num;
+
+	/* record the hostname as an attribute */
+	d.type = SDB_TYPE_STRING;
+	d.data.string = cname;
+	return batch_attribute(batch, hostname, SDB_SERVICE, name,
+			"hostname", &d, last_update);
+} /* sdb_plugin_batch_service */
+
+int
+sdb_plugin_batch_metric(sdb_plugin_batch_t *batch, const char *hostname,
+		const char *name, sdb_metric_store_t *store, sdb_time_t last_update)
+{
+	sdb_store_batch_entry_t *e;
+	sdb_metric_store_t *s = NULL;
+	sdb_data_t d;
+	char *cname;
+
+	if ((! batch) || (! hostname) || (! name))
+		return -1;
+
+	cname = batch_cname(batch, hostname);
+	if (! cname)
+		return -1;
+	e = batch_add(batch, SDB_METRIC);
+	if (! e)
+		return -1;
+
+	e->obj.metric.hostname = cname;
+	e->obj.metric.name = batch_strdup(batch, name);
+	e->obj.metric.last_update = last_update ? last_update : sdb_gettime();
+	if (! e->obj.metric.name) {
+		sdb_log(SDB_LOG_ERR, "strdup failed");
+		return -1;
+	}
+
+	if (store && store->type && store->id) {
+		s = batch_own(batch, calloc(1, sizeof(*s)));
+		if (s) {
+			s->type = batch_strdup(batch, store->type);
+			s->id = batch_strdup(batch, store->id);
+			s->last_update = store->last_update < last_update
+				? last_update : store->last_update;
+		}
+		if ((! s) || (! s->type) || (! s->id)) {
+			sdb_log(SDB_LOG_ERR, "Failed to add metric '%s/%s' to batch",
+					hostname, name);
+			return -1;
+		}
+		e->obj.metric.stores = s;
+		e->obj.metric.stores_num = 1;
+	}
+	last_update = e->obj.metric.last_update;
+	++batch->batch.entries_num;
+
+	/* record the hostname as an attribute */
+	d.type = SDB_TYPE_STRING;
+	d.data.string = cname;
+	return batch_attribute(batch, hostname, SDB_METRIC, name,
+			"hostname", &d, last_update);
+} /* sdb_plugin_batch_metric */
+
+int
+sdb_plugin_batch_attribute(sdb_plugin_batch_t *batch, const char *hostname,
+		const char *key, const sdb_data_t *value, sdb_time_t last_update)
+{
+	return batch_attribute(batch, hostname, SDB_HOST, NULL,
+			key, value, last_update);
+} /* sdb_plugin_batch_attribute */
+
+int
+sdb_plugin_batch_service_attribute(sdb_plugin_batch_t *batch,
+		const char *hostname, const char *service,
+		const char *key, const sdb_data_t *value, sdb_time_t last_update)
+{
+	if (! service)
+		return -1;
+	return batch_attribute(batch, hostname, SDB_SERVICE, service,
+			key, value, last_update);
+} /* sdb_plugin_batch_service_attribute */
+
+int
+sdb_plugin_batch_metric_attribute(sdb_plugin_batch_t *batch,
+		const char *hostname, const char *metric,
+		const char *key, const sdb_data_t *value, sdb_time_t last_update)
+{
+	if (! metric)
+		return -1;
+	return batch_attribute(batch, hostname, SDB_METRIC, metric,
+			key, value, last_update);
+} /* sdb_plugin_batch_metric_attribute */
+
+size_t
+sdb_plugin_batch_len(sdb_plugin_batch_t *batch)
+{
+	return batch ? batch->batch.entries_num : 0;
+} /* sdb_plugin_batch_len */
+
+int
+sdb_plugin_store_batch(sdb_plugin_batch_t *batch)
+{
+	char *backends[1];
+	size_t backends_num;
+
+	sdb_llist_iter_t *iter;
+	int status = 0;
+	size_t i;
+
+	if (! batch)
+		return -1;
+	if (! batch->batch.entries_num)
+		return 0;
+
+	if (! sdb_llist_len(writer_list)) {
+		sdb_log(SDB_LOG_ERR, "Cannot store batch: no writers registered");
+		batch_clear(batch);
+		return -1;
+	}
+
+	get_backend(backends, &backends_num);
+	for (i = 0; i < batch->batch.entries_num; ++i)
+		batch_entry_set_backends(batch->batch.entries + i,
+				(const char * const *)backends, backends_num);
+
+	if (sdb_llist_search(writer_list, writer_needs_interval, NULL))
+		status = batch_get_intervals(&batch->batch);
+
+	iter = sdb_llist_get_iter(writer_list);
+	while (sdb_llist_iter_has_next(iter)) {
+		writer_t *writer = WRITER(sdb_llist_iter_get_next(iter));
+		int s;
+		assert(writer);
+		if (writer->impl.store_batch)
+			s = writer->impl.store_batch(&batch->batch, writer->w_user_data);
+		else
+			s = batch_store_entries(&writer->impl,
+					&batch->batch, writer->w_user_data);
+		if (((s > 0) && (status >= 0)) || (s < 0))
+			status = s;
+	}
+	sdb_llist_iter_destroy(iter);
+
+	batch_clear(batch);
+	return status;
+} /* sdb_plugin_store_batch */
+
 /* vim: set tw=78 sw=4 ts=4 noexpandtab : */
 
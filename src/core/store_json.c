@@ -408,6 +408,7 @@ emit_attribute(sdb_store_attribute_t *attr, sdb_object_t *user_data)
 
 sdb_store_writer_t sdb_store_json_writer = {
 	emit_host, emit_service, emit_metric, emit_attribute,
+	/* store_batch = */ NULL, /* flags = */ 0,
 };
 
 sdb_store_json_formatter_t *
@@ -80,9 +80,20 @@ struct sdb_conn {
 	/* user information */
 	char *username; /* NULL if the user has not been authenticated */
 	bool  ready; /* indicates that startup finished successfully */
+
+	/* prepared statements; a statement's ID is its index plus one */
+	sdb_object_t **statements;
+	size_t statements_num;
 };
 #define CONN(obj) ((sdb_conn_t *)(obj))
 
+/*
+ * sdb_conn_statements_clear:
+ * Release all prepared statements of the specified connection.
+ */
+void
+sdb_conn_statements_clear(sdb_conn_t *conn);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
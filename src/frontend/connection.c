@@ -192,6 +192,8 @@ connection_destroy(sdb_object_t *obj)
 	conn->buf = NULL;
 	sdb_strbuf_destroy(conn->errbuf);
 	conn->errbuf = NULL;
+
+	sdb_conn_statements_clear(conn);
 } /* connection_destroy */
 
 static sdb_type_t connection_type = {
@@ -296,8 +298,13 @@ command_handle(sdb_conn_t *conn)
 	else if (conn->cmd == SDB_CONNECTION_STARTUP)
 		status = sdb_conn_session_start(conn);
 
-	else if (conn->cmd == SDB_CONNECTION_QUERY)
+	else if ((conn->cmd == SDB_CONNECTION_QUERY)
+			|| (conn->cmd == SDB_CONNECTION_QUERY_CHUNKED))
 		status = sdb_conn_query(conn);
+	else if (conn->cmd == SDB_CONNECTION_PREPARE)
+		status = sdb_conn_prepare(conn);
+	else if (conn->cmd == SDB_CONNECTION_EXECUTE)
+		status = sdb_conn_execute(conn);
 	else if (conn->cmd == SDB_CONNECTION_FETCH)
 		status = sdb_conn_fetch(conn);
 	else if (conn->cmd == SDB_CONNECTION_LIST)
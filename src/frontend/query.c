@@ -43,6 +43,8 @@
 #include <ctype.h>
 #include <string.h>
 
+#include <pthread.h>
+
 /*
  * metric fetcher:
  * Implements the callbacks necessary to read a metric object.
@@ -87,8 +89,397 @@ metric_fetcher_metric(sdb_store_metric_t *metric, sdb_object_t *user_data)
 
 static sdb_store_writer_t metric_fetcher = {
 	metric_fetcher_host, NULL, metric_fetcher_metric, NULL,
+	/* store_batch = */ NULL, /* flags = */ 0,
 };
 
+/*
+ * chunked writer:
+ * Wraps the JSON writer and sends the formatted result to the client in
+ * frames of a fixed size while the query is still being executed. Sending
+ * blocks until the client is able to receive more data, thus throttling the
+ * query to the speed of the client.
+ */
+
+/* default and maximum size of a chunk of a query result */
+#define CHUNK_SIZE_DEFAULT (64 * 1024)
+#define CHUNK_SIZE_MAX (1024 * 1024)
+
+typedef struct {
+	sdb_conn_t *conn;
+	sdb_store_json_formatter_t *f;
+	/* the result type followed by the pending JSON output */
+	sdb_strbuf_t *buf;
+	size_t chunk_size;
+} chunked_writer_t;
+
+static int
+chunked_flush(chunked_writer_t *cw)
+{
+	while (sdb_strbuf_len(cw->buf) >= sizeof(uint32_t) + cw->chunk_size) {
+		if (sdb_connection_send(cw->conn, SDB_CONNECTION_DATA_CHUNK,
+					(uint32_t)(sizeof(uint32_t) + cw->chunk_size),
+					sdb_strbuf_string(cw->buf)) < 0)
+			return -1;
+		sdb_strbuf_skip(cw->buf, sizeof(uint32_t), cw->chunk_size);
+	}
+	return 0;
+} /* chunked_flush */
+
+static int
+chunked_writer_host(sdb_store_host_t *host, sdb_object_t *user_data)
+{
+	chunked_writer_t *cw = SDB_OBJ_WRAPPER(user_data)->data;
+	if (sdb_store_json_writer.store_host(host, SDB_OBJ(cw->f)))
+		return -1;
+	return chunked_flush(cw);
+} /* chunked_writer_host */
+
+static int
+chunked_writer_service(sdb_store_service_t *service, sdb_object_t *user_data)
+{
+	chunked_writer_t *cw = SDB_OBJ_WRAPPER(user_data)->data;
+	if (sdb_store_json_writer.store_service(service, SDB_OBJ(cw->f)))
+		return -1;
+	return chunked_flush(cw);
+} /* chunked_writer_service */
+
+static int
+chunked_writer_metric(sdb_store_metric_t *metric, sdb_object_t *user_data)
+{
+	chunked_writer_t *cw = SDB_OBJ_WRAPPER(user_data)->data;
+	if (sdb_store_json_writer.store_metric(metric, SDB_OBJ(cw->f)))
+		return -1;
+	return chunked_flush(cw);
+} /* chunked_writer_metric */
+
+static int
+chunked_writer_attribute(sdb_store_attribute_t *attr, sdb_object_t *user_data)
+{
+	chunked_writer_t *cw = SDB_OBJ_WRAPPER(user_data)->data;
+	if (sdb_store_json_writer.store_attribute(attr, SDB_OBJ(cw->f)))
+		return -1;
+	return chunked_flush(cw);
+} /* chunked_writer_attribute */
+
+static sdb_store_writer_t chunked_writer = {
+	chunked_writer_host, chunked_writer_service,
+	chunked_writer_metric, chunked_writer_attribute,
+	/* store_batch = */ NULL, /* flags = */ 0,
+};
+
+/*
+ * query cache:
+ * Parsed and prepared FETCH, LIST, and LOOKUP queries are kept in a hash
+ * table keyed by the normalized query string. A list of all entries, ordered
+ * by their last use, determines which entry to evict once the cache is full.
+ * Cached queries are shared between connections and threads and, thus, are
+ * never modified.
+ */
+
+typedef struct cached_query cached_query_t;
+struct cached_query {
+	sdb_object_t super; /* name: normalized query string */
+
+	sdb_ast_node_t *ast;
+	/* the prepared query; NULL for commands other than FETCH, LIST, LOOKUP */
+	sdb_object_t *prepared;
+
+	/* cache management; protected by the cache's lock */
+	uint32_t hash;
+	cached_query_t *hnext;
+	cached_query_t *lru_prev; /* more recently used */
+	cached_query_t *lru_next; /* less recently used */
+};
+#define CACHED_QUERY(obj) ((cached_query_t *)(obj))
+
+static struct {
+	pthread_mutex_t lock;
+
+	size_t size;
+	cached_query_t **buckets;
+	size_t buckets_num; /* a power of two */
+
+	cached_query_t *lru_head;
+	cached_query_t *lru_tail;
+	size_t entries;
+
+	uint64_t hits;
+	uint64_t misses;
+} query_cache = {
+	PTHREAD_MUTEX_INITIALIZER,
+	SDB_CONN_QUERY_CACHE_SIZE_DEFAULT, NULL, 0,
+	NULL, NULL, 0,
+	0, 0,
+};
+
+/* maximum number of prepared statements per connection */
+#define STATEMENTS_MAX 1024
+
+static int
+cached_query_init(sdb_object_t *obj, va_list ap)
+{
+	cached_query_t *cq = CACHED_QUERY(obj);
+
+	cq->ast = va_arg(ap, sdb_ast_node_t *);
+	sdb_object_ref(SDB_OBJ(cq->ast));
+	/* take ownership of the prepared query */
+	cq->prepared = va_arg(ap, sdb_object_t *);
+	return 0;
+} /* cached_query_init */
+
+static void
+cached_query_destroy(sdb_object_t *obj)
+{
+	cached_query_t *cq = CACHED_QUERY(obj);
+
+	sdb_object_deref(cq->prepared);
+	sdb_object_deref(SDB_OBJ(cq->ast));
+} /* cached_query_destroy */
+
+static sdb_type_t cached_query_type = {
+	sizeof(cached_query_t),
+
+	cached_query_init,
+	cached_query_destroy
+};
+
+/* FNV-1a */
+static uint32_t
+query_hash(const char *s)
+{
+	uint32_t h = 2166136261U;
+
+	for ( ; *s; ++s) {
+		h ^= (uint32_t)(unsigned char)*s;
+		h *= 16777619U;
+	}
+	return h;
+} /* query_hash */
+
+/* Normalize a query string such that equivalent queries map to the same
+ * cache entry: comments are dropped and any sequence of whitespace outside of
+ * string literals is collapsed into a single space. Returns a newly allocated
+ * string or NULL if the query cannot be normalized, e.g., because of an
+ * unterminated string or comment. */
+static char *
+query_normalize(const char *str, size_t len)
+{
+	char *norm = malloc(len + 1);
+	size_t i = 0, n = 0;
+	bool space = 0;
+
+	if (! norm)
+		return NULL;
+
+	while ((i < len) && str[i]) {
+		if (strchr(" \t\n\r\f", str[i])) {
+			space = 1;
+			++i;
+			continue;
+		}
+		if ((str[i] == '-') && (i + 1 < len) && (str[i + 1] == '-')) {
+			while ((i < len) && str[i] && (str[i] != '\n') && (str[i] != '\r'))
+				++i;
+			space = 1;
+			continue;
+		}
+		if ((str[i] == '/') && (i + 1 < len) && (str[i + 1] == '*')) {
+			for (i += 2; i + 1 < len; ++i)
+				if ((str[i] == '*') && (str[i + 1] == '/'))
+					break;
+			if (i + 1 >= len) {
+				free(norm);
+				return NULL;
+			}
+			i += 2;
+			space = 1;
+			continue;
+		}
+
+		if (space && n)
+			norm[n++] = ' ';
+		space = 0;
+
+		if (str[i] == '\'') {
+			/* copy string literals verbatim; quotes are escaped as '' */
+			norm[n++] = str[i++];
+			while (1) {
+				if ((i >= len) || (! str[i])) {
+					free(norm);
+					return NULL;
+				}
+				norm[n++] = str[i++];
+				if (norm[n - 1] != '\'')
+					continue;
+				if ((i < len) && (str[i] == '\''))
+					norm[n++] = str[i++];
+				else
+					break;
+			}
+			continue;
+		}
+		norm[n++] = str[i++];
+	}
+	norm[n] = '\0';
+	return norm;
+} /* query_normalize */
+
+/* The cache has to be locked by the caller. */
+static void
+query_cache_unlink(cached_query_t *cq)
+{
+	cached_query_t **b = &query_cache.buckets[cq->hash
+		& (query_cache.buckets_num - 1)];
+
+	while (*b && (*b != cq))
+		b = &(*b)->hnext;
+	if (*b)
+		*b = cq->hnext;
+	cq->hnext = NULL;
+
+	if (cq->lru_prev)
+		cq->lru_prev->lru_next = cq->lru_next;
+	else
+		query_cache.lru_head = cq->lru_next;
+	if (cq->lru_next)
+		cq->lru_next->lru_prev = cq->lru_prev;
+	else
+		query_cache.lru_tail = cq->lru_prev;
+	cq->lru_prev = cq->lru_next = NULL;
+
+	--query_cache.entries;
+	sdb_object_deref(SDB_OBJ(cq));
+} /* query_cache_unlink */
+
+/* The cache has to be locked by the caller. */
+static void
+query_cache_flush(void)
+{
+	while (query_cache.lru_head)
+		query_cache_unlink(query_cache.lru_head);
+	if (query_cache.buckets)
+		free(query_cache.buckets);
+	query_cache.buckets = NULL;
+	query_cache.buckets_num = 0;
+} /* query_cache_flush */
+
+/* Look up a query by its normalized query string. Returns a new reference to
+ * the cached query or NULL if there is no (valid) entry. */
+static cached_query_t *
+query_cache_get(const char *key)
+{
+	cached_query_t *cq = NULL;
+	uint32_t hash = query_hash(key);
+
+	pthread_mutex_lock(&query_cache.lock);
+	if (query_cache.buckets_num)
+		cq = query_cache.buckets[hash & (query_cache.buckets_num - 1)];
+	while (cq && ((cq->hash != hash) || strcmp(SDB_OBJ(cq)->name, key)))
+		cq = cq->hnext;
+
+	/* the store reader might have been replaced since preparing the query */
+	if (cq && cq->prepared && (! sdb_plugin_query_is_valid(cq->prepared))) {
+		query_cache_unlink(cq);
+		cq = NULL;
+	}
+
+	if (! cq) {
+		++query_cache.misses;
+		pthread_mutex_unlock(&query_cache.lock);
+		return NULL;
+	}
+
+	++query_cache.hits;
+	if (cq->lru_prev) {
+		/* move to the front of the LRU list */
+		cq->lru_prev->lru_next = cq->lru_next;
+		if (cq->lru_next)
+			cq->lru_next->lru_prev = cq->lru_prev;
+		else
+			query_cache.lru_tail = cq->lru_prev;
+		cq->lru_prev = NULL;
+		cq->lru_next = query_cache.lru_head;
+		query_cache.lru_head->lru_prev = cq;
+		query_cache.lru_head = cq;
+	}
+	sdb_object_ref(SDB_OBJ(cq));
+	pthread_mutex_unlock(&query_cache.lock);
+	return cq;
+} /* query_cache_get */
+
+static void
+query_cache_put(cached_query_t *cq)
+{
+	cached_query_t *old;
+
+	cq->hash = query_hash(SDB_OBJ(cq)->name);
+
+	pthread_mutex_lock(&query_cache.lock);
+	if (! query_cache.size) {
+		pthread_mutex_unlock(&query_cache.lock);
+		return;
+	}
+
+	if (! query_cache.buckets) {
+		size_t n = 16;
+		while (n < query_cache.size)
+			n *= 2;
+		query_cache.buckets = calloc(n, sizeof(*query_cache.buckets));
+		if (! query_cache.buckets) {
+			pthread_mutex_unlock(&query_cache.lock);
+			return;
+		}
+		query_cache.buckets_num = n;
+	}
+
+	/* another thread might have added the same query in the meantime */
+	old = query_cache.buckets[cq->hash & (query_cache.buckets_num - 1)];
+	while (old && strcmp(SDB_OBJ(old)->name, SDB_OBJ(cq)->name))
+		old = old->hnext;
+	if (old)
+		query_cache_unlink(old);
+
+	while (query_cache.entries >= query_cache.size)
+		query_cache_unlink(query_cache.lru_tail);
+
+	sdb_object_ref(SDB_OBJ(cq));
+	cq->hnext = query_cache.buckets[cq->hash & (query_cache.buckets_num - 1)];
+	query_cache.buckets[cq->hash & (query_cache.buckets_num - 1)] = cq;
+	cq->lru_prev = NULL;
+	cq->lru_next = query_cache.lru_head;
+	if (query_cache.lru_head)
+		query_cache.lru_head->lru_prev = cq;
+	else
+		query_cache.lru_tail = cq;
+	query_cache.lru_head = cq;
+	++query_cache.entries;
+	pthread_mutex_unlock(&query_cache.lock);
+} /* query_cache_put */
+
+/* Create a new cached query object, preparing the query if applicable. */
+static cached_query_t *
+cached_query_create(const char *key, sdb_ast_node_t *ast,
+		sdb_strbuf_t *errbuf)
+{
+	sdb_object_t *prepared = NULL, *obj;
+
+	if ((ast->type == SDB_AST_TYPE_FETCH)
+			|| (ast->type == SDB_AST_TYPE_LIST)
+			|| (ast->type == SDB_AST_TYPE_LOOKUP)) {
+		prepared = sdb_plugin_prepare_query(ast, errbuf);
+		if (! prepared)
+			return NULL;
+	}
+
+	obj = sdb_object_create(key, cached_query_type, ast, prepared);
+	if (! obj) {
+		sdb_strbuf_sprintf(errbuf, "Out of memory");
+		sdb_object_deref(prepared);
+		return NULL;
+	}
+	return CACHED_QUERY(obj);
+} /* cached_query_create */
+
 /*
  * private helper functions
  */
@@ -106,7 +497,23 @@ sstrlen(const char *s)
 } /* sstrlen */
 
 static int
-exec_query(sdb_ast_node_t *ast, sdb_strbuf_t *buf, sdb_strbuf_t *errbuf)
+run_query(sdb_ast_node_t *ast, sdb_object_t *prepared,
+		sdb_store_writer_t *w, sdb_object_t *wd, sdb_strbuf_t *errbuf)
+{
+	sdb_query_opts_t opts = { true };
+
+	if (prepared)
+		return sdb_plugin_execute_query(prepared, w, wd, &opts, errbuf);
+	return sdb_plugin_query(ast, w, wd, &opts, errbuf);
+} /* run_query */
+
+/* Execute a query and write the result to 'buf'. The query is executed using
+ * 'prepared', if specified. If 'chunk_size' is non-zero, all complete chunks
+ * of the result are sent to the client while executing the query and only
+ * the remaining part is left in 'buf'. */
+static int
+exec_query(sdb_conn_t *conn, sdb_ast_node_t *ast, sdb_object_t *prepared,
+		size_t chunk_size, sdb_strbuf_t *buf, sdb_strbuf_t *errbuf)
 {
 	sdb_store_json_formatter_t *f;
 	int type = 0, flags = 0;
@@ -136,8 +543,16 @@ exec_query(sdb_ast_node_t *ast, sdb_strbuf_t *buf, sdb_strbuf_t *errbuf)
 
 	f = sdb_store_json_formatter(buf, type, flags);
 	sdb_strbuf_memcpy(buf, &res_type, sizeof(res_type));
-	status = sdb_plugin_query(ast, &sdb_store_json_writer, SDB_OBJ(f),
-			&(sdb_query_opts_t){ true }, errbuf);
+	if (chunk_size) {
+		chunked_writer_t cw = { conn, f, buf, chunk_size };
+		sdb_object_wrapper_t obj = SDB_OBJECT_WRAPPER_STATIC(&cw);
+
+		status = run_query(ast, prepared,
+				&chunked_writer, SDB_OBJ(&obj), errbuf);
+	}
+	else
+		status = run_query(ast, prepared,
+				&sdb_store_json_writer, SDB_OBJ(f), errbuf);
 	if (status < 0)
 		sdb_strbuf_clear(buf);
 	sdb_store_json_finish(f);
@@ -286,8 +701,11 @@ exec_timeseries(sdb_ast_timeseries_t *ts, sdb_strbuf_t *buf, sdb_strbuf_t *errbu
 	return status;
 } /* exec_timeseries */
 
+/* Execute the specified command. If available, 'cq' provides the prepared
+ * query for 'ast'. */
 static int
-exec_cmd(sdb_conn_t *conn, sdb_ast_node_t *ast)
+exec_cmd(sdb_conn_t *conn, sdb_ast_node_t *ast, cached_query_t *cq,
+		size_t chunk_size)
 {
 	sdb_strbuf_t *buf;
 	int status;
@@ -308,11 +726,19 @@ exec_cmd(sdb_conn_t *conn, sdb_ast_node_t *ast)
 	else if (ast->type == SDB_AST_TYPE_TIMESERIES)
 		status = exec_timeseries(SDB_AST_TIMESERIES(ast), buf, conn->errbuf);
 	else
-		status = exec_query(ast, buf, conn->errbuf);
-
-	if (status < 0) {
-		char query[conn->cmd_len + 1];
-		strncpy(query, sdb_strbuf_string(conn->buf), conn->cmd_len);
+		status = exec_query(conn, ast, cq ? cq->prepared : NULL, chunk_size,
+				buf, conn->errbuf);
+
+	if ((status < 0) && cq)
+		sdb_log(SDB_LOG_ERR, "frontend: failed to execute query '%s'",
+				SDB_OBJ(cq)->name);
+	else if (status < 0) {
+		/* skip the chunk size of chunked queries */
+		size_t offset = (conn->cmd == SDB_CONNECTION_QUERY_CHUNKED)
+			? sizeof(uint32_t) : 0;
+		char query[conn->cmd_len - offset + 1];
+		strncpy(query, sdb_strbuf_string(conn->buf) + offset,
+				conn->cmd_len - offset);
 		query[sizeof(query) - 1] = '\0';
 		sdb_log(SDB_LOG_ERR, "frontend: failed to execute query '%s'", query);
 	}
@@ -324,6 +750,76 @@ exec_cmd(sdb_conn_t *conn, sdb_ast_node_t *ast)
 	return status < 0 ? status : 0;
 } /* exec_cmd */
 
+/* Look up the specified query in the cache or parse (and prepare) it. On
+ * success, 'ast' is set to a new reference to the AST of the first command
+ * or to NULL if the query is empty. Unless the query includes multiple
+ * commands, 'cq' is set to a new reference to the respective cached
+ * query. */
+static int
+query_get(sdb_conn_t *conn, const char *query_str, uint32_t query_len,
+		sdb_ast_node_t **ast, cached_query_t **cq)
+{
+	sdb_llist_t *parsetree;
+	char *key;
+	size_t n;
+
+	*ast = NULL;
+	*cq = NULL;
+
+	key = query_normalize(query_str, query_len);
+	if (key && (*cq = query_cache_get(key))) {
+		free(key);
+		*ast = (*cq)->ast;
+		sdb_object_ref(SDB_OBJ(*ast));
+		return 0;
+	}
+
+	parsetree = sdb_parser_parse(query_str, (int)query_len, conn->errbuf);
+	if (! parsetree) {
+		char query[query_len + 1];
+		strncpy(query, query_str, query_len);
+		query[sizeof(query) - 1] = '\0';
+		sdb_log(SDB_LOG_ERR, "frontend: Failed to parse query '%s': %s",
+				query, sdb_strbuf_string(conn->errbuf));
+		free(key);
+		return -1;
+	}
+
+	n = sdb_llist_len(parsetree);
+	if (n > 1) {
+		char query[query_len + 1];
+		strncpy(query, query_str, query_len);
+		query[sizeof(query) - 1] = '\0';
+		sdb_log(SDB_LOG_WARNING, "frontend: Ignoring %zu command%s "
+				"in multi-statement query '%s'",
+				n - 1, n == 2 ? "" : "s", query);
+	}
+	if (n)
+		*ast = SDB_AST_NODE(sdb_llist_get(parsetree, 0));
+	sdb_llist_destroy(parsetree);
+
+	if (n == 1) {
+		char query[query_len + 1];
+		strncpy(query, query_str, query_len);
+		query[sizeof(query) - 1] = '\0';
+
+		/* queries which cannot be normalized are not cached */
+		*cq = cached_query_create(key ? key : query, *ast, conn->errbuf);
+		if (! *cq) {
+			sdb_object_deref(SDB_OBJ(*ast));
+			*ast = NULL;
+			free(key);
+			return -1;
+		}
+		/* other commands may depend on the time of parsing, e.g., for
+		 * default timestamps, and have to be parsed each time */
+		if (key && (*cq)->prepared)
+			query_cache_put(*cq);
+	}
+	free(key);
+	return 0;
+} /* query_get */
+
 /*
  * public API
  */
@@ -331,54 +827,209 @@ exec_cmd(sdb_conn_t *conn, sdb_ast_node_t *ast)
 int
 sdb_conn_query(sdb_conn_t *conn)
 {
-	sdb_llist_t *parsetree;
 	sdb_ast_node_t *ast = NULL;
+	cached_query_t *cq = NULL;
+	const char *query_str;
+	uint32_t query_len, chunk_size = 0;
 	int status = 0;
 
-	if ((! conn) || (conn->cmd != SDB_CONNECTION_QUERY))
+	if ((! conn) || ((conn->cmd != SDB_CONNECTION_QUERY)
+				&& (conn->cmd != SDB_CONNECTION_QUERY_CHUNKED)))
 		return -1;
 
-	parsetree = sdb_parser_parse(sdb_strbuf_string(conn->buf),
-			(int)conn->cmd_len, conn->errbuf);
-	if (! parsetree) {
-		char query[conn->cmd_len + 1];
-		strncpy(query, sdb_strbuf_string(conn->buf), conn->cmd_len);
-		query[sizeof(query) - 1] = '\0';
-		sdb_log(SDB_LOG_ERR, "frontend: Failed to parse query '%s': %s",
-				query, sdb_strbuf_string(conn->errbuf));
+	query_str = sdb_strbuf_string(conn->buf);
+	query_len = conn->cmd_len;
+
+	if (conn->cmd == SDB_CONNECTION_QUERY_CHUNKED) {
+		if (conn->cmd_len < sizeof(uint32_t)) {
+			sdb_log(SDB_LOG_ERR, "frontend: Invalid command length %d for "
+					"QUERY_CHUNKED command", conn->cmd_len);
+			sdb_strbuf_sprintf(conn->errbuf, "QUERY_CHUNKED: Invalid "
+					"command length %d", conn->cmd_len);
+			return -1;
+		}
+		sdb_proto_unmarshal_int32(query_str, query_len, &chunk_size);
+		if (! chunk_size)
+			chunk_size = CHUNK_SIZE_DEFAULT;
+		else if (chunk_size > CHUNK_SIZE_MAX)
+			chunk_size = CHUNK_SIZE_MAX;
+
+		query_str += sizeof(uint32_t);
+		query_len -= (uint32_t)sizeof(uint32_t);
+	}
+
+	if (query_get(conn, query_str, query_len, &ast, &cq))
 		return -1;
+
+	if (! ast) {
+		/* skipping empty command; send back an empty reply */
+		sdb_connection_send(conn, SDB_CONNECTION_DATA, 0, NULL);
+		return 0;
 	}
 
-	switch (sdb_llist_len(parsetree)) {
-		case 0:
-			/* skipping empty command; send back an empty reply */
-			sdb_connection_send(conn, SDB_CONNECTION_DATA, 0, NULL);
-			break;
-		case 1:
-			ast = SDB_AST_NODE(sdb_llist_get(parsetree, 0));
+	status = exec_cmd(conn, ast, cq, chunk_size);
+	sdb_object_deref(SDB_OBJ(cq));
+	sdb_object_deref(SDB_OBJ(ast));
+	return status;
+} /* sdb_conn_query */
+
+int
+sdb_conn_prepare(sdb_conn_t *conn)
+{
+	sdb_ast_node_t *ast = NULL;
+	cached_query_t *cq = NULL;
+	sdb_object_t **tmp;
+	uint32_t id;
+	size_t i;
+
+	if ((! conn) || (conn->cmd != SDB_CONNECTION_PREPARE))
+		return -1;
+
+	if (query_get(conn, sdb_strbuf_string(conn->buf), conn->cmd_len,
+				&ast, &cq))
+		return -1;
+	sdb_object_deref(SDB_OBJ(ast));
+
+	if (! cq) {
+		sdb_strbuf_sprintf(conn->errbuf, "PREPARE: Expected a single command");
+		return -1;
+	}
+
+	for (i = 0; i < conn->statements_num; ++i)
+		if (! strcmp(conn->statements[i]->name, SDB_OBJ(cq)->name))
 			break;
 
-		default:
-			{
-				char query[conn->cmd_len + 1];
-				strncpy(query, sdb_strbuf_string(conn->buf), conn->cmd_len);
-				query[sizeof(query) - 1] = '\0';
-				sdb_log(SDB_LOG_WARNING, "frontend: Ignoring %zu command%s "
-						"in multi-statement query '%s'",
-						sdb_llist_len(parsetree) - 1,
-						sdb_llist_len(parsetree) == 2 ? "" : "s",
-						query);
-				ast = SDB_AST_NODE(sdb_llist_get(parsetree, 0));
-			}
+	if (i < conn->statements_num) {
+		/* replace the statement in case it has been re-prepared */
+		sdb_object_deref(conn->statements[i]);
+		conn->statements[i] = SDB_OBJ(cq);
+	}
+	else if (conn->statements_num >= STATEMENTS_MAX) {
+		sdb_strbuf_sprintf(conn->errbuf, "PREPARE: Too many prepared "
+				"statements (maximum: %d)", STATEMENTS_MAX);
+		sdb_object_deref(SDB_OBJ(cq));
+		return -1;
+	}
+	else {
+		tmp = realloc(conn->statements,
+				(conn->statements_num + 1) * sizeof(*conn->statements));
+		if (! tmp) {
+			sdb_strbuf_sprintf(conn->errbuf, "Out of memory");
+			sdb_object_deref(SDB_OBJ(cq));
+			return -1;
+		}
+		conn->statements = tmp;
+		conn->statements[conn->statements_num++] = SDB_OBJ(cq);
+	}
+
+	id = htonl((uint32_t)i + 1);
+	sdb_connection_send(conn, SDB_CONNECTION_OK,
+			(uint32_t)sizeof(id), (const char *)&id);
+	return 0;
+} /* sdb_conn_prepare */
+
+int
+sdb_conn_execute(sdb_conn_t *conn)
+{
+	cached_query_t *cq;
+	uint32_t id = 0, chunk_size = 0;
+
+	if ((! conn) || (conn->cmd != SDB_CONNECTION_EXECUTE))
+		return -1;
+
+	if ((conn->cmd_len != sizeof(uint32_t))
+			&& (conn->cmd_len != 2 * sizeof(uint32_t))) {
+		sdb_log(SDB_LOG_ERR, "frontend: Invalid command length %d for "
+				"EXECUTE command", conn->cmd_len);
+		sdb_strbuf_sprintf(conn->errbuf, "EXECUTE: Invalid command length %d",
+				conn->cmd_len);
+		return -1;
 	}
 
-	if (ast) {
-		status = exec_cmd(conn, ast);
+	sdb_proto_unmarshal_int32(SDB_STRBUF_STR(conn->buf), &id);
+	if (conn->cmd_len == 2 * sizeof(uint32_t)) {
+		sdb_proto_unmarshal_int32(sdb_strbuf_string(conn->buf)
+				+ sizeof(uint32_t), sizeof(uint32_t), &chunk_size);
+		if (! chunk_size)
+			chunk_size = CHUNK_SIZE_DEFAULT;
+		else if (chunk_size > CHUNK_SIZE_MAX)
+			chunk_size = CHUNK_SIZE_MAX;
+	}
+
+	if ((! id) || (id > conn->statements_num)) {
+		sdb_strbuf_sprintf(conn->errbuf, "EXECUTE: Invalid statement ID %u",
+				id);
+		return -1;
+	}
+
+	cq = CACHED_QUERY(conn->statements[id - 1]);
+	if (! cq->prepared) {
+		/* parse the command again; see query_get */
+		const char *query_str = SDB_OBJ(cq)->name;
+		sdb_ast_node_t *ast = NULL;
+		int status;
+
+		cq = NULL;
+		if (query_get(conn, query_str, (uint32_t)strlen(query_str),
+					&ast, &cq))
+			return -1;
+		status = exec_cmd(conn, ast, cq, chunk_size);
+		sdb_object_deref(SDB_OBJ(cq));
 		sdb_object_deref(SDB_OBJ(ast));
+		return status;
 	}
-	sdb_llist_destroy(parsetree);
-	return status;
-} /* sdb_conn_query */
+	if (! sdb_plugin_query_is_valid(cq->prepared)) {
+		/* the store reader has been replaced; prepare the query again */
+		cached_query_t *fresh = cached_query_create(SDB_OBJ(cq)->name,
+				cq->ast, conn->errbuf);
+		if (! fresh)
+			return -1;
+		query_cache_put(fresh);
+		sdb_object_deref(SDB_OBJ(cq));
+		conn->statements[id - 1] = SDB_OBJ(fresh);
+		cq = fresh;
+	}
+
+	return exec_cmd(conn, cq->ast, cq, chunk_size);
+} /* sdb_conn_execute */
+
+void
+sdb_conn_statements_clear(sdb_conn_t *conn)
+{
+	size_t i;
+
+	if (! conn)
+		return;
+
+	for (i = 0; i < conn->statements_num; ++i)
+		sdb_object_deref(conn->statements[i]);
+	if (conn->statements)
+		free(conn->statements);
+	conn->statements = NULL;
+	conn->statements_num = 0;
+} /* sdb_conn_statements_clear */
+
+void
+sdb_conn_query_cache_configure(size_t size)
+{
+	pthread_mutex_lock(&query_cache.lock);
+	query_cache_flush();
+	query_cache.size = size;
+	pthread_mutex_unlock(&query_cache.lock);
+} /* sdb_conn_query_cache_configure */
+
+void
+sdb_conn_query_cache_stats(sdb_conn_query_cache_stats_t *stats)
+{
+	if (! stats)
+		return;
+
+	pthread_mutex_lock(&query_cache.lock);
+	stats->hits = query_cache.hits;
+	stats->misses = query_cache.misses;
+	stats->entries = query_cache.entries;
+	pthread_mutex_unlock(&query_cache.lock);
+} /* sdb_conn_query_cache_stats */
 
 int
 sdb_conn_fetch(sdb_conn_t *conn)
@@ -413,7 +1064,8 @@ sdb_conn_fetch(sdb_conn_t *conn)
 			-1, NULL,
 			name[0] ? strdup(name) : NULL,
 			/* full */ 1, /* filter = */ NULL);
-	status = exec_cmd(conn, ast);
+	status = exec_cmd(conn, ast,
+			/* cq = */ NULL, /* chunk_size = */ 0);
 	sdb_object_deref(SDB_OBJ(ast));
 	return status;
 } /* sdb_conn_fetch */
@@ -439,7 +1091,8 @@ sdb_conn_list(sdb_conn_t *conn)
 	}
 
 	ast = sdb_ast_list_create((int)type, /* filter = */ NULL);
-	status = exec_cmd(conn, ast);
+	status = exec_cmd(conn, ast,
+			/* cq = */ NULL, /* chunk_size = */ 0);
 	sdb_object_deref(SDB_OBJ(ast));
 	return status;
 } /* sdb_conn_list */
@@ -483,7 +1136,8 @@ sdb_conn_lookup(sdb_conn_t *conn)
 	}
 
 	ast = sdb_ast_lookup_create((int)type, m, /* filter = */ NULL);
-	status = exec_cmd(conn, ast);
+	status = exec_cmd(conn, ast,
+			/* cq = */ NULL, /* chunk_size = */ 0);
 	if (! ast)
 		sdb_object_deref(SDB_OBJ(m));
 	sdb_object_deref(SDB_OBJ(ast));
@@ -590,7 +1244,8 @@ sdb_conn_store(sdb_conn_t *conn)
 
 	status = sdb_parser_analyze(ast, conn->errbuf);
 	if (! status)
-		status = exec_cmd(conn, ast);
+		status = exec_cmd(conn, ast,
+				/* cq = */ NULL, /* chunk_size = */ 0);
 	sdb_object_deref(SDB_OBJ(ast));
 	return status;
 } /* sdb_conn_store */
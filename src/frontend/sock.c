@@ -52,7 +52,11 @@
 
 #include <sys/time.h>
 #include <sys/types.h>
-#include <sys/select.h>
+#ifdef HAVE_SYS_EPOLL_H
+#	include <sys/epoll.h>
+#else /* HAVE_SYS_EPOLL_H */
+#	include <sys/select.h>
+#endif /* HAVE_SYS_EPOLL_H */
 #include <sys/socket.h>
 #include <sys/param.h>
 #include <sys/un.h>
@@ -100,6 +104,15 @@ struct sdb_fe_socket {
 	listener_t *listeners;
 	size_t listeners_num;
 
+#ifdef HAVE_SYS_EPOLL_H
+	/* list of all open connections; all listeners and connections are
+	 * registered with the epoll instance, connections using edge-triggered
+	 * one-shot notifications; active connections will be passed on to the
+	 * connection handler threads which re-arm them after handling pending
+	 * actions */
+	sdb_llist_t *open_connections;
+	int epoll_fd;
+#else /* HAVE_SYS_EPOLL_H */
 	/* list of open, idle connections; active connections will be passed on to
 	 * the connection handler threads which place them back after handling
 	 * pending actions; the trigger pipe is used to notify the main thread
@@ -108,6 +121,7 @@ struct sdb_fe_socket {
 	int trigger[2];
 #define TRIGGER_READ 0
 #define TRIGGER_WRITE 1
+#endif /* HAVE_SYS_EPOLL_H */
 
 	/* channel used for communication between main
 	 * and connection handler threads */
@@ -529,6 +543,75 @@ socket_close(sdb_fe_socket_t *sock)
  * connection handler functions
  */
 
+#ifdef HAVE_SYS_EPOLL_H
+static int
+connection_cmp_ptr(const sdb_object_t *obj, const void *ptr)
+{
+	return obj != ptr;
+} /* connection_cmp_ptr */
+
+static int
+connection_arm(sdb_fe_socket_t *sock, sdb_conn_t *conn, int op)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLET | EPOLLONESHOT;
+	ev.data.ptr = conn;
+
+	if (epoll_ctl(sock->epoll_fd, op, conn->fd, &ev)) {
+		char errbuf[1024];
+		sdb_log(SDB_LOG_ERR, "frontend: Failed to %s connection %s: %s",
+				op == EPOLL_CTL_ADD ? "register" : "re-arm",
+				SDB_OBJ(conn)->name,
+				sdb_strerror(errno, errbuf, sizeof(errbuf)));
+		return -1;
+	}
+	return 0;
+} /* connection_arm */
+#endif /* HAVE_SYS_EPOLL_H */
+
+/* close a connection which is not in use by the main loop */
+static void
+connection_drop(sdb_fe_socket_t *sock, sdb_conn_t *conn)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	sdb_object_t *obj = sdb_llist_remove(sock->open_connections,
+			connection_cmp_ptr, conn);
+	/* release the list's reference */
+	sdb_object_deref(obj);
+#else /* HAVE_SYS_EPOLL_H */
+	(void)sock;
+#endif /* HAVE_SYS_EPOLL_H */
+	sdb_object_deref(SDB_OBJ(conn));
+} /* connection_drop */
+
+/* return a connection to the main loop after handling pending actions */
+static void
+connection_return(sdb_fe_socket_t *sock, sdb_conn_t *conn)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	if (connection_arm(sock, conn, EPOLL_CTL_MOD)) {
+		connection_drop(sock, conn);
+		return;
+	}
+#else /* HAVE_SYS_EPOLL_H */
+	if (sdb_llist_append(sock->open_connections, SDB_OBJ(conn))) {
+		sdb_log(SDB_LOG_ERR, "frontend: Failed to re-append "
+				"connection %s to list of open connections",
+				SDB_OBJ(conn)->name);
+	}
+	if (write(sock->trigger[TRIGGER_WRITE], "", 1) <= 0) {
+		/* This shouldn't happen and it's not critical; in the worst cases
+		 * it slows us down. */
+		sdb_log(SDB_LOG_WARNING, "frontend: Failed to trigger main loop");
+	}
+#endif /* HAVE_SYS_EPOLL_H */
+
+	/* pass ownership back to the main loop; or destroy in case of an error */
+	sdb_object_deref(SDB_OBJ(conn));
+} /* connection_return */
+
 static void *
 connection_handler(void *data)
 {
@@ -560,24 +643,11 @@ connection_handler(void *data)
 		status = (int)sdb_connection_handle(conn);
 		if (status <= 0) {
 			/* error or EOF -> close connection */
-			sdb_object_deref(SDB_OBJ(conn));
+			connection_drop(sock, conn);
 			continue;
 		}
 
-		/* return the connection to the main loop */
-		if (sdb_llist_append(sock->open_connections, SDB_OBJ(conn))) {
-			sdb_log(SDB_LOG_ERR, "frontend: Failed to re-append "
-					"connection %s to list of open connections",
-					SDB_OBJ(conn)->name);
-		}
-		if (write(sock->trigger[TRIGGER_WRITE], "", 1) <= 0) {
-			/* This shouldn't happen and it's not critical; in the worst cases
-			 * it slows us down. */
-			sdb_log(SDB_LOG_WARNING, "frontend: Failed to trigger main loop");
-		}
-
-		/* pass ownership back to list; or destroy in case of an error */
-		sdb_object_deref(SDB_OBJ(conn));
+		connection_return(sock, conn);
 	}
 	return NULL;
 } /* connection_handler */
@@ -598,12 +668,67 @@ connection_accept(sdb_fe_socket_t *sock, listener_t *listener)
 		sdb_log(SDB_LOG_ERR, "frontend: Failed to append "
 				"connection %s to list of open connections",
 				obj->name);
+#ifdef HAVE_SYS_EPOLL_H
+	else if (connection_arm(sock, CONN(obj), EPOLL_CTL_ADD)) {
+		sdb_llist_remove(sock->open_connections, connection_cmp_ptr, obj);
+		sdb_object_deref(obj);
+		status = -1;
+	}
+#endif /* HAVE_SYS_EPOLL_H */
 
 	/* hand ownership over to the list; or destroy in case of an error */
 	sdb_object_deref(obj);
 	return status;
 } /* connection_accept */
 
+#ifdef HAVE_SYS_EPOLL_H
+static listener_t *
+socket_get_listener(sdb_fe_socket_t *sock, void *ptr)
+{
+	size_t i;
+
+	for (i = 0; i < sock->listeners_num; ++i)
+		if (ptr == sock->listeners + i)
+			return sock->listeners + i;
+	return NULL;
+} /* socket_get_listener */
+
+static int
+socket_handle_events(sdb_fe_socket_t *sock,
+		struct epoll_event *events, int events_num)
+{
+	int i;
+
+	for (i = 0; i < events_num; ++i) {
+		listener_t *listener = socket_get_listener(sock, events[i].data.ptr);
+		sdb_conn_t *conn;
+
+		if (listener) {
+			connection_accept(sock, listener);
+			continue;
+		}
+
+		/* the connection is disarmed until being returned by a handler */
+		conn = events[i].data.ptr;
+		sdb_object_ref(SDB_OBJ(conn));
+
+		if (events[i].events & EPOLLERR) {
+			sdb_log(SDB_LOG_INFO, "Exception on fd %d", conn->fd);
+			connection_drop(sock, conn);
+			continue;
+		}
+
+		if (sdb_channel_write(sock->chan, &conn)) {
+			sdb_log(SDB_LOG_WARNING, "frontend: Failed to pass "
+					"connection %s to handler threads",
+					SDB_OBJ(conn)->name);
+			connection_return(sock, conn);
+		}
+	}
+	return 0;
+} /* socket_handle_events */
+#else /* HAVE_SYS_EPOLL_H */
+
 static int
 socket_handle_incoming(sdb_fe_socket_t *sock,
 		fd_set *ready, fd_set *exceptions)
@@ -645,6 +770,7 @@ socket_handle_incoming(sdb_fe_socket_t *sock,
 	sdb_llist_iter_destroy(iter);
 	return 0;
 } /* socket_handle_incoming */
+#endif /* HAVE_SYS_EPOLL_H */
 
 /*
  * public API
@@ -654,12 +780,18 @@ sdb_fe_socket_t *
 sdb_fe_sock_create(void)
 {
 	sdb_fe_socket_t *sock;
+#ifndef HAVE_SYS_EPOLL_H
 	int flags;
+#endif
 
 	sock = calloc(1, sizeof(*sock));
 	if (! sock)
 		return NULL;
+#ifdef HAVE_SYS_EPOLL_H
+	sock->epoll_fd = -1;
+#else
 	sock->trigger[TRIGGER_READ] = sock->trigger[TRIGGER_WRITE] = -1;
+#endif
 
 	sock->open_connections = sdb_llist_create();
 	if (! sock->open_connections) {
@@ -667,6 +799,16 @@ sdb_fe_sock_create(void)
 		return NULL;
 	}
 
+#ifdef HAVE_SYS_EPOLL_H
+	sock->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (sock->epoll_fd < 0) {
+		char errbuf[1024];
+		sdb_log(SDB_LOG_ERR, "frontend: Failed to create epoll instance: %s",
+				sdb_strerror(errno, errbuf, sizeof(errbuf)));
+		sdb_fe_sock_destroy(sock);
+		return NULL;
+	}
+#else /* HAVE_SYS_EPOLL_H */
 	if (pipe(sock->trigger)) {
 		char errbuf[1024];
 		sdb_log(SDB_LOG_ERR, "frontend: Failed to create pipe: %s",
@@ -692,6 +834,7 @@ sdb_fe_sock_create(void)
 		sdb_fe_sock_destroy(sock);
 		return NULL;
 	}
+#endif /* HAVE_SYS_EPOLL_H */
 	return sock;
 } /* sdb_fe_sock_create */
 
@@ -703,11 +846,17 @@ sdb_fe_sock_destroy(sdb_fe_socket_t *sock)
 
 	socket_clear(sock);
 
+#ifdef HAVE_SYS_EPOLL_H
+	if (sock->epoll_fd >= 0)
+		close(sock->epoll_fd);
+	sock->epoll_fd = -1;
+#else /* HAVE_SYS_EPOLL_H */
 	if (sock->trigger[TRIGGER_WRITE] >= 0)
 		close(sock->trigger[TRIGGER_WRITE]);
 	if (sock->trigger[TRIGGER_READ] >= 0)
 		close(sock->trigger[TRIGGER_READ]);
 	sock->trigger[TRIGGER_READ] = sock->trigger[TRIGGER_WRITE] = -1;
+#endif /* HAVE_SYS_EPOLL_H */
 
 	sdb_llist_destroy(sock->open_connections);
 	sock->open_connections = NULL;
@@ -779,8 +928,10 @@ sdb_fe_sock_clear_listeners(sdb_fe_socket_t *sock)
 int
 sdb_fe_sock_listen_and_serve(sdb_fe_socket_t *sock, sdb_fe_loop_t *loop)
 {
+#ifndef HAVE_SYS_EPOLL_H
 	fd_set sockets;
 	int max_listen_fd = 0;
+#endif
 	size_t i;
 
 	pthread_t handler_threads[loop->num_threads];
@@ -793,18 +944,37 @@ sdb_fe_sock_listen_and_serve(sdb_fe_socket_t *sock, sdb_fe_loop_t *loop)
 	if (! loop->do_loop)
 		return 0;
 
+#ifndef HAVE_SYS_EPOLL_H
 	FD_ZERO(&sockets);
+#endif
 	for (i = 0; i < sock->listeners_num; ++i) {
 		listener_t *listener = sock->listeners + i;
+#ifdef HAVE_SYS_EPOLL_H
+		struct epoll_event ev;
+#endif
 
 		if (listener_listen(listener)) {
 			socket_close(sock);
 			return -1;
 		}
 
+#ifdef HAVE_SYS_EPOLL_H
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = listener;
+		if (epoll_ctl(sock->epoll_fd, EPOLL_CTL_ADD, listener->sock_fd, &ev)) {
+			char errbuf[1024];
+			sdb_log(SDB_LOG_ERR, "frontend: Failed to register listener %s: %s",
+					listener->address,
+					sdb_strerror(errno, errbuf, sizeof(errbuf)));
+			socket_close(sock);
+			return -1;
+		}
+#else /* HAVE_SYS_EPOLL_H */
 		FD_SET(listener->sock_fd, &sockets);
 		if (listener->sock_fd > max_listen_fd)
 			max_listen_fd = listener->sock_fd;
+#endif /* HAVE_SYS_EPOLL_H */
 	}
 
 	sock->chan = sdb_channel_create(1024, sizeof(sdb_conn_t *));
@@ -833,6 +1003,30 @@ sdb_fe_sock_listen_and_serve(sdb_fe_socket_t *sock, sdb_fe_loop_t *loop)
 		}
 	}
 
+#ifdef HAVE_SYS_EPOLL_H
+	while (loop->do_loop && num_threads) {
+		struct epoll_event events[64];
+		int n;
+
+		errno = 0;
+		n = epoll_wait(sock->epoll_fd, events,
+				(int)SDB_STATIC_ARRAY_LEN(events), /* timeout = */ 1000);
+		if (n < 0) {
+			char buf[1024];
+
+			if (errno == EINTR)
+				continue;
+
+			sdb_log(SDB_LOG_ERR, "frontend: Failed to monitor sockets: %s",
+					sdb_strerror(errno, buf, sizeof(buf)));
+			break;
+		}
+
+		/* handle new and open connections */
+		if (socket_handle_events(sock, events, n))
+			break;
+	}
+#else /* HAVE_SYS_EPOLL_H */
 	while (loop->do_loop && num_threads) {
 		struct timeval timeout = { 1, 0 }; /* one second */
 		sdb_llist_iter_t *iter;
@@ -897,6 +1091,7 @@ sdb_fe_sock_listen_and_serve(sdb_fe_socket_t *sock, sdb_fe_loop_t *loop)
 		if (socket_handle_incoming(sock, &ready, &exceptions))
 			break;
 	}
+#endif /* HAVE_SYS_EPOLL_H */
 
 	socket_close(sock);
 
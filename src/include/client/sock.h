@@ -118,7 +118,9 @@ sdb_client_close(sdb_client_t *client);
  * set to UINT32_MAX. The returned data does not include the status code and
  * message len as received from the remote side but only the data associated
  * with the message. The function handles all asynchronous log messages by
- * logging them at the right log level.
+ * logging them at the right log level. Chunked results (see
+ * SDB_CONNECTION_QUERY_CHUNKED) are reassembled and returned as if they had
+ * been sent in a single DATA message.
  *
  * Returns:
  *  - the number of bytes read
@@ -142,6 +144,22 @@ ssize_t
 sdb_client_send(sdb_client_t *client,
 		uint32_t cmd, uint32_t data_len, const char *data);
 
+/*
+ * sdb_client_send_query:
+ * Send the specified query to the server. If 'chunk_size' is non-zero, ask
+ * the server to send results in parts of at most that many bytes (see
+ * SDB_CONNECTION_QUERY_CHUNKED). The server replies with zero or more
+ * DATA_CHUNK messages followed by a final DATA message in that case; each
+ * part starts with the result type.
+ *
+ * Returns:
+ *  - the number of bytes send
+ *  - a negative value else.
+ */
+ssize_t
+sdb_client_send_query(sdb_client_t *client, uint32_t chunk_size,
+		uint32_t query_len, const char *query);
+
 /*
  * sdb_client_recv:
  * Receive data from the connection. All data is written to the specified
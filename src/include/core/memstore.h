@@ -39,6 +39,8 @@
 #include <stdbool.h>
 #include <stdio.h>
 
+#include <sys/types.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -92,10 +94,27 @@ typedef struct sdb_memstore_matcher sdb_memstore_matcher_t;
 /*
  * sdb_memstore_writer:
  * A store writer implementation that provides an in-memory object store. It
- * expects a store object as its user-data argument.
+ * expects a store object as its user-data argument. The writer supports
+ * SDB_STORE_WRITER_UPSERT, that is, it computes update intervals and rejects
+ * outdated updates while holding the store's lock.
  */
 extern sdb_store_writer_t sdb_memstore_writer;
 
+/*
+ * A write-ahead log records all updates of an in-memory store on disk.
+ */
+struct sdb_memstore_wal;
+typedef struct sdb_memstore_wal sdb_memstore_wal_t;
+#define SDB_MEMSTORE_WAL(obj) ((sdb_memstore_wal_t *)(obj))
+
+/*
+ * sdb_memstore_wal_writer:
+ * A store writer implementation that updates an in-memory store and records
+ * all updates in its write-ahead log. It expects a write-ahead log object as
+ * its user-data argument.
+ */
+extern sdb_store_writer_t sdb_memstore_wal_writer;
+
 /*
  * sdb_memstore_reader:
  * A store reader implementation that uses an in-memory object store. It
@@ -114,7 +133,14 @@ sdb_memstore_create(void);
  * sdb_memstore_host, sdb_memstore_service, sdb_memstore_metric,
  * sdb_memstore_attribute, sdb_memstore_metric_attr:
  * Store an object in the specified store. The hostname is expected to be
- * canonical.
+ * canonical. If the interval is zero, it will be computed as a moving average
+ * of the time between updates of an existing object.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a positive value if the new entry is not newer than the currently stored
+ *    entry (in this case, no update will happen)
+ *  - a negative value on error
  */
 int
 sdb_memstore_host(sdb_memstore_t *store, const char *name,
@@ -139,6 +165,160 @@ sdb_memstore_metric_attr(sdb_memstore_t *store, const char *hostname,
 		const char *metric, const char *key, const sdb_data_t *value,
 		sdb_time_t last_update, sdb_time_t interval);
 
+/*
+ * sdb_memstore_index_attributes:
+ * Enable the attribute index of the specified store. The index maps the
+ * values of host, service, and metric attributes to the objects having them.
+ * Lookups matching on the equality of an attribute (or its membership in an
+ * array) use it to evaluate only the candidate objects instead of scanning
+ * the whole store. The index is built from the current content of the store
+ * and maintained on each update from then on, at the cost of additional
+ * memory and slightly slower attribute updates. Enabling the index multiple
+ * times has no effect.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_memstore_index_attributes(sdb_memstore_t *store);
+
+/*
+ * sdb_memstore_index_trigrams:
+ * Enable the trigram index of the specified store. The index maps all
+ * (case-insensitive) three-character substrings of the names of hosts,
+ * services, and metrics and of the values of the attributes with the
+ * specified keys to the objects including them. Lookups matching a name or
+ * one of the selected attributes against a regular expression use it to
+ * evaluate only objects which include all literal strings required by the
+ * expression. Expressions without any literal string of at least three
+ * characters (that all matches have to include) cannot use the index.
+ *
+ * The index is built from the current content of the store and maintained on
+ * each update from then on. Enabling it again replaces the index, e.g., to
+ * change the list of attribute keys.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_memstore_index_trigrams(sdb_memstore_t *store,
+		const char * const *keys, size_t keys_num);
+
+/*
+ * sdb_memstore_scan_threads:
+ * Set the number of threads used for full scans of the specified store
+ * (including the calling thread). Scans of large stores then split the hosts
+ * into ranges which are evaluated concurrently. The matching objects are
+ * collected per range and passed on to the callback in order, from the
+ * thread that started the scan, once all ranges have been evaluated.
+ * Defaults to one, that is, scans run serially.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_memstore_scan_threads(sdb_memstore_t *store, size_t threads);
+
+/*
+ * sdb_memstore_expire:
+ * Remove objects which have not been updated for a while from the store. An
+ * object expires if its last update is older than 'factor' times its update
+ * interval or older than 'ttl' (relative to 'now'). Either check is disabled
+ * if set to zero; objects without a known update interval only expire based
+ * on the TTL. Objects which have any remaining child objects are never
+ * removed.
+ *
+ * At most 'max_hosts' hosts (or all hosts, if zero) are checked per call,
+ * each while holding the store's lock on its own, such that expiry never
+ * blocks updates for long. The next call continues with the next host,
+ * wrapping around at the end of the store. This makes the function suitable
+ * for running periodically in the background.
+ *
+ * Returns:
+ *  - the number of removed objects on success
+ *  - a negative value else
+ */
+ssize_t
+sdb_memstore_expire(sdb_memstore_t *store, sdb_time_t now,
+		double factor, sdb_time_t ttl, size_t max_hosts);
+
+/*
+ * sdb_memstore_snapshot:
+ * Write a snapshot of all objects of the specified store to the specified
+ * file. The snapshot is written to a temporary file first which then
+ * replaces the target, so an existing snapshot is never left incomplete.
+ * Each host is written while holding the store's lock, that is, the snapshot
+ * is consistent per host but updates may happen in between hosts.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_memstore_snapshot(sdb_memstore_t *store, const char *filename);
+
+/*
+ * sdb_memstore_load:
+ * Load all objects from the specified snapshot file into the store. The file
+ * is memory-mapped and validated before loading any objects. Objects are
+ * stored in batches; any objects in the store which are newer than the
+ * snapshot are left untouched.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a positive value if the file does not exist
+ *  - a negative value else
+ */
+int
+sdb_memstore_load(sdb_memstore_t *store, const char *filename);
+
+/*
+ * sdb_memstore_wal_create:
+ * Open the write-ahead log stored in the specified file for the specified
+ * store. Any records found in the log file are replayed into the store,
+ * which should have been restored from the latest snapshot before. Use the
+ * returned object as user-data of the sdb_memstore_wal_writer to log all
+ * updates applied to the store.
+ *
+ * Records are collected in memory and written to disk in groups once
+ * 'batch_size' bytes are pending or when calling sdb_memstore_wal_sync().
+ * Use a batch size of zero to write each record right away.
+ *
+ * Returns:
+ *  - a write-ahead log object on success
+ *  - NULL else
+ */
+sdb_memstore_wal_t *
+sdb_memstore_wal_create(sdb_memstore_t *store, const char *filename,
+		size_t batch_size);
+
+/*
+ * sdb_memstore_wal_sync:
+ * Write all pending records to the log file and sync it to disk.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_memstore_wal_sync(sdb_memstore_wal_t *wal);
+
+/*
+ * sdb_memstore_wal_checkpoint:
+ * Compact the write-ahead log by writing a snapshot of the store to the
+ * specified file (see sdb_memstore_snapshot()) and discarding all records
+ * which are included in the snapshot.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_memstore_wal_checkpoint(sdb_memstore_wal_t *wal, const char *snapshot);
+
 /*
  * sdb_memstore_get_host:
  * Query the specified store for a host by its (canonicalized) name.
@@ -492,6 +672,10 @@ typedef int (*sdb_memstore_lookup_cb)(sdb_memstore_obj_t *obj,
  * filter will be used to preselect objects for further evaluation. See the
  * description of 'sdb_memstore_matcher_matches' for details.
  *
+ * The scan operates on a consistent view of the store taken when starting
+ * the scan; the store is not locked while evaluating matchers or calling
+ * the callback, so concurrent updates are neither blocked nor visible.
+ *
  * Returns:
  *  - 0 on success
  *  - a negative value else
@@ -28,6 +28,8 @@
 #ifndef SDB_CORE_OBJECT_H
 #define SDB_CORE_OBJECT_H 1
 
+#include "utils/slab.h"
+
 #include <stdarg.h>
 #include <stddef.h>
 
@@ -52,14 +54,16 @@ struct sdb_type {
 struct sdb_object {
 	sdb_type_t type;
 	int ref_cnt;
+	/* private: how the object's memory has been allocated */
+	unsigned int flags;
 	char *name;
 };
-#define SDB_OBJECT_INIT { SDB_TYPE_INIT, 1, NULL }
-#define SDB_OBJECT_TYPED_INIT(t) { (t), 1, NULL }
+#define SDB_OBJECT_INIT { SDB_TYPE_INIT, 1, 0, NULL }
+#define SDB_OBJECT_TYPED_INIT(t) { (t), 1, 0, NULL }
 
 #define SDB_OBJECT_STATIC(name) { \
 	/* type */ { sizeof(sdb_object_t), NULL, NULL }, \
-	/* ref-cnt */ 1, (name) }
+	/* ref-cnt */ 1, /* flags */ 0, (name) }
 
 typedef struct {
 	sdb_object_t super;
@@ -97,7 +101,8 @@ typedef int (*sdb_object_lookup_cb)(const sdb_object_t *, const void *user_data)
  * callback may be called on objects that were only half-way initialized. The
  * callback has to handle that case correctly.
  *
- * The reference count of the new object will be 1.
+ * The reference count of the new object will be 1. The name is stored in
+ * the same allocation as the object itself.
  *
  * Returns:
  *  - the newly allocated object
@@ -108,6 +113,19 @@ sdb_object_create(const char *name, sdb_type_t type, ...);
 sdb_object_t *
 sdb_object_vcreate(const char *name, sdb_type_t type, va_list ap);
 
+/*
+ * sdb_object_create_slab, sdb_object_vcreate_slab:
+ * Create a new object like sdb_object_create but allocate it from the
+ * specified slab. The object will be returned to the slab once its reference
+ * count drops to zero, so the slab has to outlive all of its objects.
+ */
+sdb_object_t *
+sdb_object_create_slab(sdb_slab_t *slab, const char *name,
+		sdb_type_t type, ...);
+sdb_object_t *
+sdb_object_vcreate_slab(sdb_slab_t *slab, const char *name,
+		sdb_type_t type, va_list ap);
+
 /*
  * sdb_object_create_simple:
  * Create a "simple" object without custom initialization and optional
@@ -149,7 +167,8 @@ sdb_object_create_wrapper(const char *name,
  * sdb_object_deref:
  * Dereference the object and free the allocated memory in case the ref-count
  * drops to zero. In case a 'destructor' had been registered with the object,
- * it will be called before freeing the memory.
+ * it will be called before freeing the memory. Reference counts are updated
+ * atomically, so objects may be shared between threads.
  */
 void
 sdb_object_deref(sdb_object_t *obj);
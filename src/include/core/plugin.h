@@ -45,8 +45,12 @@ extern "C" {
 
 typedef struct {
 	sdb_time_t interval;
+
+	/* maximum number of collector callbacks of the plugin running
+	 * concurrently; zero means unlimited */
+	size_t max_concurrency;
 } sdb_plugin_ctx_t;
-#define SDB_PLUGIN_CTX_INIT { 0 }
+#define SDB_PLUGIN_CTX_INIT { 0, 1 }
 
 typedef struct {
 	char *plugin_name;
@@ -74,8 +78,37 @@ typedef struct {
 typedef struct {
 	bool do_loop;
 	sdb_time_t default_interval;
+
+	/* number of threads running collector callbacks */
+	size_t num_threads;
+
+	/* upper bound of the random delay added to the first update of each
+	 * collector; it never exceeds the collector's interval */
+	sdb_time_t max_jitter;
 } sdb_plugin_loop_t;
-#define SDB_PLUGIN_LOOP_INIT { 1, 0 }
+#define SDB_PLUGIN_LOOP_INIT { 1, 0, 4, SECS_TO_SDB_TIME(10) }
+
+/*
+ * sdb_plugin_cname_cache_opts_t:
+ * Settings of the cache of canonicalized hostnames. A size of zero disables
+ * the cache; a TTL of zero disables caching of the respective results.
+ * Negative results are those where no cname callback changed the name.
+ */
+typedef struct {
+	size_t size;
+	sdb_time_t ttl;
+	sdb_time_t negative_ttl;
+} sdb_plugin_cname_cache_opts_t;
+#define SDB_PLUGIN_CNAME_CACHE_OPTS_INIT { \
+	/* size */ 4096, \
+	/* ttl */ SECS_TO_SDB_TIME(300), \
+	/* negative_ttl */ SECS_TO_SDB_TIME(60) }
+
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	size_t entries;
+} sdb_plugin_cname_cache_stats_t;
 
 /*
  * sdb_plugin_load:
@@ -379,8 +412,12 @@ sdb_plugin_shutdown_all(void);
 
 /*
  * sdb_plugin_collector_loop:
- * Loop until loop->do_loop is false, calling the next collector function on
- * each iteration and once its next update interval is passed.
+ * Loop until loop->do_loop is false, calling each collector function once
+ * its next update interval is passed. Collectors are run concurrently by a
+ * pool of loop->num_threads threads (the calling thread being one of them)
+ * while limiting the number of concurrently running collectors of each
+ * plugin to the plugin's max_concurrency setting. The function returns once
+ * all threads have terminated.
  *
  * Returns:
  *  - 0 on success
@@ -399,6 +436,28 @@ sdb_plugin_collector_loop(sdb_plugin_loop_t *loop);
 char *
 sdb_plugin_cname(char *hostname);
 
+/*
+ * sdb_plugin_cname_cache_configure:
+ * (Re-)configure the cache used by sdb_plugin_cname. This drops all cached
+ * entries. The cache is enabled using the default settings
+ * (SDB_PLUGIN_CNAME_CACHE_OPTS_INIT) unless configured otherwise. It is
+ * flushed whenever the set of registered cname callbacks changes.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_plugin_cname_cache_configure(const sdb_plugin_cname_cache_opts_t *opts);
+
+/*
+ * sdb_plugin_cname_cache_stats:
+ * Retrieve the number of cache hits and misses and the number of currently
+ * cached entries.
+ */
+void
+sdb_plugin_cname_cache_stats(sdb_plugin_cname_cache_stats_t *stats);
+
 /*
  * sdb_plugin_log:
  * Log the specified message using all registered log callbacks. The message
@@ -473,6 +532,43 @@ sdb_plugin_query(sdb_ast_node_t *ast,
 		sdb_store_writer_t *w, sdb_object_t *wd,
 		sdb_query_opts_t *opts, sdb_strbuf_t *errbuf);
 
+/*
+ * sdb_plugin_prepare_query:
+ * Prepare the query specified by 'ast' for execution by the registered
+ * store reader. The prepared query may be executed any number of times, also
+ * concurrently, using sdb_plugin_execute_query, as long as the reader which
+ * prepared it remains registered (see sdb_plugin_query_is_valid). Any errors
+ * will be written to 'errbuf'.
+ *
+ * Returns:
+ *  - a prepared query object on success
+ *  - NULL else
+ */
+sdb_object_t *
+sdb_plugin_prepare_query(sdb_ast_node_t *ast, sdb_strbuf_t *errbuf);
+
+/*
+ * sdb_plugin_query_is_valid:
+ * Check whether the specified prepared query may still be executed, that is,
+ * whether the store reader which prepared it is still registered.
+ */
+bool
+sdb_plugin_query_is_valid(sdb_object_t *q);
+
+/*
+ * sdb_plugin_execute_query:
+ * Execute a query previously prepared using sdb_plugin_prepare_query. See
+ * sdb_plugin_query for details.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_plugin_execute_query(sdb_object_t *q,
+		sdb_store_writer_t *w, sdb_object_t *wd,
+		sdb_query_opts_t *opts, sdb_strbuf_t *errbuf);
+
 /*
  * sdb_plugin_store_host, sdb_plugin_store_service, sdb_plugin_store_metric,
  * sdb_plugin_store_attribute, sdb_plugin_store_service_attribute,
@@ -502,6 +598,80 @@ int
 sdb_plugin_store_metric_attribute(const char *hostname, const char *metric,
 		const char *key, const sdb_data_t *value, sdb_time_t last_update);
 
+/*
+ * A batch collects objects to be stored in the database at once. All
+ * canonicalized hostnames and any other data are copied into the batch.
+ * Consecutive objects belonging to the same host share a single invocation of
+ * the cname callbacks. Batches may be submitted and reused any number of
+ * times.
+ *
+ * A batch object inherits from sdb_object_t and, thus, may safely be cast to
+ * a generic object.
+ */
+struct sdb_plugin_batch;
+typedef struct sdb_plugin_batch sdb_plugin_batch_t;
+
+/*
+ * sdb_plugin_batch_create:
+ * Allocate a new, empty batch.
+ */
+sdb_plugin_batch_t *
+sdb_plugin_batch_create(void);
+
+/*
+ * sdb_plugin_batch_host, sdb_plugin_batch_service, sdb_plugin_batch_metric,
+ * sdb_plugin_batch_attribute, sdb_plugin_batch_service_attribute,
+ * sdb_plugin_batch_metric_attribute:
+ * Add an object to a batch. The arguments match those of the respective
+ * sdb_plugin_store_* function. Parent objects have to be added before their
+ * children.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_plugin_batch_host(sdb_plugin_batch_t *batch, const char *name,
+		sdb_time_t last_update);
+int
+sdb_plugin_batch_service(sdb_plugin_batch_t *batch, const char *hostname,
+		const char *name, sdb_time_t last_update);
+int
+sdb_plugin_batch_metric(sdb_plugin_batch_t *batch, const char *hostname,
+		const char *name, sdb_metric_store_t *store, sdb_time_t last_update);
+int
+sdb_plugin_batch_attribute(sdb_plugin_batch_t *batch, const char *hostname,
+		const char *key, const sdb_data_t *value, sdb_time_t last_update);
+int
+sdb_plugin_batch_service_attribute(sdb_plugin_batch_t *batch,
+		const char *hostname, const char *service,
+		const char *key, const sdb_data_t *value, sdb_time_t last_update);
+int
+sdb_plugin_batch_metric_attribute(sdb_plugin_batch_t *batch,
+		const char *hostname, const char *metric,
+		const char *key, const sdb_data_t *value, sdb_time_t last_update);
+
+/*
+ * sdb_plugin_batch_len:
+ * Returns the number of entries currently stored in the batch.
+ */
+size_t
+sdb_plugin_batch_len(sdb_plugin_batch_t *batch);
+
+/*
+ * sdb_plugin_store_batch:
+ * Store all objects of a batch in the database by sending them to all
+ * registered store writer plugins and clear the batch afterwards. Writers
+ * not supporting batches receive each object individually.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a positive value if any of the objects was older than the stored entry
+ *  - a negative value if storing any of the objects failed
+ */
+int
+sdb_plugin_store_batch(sdb_plugin_batch_t *batch);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
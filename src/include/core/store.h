@@ -167,6 +167,32 @@ typedef struct {
 } sdb_store_attribute_t;
 #define SDB_STORE_ATTRIBUTE_INIT { NULL, 0, NULL, NULL, SDB_DATA_INIT, 0, 0, NULL, 0 }
 
+/*
+ * sdb_store_batch_entry_t represents a single object of a batch. The type
+ * (SDB_HOST, SDB_SERVICE, SDB_METRIC, or SDB_ATTRIBUTE) determines which
+ * member of the 'obj' union is valid.
+ */
+typedef struct {
+	int type;
+	union {
+		sdb_store_host_t host;
+		sdb_store_service_t service;
+		sdb_store_metric_t metric;
+		sdb_store_attribute_t attribute;
+	} obj;
+} sdb_store_batch_entry_t;
+
+/*
+ * sdb_store_batch_t represents a sequence of objects to be stored at once.
+ * Entries are stored in order, that is, parent objects have to be listed
+ * before any of their children.
+ */
+typedef struct {
+	sdb_store_batch_entry_t *entries;
+	size_t entries_num;
+} sdb_store_batch_t;
+#define SDB_STORE_BATCH_INIT { NULL, 0 }
+
 /*
  * A JSON formatter converts stored objects into the JSON format.
  * See http://www.ietf.org/rfc/rfc4627.txt
@@ -177,6 +203,20 @@ typedef struct {
 struct sdb_store_json_formatter;
 typedef struct sdb_store_json_formatter sdb_store_json_formatter_t;
 
+/*
+ * Flags describing the capabilities of a store writer.
+ */
+enum {
+	/*
+	 * SDB_STORE_WRITER_UPSERT:
+	 * The writer looks up the currently stored entry while storing an object.
+	 * It rejects updates which are not newer than the stored entry and
+	 * determines the update interval itself if none has been specified. Thus,
+	 * callers do not have to query the store before writing to it.
+	 */
+	SDB_STORE_WRITER_UPSERT = 1 << 0,
+};
+
 /*
  * A store writer describes the interface for plugins implementing a store.
  *
@@ -225,6 +265,23 @@ typedef struct {
 	 * the store.
 	 */
 	int (*store_attribute)(sdb_store_attribute_t *attr, sdb_object_t *user_data);
+
+	/*
+	 * store_batch (optional):
+	 * Add/update all objects of a batch in the store, in order. This allows
+	 * to amortize the cost of locking and lookups across many objects. The
+	 * return value is negative if storing any of the objects failed and
+	 * positive if any of the objects was older than the stored entry. If not
+	 * specified, each entry will be passed to the respective callback above.
+	 */
+	int (*store_batch)(sdb_store_batch_t *batch, sdb_object_t *user_data);
+
+	/*
+	 * flags:
+	 * A bitwise OR of SDB_STORE_WRITER_* flags describing the capabilities of
+	 * the writer.
+	 */
+	int flags;
 } sdb_store_writer_t;
 
 /*
@@ -171,6 +171,7 @@ sdb_conn_session_start(sdb_conn_t *conn);
  * Handle the SDB_CONNECTION_QUERY, SDB_CONNECTION_FETCH, SDB_CONNECTION_LIST,
  * SDB_CONNECTION_LOOKUP, and SDB_CONNECTION_STORE commands respectively. It
  * is expected that the current command has been initialized already.
+ * sdb_conn_query handles SDB_CONNECTION_QUERY_CHUNKED as well.
  *
  * Returns:
  *  - 0 on success
@@ -187,6 +188,53 @@ sdb_conn_lookup(sdb_conn_t *conn);
 int
 sdb_conn_store(sdb_conn_t *conn);
 
+/*
+ * sdb_conn_prepare, sdb_conn_execute:
+ * Handle the SDB_CONNECTION_PREPARE and SDB_CONNECTION_EXECUTE commands
+ * respectively. Prepared statements are tracked per connection and share
+ * the parsed and prepared queries of the query cache.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_conn_prepare(sdb_conn_t *conn);
+int
+sdb_conn_execute(sdb_conn_t *conn);
+
+/*
+ * query cache:
+ * Parsed and prepared queries are cached by their normalized query string
+ * and shared between all connections. Least recently used queries are
+ * evicted once the cache is full.
+ */
+
+#define SDB_CONN_QUERY_CACHE_SIZE_DEFAULT 1024
+
+typedef struct {
+	uint64_t hits;
+	uint64_t misses;
+	size_t entries;
+} sdb_conn_query_cache_stats_t;
+
+/*
+ * sdb_conn_query_cache_configure:
+ * Set the maximum number of cached queries and flush the cache. A size of
+ * zero disables the cache. The size defaults to
+ * SDB_CONN_QUERY_CACHE_SIZE_DEFAULT.
+ */
+void
+sdb_conn_query_cache_configure(size_t size);
+
+/*
+ * sdb_conn_query_cache_stats:
+ * Retrieve the number of cache hits and misses and the number of currently
+ * cached queries.
+ */
+void
+sdb_conn_query_cache_stats(sdb_conn_query_cache_stats_t *stats);
+
 /*
  * sdb_conn_store_host, sdb_conn_store_service, sdb_conn_store_metric,
  * sdb_conn_store_attribute:
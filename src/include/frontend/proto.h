@@ -123,6 +123,25 @@ typedef enum {
 	 * | ...                           |
 	 */
 	SDB_CONNECTION_DATA = 100,
+
+	/*
+	 * SDB_CONNECTION_DATA_CHUNK:
+	 * Carries a part of the result of a chunked query (see
+	 * SDB_CONNECTION_QUERY_CHUNKED). The message body has the same layout as
+	 * that of a DATA message but only includes the next fixed-size part of
+	 * the JSON encoded result. The result is complete once the final DATA
+	 * message, carrying the remaining part, has been received. The result
+	 * has to be discarded if the server sends an ERROR message instead.
+	 *
+	 * 0               32              64
+	 * +---------------+---------------+
+	 * | DATA_CHUNK    | length        |
+	 * +---------------+---------------+
+	 * | result type   | partial       |
+	 * +---------------+ result ...    |
+	 * | ...                           |
+	 */
+	SDB_CONNECTION_DATA_CHUNK,
 } sdb_conn_status_t;
 
 /* accepted commands / state of the connection */
@@ -245,6 +264,61 @@ typedef enum {
 	 */
 	SDB_CONNECTION_TIMESERIES,
 
+	/*
+	 * SDB_CONNECTION_QUERY_CHUNKED:
+	 * Execute a query in the server like SDB_CONNECTION_QUERY but let the
+	 * server send the result of LIST, LOOKUP, and FETCH commands as a
+	 * sequence of DATA_CHUNK messages followed by a final DATA message, while
+	 * the query is still being executed. The message body shall include the
+	 * maximum size of the partial results, encoded as a 32bit integer in
+	 * network byte-order, followed by the query string. A size of zero
+	 * selects the server's default (64kB). The server limits the size to 1MB.
+	 *
+	 * 0               32              64
+	 * +---------------+---------------+
+	 * | QUERY_CHUNKED | length        |
+	 * +---------------+---------------+
+	 * | chunk size    | query         |
+	 * +---------------+ string ...    |
+	 * | ...                           |
+	 */
+	SDB_CONNECTION_QUERY_CHUNKED,
+
+	/*
+	 * SDB_CONNECTION_PREPARE:
+	 * Parse and prepare a single query command for repeated execution using
+	 * SDB_CONNECTION_EXECUTE. The message body shall include the query
+	 * string. On success, the server replies with SDB_CONNECTION_OK and a
+	 * message body including the statement ID, encoded as a 32bit integer in
+	 * network byte-order. The ID is valid until the connection is closed.
+	 * Preparing the same query again returns the same ID. The number of
+	 * prepared statements per connection is limited.
+	 *
+	 * 0               32              64
+	 * +---------------+---------------+
+	 * | PREPARE       | len(query)    |
+	 * +---------------+---------------+
+	 * | query string ...              |
+	 */
+	SDB_CONNECTION_PREPARE,
+
+	/*
+	 * SDB_CONNECTION_EXECUTE:
+	 * Execute a statement prepared using SDB_CONNECTION_PREPARE. The message
+	 * body shall include the statement ID and, optionally, a chunk size, both
+	 * encoded as 32bit integers in network byte-order. The server replies as
+	 * it does for SDB_CONNECTION_QUERY or, if a chunk size has been
+	 * specified, as it does for SDB_CONNECTION_QUERY_CHUNKED.
+	 *
+	 * 0               32              64
+	 * +---------------+---------------+
+	 * | EXECUTE       | length        |
+	 * +---------------+---------------+
+	 * | statement ID  | [chunk size]  |
+	 * +---------------+---------------+
+	 */
+	SDB_CONNECTION_EXECUTE,
+
 	/*
 	 * SDB_CONNECTION_STORE:
 	 * Execute the 'STORE' command in the server. The message body shall
@@ -328,6 +402,9 @@ typedef enum {
 		: ((t) == SDB_CONNECTION_LIST) ? "LIST" \
 		: ((t) == SDB_CONNECTION_LOOKUP) ? "LOOKUP" \
 		: ((t) == SDB_CONNECTION_TIMESERIES) ? "TIMESERIES" \
+		: ((t) == SDB_CONNECTION_QUERY_CHUNKED) ? "QUERY_CHUNKED" \
+		: ((t) == SDB_CONNECTION_PREPARE) ? "PREPARE" \
+		: ((t) == SDB_CONNECTION_EXECUTE) ? "EXECUTE" \
 		: ((t) == SDB_CONNECTION_STORE) ? "STORE" \
 		: "UNKNOWN")
 
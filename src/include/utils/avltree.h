@@ -37,9 +37,14 @@ extern "C" {
 #endif
 
 /*
- * An AVL tree implements Adelson-Velskii and Landis' self-balancing search
- * tree. It supports search, insert, and delete operations in average and
- * worst-case time-complexity O(log n).
+ * An AVL tree is an ordered container of objects, indexed by their names
+ * (ignoring case). It supports search, insert, and delete operations in
+ * average and worst-case time-complexity O(log n) and in-order iteration.
+ *
+ * Despite its name, it is implemented as a B+-tree: objects are stored in
+ * linked leaf nodes of up to 32 entries along with a prefix of their
+ * case-folded names, which keeps the number of cache misses per operation
+ * low. The name has been kept for compatibility.
  */
 struct sdb_avltree;
 typedef struct sdb_avltree sdb_avltree_t;
@@ -73,8 +78,8 @@ sdb_avltree_clear(sdb_avltree_t *tree);
 /*
  * sdb_avltree_insert:
  * Insert a new node into the tree. Each object must be unique. This operation
- * may change the structure of the tree by rebalancing subtrees which no
- * longer comply with the rules of AVL.
+ * may change the structure of the tree by splitting nodes. Any iterators of
+ * the tree are invalidated.
  *
  * Returns:
  *  - 0 on success
@@ -83,6 +88,19 @@ sdb_avltree_clear(sdb_avltree_t *tree);
 int
 sdb_avltree_insert(sdb_avltree_t *tree, sdb_object_t *obj);
 
+/*
+ * sdb_avltree_remove:
+ * Remove the object with the specified name from the tree, releasing the
+ * object (decrement the ref-count). This operation may change the structure
+ * of the tree by merging nodes. Any iterators of the tree are invalidated.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value if no such object exists
+ */
+int
+sdb_avltree_remove(sdb_avltree_t *tree, const char *name);
+
 /*
  * sdb_avltree_lookup:
  * Lookup an object from a tree by name.
@@ -113,6 +131,15 @@ sdb_avltree_iter_has_next(sdb_avltree_iter_t *iter);
 sdb_object_t *
 sdb_avltree_iter_get_next(sdb_avltree_iter_t *iter);
 
+/*
+ * sdb_avltree_get_iter_from:
+ * Iterate through all nodes of the tree starting at the smallest element
+ * whose name is not less than the specified name. If the name is NULL, this
+ * is the same as sdb_avltree_get_iter().
+ */
+sdb_avltree_iter_t *
+sdb_avltree_get_iter_from(sdb_avltree_t *tree, const char *name);
+
 /*
  * sdb_avltree_iter_peek_next:
  * Peek at the next node, if there is one. This is similar to has_next() but
@@ -134,9 +161,9 @@ sdb_avltree_size(sdb_avltree_t *tree);
 
 /*
  * sdb_avltree_valid:
- * Validate a tree, checking if all rules of AVL are met. All errors will be
- * reported through the logging sub-system. This function is mainly intended
- * for debugging and (unit) testing.
+ * Validate a tree, checking if all rules of B+-trees are met. All errors will
+ * be reported through the logging sub-system. This function is mainly
+ * intended for debugging and (unit) testing.
  *
  * Returns:
  *  - true if the tree is valid
@@ -0,0 +1,123 @@
+/*
+ * SysDB - src/include/utils/hashtable.h
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SDB_UTILS_HASHTABLE_H
+#define SDB_UTILS_HASHTABLE_H 1
+
+#include "core/object.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A hash table indexes objects by their names, ignoring case. It uses open
+ * addressing and stores the hash of each object along with it. It supports
+ * search, insert, and delete operations in average time-complexity O(1) but
+ * does not keep the objects in any particular order. Thus, it is meant to be
+ * used alongside an AVL tree when both, fast lookups and ordered iteration,
+ * are required.
+ */
+struct sdb_hashtable;
+typedef struct sdb_hashtable sdb_hashtable_t;
+
+/*
+ * sdb_hashtable_create:
+ * Creates a hash table. Objects will be indexed by their names.
+ */
+sdb_hashtable_t *
+sdb_hashtable_create(void);
+
+/*
+ * sdb_hashtable_destroy:
+ * Destroy the specified hash table and release all included objects
+ * (decrement the ref-count).
+ */
+void
+sdb_hashtable_destroy(sdb_hashtable_t *table);
+
+/*
+ * sdb_hashtable_clear:
+ * Remove all objects from the table, releasing them (decrement the
+ * ref-count).
+ */
+void
+sdb_hashtable_clear(sdb_hashtable_t *table);
+
+/*
+ * sdb_hashtable_insert:
+ * Insert an object into the table, incrementing its ref-count. Each object
+ * name must be unique.
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value else
+ */
+int
+sdb_hashtable_insert(sdb_hashtable_t *table, sdb_object_t *obj);
+
+/*
+ * sdb_hashtable_remove:
+ * Remove the object with the specified name from the table, releasing the
+ * object (decrement the ref-count).
+ *
+ * Returns:
+ *  - 0 on success
+ *  - a negative value if no such object exists
+ */
+int
+sdb_hashtable_remove(sdb_hashtable_t *table, const char *name);
+
+/*
+ * sdb_hashtable_lookup:
+ * Lookup an object from a table by name. The ref-count of the object is
+ * incremented before returning it. The caller is responsible for releasing
+ * the object once it's no longer used.
+ *
+ * Returns:
+ *  - the requested object
+ *  - NULL if no such object exists
+ */
+sdb_object_t *
+sdb_hashtable_lookup(sdb_hashtable_t *table, const char *name);
+
+/*
+ * sdb_hashtable_size:
+ * Returns the number of objects in the table.
+ */
+size_t
+sdb_hashtable_size(sdb_hashtable_t *table);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* ! SDB_UTILS_HASHTABLE_H */
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
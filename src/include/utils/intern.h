@@ -0,0 +1,80 @@
+/*
+ * SysDB - src/include/utils/intern.h
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * SysDB string interning:
+ * The intern table keeps a single, reference counted copy of each distinct
+ * string. Interning a string which is already known returns the existing
+ * copy, such that equal strings may be compared by pointer. Interned strings
+ * must not be modified. All functions are thread-safe.
+ */
+
+#ifndef SDB_UTILS_INTERN_H
+#define SDB_UTILS_INTERN_H 1
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * sdb_intern:
+ * Return the interned copy of the specified string, adding it to the table
+ * if necessary. The caller owns a reference to the returned string which has
+ * to be released using sdb_intern_release.
+ *
+ * Returns:
+ *  - the interned string on success
+ *  - NULL else
+ */
+char *
+sdb_intern(const char *str);
+
+/*
+ * sdb_intern_release:
+ * Release a reference to an interned string. The string is removed from the
+ * table once the last reference has been released.
+ */
+void
+sdb_intern_release(char *str);
+
+/*
+ * sdb_intern_size:
+ * Return the number of distinct strings stored in the intern table.
+ */
+size_t
+sdb_intern_size(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* ! SDB_UTILS_INTERN_H */
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
@@ -0,0 +1,93 @@
+/*
+ * SysDB - src/include/utils/slab.h
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * SysDB slab allocator:
+ * A slab hands out small chunks of memory carved from large, aligned pages.
+ * Chunks are grouped into size classes; each page only holds chunks of a
+ * single class. This avoids the per-allocation overhead of malloc and keeps
+ * objects of the same kind close to each other. Chunks may be freed without
+ * knowing the slab they were allocated from. All functions are thread-safe.
+ */
+
+#ifndef SDB_UTILS_SLAB_H
+#define SDB_UTILS_SLAB_H 1
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct sdb_slab sdb_slab_t;
+
+/*
+ * sdb_slab_create, sdb_slab_destroy:
+ * Allocate / deallocate a slab. Destroying a slab releases all memory
+ * allocated from it, including any chunks that have not been freed yet.
+ */
+sdb_slab_t *
+sdb_slab_create(void);
+
+void
+sdb_slab_destroy(sdb_slab_t *slab);
+
+/*
+ * sdb_slab_alloc:
+ * Allocate a chunk of at least 'size' bytes from the slab. The memory is
+ * suitably aligned for any kind of variable but not initialized. Large
+ * allocations are served by a page of their own.
+ *
+ * Returns:
+ *  - a pointer to the allocated memory on success
+ *  - NULL else
+ */
+void *
+sdb_slab_alloc(sdb_slab_t *slab, size_t size);
+
+/*
+ * sdb_slab_free:
+ * Return a chunk previously allocated using sdb_slab_alloc to its slab.
+ */
+void
+sdb_slab_free(void *ptr);
+
+/*
+ * sdb_slab_stats:
+ * Query the number of pages and the number of chunks currently allocated
+ * from the slab. Either pointer may be NULL.
+ */
+void
+sdb_slab_stats(sdb_slab_t *slab, size_t *pages, size_t *chunks);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* ! SDB_UTILS_SLAB_H */
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
@@ -66,9 +66,12 @@ typedef struct {
 	int metrics_updated;
 	int metrics_failed;
 
+	/* all objects are submitted at once after reading the value list */
+	sdb_plugin_batch_t *batch;
+
 	user_data_t *ud;
 } state_t;
-#define STATE_INIT { NULL, 0, 0, 0, NULL }
+#define STATE_INIT { NULL, 0, 0, 0, NULL, NULL }
 
 /*
  * private helper functions
@@ -124,24 +127,18 @@ store_host(state_t *state, const char *hostname, sdb_time_t last_update)
 		return -1;
 	}
 
-	status = sdb_plugin_store_host(hostname, last_update);
+	status = sdb_plugin_batch_host(state->batch, hostname, last_update);
 
 	if (status < 0) {
 		sdb_log(SDB_LOG_ERR, "Failed to store/update host '%s'.", hostname);
 		return -1;
 	}
-	else if (status > 0) /* value too old */
-		return 0;
-
-	sdb_log(SDB_LOG_DEBUG, "Added/updated host '%s' "
-			"(last update timestamp = %"PRIsdbTIME").",
-			hostname, last_update);
 	return 0;
 } /* store_host */
 
 static int
 add_metrics(const char *hostname, char *plugin, char *type,
-		sdb_time_t last_update, user_data_t *ud)
+		sdb_time_t last_update, sdb_plugin_batch_t *batch, user_data_t *ud)
 {
 	char  name[strlen(plugin) + strlen(type) + 2];
 	char *plugin_instance, *type_instance;
@@ -159,10 +156,12 @@ add_metrics(const char *hostname, char *plugin, char *type,
 	if (ud->ts_base) {
 		snprintf(metric_id, sizeof(metric_id), "%s/%s/%s.rrd",
 				ud->ts_base, hostname, name);
-		status = sdb_plugin_store_metric(hostname, name, &store, last_update);
+		status = sdb_plugin_batch_metric(batch, hostname, name,
+				&store, last_update);
 	}
 	else
-		status = sdb_plugin_store_metric(hostname, name, NULL, last_update);
+		status = sdb_plugin_batch_metric(batch, hostname, name,
+				NULL, last_update);
 	if (status < 0) {
 		sdb_log(SDB_LOG_ERR, "Failed to store/update metric '%s/%s'.", hostname, name);
 		return -1;
@@ -174,7 +173,7 @@ add_metrics(const char *hostname, char *plugin, char *type,
 		++plugin_instance;
 
 		data.data.string = plugin_instance;
-		sdb_plugin_store_metric_attribute(hostname, name,
+		sdb_plugin_batch_metric_attribute(batch, hostname, name,
 				"plugin_instance", &data, last_update);
 	}
 
@@ -184,14 +183,16 @@ add_metrics(const char *hostname, char *plugin, char *type,
 		++type_instance;
 
 		data.data.string = type_instance;
-		sdb_plugin_store_metric_attribute(hostname, name,
+		sdb_plugin_batch_metric_attribute(batch, hostname, name,
 				"type_instance", &data, last_update);
 	}
 
 	data.data.string = plugin;
-	sdb_plugin_store_metric_attribute(hostname, name, "plugin", &data, last_update);
+	sdb_plugin_batch_metric_attribute(batch, hostname, name,
+			"plugin", &data, last_update);
 	data.data.string = type;
-	sdb_plugin_store_metric_attribute(hostname, name, "type", &data, last_update);
+	sdb_plugin_batch_metric_attribute(batch, hostname, name,
+			"type", &data, last_update);
 	return 0;
 } /* add_metrics */
 
@@ -242,7 +243,7 @@ get_data(sdb_unixsock_client_t __attribute__((unused)) *client,
 		return -1;
 
 	if (add_metrics(hostname, plugin, type,
-				last_update.data.datetime, state->ud))
+				last_update.data.datetime, state->batch, state->ud))
 		++state->metrics_failed;
 	else
 		++state->metrics_updated;
@@ -327,12 +328,21 @@ sdb_collectd_collect(sdb_object_t *user_data)
 		return -1;
 	}
 
+	state.batch = sdb_plugin_batch_create();
+	if (! state.batch) {
+		sdb_log(SDB_LOG_ERR, "Failed to allocate store batch");
+		return -1;
+	}
+
 	if (sdb_unixsock_client_process_lines(ud->client, get_data,
 				SDB_OBJ(&state_obj), count, /* delim */ "/",
 				/* column count = */ 3,
 				SDB_TYPE_STRING, SDB_TYPE_STRING, SDB_TYPE_STRING)) {
 		sdb_log(SDB_LOG_ERR, "Failed to read response from collectd @ %s.",
 				sdb_unixsock_client_path(ud->client));
+		if (state.current_host)
+			free(state.current_host);
+		sdb_object_deref(SDB_OBJ(state.batch));
 		return -1;
 	}
 
@@ -342,6 +352,12 @@ sdb_collectd_collect(sdb_object_t *user_data)
 				state.metrics_failed, state.current_host);
 		free(state.current_host);
 	}
+
+	if (sdb_plugin_store_batch(state.batch) < 0)
+		sdb_log(SDB_LOG_ERR, "Failed to store/update some objects "
+				"retrieved from collectd @ %s.",
+				sdb_unixsock_client_path(ud->client));
+	sdb_object_deref(SDB_OBJ(state.batch));
 	return 0;
 } /* collect */
 
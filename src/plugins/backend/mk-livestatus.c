@@ -54,8 +54,7 @@ SDB_PLUGIN_MAGIC;
 
 static int
 sdb_livestatus_get_host(sdb_unixsock_client_t __attribute__((unused)) *client,
-		size_t n, sdb_data_t *data,
-		sdb_object_t __attribute__((unused)) *user_data)
+		size_t n, sdb_data_t *data, sdb_object_t *user_data)
 {
 	const char *hostname;
 	sdb_time_t timestamp;
@@ -69,25 +68,19 @@ sdb_livestatus_get_host(sdb_unixsock_client_t __attribute__((unused)) *client,
 	hostname  = data[0].data.string;
 	timestamp = data[1].data.datetime;
 
-	status = sdb_plugin_store_host(hostname, timestamp);
+	status = sdb_plugin_batch_host((sdb_plugin_batch_t *)user_data,
+			hostname, timestamp);
 
 	if (status < 0) {
 		sdb_log(SDB_LOG_ERR, "Failed to store/update host '%s'.", hostname);
 		return -1;
 	}
-	else if (status > 0) /* value too old */
-		return 0;
-
-	sdb_log(SDB_LOG_DEBUG, "Added/updated host '%s' "
-			"(last update timestamp = %"PRIsdbTIME").",
-			hostname, timestamp);
 	return 0;
 } /* sdb_livestatus_get_host */
 
 static int
 sdb_livestatus_get_svc(sdb_unixsock_client_t __attribute__((unused)) *client,
-		size_t n, sdb_data_t *data,
-		sdb_object_t __attribute__((unused)) *user_data)
+		size_t n, sdb_data_t *data, sdb_object_t *user_data)
 {
 	const char *hostname = NULL;
 	const char *svcname = NULL;
@@ -104,19 +97,14 @@ sdb_livestatus_get_svc(sdb_unixsock_client_t __attribute__((unused)) *client,
 	svcname   = data[1].data.string;
 	timestamp = data[2].data.datetime;
 
-	status = sdb_plugin_store_service(hostname, svcname, timestamp);
+	status = sdb_plugin_batch_service((sdb_plugin_batch_t *)user_data,
+			hostname, svcname, timestamp);
 
 	if (status < 0) {
 		sdb_log(SDB_LOG_ERR, "Failed to store/update service '%s / %s'.",
 				hostname, svcname);
 		return -1;
 	}
-	else if (status > 0) /* value too old */
-		return 0;
-
-	sdb_log(SDB_LOG_DEBUG, "Added/updated service '%s / %s' "
-			"(last update timestamp = %"PRIsdbTIME").",
-			hostname, svcname, timestamp);
 	return 0;
 } /* sdb_livestatus_get_svc */
 
@@ -156,17 +144,11 @@ sdb_livestatus_shutdown(sdb_object_t *user_data)
 } /* sdb_livestatus_shutdown */
 
 static int
-sdb_livestatus_collect(sdb_object_t *user_data)
+sdb_livestatus_collect_objects(sdb_unixsock_client_t *client,
+		sdb_plugin_batch_t *batch)
 {
-	sdb_unixsock_client_t *client;
-
 	int status;
 
-	if (! user_data)
-		return -1;
-
-	client = SDB_OBJ_WRAPPER(user_data)->data;
-
 	status = sdb_unixsock_client_send(client, "GET hosts\r\n"
 			"Columns: name last_check");
 	if (status <= 0) {
@@ -178,7 +160,7 @@ sdb_livestatus_collect(sdb_object_t *user_data)
 	sdb_unixsock_client_shutdown(client, SHUT_WR);
 
 	if (sdb_unixsock_client_process_lines(client, sdb_livestatus_get_host,
-				/* user data */ NULL, /* -> EOF */ -1, /* delim */ ";",
+				SDB_OBJ(batch), /* -> EOF */ -1, /* delim */ ";",
 				/* column count */ 2, SDB_TYPE_STRING, SDB_TYPE_DATETIME)) {
 		sdb_log(SDB_LOG_ERR, "Failed to read response from livestatus @ %s "
 				"while reading hosts.", sdb_unixsock_client_path(client));
@@ -205,7 +187,7 @@ sdb_livestatus_collect(sdb_object_t *user_data)
 	sdb_unixsock_client_shutdown(client, SHUT_WR);
 
 	if (sdb_unixsock_client_process_lines(client, sdb_livestatus_get_svc,
-				/* user data */ NULL, /* -> EOF */ -1, /* delim */ ";",
+				SDB_OBJ(batch), /* -> EOF */ -1, /* delim */ ";",
 				/* column count */ 3, SDB_TYPE_STRING, SDB_TYPE_STRING,
 				SDB_TYPE_DATETIME)) {
 		sdb_log(SDB_LOG_ERR, "Failed to read response from livestatus @ %s while reading services.",
@@ -222,6 +204,38 @@ sdb_livestatus_collect(sdb_object_t *user_data)
 		return -1;
 	}
 	return 0;
+} /* sdb_livestatus_collect_objects */
+
+static int
+sdb_livestatus_collect(sdb_object_t *user_data)
+{
+	sdb_unixsock_client_t *client;
+	sdb_plugin_batch_t *batch;
+
+	int status;
+
+	if (! user_data)
+		return -1;
+
+	client = SDB_OBJ_WRAPPER(user_data)->data;
+
+	batch = sdb_plugin_batch_create();
+	if (! batch) {
+		sdb_log(SDB_LOG_ERR, "Failed to allocate store batch");
+		return -1;
+	}
+
+	/* hosts and services are submitted at once after reading all of them;
+	 * on error, store whatever has been read successfully */
+	status = sdb_livestatus_collect_objects(client, batch);
+	if (sdb_plugin_store_batch(batch) < 0) {
+		sdb_log(SDB_LOG_ERR, "Failed to store/update some objects "
+				"retrieved from livestatus @ %s.",
+				sdb_unixsock_client_path(client));
+		status = -1;
+	}
+	sdb_object_deref(SDB_OBJ(batch));
+	return status;
 } /* sdb_livestatus_collect */
 
 static int
@@ -47,8 +47,7 @@ SDB_PLUGIN_MAGIC;
 
 static int
 sdb_puppet_stcfg_get_hosts(sdb_dbi_client_t __attribute__((unused)) *client,
-		size_t n, sdb_data_t *data,
-		sdb_object_t __attribute__((unused)) *user_data)
+		size_t n, sdb_data_t *data, sdb_object_t *user_data)
 {
 	const char *hostname;
 	sdb_time_t timestamp;
@@ -62,23 +61,19 @@ sdb_puppet_stcfg_get_hosts(sdb_dbi_client_t __attribute__((unused)) *client,
 	hostname = data[0].data.string;
 	timestamp = data[1].data.datetime;
 
-	status = sdb_plugin_store_host(hostname, timestamp);
+	status = sdb_plugin_batch_host((sdb_plugin_batch_t *)user_data,
+			hostname, timestamp);
 
 	if (status < 0) {
 		sdb_log(SDB_LOG_ERR, "Failed to store/update host '%s'.", hostname);
 		return -1;
 	}
-	else if (! status)
-		sdb_log(SDB_LOG_DEBUG, "Added/updated host '%s' "
-				"(last update timestamp = %"PRIsdbTIME").",
-				hostname, timestamp);
 	return 0;
 } /* sdb_puppet_stcfg_get_hosts */
 
 static int
 sdb_puppet_stcfg_get_attrs(sdb_dbi_client_t __attribute__((unused)) *client,
-		size_t n, sdb_data_t *data,
-		sdb_object_t __attribute__((unused)) *user_data)
+		size_t n, sdb_data_t *data, sdb_object_t *user_data)
 {
 	int status;
 
@@ -99,7 +94,8 @@ sdb_puppet_stcfg_get_attrs(sdb_dbi_client_t __attribute__((unused)) *client,
 	value.data.string = data[2].data.string;
 	last_update = data[3].data.datetime;
 
-	status = sdb_plugin_store_attribute(hostname, key, &value, last_update);
+	status = sdb_plugin_batch_attribute((sdb_plugin_batch_t *)user_data,
+			hostname, key, &value, last_update);
 
 	if (status < 0) {
 		sdb_log(SDB_LOG_ERR, "Failed to store/update host attribute "
@@ -147,6 +143,9 @@ static int
 sdb_puppet_stcfg_collect(sdb_object_t *user_data)
 {
 	sdb_dbi_client_t *client;
+	sdb_plugin_batch_t *batch;
+
+	int status = 0;
 
 	if (! user_data)
 		return -1;
@@ -157,13 +156,21 @@ sdb_puppet_stcfg_collect(sdb_object_t *user_data)
 		return -1;
 	}
 
+	batch = sdb_plugin_batch_create();
+	if (! batch) {
+		sdb_log(SDB_LOG_ERR, "Failed to allocate store batch");
+		return -1;
+	}
+
 	if (sdb_dbi_exec_query(client, "SELECT name, updated_at FROM hosts;",
-				sdb_puppet_stcfg_get_hosts, NULL, /* #columns = */ 2,
+				sdb_puppet_stcfg_get_hosts, SDB_OBJ(batch), /* #columns = */ 2,
 				/* col types = */ SDB_TYPE_STRING, SDB_TYPE_DATETIME)) {
 		sdb_log(SDB_LOG_ERR, "Failed to retrieve hosts from the storeconfigs DB.");
+		sdb_object_deref(SDB_OBJ(batch));
 		return -1;
 	}
 
+	/* order by host to canonicalize each hostname only once */
 	if (sdb_dbi_exec_query(client, "SELECT "
 					"hosts.name AS hostname, "
 					"fact_names.name AS name, "
@@ -173,14 +180,23 @@ sdb_puppet_stcfg_collect(sdb_object_t *user_data)
 				"INNER JOIN hosts "
 					"ON fact_values.host_id = hosts.id "
 				"INNER JOIN fact_names "
-					"ON fact_values.fact_name_id = fact_names.id;",
-				sdb_puppet_stcfg_get_attrs, NULL, /* #columns = */ 4,
+					"ON fact_values.fact_name_id = fact_names.id "
+				"ORDER BY hosts.name;",
+				sdb_puppet_stcfg_get_attrs, SDB_OBJ(batch), /* #columns = */ 4,
 				/* col types = */ SDB_TYPE_STRING, SDB_TYPE_STRING,
 				SDB_TYPE_STRING, SDB_TYPE_DATETIME)) {
 		sdb_log(SDB_LOG_ERR, "Failed to retrieve host attributes from the storeconfigs DB.");
-		return -1;
+		/* store the hosts anyway */
+		status = -1;
 	}
-	return 0;
+
+	if (sdb_plugin_store_batch(batch) < 0) {
+		sdb_log(SDB_LOG_ERR, "Failed to store/update some objects "
+				"retrieved from the storeconfigs DB.");
+		status = -1;
+	}
+	sdb_object_deref(SDB_OBJ(batch));
+	return status;
 } /* sdb_puppet_stcfg_collect */
 
 static int
@@ -35,23 +35,131 @@
 #include "core/store.h"
 #include "utils/error.h"
 
+#include "liboconfig/utils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
 SDB_PLUGIN_MAGIC;
 
+/* store singleton */
+static sdb_memstore_t *mem_store = NULL;
+static sdb_memstore_wal_t *mem_wal = NULL;
+
+static char *snapshot_file = NULL;
+static sdb_time_t snapshot_interval = 0;
+
+static char *wal_file = NULL;
+static size_t wal_batch_size = 65536;
+static sdb_time_t wal_sync_interval = SECS_TO_SDB_TIME(1);
+
+/* check a limited number of hosts at a time to keep lock times short */
+#define EXPIRE_HOSTS_PER_RUN 100
+
+static double expire_factor = 0.0;
+static sdb_time_t expire_ttl = 0;
+static sdb_time_t expire_interval = SECS_TO_SDB_TIME(1);
+
+static bool attribute_index = 0;
+
+static bool trigram_index = 0;
+static char **trigram_keys = NULL;
+static size_t trigram_keys_num = 0;
+
+static size_t scan_threads = 1;
+
 /*
  * plugin API
  */
 
+static int
+mem_snapshot(sdb_object_t *user_data)
+{
+	return sdb_memstore_snapshot(SDB_MEMSTORE(user_data), snapshot_file);
+} /* mem_snapshot */
+
+static int
+mem_checkpoint(sdb_object_t *user_data)
+{
+	return sdb_memstore_wal_checkpoint(SDB_MEMSTORE_WAL(user_data),
+			snapshot_file);
+} /* mem_checkpoint */
+
+static int
+mem_wal_sync(sdb_object_t *user_data)
+{
+	return sdb_memstore_wal_sync(SDB_MEMSTORE_WAL(user_data));
+} /* mem_wal_sync */
+
+static int
+mem_expire(sdb_object_t *user_data)
+{
+	ssize_t n;
+
+	n = sdb_memstore_expire(SDB_MEMSTORE(user_data), sdb_gettime(),
+			expire_factor, expire_ttl, EXPIRE_HOSTS_PER_RUN);
+	if (n < 0)
+		return -1;
+	if (n > 0)
+		sdb_log(SDB_LOG_DEBUG, "Removed %zd expired object%s",
+				n, n == 1 ? "" : "s");
+	return 0;
+} /* mem_expire */
+
 static int
 mem_init(sdb_object_t *user_data)
 {
 	sdb_memstore_t *store = SDB_MEMSTORE(user_data);
+	sdb_store_writer_t *writer = &sdb_memstore_writer;
+	sdb_object_t *writer_ud = SDB_OBJ(store);
+	sdb_plugin_ctx_t ctx = sdb_plugin_get_ctx();
 
 	if (! store) {
 		sdb_log(SDB_LOG_ERR, "Failed to allocate store");
 		return -1;
 	}
-	if (sdb_plugin_register_writer("memstore",
-				&sdb_memstore_writer, SDB_OBJ(store))) {
+
+	/* The collectors below synchronize through the store and the
+	 * write-ahead log. Let them run concurrently such that syncing the log
+	 * is not held back by a long-running snapshot. */
+	ctx.max_concurrency = 0;
+	sdb_plugin_set_ctx(ctx, NULL);
+
+	/* build the index incrementally while loading the snapshot */
+	if (attribute_index && sdb_memstore_index_attributes(store)) {
+		sdb_object_deref(SDB_OBJ(store));
+		return -1;
+	}
+
+	if (trigram_index && sdb_memstore_index_trigrams(store,
+				(const char * const *)trigram_keys, trigram_keys_num)) {
+		sdb_object_deref(SDB_OBJ(store));
+		return -1;
+	}
+
+	if (sdb_memstore_scan_threads(store, scan_threads)) {
+		sdb_object_deref(SDB_OBJ(store));
+		return -1;
+	}
+
+	if (snapshot_file && (sdb_memstore_load(store, snapshot_file) < 0))
+		sdb_log(SDB_LOG_WARNING, "Failed to load snapshot from %s; "
+				"starting with an empty store", snapshot_file);
+
+	if (wal_file) {
+		mem_wal = sdb_memstore_wal_create(store, wal_file, wal_batch_size);
+		if (! mem_wal) {
+			sdb_log(SDB_LOG_ERR, "Failed to open write-ahead log %s",
+					wal_file);
+			sdb_object_deref(SDB_OBJ(store));
+			return -1;
+		}
+		writer = &sdb_memstore_wal_writer;
+		writer_ud = SDB_OBJ(mem_wal);
+	}
+
+	if (sdb_plugin_register_writer("memstore", writer, writer_ud)) {
 		sdb_object_deref(SDB_OBJ(store));
 		return -1;
 	}
@@ -60,22 +168,272 @@ mem_init(sdb_object_t *user_data)
 		sdb_object_deref(SDB_OBJ(store));
 		return -1;
 	}
+
+	if (mem_wal)
+		sdb_plugin_register_collector("wal-sync", mem_wal_sync,
+				&wal_sync_interval, SDB_OBJ(mem_wal));
+
+	/* without an interval, snapshots are only written on shutdown */
+	if (snapshot_file && snapshot_interval) {
+		if (mem_wal)
+			sdb_plugin_register_collector("snapshot", mem_checkpoint,
+					&snapshot_interval, SDB_OBJ(mem_wal));
+		else
+			sdb_plugin_register_collector("snapshot", mem_snapshot,
+					&snapshot_interval, SDB_OBJ(store));
+	}
+
+	if ((expire_factor > 0.0) || expire_ttl)
+		sdb_plugin_register_collector("expire", mem_expire,
+				&expire_interval, SDB_OBJ(store));
 	return 0;
 } /* mem_init */
 
 static int
 mem_shutdown(sdb_object_t *user_data)
 {
+	int status = 0;
+
+	if (mem_wal) {
+		if (snapshot_file)
+			status = sdb_memstore_wal_checkpoint(mem_wal, snapshot_file);
+		else
+			status = sdb_memstore_wal_sync(mem_wal);
+		sdb_object_deref(SDB_OBJ(mem_wal));
+		mem_wal = NULL;
+	}
+	else if (snapshot_file)
+		status = sdb_memstore_snapshot(SDB_MEMSTORE(user_data), snapshot_file);
+
+	if (status)
+		sdb_log(SDB_LOG_ERR, "Failed to persist store on shutdown");
 	sdb_object_deref(user_data);
 	return 0;
 } /* mem_shutdown */
 
+static int
+mem_config_wal(oconfig_item_t *ci)
+{
+	char *filename = NULL;
+	int i;
+
+	if (oconfig_get_string(ci, &filename)) {
+		sdb_log(SDB_LOG_ERR, "WriteAheadLog requires a single string "
+				"argument\n\tUsage: <WriteAheadLog FILENAME>");
+		return -1;
+	}
+
+	for (i = 0; i < ci->children_num; ++i) {
+		oconfig_item_t *child = ci->children + i;
+		double value = 0.0;
+
+		if (! strcasecmp(child->key, "BatchSize")) {
+			if (oconfig_get_number(child, &value) || (value < 0.0)) {
+				sdb_log(SDB_LOG_ERR, "BatchSize requires a single "
+						"positive numeric argument\n"
+						"\tUsage: BatchSize BYTES");
+				return -1;
+			}
+			wal_batch_size = (size_t)value;
+		}
+		else if (! strcasecmp(child->key, "SyncInterval")) {
+			if (oconfig_get_number(child, &value) || (value <= 0.0)) {
+				sdb_log(SDB_LOG_ERR, "SyncInterval requires a single "
+						"positive numeric argument\n"
+						"\tUsage: SyncInterval SECONDS");
+				return -1;
+			}
+			wal_sync_interval = DOUBLE_TO_SDB_TIME(value);
+		}
+		else
+			sdb_log(SDB_LOG_WARNING, "Ignoring unknown config option '%s' "
+					"inside <WriteAheadLog %s>.", child->key, filename);
+	}
+
+	if (wal_file)
+		free(wal_file);
+	wal_file = strdup(filename);
+	if (! wal_file) {
+		sdb_log(SDB_LOG_ERR, "Failed to allocate memory");
+		return -1;
+	}
+	return 0;
+} /* mem_config_wal */
+
+static void
+mem_config_reset_trigram_keys(void)
+{
+	size_t i;
+
+	for (i = 0; i < trigram_keys_num; ++i)
+		free(trigram_keys[i]);
+	if (trigram_keys)
+		free(trigram_keys);
+	trigram_keys = NULL;
+	trigram_keys_num = 0;
+} /* mem_config_reset_trigram_keys */
+
+static int
+mem_config_trigram_attribute(oconfig_item_t *ci)
+{
+	char *key = NULL;
+	char **tmp;
+
+	if (oconfig_get_string(ci, &key)) {
+		sdb_log(SDB_LOG_ERR, "TrigramAttribute requires a single string "
+				"argument\n\tUsage: TrigramAttribute KEY");
+		return -1;
+	}
+
+	tmp = realloc(trigram_keys, (trigram_keys_num + 1) * sizeof(*tmp));
+	if (! tmp) {
+		sdb_log(SDB_LOG_ERR, "Failed to allocate memory");
+		return -1;
+	}
+	trigram_keys = tmp;
+	if (! (trigram_keys[trigram_keys_num] = strdup(key))) {
+		sdb_log(SDB_LOG_ERR, "Failed to allocate memory");
+		return -1;
+	}
+	++trigram_keys_num;
+	return 0;
+} /* mem_config_trigram_attribute */
+
+static int
+mem_config(oconfig_item_t *ci)
+{
+	char *filename = NULL;
+	double interval = 0.0;
+	double value = 0.0;
+	int i;
+
+	if (! ci) {
+		/* reset config */
+		if (snapshot_file)
+			free(snapshot_file);
+		snapshot_file = NULL;
+		snapshot_interval = 0;
+		if (wal_file)
+			free(wal_file);
+		wal_file = NULL;
+		wal_batch_size = 65536;
+		wal_sync_interval = SECS_TO_SDB_TIME(1);
+		expire_factor = 0.0;
+		expire_ttl = 0;
+		expire_interval = SECS_TO_SDB_TIME(1);
+		attribute_index = 0;
+		trigram_index = 0;
+		mem_config_reset_trigram_keys();
+		scan_threads = 1;
+		return 0;
+	}
+
+	for (i = 0; i < ci->children_num; ++i) {
+		oconfig_item_t *child = ci->children + i;
+
+		if (! strcasecmp(child->key, "Snapshot")) {
+			if (oconfig_get_string(child, &filename)) {
+				sdb_log(SDB_LOG_ERR, "Snapshot requires a single string "
+						"argument\n\tUsage: Snapshot FILENAME");
+				return -1;
+			}
+		}
+		else if (! strcasecmp(child->key, "SnapshotInterval")) {
+			if (oconfig_get_number(child, &interval) || (interval < 0.0)) {
+				sdb_log(SDB_LOG_ERR, "SnapshotInterval requires a single "
+						"positive numeric argument\n"
+						"\tUsage: SnapshotInterval SECONDS");
+				return -1;
+			}
+			snapshot_interval = DOUBLE_TO_SDB_TIME(interval);
+		}
+		else if (! strcasecmp(child->key, "WriteAheadLog")) {
+			if (mem_config_wal(child))
+				return -1;
+		}
+		else if (! strcasecmp(child->key, "ExpireFactor")) {
+			if (oconfig_get_number(child, &expire_factor)
+					|| (expire_factor < 0.0)) {
+				sdb_log(SDB_LOG_ERR, "ExpireFactor requires a single "
+						"positive numeric argument\n"
+						"\tUsage: ExpireFactor FACTOR");
+				return -1;
+			}
+		}
+		else if (! strcasecmp(child->key, "ExpireTTL")) {
+			if (oconfig_get_number(child, &value) || (value < 0.0)) {
+				sdb_log(SDB_LOG_ERR, "ExpireTTL requires a single "
+						"positive numeric argument\n"
+						"\tUsage: ExpireTTL SECONDS");
+				return -1;
+			}
+			expire_ttl = DOUBLE_TO_SDB_TIME(value);
+		}
+		else if (! strcasecmp(child->key, "ExpireInterval")) {
+			if (oconfig_get_number(child, &value) || (value <= 0.0)) {
+				sdb_log(SDB_LOG_ERR, "ExpireInterval requires a single "
+						"positive numeric argument\n"
+						"\tUsage: ExpireInterval SECONDS");
+				return -1;
+			}
+			expire_interval = DOUBLE_TO_SDB_TIME(value);
+		}
+		else if (! strcasecmp(child->key, "AttributeIndex")) {
+			if (oconfig_get_boolean(child, &attribute_index)) {
+				sdb_log(SDB_LOG_ERR, "AttributeIndex requires a single "
+						"boolean argument\n"
+						"\tUsage: AttributeIndex true|false");
+				return -1;
+			}
+		}
+		else if (! strcasecmp(child->key, "TrigramIndex")) {
+			if (oconfig_get_boolean(child, &trigram_index)) {
+				sdb_log(SDB_LOG_ERR, "TrigramIndex requires a single "
+						"boolean argument\n"
+						"\tUsage: TrigramIndex true|false");
+				return -1;
+			}
+		}
+		else if (! strcasecmp(child->key, "TrigramAttribute")) {
+			if (mem_config_trigram_attribute(child))
+				return -1;
+		}
+		else if (! strcasecmp(child->key, "ScanThreads")) {
+			if (oconfig_get_number(child, &value) || (value < 1.0)) {
+				sdb_log(SDB_LOG_ERR, "ScanThreads requires a single "
+						"positive numeric argument\n"
+						"\tUsage: ScanThreads NUM");
+				return -1;
+			}
+			scan_threads = (size_t)value;
+		}
+		else
+			sdb_log(SDB_LOG_WARNING, "Ignoring unknown config option '%s'.",
+					child->key);
+	}
+
+	if (filename) {
+		if (snapshot_file)
+			free(snapshot_file);
+		snapshot_file = strdup(filename);
+		if (! snapshot_file) {
+			sdb_log(SDB_LOG_ERR, "Failed to allocate memory");
+			return -1;
+		}
+	}
+
+	if (trigram_keys_num && (! trigram_index))
+		sdb_log(SDB_LOG_WARNING, "TrigramAttribute has no effect unless "
+				"the trigram index is enabled using TrigramIndex");
+	if (wal_file && (! snapshot_file))
+		sdb_log(SDB_LOG_WARNING, "Write-ahead log configured without a "
+				"snapshot; the log will grow without bounds");
+	return 0;
+} /* mem_config */
+
 int
 sdb_module_init(sdb_plugin_info_t *info)
 {
-	/* store singleton */
-	static sdb_memstore_t *store;
-
 	sdb_plugin_set_info(info, SDB_PLUGIN_INFO_DESC, "in-memory object store");
 	sdb_plugin_set_info(info, SDB_PLUGIN_INFO_COPYRIGHT,
 			"Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>");
@@ -83,15 +441,16 @@ sdb_module_init(sdb_plugin_info_t *info)
 	sdb_plugin_set_info(info, SDB_PLUGIN_INFO_VERSION, SDB_VERSION);
 	sdb_plugin_set_info(info, SDB_PLUGIN_INFO_PLUGIN_VERSION, SDB_VERSION);
 
-	if (! store) {
-		if (! (store = sdb_memstore_create())) {
+	if (! mem_store) {
+		if (! (mem_store = sdb_memstore_create())) {
 			sdb_log(SDB_LOG_ERR, "Failed to create store object");
 			return -1;
 		}
 	}
 
-	sdb_plugin_register_init("main", mem_init, SDB_OBJ(store));
-	sdb_plugin_register_shutdown("main", mem_shutdown, SDB_OBJ(store));
+	sdb_plugin_register_config(mem_config);
+	sdb_plugin_register_init("main", mem_init, SDB_OBJ(mem_store));
+	sdb_plugin_register_shutdown("main", mem_shutdown, SDB_OBJ(mem_store));
 	return 0;
 } /* sdb_module_init */
 
@@ -45,6 +45,8 @@
 #include <string.h>
 #include <strings.h>
 
+#include <pthread.h>
+
 SDB_PLUGIN_MAGIC;
 
 /*
@@ -52,6 +54,9 @@ SDB_PLUGIN_MAGIC;
  */
 
 typedef struct {
+	/* collectors of all backends share the connection and may write to it
+	 * concurrently; the lock serializes RPCs and reconnects */
+	pthread_mutex_t lock;
 	sdb_client_t *client;
 	char *addr;
 	char *username;
@@ -79,6 +84,7 @@ user_data_destroy(void *obj)
 
 	sdb_ssl_free_options(&ud->ssl_opts);
 
+	pthread_mutex_destroy(&ud->lock);
 	free(ud);
 } /* user_data_destroy */
 
@@ -93,11 +99,14 @@ store_rpc(user_data_t *ud, const char *msg, size_t msg_len)
 	uint32_t rstatus = 0;
 	ssize_t status;
 
+	pthread_mutex_lock(&ud->lock);
 	if (sdb_client_eof(ud->client)) {
 		sdb_client_close(ud->client);
 		if (sdb_client_connect(ud->client, ud->username)) {
+			pthread_mutex_unlock(&ud->lock);
 			sdb_log(SDB_LOG_ERR, "Failed to reconnect to SysDB "
 					"at %s as user %s", ud->addr, ud->username);
+			sdb_strbuf_destroy(buf);
 			return -1;
 		}
 		sdb_log(SDB_LOG_INFO, "Successfully reconnected to SysDB "
@@ -106,6 +115,7 @@ store_rpc(user_data_t *ud, const char *msg, size_t msg_len)
 
 	status = sdb_client_rpc(ud->client, SDB_CONNECTION_STORE,
 			(uint32_t)msg_len, msg, &rstatus, buf);
+	pthread_mutex_unlock(&ud->lock);
 	if (status < 0)
 		sdb_log(SDB_LOG_ERR, "%s", sdb_strbuf_string(buf));
 	else if (rstatus != SDB_CONNECTION_OK) {
@@ -177,6 +187,9 @@ store_attr(sdb_store_attribute_t *attr, sdb_object_t *user_data)
 
 static sdb_store_writer_t store_impl = {
 	store_host, store_service, store_metric, store_attr,
+	/* store_batch = */ NULL,
+	/* the remote instance determines update intervals itself */
+	/* flags = */ SDB_STORE_WRITER_UPSERT,
 };
 
 /*
@@ -187,12 +200,16 @@ static int
 store_init(sdb_object_t *user_data)
 {
 	user_data_t *ud;
+	int status;
 
 	if (! user_data)
 		return -1;
 
 	ud = SDB_OBJ_WRAPPER(user_data)->data;
-	if (sdb_client_connect(ud->client, ud->username)) {
+	pthread_mutex_lock(&ud->lock);
+	status = sdb_client_connect(ud->client, ud->username);
+	pthread_mutex_unlock(&ud->lock);
+	if (status) {
 		sdb_log(SDB_LOG_ERR, "Failed to connect to SysDB "
 				"at %s as user %s", ud->addr, ud->username);
 		return -1;
@@ -218,6 +235,7 @@ store_config_server(oconfig_item_t *ci)
 				sdb_strerror(errno, errbuf, sizeof(errbuf)));
 		return -1;
 	}
+	pthread_mutex_init(&ud->lock, /* attr = */ NULL);
 
 	if (oconfig_get_string(ci, &ud->addr)) {
 		sdb_log(SDB_LOG_ERR, "Server requires a single string argument\n"
@@ -201,6 +201,51 @@ static struct {
 	{ SDB_CONNECTION_DATA, data_printer },
 };
 
+/*
+ * Receive the remaining parts of a chunked result and append them to 'buf'.
+ * Log messages sent in between are printed right away. On error, 'buf' is
+ * replaced with the error message.
+ */
+static void
+recv_chunks(sdb_input_t *input, uint32_t *rcode, sdb_strbuf_t *buf)
+{
+	sdb_strbuf_t *chunk = sdb_strbuf_create(1024);
+
+	if (! chunk) {
+		*rcode = UINT32_MAX;
+		return;
+	}
+
+	while (*rcode == SDB_CONNECTION_DATA_CHUNK) {
+		sdb_strbuf_clear(chunk);
+		if (sdb_client_recv(input->client, rcode, chunk) < 0) {
+			*rcode = UINT32_MAX;
+			break;
+		}
+
+		if (*rcode == SDB_CONNECTION_LOG) {
+			log_printer(input, chunk);
+			*rcode = SDB_CONNECTION_DATA_CHUNK;
+			continue;
+		}
+
+		if ((*rcode == SDB_CONNECTION_DATA_CHUNK)
+				|| (*rcode == SDB_CONNECTION_DATA)) {
+			/* skip the result type repeated in each part */
+			if (sdb_strbuf_len(chunk) > sizeof(uint32_t))
+				sdb_strbuf_memappend(buf,
+						sdb_strbuf_string(chunk) + sizeof(uint32_t),
+						sdb_strbuf_len(chunk) - sizeof(uint32_t));
+			continue;
+		}
+
+		/* discard the partial result */
+		sdb_strbuf_memcpy(buf, sdb_strbuf_string(chunk),
+				sdb_strbuf_len(chunk));
+	}
+	sdb_strbuf_destroy(chunk);
+} /* recv_chunks */
+
 static void
 clear_query(sdb_input_t *input)
 {
@@ -230,6 +275,8 @@ sdb_command_print_reply(sdb_input_t *input)
 
 	if (sdb_client_recv(input->client, &rcode, recv_buf) < 0)
 		rcode = UINT32_MAX;
+	if (rcode == SDB_CONNECTION_DATA_CHUNK)
+		recv_chunks(input, &rcode, recv_buf);
 
 	if (sdb_client_eof(input->client)) {
 		sdb_strbuf_destroy(recv_buf);
@@ -295,7 +342,7 @@ sdb_command_exec(sdb_input_t *input)
 	else if (! query_len)
 		return NULL;
 
-	sdb_client_send(input->client, SDB_CONNECTION_QUERY, query_len, query);
+	sdb_client_send_query(input->client, input->chunk_size, query_len, query);
 
 	/* The server may send back log messages but will eventually reply to the
 	 * query, which is either DATA or ERROR. */
@@ -44,9 +44,12 @@ typedef struct {
 
 	bool interactive;
 	bool eof;
+
+	/* request results in chunks of this size; zero disables chunking */
+	uint32_t chunk_size;
 } sdb_input_t;
 
-#define SDB_INPUT_INIT { NULL, NULL, NULL, 0, 0, 0, 1, 0 }
+#define SDB_INPUT_INIT { NULL, NULL, NULL, 0, 0, 0, 1, 0, 0 }
 
 /*
  * sysdb_input:
@@ -124,6 +124,7 @@ exit_usage(char *name, int status)
 "  -U USER      the username to connect as\n"
 "               default: %s\n"
 "  -c CMD       execute the specified command and then exit\n"
+"  -s SIZE      request query results in chunks of SIZE bytes\n"
 "\n"
 "SSL options:\n"
 "  -K KEYFILE   private key file name\n"
@@ -177,7 +178,7 @@ execute_commands(sdb_input_t *input, sdb_llist_t *commands)
 	while (sdb_llist_iter_has_next(iter)) {
 		sdb_object_t *obj = sdb_llist_iter_get_next(iter);
 
-		if (sdb_client_send(input->client, SDB_CONNECTION_QUERY,
+		if (sdb_client_send_query(input->client, input->chunk_size,
 					(uint32_t)strlen(obj->name), obj->name) <= 0) {
 			sdb_log(SDB_LOG_ERR, "Failed to send command '%s' to server",
 					obj->name);
@@ -227,7 +228,7 @@ main(int argc, char **argv)
 	sdb_llist_t *commands = NULL;
 
 	while (42) {
-		int opt = getopt(argc, argv, "H:U:c:C:K:A:hV");
+		int opt = getopt(argc, argv, "H:U:c:s:C:K:A:hV");
 
 		if (-1 == opt)
 			break;
@@ -263,6 +264,22 @@ main(int argc, char **argv)
 					sdb_object_deref(obj);
 				}
 				break;
+			case 's':
+				{
+					char *endptr = NULL;
+					long size;
+
+					errno = 0;
+					size = strtol(optarg, &endptr, 0);
+					if (errno || (! *optarg) || *endptr || (size <= 0)
+							|| (size > (long)UINT32_MAX)) {
+						sdb_log(SDB_LOG_ERR, "Invalid chunk size '%s'",
+								optarg);
+						exit_usage(argv[0], 1);
+					}
+					input.chunk_size = (uint32_t)size;
+				}
+				break;
 
 			case 'C':
 				ssl_options.cert_file = optarg;
@@ -34,6 +34,7 @@
 #include "sysdb.h"
 #include "core/plugin.h"
 #include "core/time.h"
+#include "frontend/connection.h"
 #include "utils/error.h"
 
 #include "liboconfig/oconfig.h"
@@ -67,6 +68,10 @@ enum {
 static sdb_time_t default_interval = 0;
 static char *plugin_dir = NULL;
 
+static sdb_plugin_cname_cache_opts_t cname_cache_opts =
+	SDB_PLUGIN_CNAME_CACHE_OPTS_INIT;
+static size_t query_cache_size = SDB_CONN_QUERY_CACHE_SIZE_DEFAULT;
+
 /*
  * private helper functions
  */
@@ -96,6 +101,31 @@ config_get_interval(oconfig_item_t *ci, sdb_time_t *interval)
 	return 0;
 } /* config_get_interval */
 
+static int
+config_get_duration(oconfig_item_t *ci, sdb_time_t *duration)
+{
+	double duration_dbl = 0.0;
+
+	assert(ci && duration);
+
+	if (oconfig_get_number(ci, &duration_dbl)) {
+		sdb_log(SDB_LOG_ERR, "config: %s requires "
+				"a single numeric argument\n"
+				"\tUsage: %s SECONDS", ci->key, ci->key);
+		return ERR_INVALID_ARG;
+	}
+
+	if (duration_dbl < 0.0) {
+		sdb_log(SDB_LOG_ERR, "config: Invalid %s: %f\n"
+				"\t%s may not be less than zero.",
+				ci->key, duration_dbl, ci->key);
+		return ERR_INVALID_ARG;
+	}
+
+	*duration = DOUBLE_TO_SDB_TIME(duration_dbl);
+	return 0;
+} /* config_get_duration */
+
 /*
  * public parse results
  */
@@ -103,6 +133,8 @@ config_get_interval(oconfig_item_t *ci, sdb_time_t *interval)
 daemon_listener_t *listen_addresses = NULL;
 size_t listen_addresses_num = 0;
 
+sdb_plugin_loop_t collector_loop_opts = SDB_PLUGIN_LOOP_INIT;
+
 /*
  * token parser
  */
@@ -194,6 +226,72 @@ daemon_set_interval(oconfig_item_t *ci)
 	return config_get_interval(ci, &default_interval);
 } /* daemon_set_interval */
 
+static int
+daemon_set_cname_cache_size(oconfig_item_t *ci)
+{
+	double size = 0.0;
+
+	if (oconfig_get_number(ci, &size) || (size < 0.0)) {
+		sdb_log(SDB_LOG_ERR, "config: CNameCacheSize requires "
+				"a single non-negative numeric argument\n"
+				"\tUsage: CNameCacheSize ENTRIES");
+		return ERR_INVALID_ARG;
+	}
+
+	cname_cache_opts.size = (size_t)size;
+	return 0;
+} /* daemon_set_cname_cache_size */
+
+static int
+daemon_set_query_cache_size(oconfig_item_t *ci)
+{
+	double size = 0.0;
+
+	if (oconfig_get_number(ci, &size) || (size < 0.0)) {
+		sdb_log(SDB_LOG_ERR, "config: QueryCacheSize requires "
+				"a single non-negative numeric argument\n"
+				"\tUsage: QueryCacheSize ENTRIES");
+		return ERR_INVALID_ARG;
+	}
+
+	query_cache_size = (size_t)size;
+	return 0;
+} /* daemon_set_query_cache_size */
+
+static int
+daemon_set_cname_cache_ttl(oconfig_item_t *ci)
+{
+	return config_get_duration(ci, &cname_cache_opts.ttl);
+} /* daemon_set_cname_cache_ttl */
+
+static int
+daemon_set_cname_cache_negative_ttl(oconfig_item_t *ci)
+{
+	return config_get_duration(ci, &cname_cache_opts.negative_ttl);
+} /* daemon_set_cname_cache_negative_ttl */
+
+static int
+daemon_set_collector_threads(oconfig_item_t *ci)
+{
+	double num = 0.0;
+
+	if (oconfig_get_number(ci, &num) || (num < 1.0)) {
+		sdb_log(SDB_LOG_ERR, "config: CollectorThreads requires "
+				"a single positive numeric argument\n"
+				"\tUsage: CollectorThreads NUM");
+		return ERR_INVALID_ARG;
+	}
+
+	collector_loop_opts.num_threads = (size_t)num;
+	return 0;
+} /* daemon_set_collector_threads */
+
+static int
+daemon_set_collector_jitter(oconfig_item_t *ci)
+{
+	return config_get_duration(ci, &collector_loop_opts.max_jitter);
+} /* daemon_set_collector_jitter */
+
 static int
 daemon_set_plugindir(oconfig_item_t *ci)
 {
@@ -262,6 +360,16 @@ daemon_load_backend(oconfig_item_t *ci)
 			if (config_get_interval(child, &ctx.interval))
 				return ERR_INVALID_ARG;
 		}
+		else if (! strcasecmp(child->key, "MaxConcurrency")) {
+			double num = 0.0;
+			if (oconfig_get_number(child, &num) || (num < 0.0)) {
+				sdb_log(SDB_LOG_ERR, "config: MaxConcurrency requires "
+						"a single non-negative numeric argument\n"
+						"\tUsage: MaxConcurrency NUM");
+				return ERR_INVALID_ARG;
+			}
+			ctx.max_concurrency = (size_t)num;
+		}
 		else {
 			sdb_log(SDB_LOG_WARNING, "config: Unknown option '%s' "
 					"inside 'LoadBackend' -- see the documentation for "
@@ -299,6 +407,12 @@ daemon_configure_plugin(oconfig_item_t *ci)
 static token_parser_t token_parser_list[] = {
 	{ "Listen", daemon_add_listener },
 	{ "Interval", daemon_set_interval },
+	{ "CollectorThreads", daemon_set_collector_threads },
+	{ "CollectorJitter", daemon_set_collector_jitter },
+	{ "CNameCacheSize", daemon_set_cname_cache_size },
+	{ "CNameCacheTTL", daemon_set_cname_cache_ttl },
+	{ "CNameCacheNegativeTTL", daemon_set_cname_cache_negative_ttl },
+	{ "QueryCacheSize", daemon_set_query_cache_size },
 	{ "PluginDir", daemon_set_plugindir },
 	{ "LoadPlugin", daemon_load_plugin },
 	{ "LoadBackend", daemon_load_backend },
@@ -332,6 +446,9 @@ daemon_free_listen_addresses(void)
 int
 daemon_parse_config(const char *filename)
 {
+	sdb_plugin_cname_cache_opts_t cname_cache_defaults =
+		SDB_PLUGIN_CNAME_CACHE_OPTS_INIT;
+	sdb_plugin_loop_t loop_defaults = SDB_PLUGIN_LOOP_INIT;
 	oconfig_item_t *ci;
 	int retval = 0, i;
 
@@ -339,6 +456,10 @@ daemon_parse_config(const char *filename)
 	if (! ci)
 		return ERR_PARSE_FAILED;
 
+	cname_cache_opts = cname_cache_defaults;
+	collector_loop_opts = loop_defaults;
+	query_cache_size = SDB_CONN_QUERY_CACHE_SIZE_DEFAULT;
+
 	for (i = 0; i < ci->children_num; ++i) {
 		oconfig_item_t *child = ci->children + i;
 		int status = ERR_UNKNOWN_OPTION, j;
@@ -364,6 +485,10 @@ daemon_parse_config(const char *filename)
 	oconfig_free(ci);
 	free(ci);
 
+	if (sdb_plugin_cname_cache_configure(&cname_cache_opts))
+		retval = -1;
+	sdb_conn_query_cache_configure(query_cache_size);
+
 	if (plugin_dir) {
 		free(plugin_dir);
 		plugin_dir = NULL;
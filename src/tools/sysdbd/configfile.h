@@ -25,6 +25,7 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "core/plugin.h"
 #include "utils/ssl.h"
 
 #include <unistd.h>
@@ -44,6 +45,9 @@ typedef struct {
 extern daemon_listener_t *listen_addresses;
 extern size_t listen_addresses_num;
 
+/* collector loop settings (num_threads, max_jitter) */
+extern sdb_plugin_loop_t collector_loop_opts;
+
 void
 daemon_free_listen_addresses(void);
 
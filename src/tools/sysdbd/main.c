@@ -200,6 +200,9 @@ configure(void)
 		listen_addresses = default_listen_addresses;
 		listen_addresses_num = SDB_STATIC_ARRAY_LEN(default_listen_addresses);
 	}
+
+	plugin_main_loop.num_threads = collector_loop_opts.num_threads;
+	plugin_main_loop.max_jitter = collector_loop_opts.max_jitter;
 	return 0;
 } /* configure */
 
@@ -311,6 +314,7 @@ main(int argc, char **argv)
 
 	struct sigaction sa_intterm;
 	struct sigaction sa_hup;
+	sdb_conn_query_cache_stats_t query_cache_stats;
 	int status;
 
 	sdb_error_set_logger(sdb_plugin_log);
@@ -393,6 +397,14 @@ main(int argc, char **argv)
 
 	sdb_log(SDB_LOG_INFO, "Shutting down SysDB daemon "SDB_VERSION_STRING
 			SDB_VERSION_EXTRA" (pid %i)", (int)getpid());
+
+	sdb_conn_query_cache_stats(&query_cache_stats);
+	if (query_cache_stats.hits || query_cache_stats.misses)
+		sdb_log(SDB_LOG_INFO, "query cache: %"PRIu64" hits, "
+				"%"PRIu64" misses, %zu entries", query_cache_stats.hits,
+				query_cache_stats.misses, query_cache_stats.entries);
+	sdb_conn_query_cache_configure(0);
+
 	sdb_plugin_shutdown_all();
 	sdb_plugin_unregister_all();
 	sdb_ssl_shutdown();
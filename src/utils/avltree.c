@@ -32,9 +32,12 @@
 #include "sysdb.h"
 #include "utils/avltree.h"
 #include "utils/error.h"
+#include "utils/slab.h"
 
 #include <assert.h>
 
+#include <ctype.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
@@ -44,26 +47,58 @@
  * private data types
  */
 
-struct node;
-typedef struct node node_t;
+/* The tree is a B+-tree: all objects are stored in the leaf nodes which are
+ * linked in order; inner nodes only hold separator keys. Each key carries
+ * the first bytes of the case-folded name, such that most comparisons don't
+ * have to touch the object or its name at all. */
 
-struct node {
+#define LEAF_SLOTS 32
+#define INNER_SLOTS 32 /* max number of children */
+
+/* all nodes but the root hold at least half the maximum number of entries */
+#define LEAF_MIN (LEAF_SLOTS / 2)
+#define INNER_MIN (INNER_SLOTS / 2)
+
+/* the root leaf starts small and grows up to LEAF_SLOTS */
+#define ROOT_LEAF_INITIAL 2
+
+typedef struct {
+	bool is_leaf;
+	size_t num; /* number of objects or children */
+} node_t;
+#define LEAF(n) ((leaf_t *)(n))
+#define INNER(n) ((inner_t *)(n))
+
+typedef struct {
+	/* case-folded name prefix */
+	uint64_t prefix;
 	sdb_object_t *obj;
+} entry_t;
 
-	node_t *parent;
-	node_t *left;
-	node_t *right;
+struct leaf;
+typedef struct leaf leaf_t;
 
-	size_t height;
+struct leaf {
+	node_t super;
+	size_t cap;
+	leaf_t *next;
+	entry_t entries[];
 };
 
-#define NODE_NAME(n) ((n) && (n)->obj ? (n)->obj->name : "<nil>")
-#define NODE_HEIGHT(n) ((n) ? (n)->height : (size_t)0)
-#define CALC_HEIGHT(n) (SDB_MAX(NODE_HEIGHT((n)->right), \
-			NODE_HEIGHT((n)->left)) + 1)
+typedef struct {
+	node_t super;
+
+	/* sep[i] separates child[i] and child[i + 1]; it's greater than any name
+	 * stored in child[i] and not greater than any name in child[i + 1] */
+	uint64_t prefix[INNER_SLOTS - 1];
+	char *sep[INNER_SLOTS - 1];
+	node_t *child[INNER_SLOTS];
+} inner_t;
 
-#define BALANCE(n) \
-	((n) ? (int)NODE_HEIGHT((n)->left) - (int)NODE_HEIGHT((n)->right) : 0)
+typedef struct {
+	uint64_t prefix;
+	const char *name;
+} search_key_t;
 
 struct sdb_avltree {
 	pthread_rwlock_t lock;
@@ -74,207 +109,474 @@ struct sdb_avltree {
 
 struct sdb_avltree_iter {
 	sdb_avltree_t *tree;
-	node_t *node;
+	leaf_t *leaf;
+	size_t idx;
 };
 
 /*
  * private helper functions
  */
 
+/* Nodes of all trees are allocated from a shared slab. If it cannot be
+ * created, sdb_slab_alloc fails and so does any operation allocating nodes. */
+static pthread_once_t node_slab_once = PTHREAD_ONCE_INIT;
+static sdb_slab_t *node_slab = NULL;
+
 static void
-node_destroy(node_t *n)
+node_slab_init(void)
 {
-	sdb_object_deref(n->obj);
-	n->obj = NULL;
-	n->parent = n->left = n->right = NULL;
-	free(n);
-} /* node_destroy */
+	node_slab = sdb_slab_create();
+} /* node_slab_init */
 
-static node_t *
-node_create(sdb_object_t *obj)
+static void *
+node_alloc(size_t size)
 {
-	node_t *n = malloc(sizeof(*n));
-	if (! n)
-		return NULL;
+	pthread_once(&node_slab_once, node_slab_init);
+	return sdb_slab_alloc(node_slab, size);
+} /* node_alloc */
+
+/* Pack the first bytes of the case-folded name into an integer such that
+ * comparing two prefixes yields the same order as strcasecmp(). */
+static uint64_t
+name_prefix(const char *name)
+{
+	uint64_t p = 0;
+	size_t i;
+
+	for (i = 0; i < sizeof(p); ++i) {
+		p <<= 8;
+		if (*name) {
+			p |= (uint64_t)(unsigned char)tolower((unsigned char)*name);
+			++name;
+		}
+	}
+	return p;
+} /* name_prefix */
 
-	sdb_object_ref(obj);
-	n->obj = obj;
-	n->parent = n->left = n->right = NULL;
-	n->height = 1;
-	return n;
-} /* node_create */
+static int
+key_cmp(uint64_t p1, const char *n1, uint64_t p2, const char *n2)
+{
+	if (p1 != p2)
+		return p1 < p2 ? -1 : 1;
+	/* a prefix including the terminating null byte covers the whole name */
+	if (! (p1 & 0xff))
+		return 0;
+	return strcasecmp(n1, n2);
+} /* key_cmp */
 
-static node_t *
-node_next(node_t *n)
+#define ENTRY_CMP(e, k) \
+	key_cmp((e)->prefix, (e)->obj->name, (k)->prefix, (k)->name)
+#define SEP_CMP(in, i, k) \
+	key_cmp((in)->prefix[i], (in)->sep[i], (k)->prefix, (k)->name)
+
+static leaf_t *
+leaf_create(size_t cap)
 {
-	node_t *next;
+	leaf_t *l = node_alloc(sizeof(*l) + cap * sizeof(l->entries[0]));
+	if (! l)
+		return NULL;
 
-	if (! n)
+	l->super.is_leaf = 1;
+	l->super.num = 0;
+	l->cap = cap;
+	l->next = NULL;
+	return l;
+} /* leaf_create */
+
+static inner_t *
+inner_create(void)
+{
+	inner_t *in = node_alloc(sizeof(*in));
+	if (! in)
 		return NULL;
 
-	/* descend into the right tree */
-	if (n->right) {
-		next = n->right;
-		while (next->left)
-			next = next->left;
-		return next;
+	in->super.is_leaf = 0;
+	in->super.num = 0;
+	return in;
+} /* inner_create */
+
+static void
+node_destroy(node_t *n)
+{
+	size_t i;
+
+	if (n->is_leaf) {
+		for (i = 0; i < n->num; ++i)
+			sdb_object_deref(LEAF(n)->entries[i].obj);
 	}
+	else {
+		for (i = 0; i < n->num; ++i)
+			node_destroy(INNER(n)->child[i]);
+		for (i = 0; i + 1 < n->num; ++i)
+			free(INNER(n)->sep[i]);
+	}
+	sdb_slab_free(n);
+} /* node_destroy */
 
-	/* visit the parent if we're in its left tree */
-	if (n->parent && (n->parent->left == n))
-		return n->parent;
+static bool
+node_full(node_t *n)
+{
+	if (n->is_leaf)
+		return n->num >= LEAF_SLOTS;
+	return n->num >= INNER_SLOTS;
+} /* node_full */
+
+/* Returns the position of the first entry not less than the key. */
+static size_t
+leaf_find(leaf_t *l, const search_key_t *k, bool *found)
+{
+	size_t lo = 0, hi = l->super.num;
 
-	/* find the parent of the sibling sub-tree on the right */
-	next = n->parent;
-	next = NULL;
-	while (n->parent && (n->parent->right == n)) {
-		n = n->parent;
-		next = n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (ENTRY_CMP(l->entries + mid, k) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
-	if (next)
-		next = next->parent;
-	return next;
-} /* node_next */
 
-static node_t *
-node_smallest(sdb_avltree_t *tree)
+	if (found)
+		*found = (lo < l->super.num) && (! ENTRY_CMP(l->entries + lo, k));
+	return lo;
+} /* leaf_find */
+
+/* Returns the index of the child which may contain the key. */
+static size_t
+inner_find(inner_t *in, const search_key_t *k)
 {
-	node_t *n;
+	size_t lo = 0, hi = in->super.num - 1;
 
-	if (! tree)
-		return NULL;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (SEP_CMP(in, mid, k) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+} /* inner_find */
 
-	n = tree->root;
-	while (n && n->left)
-		n = n->left;
-	return n;
-} /* node_smallest */
+static leaf_t *
+leaf_smallest(sdb_avltree_t *tree)
+{
+	node_t *n = tree->root;
+
+	while (n && (! n->is_leaf))
+		n = INNER(n)->child[0];
+	return LEAF(n);
+} /* leaf_smallest */
 
+/* Make room for a new child at position 'i' (and for a new separator at
+ * position 'i - 1'). */
 static void
-tree_clear(sdb_avltree_t *tree)
+inner_open(inner_t *in, size_t i)
 {
-	node_t *n;
+	memmove(in->child + i + 1, in->child + i,
+			(in->super.num - i) * sizeof(in->child[0]));
+	if (i) {
+		memmove(in->sep + i, in->sep + i - 1,
+				(in->super.num - i) * sizeof(in->sep[0]));
+		memmove(in->prefix + i, in->prefix + i - 1,
+				(in->super.num - i) * sizeof(in->prefix[0]));
+	}
+	++in->super.num;
+} /* inner_open */
 
-	if ((! tree) || (! tree->root))
-		return;
+/* Remove the child at position 'i' along with the separator at position
+ * 'i - 1'. The separator is not freed. */
+static void
+inner_close(inner_t *in, size_t i)
+{
+	assert(i > 0);
+	memmove(in->child + i, in->child + i + 1,
+			(in->super.num - i - 1) * sizeof(in->child[0]));
+	memmove(in->sep + i - 1, in->sep + i,
+			(in->super.num - i - 1) * sizeof(in->sep[0]));
+	memmove(in->prefix + i - 1, in->prefix + i,
+			(in->super.num - i - 1) * sizeof(in->prefix[0]));
+	--in->super.num;
+} /* inner_close */
+
+/* Split the full child 'i' of a non-full inner node into two halves. */
+static int
+split_child(inner_t *in, size_t i)
+{
+	node_t *c = in->child[i];
+	node_t *right;
+	uint64_t prefix;
+	char *sep;
 
-	/* do a depth-first iteration and delete the leafs */
-	n = tree->root;
-	while (n) {
-		node_t *tmp;
+	assert(in->super.num < INNER_SLOTS);
 
-		if (n->left) {
-			n = n->left;
-			continue;
-		}
-		else if (n->right) {
-			n = n->right;
-			continue;
-		}
+	if (c->is_leaf) {
+		leaf_t *l = LEAF(c);
+		size_t mid = LEAF_SLOTS / 2;
 
-		tmp = n->parent;
-		if (tmp) {
-			if (tmp->left == n)
-				tmp->left = NULL;
-			else
-				tmp->right = NULL;
+		sep = strdup(l->entries[mid].obj->name);
+		if (! sep)
+			return -1;
+		prefix = l->entries[mid].prefix;
+
+		right = (node_t *)leaf_create(LEAF_SLOTS);
+		if (! right) {
+			free(sep);
+			return -1;
 		}
 
-		node_destroy(n);
-		n = tmp;
+		memcpy(LEAF(right)->entries, l->entries + mid,
+				(c->num - mid) * sizeof(l->entries[0]));
+		right->num = c->num - mid;
+		c->num = mid;
+
+		LEAF(right)->next = l->next;
+		l->next = LEAF(right);
 	}
+	else {
+		inner_t *left = INNER(c);
+		size_t mid = INNER_SLOTS / 2;
 
-	tree->root = NULL;
-	tree->size = 0;
-} /* tree_clear */
+		right = (node_t *)inner_create();
+		if (! right)
+			return -1;
 
-/* Switch node 'n' with its right child, making 'n'
- * the new left child of that node. */
-static void
-rotate_left(sdb_avltree_t *tree, node_t *n)
+		/* the middle separator moves up into the parent */
+		sep = left->sep[mid - 1];
+		prefix = left->prefix[mid - 1];
+
+		memcpy(INNER(right)->child, left->child + mid,
+				(c->num - mid) * sizeof(left->child[0]));
+		memcpy(INNER(right)->sep, left->sep + mid,
+				(c->num - mid - 1) * sizeof(left->sep[0]));
+		memcpy(INNER(right)->prefix, left->prefix + mid,
+				(c->num - mid - 1) * sizeof(left->prefix[0]));
+		right->num = c->num - mid;
+		c->num = mid;
+	}
+
+	inner_open(in, i + 1);
+	in->child[i + 1] = right;
+	in->sep[i] = sep;
+	in->prefix[i] = prefix;
+	return 0;
+} /* split_child */
+
+/* Move one entry from the left sibling of child 'i' to that child. */
+static int
+borrow_left(inner_t *in, size_t i)
 {
-	node_t *n2 = n->right;
-	node_t *c = n2->left;
+	node_t *c = in->child[i], *left = in->child[i - 1];
 
-	n2->parent = n->parent;
-	if (! n2->parent)
-		tree->root = n2;
-	else if (n2->parent->left == n)
-		n2->parent->left = n2;
-	else
-		n2->parent->right = n2;
+	if (c->is_leaf) {
+		entry_t *e = LEAF(left)->entries + left->num - 1;
+		char *sep = strdup(e->obj->name);
+
+		if (! sep)
+			return -1;
+
+		memmove(LEAF(c)->entries + 1, LEAF(c)->entries,
+				c->num * sizeof(*e));
+		LEAF(c)->entries[0] = *e;
+		free(in->sep[i - 1]);
+		in->sep[i - 1] = sep;
+		in->prefix[i - 1] = e->prefix;
+	}
+	else {
+		inner_t *l = INNER(left), *r = INNER(c);
+
+		memmove(r->child + 1, r->child, c->num * sizeof(r->child[0]));
+		memmove(r->sep + 1, r->sep, (c->num - 1) * sizeof(r->sep[0]));
+		memmove(r->prefix + 1, r->prefix,
+				(c->num - 1) * sizeof(r->prefix[0]));
+
+		r->child[0] = l->child[left->num - 1];
+		r->sep[0] = in->sep[i - 1];
+		r->prefix[0] = in->prefix[i - 1];
+		in->sep[i - 1] = l->sep[left->num - 2];
+		in->prefix[i - 1] = l->prefix[left->num - 2];
+	}
+
+	++c->num;
+	--left->num;
+	return 0;
+} /* borrow_left */
 
-	n2->left = n;
-	n->parent = n2;
+/* Move one entry from the right sibling of child 'i' to that child. */
+static int
+borrow_right(inner_t *in, size_t i)
+{
+	node_t *c = in->child[i], *right = in->child[i + 1];
+
+	if (c->is_leaf) {
+		entry_t *e = LEAF(right)->entries;
+		char *sep = strdup(e[1].obj->name);
+
+		if (! sep)
+			return -1;
 
-	n->right = c;
-	if (c)
-		c->parent = n;
+		LEAF(c)->entries[c->num] = e[0];
+		memmove(e, e + 1, (right->num - 1) * sizeof(*e));
+		free(in->sep[i]);
+		in->sep[i] = sep;
+		in->prefix[i] = e[0].prefix;
+	}
+	else {
+		inner_t *l = INNER(c), *r = INNER(right);
+
+		l->child[c->num] = r->child[0];
+		l->sep[c->num - 1] = in->sep[i];
+		l->prefix[c->num - 1] = in->prefix[i];
+		in->sep[i] = r->sep[0];
+		in->prefix[i] = r->prefix[0];
+
+		memmove(r->child, r->child + 1,
+				(right->num - 1) * sizeof(r->child[0]));
+		memmove(r->sep, r->sep + 1, (right->num - 2) * sizeof(r->sep[0]));
+		memmove(r->prefix, r->prefix + 1,
+				(right->num - 2) * sizeof(r->prefix[0]));
+	}
 
-	n->height = CALC_HEIGHT(n);
-	n2->height = CALC_HEIGHT(n2);
-} /* rotate_left */
+	++c->num;
+	--right->num;
+	return 0;
+} /* borrow_right */
 
-/* Switch node 'n' with its left child, making 'n'
- * the new right child of that node. */
+/* Merge child 'i' into child 'i - 1'. */
 static void
-rotate_right(sdb_avltree_t *tree, node_t *n)
+merge_children(inner_t *in, size_t i)
 {
-	node_t *n2 = n->left;
-	node_t *c = n2->right;
+	node_t *left = in->child[i - 1], *right = in->child[i];
 
-	n2->parent = n->parent;
-	if (! n2->parent)
-		tree->root = n2;
-	else if (n2->parent->left == n)
-		n2->parent->left = n2;
-	else
-		n2->parent->right = n2;
+	if (left->is_leaf) {
+		memcpy(LEAF(left)->entries + left->num, LEAF(right)->entries,
+				right->num * sizeof(LEAF(right)->entries[0]));
+		LEAF(left)->next = LEAF(right)->next;
+		free(in->sep[i - 1]);
+	}
+	else {
+		inner_t *l = INNER(left), *r = INNER(right);
+
+		/* the separator moves down between the merged children */
+		l->sep[left->num - 1] = in->sep[i - 1];
+		l->prefix[left->num - 1] = in->prefix[i - 1];
+		memcpy(l->child + left->num, r->child,
+				right->num * sizeof(r->child[0]));
+		memcpy(l->sep + left->num, r->sep,
+				(right->num - 1) * sizeof(r->sep[0]));
+		memcpy(l->prefix + left->num, r->prefix,
+				(right->num - 1) * sizeof(r->prefix[0]));
+	}
 
-	n2->right = n;
-	n->parent = n2;
+	left->num += right->num;
+	sdb_slab_free(right);
+	inner_close(in, i);
+} /* merge_children */
 
-	n->left = c;
-	if (c)
-		c->parent = n;
+/* Make sure that child 'i' holds more than the minimum number of entries
+ * before descending into it for removing an entry. Returns the index of the
+ * child to descend into. */
+static int
+fill_child(inner_t *in, size_t i, size_t *next)
+{
+	node_t *c = in->child[i];
+	size_t min = c->is_leaf ? LEAF_MIN : INNER_MIN;
 
-	n->height = CALC_HEIGHT(n);
-	n2->height = CALC_HEIGHT(n2);
-} /* rotate_right */
+	*next = i;
+	if (c->num > min)
+		return 0;
+
+	if ((i > 0) && (in->child[i - 1]->num > min))
+		return borrow_left(in, i);
+	if ((i + 1 < in->super.num) && (in->child[i + 1]->num > min))
+		return borrow_right(in, i);
 
-/* Rebalance a tree starting at node 'n' towards the root;
- * also, update the node heights all the way up to the root. */
+	if (i > 0) {
+		merge_children(in, i);
+		*next = i - 1;
+	}
+	else
+		merge_children(in, i + 1);
+	return 0;
+} /* fill_child */
+
+/* Replace an inner root with a single child by that child. */
 static void
-rebalance(sdb_avltree_t *tree, node_t *n)
+collapse_root(sdb_avltree_t *tree)
 {
-	for ( ; n; n = n->parent) {
-		int bf = BALANCE(n);
+	node_t *n = tree->root;
 
-		if (bf == 0)
-			return;
+	if (n && (! n->is_leaf) && (n->num == 1)) {
+		tree->root = INNER(n)->child[0];
+		sdb_slab_free(n);
+	}
+	else if (n && n->is_leaf && (! n->num)) {
+		tree->root = NULL;
+		sdb_slab_free(n);
+	}
+} /* collapse_root */
 
-		if ((-1 <= bf) && (bf <= 1)) {
-			n->height = CALC_HEIGHT(n);
-			continue;
-		}
+static bool
+node_valid(node_t *n, bool is_root, const char *lo, const char *hi,
+		size_t depth, size_t *leaf_depth)
+{
+	bool status = 1;
+	size_t i;
 
-		assert((-2 <= bf) && (bf <= 2));
+	if ((! is_root) && (n->num < (n->is_leaf ? LEAF_MIN : INNER_MIN))) {
+		sdb_log(SDB_LOG_ERR, "avltree: Underfull %s node at depth %zu "
+				"(%zu entries)", n->is_leaf ? "leaf" : "inner",
+				depth, n->num);
+		status = 0;
+	}
 
-		if (bf == 2) {
-			if (BALANCE(n->left) == -1)
-				rotate_left(tree, n->left);
-			rotate_right(tree, n);
+	if (n->is_leaf) {
+		leaf_t *l = LEAF(n);
+
+		if (*leaf_depth && (*leaf_depth != depth)) {
+			sdb_log(SDB_LOG_ERR, "avltree: Leaf at depth %zu; "
+					"expected: %zu", depth, *leaf_depth);
+			status = 0;
 		}
-		else {
-			if (BALANCE(n->right) == 1)
-				rotate_right(tree, n->right);
-			rotate_left(tree, n);
+		*leaf_depth = depth;
+
+		for (i = 0; i < n->num; ++i) {
+			const char *name = l->entries[i].obj->name;
+
+			if (l->entries[i].prefix != name_prefix(name)) {
+				sdb_log(SDB_LOG_ERR, "avltree: Invalid prefix for '%s'",
+						name);
+				status = 0;
+			}
+			if ((i && (strcasecmp(l->entries[i - 1].obj->name, name) >= 0))
+					|| (lo && (strcasecmp(lo, name) > 0))
+					|| (hi && (strcasecmp(name, hi) >= 0))) {
+				sdb_log(SDB_LOG_ERR, "avltree: Misplaced node '%s'", name);
+				status = 0;
+			}
 		}
+		return status;
+	}
 
-		/* n was moved downwards; get back to the previous level */
-		n = n->parent;
+	if (n->num < 2) {
+		sdb_log(SDB_LOG_ERR, "avltree: Inner node at depth %zu with "
+				"%zu child%s", depth, n->num, n->num == 1 ? "" : "ren");
+		status = 0;
+	}
+
+	for (i = 0; i < n->num; ++i) {
+		const char *l = i ? INNER(n)->sep[i - 1] : lo;
+		const char *h = (i + 1 < n->num) ? INNER(n)->sep[i] : hi;
+
+		if ((i + 1 < n->num)
+				&& (INNER(n)->prefix[i] != name_prefix(INNER(n)->sep[i]))) {
+			sdb_log(SDB_LOG_ERR, "avltree: Invalid prefix for "
+					"separator '%s'", INNER(n)->sep[i]);
+			status = 0;
+		}
+		if (! node_valid(INNER(n)->child[i], 0, l, h, depth + 1, leaf_depth))
+			status = 0;
 	}
-} /* rebalance */
+	return status;
+} /* node_valid */
 
 /*
  * public API
@@ -285,7 +587,7 @@ sdb_avltree_create(void)
 {
 	sdb_avltree_t *tree;
 
-	tree = malloc(sizeof(*tree));
+	tree = node_alloc(sizeof(*tree));
 	if (! tree)
 		return NULL;
 
@@ -302,11 +604,9 @@ sdb_avltree_destroy(sdb_avltree_t *tree)
 	if (! tree)
 		return;
 
-	pthread_rwlock_wrlock(&tree->lock);
-	tree_clear(tree);
-	pthread_rwlock_unlock(&tree->lock);
+	sdb_avltree_clear(tree);
 	pthread_rwlock_destroy(&tree->lock);
-	free(tree);
+	sdb_slab_free(tree);
 } /* sdb_avltree_destroy */
 
 void
@@ -316,93 +616,199 @@ sdb_avltree_clear(sdb_avltree_t *tree)
 		return;
 
 	pthread_rwlock_wrlock(&tree->lock);
-	tree_clear(tree);
+	if (tree->root)
+		node_destroy(tree->root);
+	tree->root = NULL;
+	tree->size = 0;
 	pthread_rwlock_unlock(&tree->lock);
 } /* sdb_avltree_clear */
 
 int
 sdb_avltree_insert(sdb_avltree_t *tree, sdb_object_t *obj)
 {
-	node_t *parent;
+	search_key_t k;
 	node_t *n;
+	leaf_t *l;
+	size_t pos;
+	bool found;
 
-	int diff = -1;
-
-	if (! tree)
+	if ((! tree) || (! obj) || (! obj->name))
 		return -1;
 
-	n = node_create(obj);
-	if (! n)
-		return -1;
+	k.prefix = name_prefix(obj->name);
+	k.name = obj->name;
 
 	pthread_rwlock_wrlock(&tree->lock);
 
 	if (! tree->root) {
-		tree->root = n;
-		tree->size = 1;
-		pthread_rwlock_unlock(&tree->lock);
-		return 0;
+		tree->root = (node_t *)leaf_create(ROOT_LEAF_INITIAL);
+		if (! tree->root) {
+			pthread_rwlock_unlock(&tree->lock);
+			return -1;
+		}
 	}
-
-	parent = tree->root;
-	while (42) {
-		assert(parent);
-
-		diff = strcasecmp(obj->name, parent->obj->name);
-		if (! diff) {
-			node_destroy(n);
+	else if (tree->root->is_leaf
+			&& (tree->root->num == LEAF(tree->root)->cap)
+			&& (LEAF(tree->root)->cap < LEAF_SLOTS)) {
+		size_t cap = 2 * LEAF(tree->root)->cap;
+		leaf_t *root;
+
+		if (cap > LEAF_SLOTS)
+			cap = LEAF_SLOTS;
+		root = leaf_create(cap);
+		if (! root) {
 			pthread_rwlock_unlock(&tree->lock);
 			return -1;
 		}
+		root->super.num = tree->root->num;
+		memcpy(root->entries, LEAF(tree->root)->entries,
+				tree->root->num * sizeof(entry_t));
+		sdb_slab_free(tree->root);
+		tree->root = (node_t *)root;
+	}
 
-		if (diff < 0) {
-			if (! parent->left) {
-				parent->left = n;
-				break;
-			}
-			parent = parent->left;
+	/* split full nodes on the way down, such that there's always room for
+	 * a new entry in the parent node */
+	if (node_full(tree->root)) {
+		inner_t *root = inner_create();
+		if (! root) {
+			pthread_rwlock_unlock(&tree->lock);
+			return -1;
+		}
+		root->child[0] = tree->root;
+		root->super.num = 1;
+		if (split_child(root, 0)) {
+			sdb_slab_free(root);
+			pthread_rwlock_unlock(&tree->lock);
+			return -1;
 		}
-		else {
-			if (! parent->right) {
-				parent->right = n;
-				break;
+		tree->root = (node_t *)root;
+	}
+
+	n = tree->root;
+	while (! n->is_leaf) {
+		inner_t *in = INNER(n);
+		size_t i = inner_find(in, &k);
+
+		if (node_full(in->child[i])) {
+			if (split_child(in, i)) {
+				pthread_rwlock_unlock(&tree->lock);
+				return -1;
 			}
-			parent = parent->right;
+			if (SEP_CMP(in, i, &k) <= 0)
+				++i;
 		}
+		n = in->child[i];
 	}
 
-	n->parent = parent;
+	l = LEAF(n);
+	pos = leaf_find(l, &k, &found);
+	if (found) {
+		pthread_rwlock_unlock(&tree->lock);
+		return -1;
+	}
+
+	memmove(l->entries + pos + 1, l->entries + pos,
+			(n->num - pos) * sizeof(l->entries[0]));
+	l->entries[pos].prefix = k.prefix;
+	l->entries[pos].obj = obj;
+	sdb_object_ref(obj);
+	++n->num;
 	++tree->size;
 
-	rebalance(tree, parent);
 	pthread_rwlock_unlock(&tree->lock);
 	return 0;
 } /* sdb_avltree_insert */
 
+int
+sdb_avltree_remove(sdb_avltree_t *tree, const char *name)
+{
+	search_key_t k;
+	node_t *n;
+	leaf_t *l;
+	size_t pos;
+	bool found;
+
+	if ((! tree) || (! name))
+		return -1;
+
+	k.prefix = name_prefix(name);
+	k.name = name;
+
+	pthread_rwlock_wrlock(&tree->lock);
+
+	/* make sure each node has more than the minimum number of entries
+	 * before descending into it, such that removing an entry never
+	 * requires fixing up any parent nodes */
+	n = tree->root;
+	while (n && (! n->is_leaf)) {
+		size_t i = inner_find(INNER(n), &k);
+
+		if (fill_child(INNER(n), i, &i)) {
+			pthread_rwlock_unlock(&tree->lock);
+			return -1;
+		}
+		if ((n == tree->root) && (n->num == 1)) {
+			collapse_root(tree);
+			n = tree->root;
+			continue;
+		}
+		/* merging may have moved the key into the previous child */
+		n = INNER(n)->child[i];
+	}
+
+	if (! n) {
+		pthread_rwlock_unlock(&tree->lock);
+		return -1;
+	}
+
+	l = LEAF(n);
+	pos = leaf_find(l, &k, &found);
+	if (! found) {
+		pthread_rwlock_unlock(&tree->lock);
+		return -1;
+	}
+
+	sdb_object_deref(l->entries[pos].obj);
+	memmove(l->entries + pos, l->entries + pos + 1,
+			(n->num - pos - 1) * sizeof(l->entries[0]));
+	--n->num;
+	--tree->size;
+
+	collapse_root(tree);
+	pthread_rwlock_unlock(&tree->lock);
+	return 0;
+} /* sdb_avltree_remove */
+
 sdb_object_t *
 sdb_avltree_lookup(sdb_avltree_t *tree, const char *name)
 {
+	sdb_object_t *obj = NULL;
+	search_key_t k;
 	node_t *n;
 
-	if (! tree)
+	if ((! tree) || (! name))
 		return NULL;
 
-	n = tree->root;
-	while (n) {
-		int diff = strcasecmp(n->obj->name, name);
+	k.prefix = name_prefix(name);
+	k.name = name;
 
-		if (! diff) {
-			sdb_object_ref(n->obj);
-			return n->obj;
+	pthread_rwlock_rdlock(&tree->lock);
+	n = tree->root;
+	while (n && (! n->is_leaf))
+		n = INNER(n)->child[inner_find(INNER(n), &k)];
+
+	if (n) {
+		bool found;
+		size_t pos = leaf_find(LEAF(n), &k, &found);
+		if (found) {
+			obj = LEAF(n)->entries[pos].obj;
+			sdb_object_ref(obj);
 		}
-
-		if (diff < 0)
-			n = n->right;
-		else
-			n = n->left;
 	}
-	return NULL;
-} /* sdb_avltree_lookup_by_name */
+	pthread_rwlock_unlock(&tree->lock);
+	return obj;
+} /* sdb_avltree_lookup */
 
 sdb_avltree_iter_t *
 sdb_avltree_get_iter(sdb_avltree_t *tree)
@@ -419,12 +825,50 @@ sdb_avltree_get_iter(sdb_avltree_t *tree)
 	pthread_rwlock_rdlock(&tree->lock);
 
 	iter->tree = tree;
-	iter->node = node_smallest(tree);
+	iter->leaf = leaf_smallest(tree);
+	iter->idx = 0;
 
 	pthread_rwlock_unlock(&tree->lock);
 	return iter;
 } /* sdb_avltree_get_iter */
 
+sdb_avltree_iter_t *
+sdb_avltree_get_iter_from(sdb_avltree_t *tree, const char *name)
+{
+	sdb_avltree_iter_t *iter;
+	search_key_t k;
+	node_t *n;
+
+	if (! name)
+		return sdb_avltree_get_iter(tree);
+	if (! tree)
+		return NULL;
+
+	iter = malloc(sizeof(*iter));
+	if (! iter)
+		return NULL;
+
+	k.prefix = name_prefix(name);
+	k.name = name;
+
+	pthread_rwlock_rdlock(&tree->lock);
+
+	n = tree->root;
+	while (n && (! n->is_leaf))
+		n = INNER(n)->child[inner_find(INNER(n), &k)];
+
+	iter->tree = tree;
+	iter->leaf = LEAF(n);
+	iter->idx = n ? leaf_find(LEAF(n), &k, NULL) : 0;
+	if (iter->leaf && (iter->idx >= n->num)) {
+		iter->leaf = iter->leaf->next;
+		iter->idx = 0;
+	}
+
+	pthread_rwlock_unlock(&tree->lock);
+	return iter;
+} /* sdb_avltree_get_iter_from */
+
 void
 sdb_avltree_iter_destroy(sdb_avltree_iter_t *iter)
 {
@@ -432,7 +876,7 @@ sdb_avltree_iter_destroy(sdb_avltree_iter_t *iter)
 		return;
 
 	iter->tree = NULL;
-	iter->node = NULL;
+	iter->leaf = NULL;
 	free(iter);
 } /* sdb_avltree_iter_destroy */
 
@@ -442,28 +886,31 @@ sdb_avltree_iter_has_next(sdb_avltree_iter_t *iter)
 	if (! iter)
 		return 0;
 
-	return iter->node != NULL;
+	return iter->leaf != NULL;
 } /* sdb_avltree_iter_has_next */
 
 sdb_object_t *
 sdb_avltree_iter_get_next(sdb_avltree_iter_t *iter)
 {
-	node_t *n;
+	sdb_object_t *obj;
 
-	if (! iter)
+	if ((! iter) || (! iter->leaf))
 		return NULL;
 
-	n = iter->node;
-	iter->node = node_next(iter->node);
-	return n ? n->obj : NULL;
+	obj = iter->leaf->entries[iter->idx].obj;
+	if (++iter->idx >= iter->leaf->super.num) {
+		iter->leaf = iter->leaf->next;
+		iter->idx = 0;
+	}
+	return obj;
 } /* sdb_avltree_iter_get_next */
 
 sdb_object_t *
 sdb_avltree_iter_peek_next(sdb_avltree_iter_t *iter)
 {
-	if ((! iter) || (! iter->node))
+	if ((! iter) || (! iter->leaf))
 		return NULL;
-	return iter->node->obj;
+	return iter->leaf->entries[iter->idx].obj;
 } /* sdb_avltree_iter_peek_next */
 
 size_t
@@ -475,44 +922,30 @@ sdb_avltree_size(sdb_avltree_t *tree)
 bool
 sdb_avltree_valid(sdb_avltree_t *tree)
 {
-	node_t *n;
-
-	bool status = 1;
+	size_t leaf_depth = 0;
 	size_t size = 0;
+	bool status = 1;
+	leaf_t *l;
 
-	if (! tree)
-		return 1;
-
-	for (n = node_smallest(tree); n; n = node_next(n)) {
-		int bf = BALANCE(n);
-
-		if ((bf < -1) || (1 < bf)) {
-			sdb_log(SDB_LOG_ERR, "avltree: Unbalanced node '%s' (bf=%i)",
-					NODE_NAME(n), bf);
-			status = 0;
-		}
+	if ((! tree) || (! tree->root))
+		return (! tree) || (! tree->size);
 
-		if (NODE_HEIGHT(n) != n->height) {
-			sdb_log(SDB_LOG_ERR, "avltree: Unexpected height for node '%s': "
-					"%zu; expected: %zu", NODE_NAME(n), n->height,
-					NODE_HEIGHT(n));
-			status = 0;
-		}
+	if (! node_valid(tree->root, 1, NULL, NULL, 1, &leaf_depth))
+		status = 0;
 
-		if (n->parent && (n->parent->left != n) && (n->parent->right != n)) {
-			sdb_log(SDB_LOG_ERR, "avltree: Invalid child nodes for parent of "
-					"node '%s': {left: %s, right: %s}; expected: %s",
-					NODE_NAME(n), NODE_NAME(n->parent->left),
-					NODE_NAME(n->parent->right), NODE_NAME(n));
+	for (l = leaf_smallest(tree); l; l = l->next) {
+		if ((! l->super.num) && (LEAF(tree->root) != l)) {
+			sdb_log(SDB_LOG_ERR, "avltree: Empty leaf node");
 			status = 0;
 		}
-		if ((! n->parent) && (n != tree->root)) {
-			sdb_log(SDB_LOG_ERR, "avltree: Non-root node '%s' does not "
-					"have a parent", NODE_NAME(n));
+		if (l->next && l->super.num && l->next->super.num
+				&& (strcasecmp(l->entries[l->super.num - 1].obj->name,
+						l->next->entries[0].obj->name) >= 0)) {
+			sdb_log(SDB_LOG_ERR, "avltree: Leaf nodes out of order at '%s'",
+					l->next->entries[0].obj->name);
 			status = 0;
 		}
-
-		++size;
+		size += l->super.num;
 	}
 
 	if (size != tree->size) {
@@ -524,4 +957,3 @@ sdb_avltree_valid(sdb_avltree_t *tree)
 } /* sdb_avltree_valid */
 
 /* vim: set tw=78 sw=4 ts=4 noexpandtab : */
-
@@ -0,0 +1,308 @@
+/*
+ * SysDB - src/utils/hashtable.c
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#	include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "sysdb.h"
+#include "utils/hashtable.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <pthread.h>
+
+/*
+ * private data types
+ */
+
+typedef struct {
+	/* hash of the case-folded name of the object */
+	uint32_t hash;
+	sdb_object_t *obj; /* NULL for empty slots */
+} slot_t;
+
+struct sdb_hashtable {
+	pthread_rwlock_t lock;
+
+	/* open addressing with linear probing; the number of slots is a power
+	 * of two (or zero before the first insert) */
+	slot_t *slots;
+	size_t slots_num;
+	size_t size;
+};
+
+#define INITIAL_SLOTS 8
+
+/* grow the table once it's filled by more than 3/4 */
+#define NEEDS_GROWING(t) (4 * ((t)->size + 1) > 3 * (t)->slots_num)
+
+/*
+ * private helper functions
+ */
+
+/* FNV-1a of the case-folded name */
+static uint32_t
+hash_name(const char *name)
+{
+	uint32_t h = 2166136261U;
+
+	for ( ; *name; ++name) {
+		h ^= (uint32_t)tolower((unsigned char)*name);
+		h *= 16777619U;
+	}
+	return h;
+} /* hash_name */
+
+/* Returns the slot containing the object with the specified name or the
+ * empty slot where it would have to be inserted. */
+static slot_t *
+find_slot(sdb_hashtable_t *table, uint32_t hash, const char *name)
+{
+	size_t mask = table->slots_num - 1;
+	size_t i = hash & mask;
+
+	while (table->slots[i].obj) {
+		slot_t *s = table->slots + i;
+		if ((s->hash == hash) && (! strcasecmp(s->obj->name, name)))
+			return s;
+		i = (i + 1) & mask;
+	}
+	return table->slots + i;
+} /* find_slot */
+
+static int
+resize(sdb_hashtable_t *table, size_t slots_num)
+{
+	slot_t *old = table->slots;
+	size_t old_num = table->slots_num, i;
+
+	table->slots = calloc(slots_num, sizeof(*table->slots));
+	if (! table->slots) {
+		table->slots = old;
+		return -1;
+	}
+	table->slots_num = slots_num;
+
+	for (i = 0; i < old_num; ++i) {
+		slot_t *s;
+
+		if (! old[i].obj)
+			continue;
+		s = find_slot(table, old[i].hash, old[i].obj->name);
+		*s = old[i];
+	}
+	if (old)
+		free(old);
+	return 0;
+} /* resize */
+
+/* Remove the object from the specified slot and move up all following
+ * entries of the same probe sequence to fill the gap. This keeps lookups
+ * working without having to use tombstones. */
+static void
+remove_slot(sdb_hashtable_t *table, size_t i)
+{
+	size_t mask = table->slots_num - 1;
+	size_t j = i;
+
+	sdb_object_deref(table->slots[i].obj);
+	table->slots[i].obj = NULL;
+
+	while (42) {
+		size_t home;
+
+		j = (j + 1) & mask;
+		if (! table->slots[j].obj)
+			break;
+
+		/* leave entries in place if their home slot lies in (i, j] */
+		home = table->slots[j].hash & mask;
+		if ((i <= j) ? ((i < home) && (home <= j))
+				: ((i < home) || (home <= j)))
+			continue;
+
+		table->slots[i] = table->slots[j];
+		table->slots[j].obj = NULL;
+		i = j;
+	}
+	--table->size;
+} /* remove_slot */
+
+static void
+table_clear(sdb_hashtable_t *table)
+{
+	size_t i;
+
+	for (i = 0; i < table->slots_num; ++i)
+		if (table->slots[i].obj)
+			sdb_object_deref(table->slots[i].obj);
+	if (table->slots)
+		free(table->slots);
+	table->slots = NULL;
+	table->slots_num = 0;
+	table->size = 0;
+} /* table_clear */
+
+/*
+ * public API
+ */
+
+sdb_hashtable_t *
+sdb_hashtable_create(void)
+{
+	sdb_hashtable_t *table;
+
+	table = malloc(sizeof(*table));
+	if (! table)
+		return NULL;
+
+	pthread_rwlock_init(&table->lock, /* attr = */ NULL);
+
+	table->slots = NULL;
+	table->slots_num = 0;
+	table->size = 0;
+	return table;
+} /* sdb_hashtable_create */
+
+void
+sdb_hashtable_destroy(sdb_hashtable_t *table)
+{
+	if (! table)
+		return;
+
+	pthread_rwlock_wrlock(&table->lock);
+	table_clear(table);
+	pthread_rwlock_unlock(&table->lock);
+	pthread_rwlock_destroy(&table->lock);
+	free(table);
+} /* sdb_hashtable_destroy */
+
+void
+sdb_hashtable_clear(sdb_hashtable_t *table)
+{
+	if (! table)
+		return;
+
+	pthread_rwlock_wrlock(&table->lock);
+	table_clear(table);
+	pthread_rwlock_unlock(&table->lock);
+} /* sdb_hashtable_clear */
+
+int
+sdb_hashtable_insert(sdb_hashtable_t *table, sdb_object_t *obj)
+{
+	uint32_t hash;
+	slot_t *s;
+
+	if ((! table) || (! obj) || (! obj->name))
+		return -1;
+
+	hash = hash_name(obj->name);
+
+	pthread_rwlock_wrlock(&table->lock);
+
+	if (NEEDS_GROWING(table)) {
+		size_t num = table->slots_num ? 2 * table->slots_num : INITIAL_SLOTS;
+		if (resize(table, num)) {
+			pthread_rwlock_unlock(&table->lock);
+			return -1;
+		}
+	}
+
+	s = find_slot(table, hash, obj->name);
+	if (s->obj) {
+		pthread_rwlock_unlock(&table->lock);
+		return -1;
+	}
+
+	sdb_object_ref(obj);
+	s->hash = hash;
+	s->obj = obj;
+	++table->size;
+
+	pthread_rwlock_unlock(&table->lock);
+	return 0;
+} /* sdb_hashtable_insert */
+
+int
+sdb_hashtable_remove(sdb_hashtable_t *table, const char *name)
+{
+	slot_t *s;
+
+	if ((! table) || (! name))
+		return -1;
+
+	pthread_rwlock_wrlock(&table->lock);
+	if (! table->size) {
+		pthread_rwlock_unlock(&table->lock);
+		return -1;
+	}
+
+	s = find_slot(table, hash_name(name), name);
+	if (! s->obj) {
+		pthread_rwlock_unlock(&table->lock);
+		return -1;
+	}
+
+	remove_slot(table, (size_t)(s - table->slots));
+	pthread_rwlock_unlock(&table->lock);
+	return 0;
+} /* sdb_hashtable_remove */
+
+sdb_object_t *
+sdb_hashtable_lookup(sdb_hashtable_t *table, const char *name)
+{
+	sdb_object_t *obj = NULL;
+	uint32_t hash;
+
+	if ((! table) || (! name))
+		return NULL;
+
+	hash = hash_name(name);
+
+	pthread_rwlock_rdlock(&table->lock);
+	if (table->size) {
+		obj = find_slot(table, hash, name)->obj;
+		if (obj)
+			sdb_object_ref(obj);
+	}
+	pthread_rwlock_unlock(&table->lock);
+	return obj;
+} /* sdb_hashtable_lookup */
+
+size_t
+sdb_hashtable_size(sdb_hashtable_t *table)
+{
+	return table ? table->size : 0;
+} /* sdb_hashtable_size */
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
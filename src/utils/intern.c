@@ -0,0 +1,246 @@
+/*
+ * SysDB - src/utils/intern.c
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#if HAVE_CONFIG_H
+#	include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "sysdb.h"
+#include "utils/intern.h"
+#include "utils/slab.h"
+
+#include <assert.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+/*
+ * private data types
+ */
+
+/* The table is split into stripes, each of them being a chained hash table
+ * protected by a lock of its own. Entries are allocated from a slab. */
+#define STRIPES_NUM 64
+#define INITIAL_BUCKETS 16
+
+struct entry;
+typedef struct entry entry_t;
+
+struct entry {
+	entry_t *next;
+	uint32_t hash;
+	unsigned int ref_cnt;
+	char str[];
+};
+#define ENTRY(s) ((entry_t *)(void *)((s) - offsetof(entry_t, str)))
+
+typedef struct {
+	pthread_mutex_t lock;
+
+	entry_t **buckets;
+	size_t buckets_num;
+	size_t size;
+} stripe_t;
+
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+static stripe_t stripes[STRIPES_NUM];
+static sdb_slab_t *entry_slab = NULL;
+
+#define STRIPE(h) (stripes + ((h) % STRIPES_NUM))
+#define BUCKET(s, h) \
+	((s)->buckets + (((h) / STRIPES_NUM) & ((s)->buckets_num - 1)))
+
+/*
+ * private helper functions
+ */
+
+static void
+table_init(void)
+{
+	size_t i;
+
+	for (i = 0; i < STRIPES_NUM; ++i) {
+		pthread_mutex_init(&stripes[i].lock, /* attr = */ NULL);
+		stripes[i].buckets = NULL;
+		stripes[i].buckets_num = 0;
+		stripes[i].size = 0;
+	}
+	entry_slab = sdb_slab_create();
+} /* table_init */
+
+/* FNV-1a of the string */
+static uint32_t
+hash_str(const char *str)
+{
+	uint32_t h = 2166136261U;
+
+	for ( ; *str; ++str) {
+		h ^= (uint32_t)(unsigned char)*str;
+		h *= 16777619U;
+	}
+	return h;
+} /* hash_str */
+
+/* Double the number of buckets of a stripe; entries don't have to be hashed
+ * again since they remember their hash. */
+static int
+stripe_grow(stripe_t *s)
+{
+	entry_t **old = s->buckets;
+	size_t old_num = s->buckets_num, i;
+
+	s->buckets_num = old_num ? 2 * old_num : INITIAL_BUCKETS;
+	s->buckets = calloc(s->buckets_num, sizeof(*s->buckets));
+	if (! s->buckets) {
+		s->buckets = old;
+		s->buckets_num = old_num;
+		return -1;
+	}
+
+	for (i = 0; i < old_num; ++i) {
+		entry_t *e = old[i];
+		while (e) {
+			entry_t *next = e->next;
+			entry_t **b = BUCKET(s, e->hash);
+
+			e->next = *b;
+			*b = e;
+			e = next;
+		}
+	}
+	if (old)
+		free(old);
+	return 0;
+} /* stripe_grow */
+
+/*
+ * public API
+ */
+
+char *
+sdb_intern(const char *str)
+{
+	stripe_t *s;
+	entry_t *e;
+	uint32_t hash;
+	size_t len;
+
+	if (! str)
+		return NULL;
+
+	pthread_once(&table_once, table_init);
+
+	hash = hash_str(str);
+	s = STRIPE(hash);
+	pthread_mutex_lock(&s->lock);
+
+	if (s->buckets_num) {
+		for (e = *BUCKET(s, hash); e; e = e->next) {
+			if ((e->hash == hash) && (! strcmp(e->str, str))) {
+				++e->ref_cnt;
+				pthread_mutex_unlock(&s->lock);
+				return e->str;
+			}
+		}
+	}
+
+	/* grow the stripe once it holds more entries than buckets */
+	if ((s->size >= s->buckets_num) && stripe_grow(s)
+			&& (! s->buckets_num)) {
+		pthread_mutex_unlock(&s->lock);
+		return NULL;
+	}
+
+	len = strlen(str);
+	e = sdb_slab_alloc(entry_slab, sizeof(*e) + len + 1);
+	if (! e) {
+		pthread_mutex_unlock(&s->lock);
+		return NULL;
+	}
+	e->hash = hash;
+	e->ref_cnt = 1;
+	memcpy(e->str, str, len + 1);
+
+	e->next = *BUCKET(s, hash);
+	*BUCKET(s, hash) = e;
+	++s->size;
+
+	pthread_mutex_unlock(&s->lock);
+	return e->str;
+} /* sdb_intern */
+
+void
+sdb_intern_release(char *str)
+{
+	entry_t *e, **b;
+	stripe_t *s;
+
+	if (! str)
+		return;
+
+	e = ENTRY(str);
+	s = STRIPE(e->hash);
+	pthread_mutex_lock(&s->lock);
+
+	assert(e->ref_cnt > 0);
+	if (--e->ref_cnt) {
+		pthread_mutex_unlock(&s->lock);
+		return;
+	}
+
+	for (b = BUCKET(s, e->hash); *b; b = &(*b)->next) {
+		if (*b == e) {
+			*b = e->next;
+			break;
+		}
+	}
+	--s->size;
+	pthread_mutex_unlock(&s->lock);
+	sdb_slab_free(e);
+} /* sdb_intern_release */
+
+size_t
+sdb_intern_size(void)
+{
+	size_t size = 0, i;
+
+	pthread_once(&table_once, table_init);
+
+	for (i = 0; i < STRIPES_NUM; ++i) {
+		pthread_mutex_lock(&stripes[i].lock);
+		size += stripes[i].size;
+		pthread_mutex_unlock(&stripes[i].lock);
+	}
+	return size;
+} /* sdb_intern_size */
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
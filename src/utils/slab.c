@@ -0,0 +1,361 @@
+/*
+ * SysDB - src/utils/slab.c
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#	include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include "sysdb.h"
+#include "utils/slab.h"
+
+#include <assert.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+/*
+ * private data types
+ */
+
+/* Pages are aligned to their size, such that the page holding a chunk may be
+ * determined from the chunk's address. The page header is stored at the
+ * beginning of each page. */
+#define SLAB_PAGE_SIZE 65536
+#define CHUNK_ALIGN 16
+
+/* size classes in steps of CHUNK_ALIGN bytes up to 1 KiB */
+#define CLASSES_NUM 64
+#define CHUNK_MAX (CLASSES_NUM * CHUNK_ALIGN)
+
+#define ALIGN(n) (((n) + CHUNK_ALIGN - 1) & ~((size_t)CHUNK_ALIGN - 1))
+#define PAGE_HEADER ALIGN(sizeof(page_t))
+#define PAGE_OF(ptr) \
+	((page_t *)((uintptr_t)(ptr) & ~((uintptr_t)SLAB_PAGE_SIZE - 1)))
+
+struct page;
+typedef struct page page_t;
+
+typedef struct {
+	pthread_mutex_t lock;
+	size_t size;
+
+	/* pages with free chunks come first */
+	page_t *head;
+	page_t *tail;
+
+	size_t pages_num;
+	size_t chunks_num;
+} slab_class_t;
+
+struct page {
+	sdb_slab_t *slab;
+	slab_class_t *cls; /* NULL for large allocations */
+
+	page_t *prev;
+	page_t *next;
+
+	/* chunks which have been freed and chunks which have never been used */
+	void *free;
+	char *unused;
+	size_t used;
+};
+
+struct sdb_slab {
+	slab_class_t classes[CLASSES_NUM];
+
+	/* allocations larger than CHUNK_MAX */
+	pthread_mutex_t lock;
+	page_t *large;
+	size_t large_num;
+};
+
+/*
+ * private helper functions
+ */
+
+static page_t *
+page_alloc(size_t size)
+{
+	void *p = NULL;
+
+	if (posix_memalign(&p, SLAB_PAGE_SIZE, size))
+		return NULL;
+	return p;
+} /* page_alloc */
+
+static bool
+page_full(slab_class_t *cls, page_t *page)
+{
+	return (! page->free)
+		&& (page->unused + cls->size > (char *)page + SLAB_PAGE_SIZE);
+} /* page_full */
+
+static void
+page_unlink(slab_class_t *cls, page_t *page)
+{
+	if (page->prev)
+		page->prev->next = page->next;
+	else
+		cls->head = page->next;
+	if (page->next)
+		page->next->prev = page->prev;
+	else
+		cls->tail = page->prev;
+	page->prev = page->next = NULL;
+} /* page_unlink */
+
+static void
+page_push_head(slab_class_t *cls, page_t *page)
+{
+	page->prev = NULL;
+	page->next = cls->head;
+	if (cls->head)
+		cls->head->prev = page;
+	else
+		cls->tail = page;
+	cls->head = page;
+} /* page_push_head */
+
+static void
+page_push_tail(slab_class_t *cls, page_t *page)
+{
+	page->next = NULL;
+	page->prev = cls->tail;
+	if (cls->tail)
+		cls->tail->next = page;
+	else
+		cls->head = page;
+	cls->tail = page;
+} /* page_push_tail */
+
+static void
+pages_destroy(page_t *page)
+{
+	while (page) {
+		page_t *next = page->next;
+		free(page);
+		page = next;
+	}
+} /* pages_destroy */
+
+static void *
+large_alloc(sdb_slab_t *slab, size_t size)
+{
+	page_t *page = page_alloc(PAGE_HEADER + size);
+
+	if (! page)
+		return NULL;
+	memset(page, 0, sizeof(*page));
+	page->slab = slab;
+	page->used = 1;
+
+	pthread_mutex_lock(&slab->lock);
+	page->next = slab->large;
+	if (slab->large)
+		slab->large->prev = page;
+	slab->large = page;
+	++slab->large_num;
+	pthread_mutex_unlock(&slab->lock);
+	return (char *)page + PAGE_HEADER;
+} /* large_alloc */
+
+static void
+large_free(page_t *page)
+{
+	sdb_slab_t *slab = page->slab;
+
+	pthread_mutex_lock(&slab->lock);
+	if (page->prev)
+		page->prev->next = page->next;
+	else
+		slab->large = page->next;
+	if (page->next)
+		page->next->prev = page->prev;
+	--slab->large_num;
+	pthread_mutex_unlock(&slab->lock);
+	free(page);
+} /* large_free */
+
+/*
+ * public API
+ */
+
+sdb_slab_t *
+sdb_slab_create(void)
+{
+	sdb_slab_t *slab;
+	size_t i;
+
+	slab = calloc(1, sizeof(*slab));
+	if (! slab)
+		return NULL;
+
+	for (i = 0; i < CLASSES_NUM; ++i) {
+		pthread_mutex_init(&slab->classes[i].lock, /* attr = */ NULL);
+		slab->classes[i].size = (i + 1) * CHUNK_ALIGN;
+	}
+	pthread_mutex_init(&slab->lock, /* attr = */ NULL);
+	return slab;
+} /* sdb_slab_create */
+
+void
+sdb_slab_destroy(sdb_slab_t *slab)
+{
+	size_t i;
+
+	if (! slab)
+		return;
+
+	for (i = 0; i < CLASSES_NUM; ++i) {
+		pages_destroy(slab->classes[i].head);
+		pthread_mutex_destroy(&slab->classes[i].lock);
+	}
+	pages_destroy(slab->large);
+	pthread_mutex_destroy(&slab->lock);
+	free(slab);
+} /* sdb_slab_destroy */
+
+void *
+sdb_slab_alloc(sdb_slab_t *slab, size_t size)
+{
+	slab_class_t *cls;
+	page_t *page;
+	void *ptr;
+
+	if (! slab)
+		return NULL;
+	if (size > CHUNK_MAX)
+		return large_alloc(slab, size);
+
+	cls = slab->classes + (size ? (size - 1) / CHUNK_ALIGN : 0);
+	pthread_mutex_lock(&cls->lock);
+
+	page = cls->head;
+	if ((! page) || page_full(cls, page)) {
+		page = page_alloc(SLAB_PAGE_SIZE);
+		if (! page) {
+			pthread_mutex_unlock(&cls->lock);
+			return NULL;
+		}
+		memset(page, 0, sizeof(*page));
+		page->slab = slab;
+		page->cls = cls;
+		page->unused = (char *)page + PAGE_HEADER;
+		page_push_head(cls, page);
+		++cls->pages_num;
+	}
+
+	if (page->free) {
+		ptr = page->free;
+		page->free = *(void **)ptr;
+	}
+	else {
+		ptr = page->unused;
+		page->unused += cls->size;
+	}
+	++page->used;
+	++cls->chunks_num;
+
+	/* keep pages with free chunks in front */
+	if (page_full(cls, page) && page->next) {
+		page_unlink(cls, page);
+		page_push_tail(cls, page);
+	}
+
+	pthread_mutex_unlock(&cls->lock);
+	return ptr;
+} /* sdb_slab_alloc */
+
+void
+sdb_slab_free(void *ptr)
+{
+	slab_class_t *cls;
+	page_t *page;
+
+	if (! ptr)
+		return;
+
+	page = PAGE_OF(ptr);
+	if (! page->cls) {
+		large_free(page);
+		return;
+	}
+
+	cls = page->cls;
+	pthread_mutex_lock(&cls->lock);
+	assert(page->used > 0);
+
+	if (page_full(cls, page)) {
+		page_unlink(cls, page);
+		page_push_head(cls, page);
+	}
+
+	*(void **)ptr = page->free;
+	page->free = ptr;
+	--page->used;
+	--cls->chunks_num;
+
+	/* release empty pages unless it's the only one left to allocate from;
+	 * all pages with free chunks are stored in front of the list */
+	if ((! page->used) && ((cls->head != page)
+				|| (page->next && (! page_full(cls, page->next))))) {
+		page_unlink(cls, page);
+		--cls->pages_num;
+		free(page);
+	}
+	pthread_mutex_unlock(&cls->lock);
+} /* sdb_slab_free */
+
+void
+sdb_slab_stats(sdb_slab_t *slab, size_t *pages, size_t *chunks)
+{
+	size_t p = 0, c = 0;
+	size_t i;
+
+	if (slab) {
+		for (i = 0; i < CLASSES_NUM; ++i) {
+			pthread_mutex_lock(&slab->classes[i].lock);
+			p += slab->classes[i].pages_num;
+			c += slab->classes[i].chunks_num;
+			pthread_mutex_unlock(&slab->classes[i].lock);
+		}
+		pthread_mutex_lock(&slab->lock);
+		p += slab->large_num;
+		c += slab->large_num;
+		pthread_mutex_unlock(&slab->lock);
+	}
+
+	if (pages)
+		*pages = p;
+	if (chunks)
+		*chunks = c;
+} /* sdb_slab_stats */
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
@@ -98,6 +98,35 @@ echo "$output" \
 	| grep -F '"example service two"' \
 	| grep -F '"example service three"'
 
+# Chunked results are reassembled by the client, even if log messages or
+# chunk boundaries fall in between.
+output="$( run_sysdb -H "$SOCKET_FILE" -s 16 -c 'LIST services' 2>&1 )"
+echo "$output" | grep -F 'ERROR' && exit 1
+echo "$output" \
+	| grep -F '"host1.example.com"' \
+	| grep -F '"some.host.name"' \
+	| grep -F '"mock service"' \
+	| grep -F '"example service three"'
+chunked="$( run_sysdb -H "$SOCKET_FILE" -s 1 -c 'LIST hosts' \
+	| grep -o '"name": "[^"]*"' )"
+plain="$( run_sysdb -H "$SOCKET_FILE" -c 'LIST hosts' \
+	| grep -o '"name": "[^"]*"' )"
+test -n "$plain" && test "$chunked" = "$plain"
+
+output="$( echo 'LIST hosts;' | run_sysdb -H "$SOCKET_FILE" -s 32 )" || echo $?
+echo "$output" \
+	| grep -F '"host1.example.com"' \
+	| grep -F '"host2.example.com"' \
+	| grep -F '"localhost"' \
+	| grep -F '"other.host.name"' \
+	| grep -F '"some.host.name"'
+
+# Invalid chunk sizes.
+output="$( run_sysdb -H "$SOCKET_FILE" -s 0 -c 'LIST hosts' 2>&1 )" && exit 1
+echo "$output" | grep -F 'Usage:'
+output="$( run_sysdb -H "$SOCKET_FILE" -s 1k -c 'LIST hosts' 2>&1 )" && exit 1
+echo "$output" | grep -F 'Usage:'
+
 stop_sysdbd
 
 # vim: set tw=78 sw=4 ts=4 noexpandtab :
@@ -29,10 +29,12 @@
 #	include "config.h"
 #endif
 
+#include "sysdb.h"
 #include "core/object.h"
 #include "testutils.h"
 
 #include <check.h>
+#include <pthread.h>
 
 /*
  * private data types
@@ -193,6 +195,74 @@ START_TEST(test_obj_create)
 }
 END_TEST
 
+START_TEST(test_obj_slab)
+{
+	sdb_slab_t *slab;
+	sdb_object_t *obj1, *obj2;
+	size_t chunks = 0;
+
+	slab = sdb_slab_create();
+	fail_unless(slab != NULL,
+			"INTERNAL ERROR: failed to create slab");
+
+	init_noop_called = 0;
+	init_noop_retval = 0;
+	destroy_noop_called = 0;
+	obj1 = sdb_object_create_slab(slab, "test-object", noop_type);
+	fail_unless(obj1 != NULL,
+			"sdb_object_create_slab() = NULL; expected: a new object");
+	fail_unless(!strcmp(obj1->name, "test-object"),
+			"after sdb_object_create_slab(): obj->name = '%s'; "
+			"expected: 'test-object'", obj1->name);
+	fail_unless(obj1->name == (char *)obj1 + sizeof(struct noop),
+			"after sdb_object_create_slab(): obj->name = %p; "
+			"expected: %p (stored inline)", obj1->name,
+			(char *)obj1 + sizeof(struct noop));
+	fail_unless(init_noop_called == 1,
+			"sdb_object_create_slab() did not call object's init function");
+
+	obj2 = sdb_object_create_slab(slab, NULL, noop_type);
+	fail_unless(obj2 != NULL,
+			"sdb_object_create_slab(<slab>, NULL) = NULL; "
+			"expected: a new object");
+	fail_unless(obj2->name == NULL,
+			"sdb_object_create_slab(<slab>, NULL) created object with "
+			"name '%s'; expected: NULL", obj2->name);
+
+	sdb_slab_stats(slab, NULL, &chunks);
+	fail_unless(chunks == 2,
+			"sdb_slab_stats() reported %zu chunks after creating two "
+			"objects; expected: 2", chunks);
+
+	sdb_object_deref(obj1);
+	sdb_object_deref(obj2);
+	fail_unless(destroy_noop_called == 2,
+			"sdb_object_deref() called destroy %d times; expected: 2",
+			destroy_noop_called);
+	sdb_slab_stats(slab, NULL, &chunks);
+	fail_unless(chunks == 0,
+			"sdb_slab_stats() reported %zu chunks after destroying all "
+			"objects; expected: 0", chunks);
+
+	init_noop_retval = -1;
+	destroy_noop_called = 0;
+	obj1 = sdb_object_create_slab(slab, "test-object", noop_type);
+	fail_unless(obj1 == NULL,
+			"sdb_object_create_slab() = %p; expected NULL "
+			"(init returned -1)", obj1);
+	fail_unless(destroy_noop_called == 1,
+			"sdb_object_create_slab() did not call object's destroy "
+			"function after init failure");
+	sdb_slab_stats(slab, NULL, &chunks);
+	fail_unless(chunks == 0,
+			"sdb_object_create_slab() leaked %zu chunks after init "
+			"failure", chunks);
+	init_noop_retval = 0;
+
+	sdb_slab_destroy(slab);
+}
+END_TEST
+
 START_TEST(test_obj_wrapper)
 {
 	sdb_object_t *obj;
@@ -293,6 +363,47 @@ START_TEST(test_obj_ref)
 }
 END_TEST
 
+static void *
+ref_loop(void *arg)
+{
+	sdb_object_t *obj = arg;
+	int i;
+
+	for (i = 0; i < 100000; ++i) {
+		sdb_object_ref(obj);
+		sdb_object_deref(obj);
+	}
+	return NULL;
+} /* ref_loop */
+
+START_TEST(test_obj_ref_threads)
+{
+	pthread_t threads[4];
+	sdb_object_t *obj;
+	size_t i;
+
+	destroy_noop_called = 0;
+
+	obj = sdb_object_create("test-object", noop_type);
+	fail_unless(obj != NULL,
+			"sdb_object_create() = NULL; expected: valid object");
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(threads); ++i)
+		fail_unless(pthread_create(threads + i, NULL, ref_loop, obj) == 0,
+				"INTERNAL ERROR: failed to create thread");
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(threads); ++i)
+		pthread_join(threads[i], NULL);
+
+	fail_unless(obj->ref_cnt == 1,
+			"after concurrent sdb_object_{de,}ref(): obj->ref_cnt = %d; "
+			"expected: 1", obj->ref_cnt);
+	fail_unless(destroy_noop_called == 0,
+			"after concurrent sdb_object_{de,}ref(): object's destroy "
+			"called %d times; expected: 0", destroy_noop_called);
+	sdb_object_deref(obj);
+}
+END_TEST
+
 START_TEST(test_obj_cmp)
 {
 	sdb_object_t *obj1, *obj2, *obj3, *obj4;
@@ -327,8 +438,10 @@ TEST_MAIN("core::object")
 {
 	TCase *tc = tcase_create("core");
 	tcase_add_test(tc, test_obj_create);
+	tcase_add_test(tc, test_obj_slab);
 	tcase_add_test(tc, test_obj_wrapper);
 	tcase_add_test(tc, test_obj_ref);
+	tcase_add_test(tc, test_obj_ref_threads);
 	tcase_add_test(tc, test_obj_cmp);
 	ADD_TCASE(tc);
 }
@@ -0,0 +1,605 @@
+/*
+ * SysDB - t/unit/core/plugin_test.c
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#	include "config.h"
+#endif
+
+#include "core/plugin-private.h"
+#include "core/time.h"
+#include "testutils.h"
+
+#include <check.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MSECS_TO_SDB_TIME(ms) ((sdb_time_t)(ms) * (sdb_time_t)1000000)
+
+static void
+msleep(int ms)
+{
+	sdb_sleep(MSECS_TO_SDB_TIME(ms), NULL);
+} /* msleep */
+
+/*
+ * cname cache
+ */
+
+static pthread_mutex_t cname_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  cname_cond = PTHREAD_COND_INITIALIZER;
+
+static int cname_calls = 0;
+/* names starting with "same" are left unchanged */
+static const char *cname_negative = "same";
+
+/* lookups of this name block until cname_release is set */
+static const char *cname_blocking = NULL;
+static bool cname_blocked = 0;
+static bool cname_release = 0;
+
+static char *
+cname_cb(const char *name, sdb_object_t __attribute__((unused)) *user_data)
+{
+	char buf[1024];
+
+	pthread_mutex_lock(&cname_lock);
+	++cname_calls;
+	if (cname_blocking && (! strcmp(name, cname_blocking))) {
+		cname_blocked = 1;
+		pthread_cond_broadcast(&cname_cond);
+		while (! cname_release)
+			pthread_cond_wait(&cname_cond, &cname_lock);
+	}
+	pthread_mutex_unlock(&cname_lock);
+
+	if (! strncmp(name, cname_negative, strlen(cname_negative)))
+		return NULL;
+	snprintf(buf, sizeof(buf), "%s.example.com", name);
+	return strdup(buf);
+} /* cname_cb */
+
+static int
+calls(void)
+{
+	int n;
+	pthread_mutex_lock(&cname_lock);
+	n = cname_calls;
+	pthread_mutex_unlock(&cname_lock);
+	return n;
+} /* calls */
+
+static size_t
+entries(void)
+{
+	sdb_plugin_cname_cache_stats_t stats;
+	sdb_plugin_cname_cache_stats(&stats);
+	return stats.entries;
+} /* entries */
+
+/* look up 'name' and return whether the callback was invoked */
+static bool
+lookup(const char *name)
+{
+	char buf[1024];
+	int before = calls();
+	char *cname = sdb_plugin_cname(strdup(name));
+
+	fail_unless(cname != NULL,
+			"sdb_plugin_cname(%s) = NULL; expected: <name>", name);
+	if (! strncmp(name, cname_negative, strlen(cname_negative)))
+		strncpy(buf, name, sizeof(buf));
+	else
+		snprintf(buf, sizeof(buf), "%s.example.com", name);
+	fail_unless(! strcmp(cname, buf),
+			"sdb_plugin_cname(%s) = '%s'; expected: '%s'", name, cname, buf);
+	free(cname);
+	return calls() != before;
+} /* lookup */
+
+static void
+configure(size_t size, sdb_time_t ttl, sdb_time_t negative_ttl)
+{
+	sdb_plugin_cname_cache_opts_t opts = { size, ttl, negative_ttl };
+	int check = sdb_plugin_cname_cache_configure(&opts);
+	fail_unless(check == 0,
+			"sdb_plugin_cname_cache_configure() = %d; expected: 0", check);
+} /* configure */
+
+static void
+cname_setup(void)
+{
+	int check = sdb_plugin_register_cname("test", cname_cb, NULL);
+	fail_unless(check == 0,
+			"sdb_plugin_register_cname() = %d; expected: 0", check);
+	cname_calls = 0;
+	cname_blocking = NULL;
+	cname_blocked = cname_release = 0;
+} /* cname_setup */
+
+static void
+cname_teardown(void)
+{
+	sdb_plugin_cname_cache_opts_t opts = SDB_PLUGIN_CNAME_CACHE_OPTS_INIT;
+	sdb_plugin_unregister_all();
+	sdb_plugin_cname_cache_configure(&opts);
+} /* cname_teardown */
+
+START_TEST(test_cname_expire)
+{
+	/* entries with a TTL of 1ns are expired once any time has passed while
+	 * those with a TTL of an hour stay, no matter how slow the test runs */
+	configure(64, 1, SECS_TO_SDB_TIME(3600));
+	fail_unless(lookup("host1"), "first lookup of host1 was a cache hit");
+	fail_unless(lookup("same1"), "first lookup of same1 was a cache hit");
+	fail_unless(! lookup("same1"), "second lookup of same1 was a cache miss");
+	msleep(1);
+	fail_unless(lookup("host1"),
+			"lookup of host1 was a cache hit after its TTL expired");
+	fail_unless(! lookup("same1"),
+			"lookup of same1 was a cache miss before its negative TTL expired");
+
+	configure(64, SECS_TO_SDB_TIME(3600), 1);
+	fail_unless(lookup("host1"), "first lookup of host1 was a cache hit");
+	fail_unless(! lookup("host1"), "second lookup of host1 was a cache miss");
+	fail_unless(lookup("same1"), "first lookup of same1 was a cache hit");
+	msleep(1);
+	fail_unless(! lookup("host1"),
+			"lookup of host1 was a cache miss before its TTL expired");
+	fail_unless(lookup("same1"),
+			"lookup of same1 was a cache hit after its negative TTL expired");
+
+	/* a TTL of zero disables caching of the respective results */
+	configure(64, 0, SECS_TO_SDB_TIME(3600));
+	fail_unless(lookup("host1"), "first lookup of host1 was a cache hit");
+	fail_unless(lookup("host1"), "lookup of host1 was a cache hit "
+			"with a positive TTL of zero");
+	fail_unless(entries() == 0, "cache has %zu entries; expected: 0",
+			entries());
+}
+END_TEST
+
+START_TEST(test_cname_lru)
+{
+	char same_shard[2][64];
+	size_t found = 0;
+	int i;
+
+	/* with one entry per shard, any name evicting host0 shares its shard */
+	for (i = 1; (i < 1000) && (found < 2); ++i) {
+		char name[64];
+
+		snprintf(name, sizeof(name), "host%d", i);
+		configure(16, SECS_TO_SDB_TIME(3600), SECS_TO_SDB_TIME(3600));
+		lookup("host0");
+		lookup(name);
+		if (entries() == 1) {
+			fail_unless(lookup("host0"),
+					"host0 was not evicted by %s in a shard of size 1", name);
+			strncpy(same_shard[found], name, sizeof(same_shard[found]));
+			++found;
+		}
+	}
+	fail_unless(found == 2, "failed to find names in the shard of host0");
+
+	/* two entries per shard */
+	configure(32, SECS_TO_SDB_TIME(3600), SECS_TO_SDB_TIME(3600));
+	lookup("host0");
+	lookup(same_shard[0]);
+	fail_unless(! lookup("host0"), "lookup of host0 was a cache miss");
+	/* evicts the least recently used entry, that is, same_shard[0] */
+	fail_unless(lookup(same_shard[1]),
+			"first lookup of %s was a cache hit", same_shard[1]);
+	fail_unless(entries() == 2, "cache has %zu entries; expected: 2",
+			entries());
+	fail_unless(! lookup("host0"), "recently used host0 was evicted");
+	fail_unless(! lookup(same_shard[1]),
+			"lookup of %s was a cache miss", same_shard[1]);
+	fail_unless(lookup(same_shard[0]),
+			"least recently used %s was not evicted", same_shard[0]);
+
+	/* size zero disables the cache */
+	configure(0, SECS_TO_SDB_TIME(3600), SECS_TO_SDB_TIME(3600));
+	fail_unless(lookup("host0"), "first lookup of host0 was a cache hit");
+	fail_unless(lookup("host0"), "lookup of host0 was a cache hit "
+			"with the cache disabled");
+}
+END_TEST
+
+static void *
+cname_thread(void *arg)
+{
+	lookup(arg);
+	return NULL;
+} /* cname_thread */
+
+START_TEST(test_cname_flush)
+{
+	pthread_t thread;
+
+	configure(64, SECS_TO_SDB_TIME(3600), SECS_TO_SDB_TIME(3600));
+	lookup("host1");
+
+	cname_blocking = "host2";
+	pthread_create(&thread, NULL, cname_thread, "host2");
+
+	pthread_mutex_lock(&cname_lock);
+	while (! cname_blocked)
+		pthread_cond_wait(&cname_cond, &cname_lock);
+	pthread_mutex_unlock(&cname_lock);
+
+	/* flush while the callbacks are running for host2 */
+	configure(64, SECS_TO_SDB_TIME(3600), SECS_TO_SDB_TIME(3600));
+
+	pthread_mutex_lock(&cname_lock);
+	cname_release = 1;
+	pthread_cond_broadcast(&cname_cond);
+	pthread_mutex_unlock(&cname_lock);
+	pthread_join(thread, NULL);
+
+	fail_unless(entries() == 0,
+			"cache has %zu entries after flush; expected: 0", entries());
+	fail_unless(lookup("host1"), "host1 was not flushed");
+	fail_unless(lookup("host2"),
+			"host2 looked up during the flush was cached");
+
+	/* registering a cname callback flushes the cache as well */
+	fail_unless(! lookup("host1"), "lookup of host1 was a cache miss");
+	sdb_plugin_register_cname("test2", cname_cb, NULL);
+	fail_unless(entries() == 0,
+			"cache has %zu entries after registering a callback; "
+			"expected: 0", entries());
+}
+END_TEST
+
+/*
+ * collector scheduling
+ */
+
+#define MAX_RUNS 64
+
+typedef struct {
+	sdb_time_t interval;
+	/* whether the collector belongs to the plugin with limited concurrency */
+	bool limited;
+	/* block the first run until the other collector started another run */
+	void *wait_for;
+	bool waited;
+
+	sdb_time_t runs[MAX_RUNS];
+	int runs_num;
+} collector_data_t;
+
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  sched_cond = PTHREAD_COND_INITIALIZER;
+static int limited_running = 0;
+static int limited_max_running = 0;
+
+static sdb_plugin_loop_t loop = SDB_PLUGIN_LOOP_INIT;
+
+/* The virtual clock only advances while the (single) worker waits for the
+ * next collector, so collectors run in no time and all tests using it are
+ * deterministic. The loop terminates once the clock reaches its end. */
+static sdb_time_t virtual_now = 0;
+static sdb_time_t virtual_end = 0;
+
+static sdb_time_t
+virtual_gettime(void)
+{
+	return virtual_now;
+} /* virtual_gettime */
+
+static void
+virtual_wait(pthread_cond_t __attribute__((unused)) *cond,
+		pthread_mutex_t __attribute__((unused)) *lock, sdb_time_t until)
+{
+	fail_unless(until > virtual_now,
+			"scheduler waited until %"PRIsdbTIME" at %"PRIsdbTIME"; "
+			"expected: a time in the future", until, virtual_now);
+	virtual_now = until;
+	if (virtual_now >= virtual_end)
+		loop.do_loop = 0;
+} /* virtual_wait */
+
+static const sdb_plugin_sched_clock_t virtual_clock = {
+	virtual_gettime, virtual_wait,
+};
+
+static void
+to_timespec(sdb_time_t t, struct timespec *ts)
+{
+	ts->tv_sec = (time_t)SDB_TIME_TO_SECS(t);
+	ts->tv_nsec = (long)(t % SECS_TO_SDB_TIME(1));
+} /* to_timespec */
+
+/* The system clock, but stopping the loop from within the scheduler (which
+ * holds its lock while waiting) once requested by the test. */
+static bool sched_stop = 0;
+
+static void
+stopping_wait(pthread_cond_t *cond, pthread_mutex_t *lock, sdb_time_t until)
+{
+	struct timespec ts;
+
+	to_timespec(until, &ts);
+	pthread_cond_timedwait(cond, lock, &ts);
+	pthread_mutex_lock(&sched_lock);
+	if (sched_stop)
+		loop.do_loop = 0;
+	pthread_mutex_unlock(&sched_lock);
+} /* stopping_wait */
+
+static const sdb_plugin_sched_clock_t stopping_clock = {
+	sdb_gettime, stopping_wait,
+};
+
+static int
+collector_cb(sdb_object_t *user_data)
+{
+	collector_data_t *data = SDB_OBJ_WRAPPER(user_data)->data;
+	collector_data_t *other = data->wait_for;
+	sdb_time_t now = virtual_now ? virtual_now : sdb_gettime();
+
+	pthread_mutex_lock(&sched_lock);
+	if (data->runs_num < MAX_RUNS)
+		data->runs[data->runs_num++] = now;
+	if (data->limited && (++limited_running > limited_max_running))
+		limited_max_running = limited_running;
+	pthread_cond_broadcast(&sched_cond);
+
+	if (other && (data->runs_num == 1)) {
+		/* generous deadline to keep the test from hanging on failure */
+		int n = other->runs_num;
+		struct timespec ts;
+
+		to_timespec(sdb_gettime() + SECS_TO_SDB_TIME(60), &ts);
+		while ((other->runs_num == n)
+				&& (! pthread_cond_timedwait(&sched_cond, &sched_lock, &ts)))
+			/* wait */;
+		data->waited = other->runs_num > n;
+	}
+
+	if (data->limited)
+		--limited_running;
+	pthread_mutex_unlock(&sched_lock);
+	return 0;
+} /* collector_cb */
+
+static void
+register_collector(const char *name, collector_data_t *data)
+{
+	sdb_object_t *obj = sdb_object_create_wrapper(name, data, NULL);
+	int check = sdb_plugin_register_collector(name, collector_cb,
+			&data->interval, obj);
+	fail_unless(check == 0,
+			"sdb_plugin_register_collector(%s) = %d; expected: 0",
+			name, check);
+	sdb_object_deref(obj);
+} /* register_collector */
+
+static void *
+loop_thread(void __attribute__((unused)) *arg)
+{
+	sdb_plugin_collector_loop(&loop);
+	return NULL;
+} /* loop_thread */
+
+/* run the collector loop in the current thread using the virtual clock
+ * until the specified (virtual) time has passed since its start */
+static void
+run_virtual_loop(sdb_time_t max_jitter, sdb_time_t duration)
+{
+	sdb_plugin_loop_t l = SDB_PLUGIN_LOOP_INIT;
+	int check;
+
+	l.num_threads = 1;
+	l.max_jitter = max_jitter;
+	loop = l;
+
+	virtual_end = virtual_now + duration;
+	check = sdb_plugin_collector_loop(&loop);
+	fail_unless(check == 0,
+			"sdb_plugin_collector_loop() = %d; expected: 0", check);
+} /* run_virtual_loop */
+
+static void
+sched_setup(void)
+{
+	limited_running = limited_max_running = 0;
+	sched_stop = 0;
+	/* any (non-zero) start time will do */
+	virtual_now = SECS_TO_SDB_TIME(1000);
+	sdb_plugin_set_sched_clock(&virtual_clock);
+} /* sched_setup */
+
+static void
+sched_teardown(void)
+{
+	sdb_plugin_unregister_all();
+	sdb_plugin_set_sched_clock(NULL);
+	virtual_now = 0;
+} /* sched_teardown */
+
+START_TEST(test_sched_order)
+{
+	collector_data_t fast = { MSECS_TO_SDB_TIME(10), 0, NULL, 0, { 0 }, 0 };
+	collector_data_t slow = { MSECS_TO_SDB_TIME(100), 0, NULL, 0, { 0 }, 0 };
+	sdb_time_t start = virtual_now;
+	int i;
+
+	register_collector("slow", &slow);
+	register_collector("fast", &fast);
+	run_virtual_loop(0, MSECS_TO_SDB_TIME(350));
+
+	/* each collector runs exactly once per interval */
+	fail_unless(slow.runs_num == 4,
+			"slow collector ran %d times; expected: 4", slow.runs_num);
+	fail_unless(fast.runs_num == 35,
+			"fast collector ran %d times; expected: 35", fast.runs_num);
+	for (i = 0; i < slow.runs_num; ++i)
+		fail_unless(slow.runs[i] == start + (sdb_time_t)i * slow.interval,
+				"slow collector run %d happened at +%"PRIsdbTIME"ns; "
+				"expected: +%"PRIsdbTIME"ns", i, slow.runs[i] - start,
+				(sdb_time_t)i * slow.interval);
+	for (i = 0; i < fast.runs_num; ++i)
+		fail_unless(fast.runs[i] == start + (sdb_time_t)i * fast.interval,
+				"fast collector run %d happened at +%"PRIsdbTIME"ns; "
+				"expected: +%"PRIsdbTIME"ns", i, fast.runs[i] - start,
+				(sdb_time_t)i * fast.interval);
+}
+END_TEST
+
+START_TEST(test_sched_concurrency)
+{
+	sdb_plugin_ctx_t ctx = SDB_PLUGIN_CTX_INIT;
+	collector_data_t limited1 = { MSECS_TO_SDB_TIME(10), 1, NULL, 0, { 0 }, 0 };
+	collector_data_t limited2 = { MSECS_TO_SDB_TIME(10), 1, NULL, 0, { 0 }, 0 };
+	collector_data_t other = { MSECS_TO_SDB_TIME(10), 0, NULL, 0, { 0 }, 0 };
+	sdb_plugin_loop_t l = SDB_PLUGIN_LOOP_INIT;
+	struct timespec ts;
+	pthread_t thread;
+	int check;
+
+	/* this test uses multiple workers and, thus, the system clock */
+	sdb_plugin_set_sched_clock(&stopping_clock);
+	virtual_now = 0;
+
+	/* the first run of limited1 blocks until 'other' ran (again) */
+	limited1.wait_for = &other;
+
+	ctx.max_concurrency = 1;
+	check = sdb_plugin_builtin_begin("limited", &ctx);
+	fail_unless(check == 0,
+			"sdb_plugin_builtin_begin() = %d; expected: 0", check);
+	register_collector("c1", &limited1);
+	register_collector("c2", &limited2);
+	sdb_plugin_builtin_end();
+	register_collector("other", &other);
+
+	l.num_threads = 4;
+	l.max_jitter = 0;
+	loop = l;
+	pthread_create(&thread, NULL, loop_thread, NULL);
+
+	/* wait for a couple of runs of each collector rather than for any
+	 * specific amount of time */
+	to_timespec(sdb_gettime() + SECS_TO_SDB_TIME(60), &ts);
+	pthread_mutex_lock(&sched_lock);
+	while (((limited1.runs_num < 3) || (limited2.runs_num < 3)
+				|| (other.runs_num < 3))
+			&& (! pthread_cond_timedwait(&sched_cond, &sched_lock, &ts)))
+		/* wait */;
+	sched_stop = 1;
+	pthread_mutex_unlock(&sched_lock);
+	pthread_join(thread, NULL);
+
+	fail_unless(limited_max_running == 1,
+			"up to %d collectors of a plugin with max_concurrency 1 "
+			"ran concurrently; expected: 1", limited_max_running);
+	fail_unless(limited1.waited,
+			"collector 'other' did not run while a collector of a plugin "
+			"at its concurrency limit was running");
+	fail_unless((limited1.runs_num >= 3) && (limited2.runs_num >= 3)
+			&& (other.runs_num >= 3),
+			"collectors ran %d, %d, and %d times; expected: >= 3 each "
+			"(deferred collectors must not starve)",
+			limited1.runs_num, limited2.runs_num, other.runs_num);
+}
+END_TEST
+
+START_TEST(test_sched_jitter)
+{
+	collector_data_t data[8];
+	sdb_time_t interval = MSECS_TO_SDB_TIME(200);
+	sdb_time_t max_jitter = MSECS_TO_SDB_TIME(100);
+	sdb_time_t start = virtual_now, first_min = 0, first_max = 0;
+	size_t i;
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(data); ++i) {
+		char name[16];
+
+		memset(data + i, 0, sizeof(data[i]));
+		data[i].interval = interval;
+		snprintf(name, sizeof(name), "c%zu", i);
+		register_collector(name, data + i);
+	}
+
+	run_virtual_loop(max_jitter, MSECS_TO_SDB_TIME(550));
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(data); ++i) {
+		sdb_time_t first;
+		int j;
+
+		fail_unless(data[i].runs_num >= 2,
+				"collector %zu ran %d times; expected: >= 2",
+				i, data[i].runs_num);
+
+		first = data[i].runs[0];
+		fail_unless((first >= start) && (first < start + max_jitter),
+				"first run of collector %zu happened at +%"PRIsdbTIME"ns; "
+				"expected: within the maximum jitter of %"PRIsdbTIME"ns",
+				i, first - start, max_jitter);
+		if ((! first_min) || (first < first_min))
+			first_min = first;
+		if (first > first_max)
+			first_max = first;
+
+		/* jitter only delays the first run; the offset is kept */
+		for (j = 1; j < data[i].runs_num; ++j)
+			fail_unless(data[i].runs[j] == first + (sdb_time_t)j * interval,
+					"run %d of collector %zu happened %"PRIsdbTIME"ns "
+					"after its first run; expected: %"PRIsdbTIME"ns",
+					j, i, data[i].runs[j] - first, (sdb_time_t)j * interval);
+	}
+
+	fail_unless(first_max > first_min,
+			"first runs of all collectors happened at the same time; "
+			"expected them to be spread over up to %"PRIsdbTIME"ns",
+			max_jitter);
+}
+END_TEST
+
+TEST_MAIN("core::plugin")
+{
+	TCase *tc = tcase_create("cname");
+	tcase_add_checked_fixture(tc, cname_setup, cname_teardown);
+	tcase_add_test(tc, test_cname_expire);
+	tcase_add_test(tc, test_cname_lru);
+	tcase_add_test(tc, test_cname_flush);
+	ADD_TCASE(tc);
+
+	tc = tcase_create("scheduler");
+	tcase_add_checked_fixture(tc, sched_setup, sched_teardown);
+	tcase_add_test(tc, test_sched_order);
+	tcase_add_test(tc, test_sched_concurrency);
+	tcase_add_test(tc, test_sched_jitter);
+	ADD_TCASE(tc);
+}
+TEST_MAIN_END
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
@@ -636,11 +636,87 @@ START_TEST(test_expr_iter)
 }
 END_TEST
 
+START_TEST(test_expr_eval_borrowed)
+{
+	sdb_data_t one = { SDB_TYPE_INTEGER, { .integer = 1 } };
+	sdb_memstore_expr_t *exprs[6], *tmp;
+	sdb_memstore_obj_t *obj;
+	size_t i;
+
+	struct {
+		bool owned;
+		sdb_data_t expected;
+	} golden_data[] = {
+		{ 0, { SDB_TYPE_STRING, { .string = "a" } } },
+		{ 0, { SDB_TYPE_STRING, { .string = "v1" } } },
+		{ 0, { SDB_TYPE_STRING, { .string = NULL } } },
+		{ 0, { SDB_TYPE_INTEGER, { .integer = 1 } } },
+		{ 1, { SDB_TYPE_INTEGER, { .integer = 124 } } },
+		{ 0, { SDB_TYPE_STRING, { .string = "a" } } },
+	};
+
+	exprs[0] = sdb_memstore_expr_fieldvalue(SDB_FIELD_NAME);
+	exprs[1] = sdb_memstore_expr_attrvalue("k1");
+	exprs[2] = sdb_memstore_expr_attrvalue("x");
+	exprs[3] = sdb_memstore_expr_constvalue(&one);
+	tmp = sdb_memstore_expr_attrvalue("k2");
+	exprs[4] = sdb_memstore_expr_create(SDB_DATA_ADD, tmp, exprs[3]);
+	sdb_object_deref(SDB_OBJ(tmp));
+	exprs[5] = sdb_memstore_expr_typed(SDB_HOST, exprs[0]);
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(exprs); ++i)
+		ck_assert(exprs[i] != NULL);
+
+	obj = sdb_memstore_get_host(store, "a");
+	ck_assert(obj != NULL);
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(golden_data); ++i) {
+		sdb_memstore_obj_t *o = obj;
+		sdb_data_t v = SDB_DATA_INIT;
+		char v_str[64], expected_str[64];
+		bool owned = 1;
+		int check;
+
+		if (i == 5)
+			o = sdb_memstore_get_child(obj, SDB_SERVICE, "s1");
+		ck_assert(o != NULL);
+
+		check = sdb_memstore_expr_eval_borrowed(exprs[i], o, &v, &owned,
+				/* filter = */ NULL);
+		sdb_data_format(&v, v_str, sizeof(v_str), SDB_DOUBLE_QUOTED);
+		sdb_data_format(&golden_data[i].expected,
+				expected_str, sizeof(expected_str), SDB_DOUBLE_QUOTED);
+		fail_unless((check == 0) && (owned == golden_data[i].owned)
+				&& (! sdb_data_cmp(&v, &golden_data[i].expected)),
+				"sdb_memstore_expr_eval_borrowed(%s expression) = %d "
+				"(value: %s, owned: %d); expected: 0 (value: %s, owned: %d)",
+				EXPR_TO_STRING(exprs[i]), check, v_str, owned,
+				expected_str, golden_data[i].owned);
+
+		/* names are not copied */
+		if ((i == 0) || (i == 5))
+			fail_unless(v.data.string == SDB_OBJ(obj)->name,
+					"sdb_memstore_expr_eval_borrowed(%s expression) "
+					"returned a copy of the name; expected: <borrowed>",
+					EXPR_TO_STRING(exprs[i]));
+
+		if (owned)
+			sdb_data_free_datum(&v);
+		if (o != obj)
+			sdb_object_deref(SDB_OBJ(o));
+	}
+
+	sdb_object_deref(SDB_OBJ(obj));
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(exprs); ++i)
+		sdb_object_deref(SDB_OBJ(exprs[i]));
+}
+END_TEST
+
 TEST_MAIN("core::store_expr")
 {
 	TCase *tc = tcase_create("core");
 	tcase_add_checked_fixture(tc, populate, turndown);
 	TC_ADD_LOOP_TEST(tc, expr_iter);
+	tcase_add_test(tc, test_expr_eval_borrowed);
 	ADD_TCASE(tc);
 }
 TEST_MAIN_END
@@ -61,13 +61,10 @@ populate(void)
 	datum.data.string = "v3";
 	sdb_memstore_attribute(store, "h1", "k3", &datum, 2 * SDB_INTERVAL_SECOND, 0);
 
-/* TODO: move these tests into generic store tests */
-#if 0
 	/* make sure that older updates don't overwrite existing values */
 	datum.data.string = "fail";
 	sdb_memstore_attribute(store, "h1", "k2", &datum, 1 * SDB_INTERVAL_SECOND, 0);
 	sdb_memstore_attribute(store, "h1", "k3", &datum, 2 * SDB_INTERVAL_SECOND, 0);
-#endif
 
 	sdb_memstore_metric(store, "h1", "m1", /* store */ NULL, 2 * SDB_INTERVAL_SECOND, 0);
 	sdb_memstore_metric(store, "h1", "m2", /* store */ NULL, 1 * SDB_INTERVAL_SECOND, 0);
@@ -32,10 +32,12 @@
 #include "core/plugin.h"
 #include "core/store.h"
 #include "core/memstore-private.h"
+#include "parser/ast.h"
 #include "parser/parser.h"
 #include "testutils.h"
 
 #include <check.h>
+#include <stdio.h>
 #include <string.h>
 
 static sdb_memstore_t *store;
@@ -537,6 +539,17 @@ struct {
 	{ "name =~ 'a|b'", NULL,                     2 },
 	{ "name =~ 'host'", NULL,                    0 },
 	{ "name =~ '.'", NULL,                       3 },
+	{ "name =~ '^A$'", NULL,                     1 },
+	{ "name =~ '^a'", NULL,                      1 },
+	{ "name =~ 'B$'", NULL,                      1 },
+	{ "name =~ '^ab'", NULL,                     0 },
+	{ "name !~ '^a$'", NULL,                     2 },
+	{ "name =~ 'a' || '$'", NULL,                1 },
+	{ "name =~ '[ab]' || '$'", NULL,             2 },
+	{ "attribute['k1'] =~ attribute['k1']",
+		NULL,                                    2 },
+	{ "attribute['k1'] =~ '^' || name",
+		NULL,                                    0 },
 	{ "ANY backend = 'backend'", NULL,           0 },
 	{ "ALL backend = ''", NULL,                  3 }, /* backend is empty */
 	{ "backend = ['backend']", NULL,             0 },
@@ -623,12 +636,34 @@ struct {
 	{ "attribute['k1'] != 'v2'", NULL,     1 },
 	{ "ANY attribute.name != 'x' "
 	  "AND attribute['k1'] !~ 'x'", NULL,  2 },
+	{ "attribute['k1'] = 'V1'", NULL,      1 },
+	{ "'v1' = attribute['k1']", NULL,      1 },
+	{ "attribute['k2'] = '123'", NULL,     1 },
+	{ "attribute['k1'] IN ['v1', 'v2']",
+		NULL,                              2 },
+	{ "attribute['k1'] IN ['V2', 'x']",
+		NULL,                              1 },
+	{ "attribute['k1'] IN ['v1', 'v2']",
+		"name != 'b'",                     1 },
+	{ "attribute['k2'] IN [123, 456]",
+		NULL,                              1 },
+	{ "attribute['k1'] = 'v1' "
+	  "OR attribute['k1'] = 'v2'", NULL,   2 },
+	{ "attribute['k1'] = 'v1' "
+	  "OR name = 'b'", NULL,               2 },
+	{ "attribute['k1'] = 'v1' "
+	  "AND attribute['k2'] = 123", NULL,   1 },
+	{ "attribute['k1'] = 'v2' "
+	  "AND attribute['k2'] = 123", NULL,   0 },
+	{ "name =~ 'a|b' "
+	  "AND attribute['k1'] = 'v2'", NULL,  1 },
 };
 
 START_TEST(test_scan)
 {
 	sdb_strbuf_t *errbuf = sdb_strbuf_create(64);
 	sdb_memstore_matcher_t *m, *filter = NULL;
+	sdb_memstore_matcher_t *prog, *prog_filter = NULL;
 	sdb_ast_node_t *ast;
 	int check, n;
 
@@ -666,12 +701,468 @@ START_TEST(test_scan)
 			"found %d hosts; expected: %d", scan_data[_i].query,
 			scan_data[_i].filter, n, scan_data[_i].expected);
 
+	/* compiled matchers have to match the same objects */
+	prog = sdb_memstore_matcher_compile(m);
+	fail_unless(prog != NULL,
+			"sdb_memstore_matcher_compile(%s) = NULL; expected: <matcher>",
+			scan_data[_i].query);
+	if (filter) {
+		prog_filter = sdb_memstore_matcher_compile(filter);
+		fail_unless(prog_filter != NULL,
+				"sdb_memstore_matcher_compile(%s) = NULL; expected: <matcher>",
+				scan_data[_i].filter);
+	}
+
+	n = 0;
+	sdb_memstore_scan(store, SDB_HOST, prog, prog_filter, scan_cb, &n);
+	fail_unless(n == scan_data[_i].expected,
+			"sdb_memstore_scan(HOST, compiled{%s}, compiled{%s}) "
+			"found %d hosts; expected: %d", scan_data[_i].query,
+			scan_data[_i].filter, n, scan_data[_i].expected);
+
+	sdb_object_deref(SDB_OBJ(prog_filter));
+	sdb_object_deref(SDB_OBJ(prog));
 	sdb_object_deref(SDB_OBJ(filter));
 	sdb_object_deref(SDB_OBJ(m));
 	sdb_strbuf_destroy(errbuf);
 }
 END_TEST
 
+/* Look up objects using the attribute index which is expected to be
+ * applicable to the query; returns the number of matches. */
+static int
+lookup_indexed(int type, const char *query, const char *filter)
+{
+	sdb_strbuf_t *errbuf = sdb_strbuf_create(64);
+	sdb_ast_node_t *m_ast, *f_ast = NULL, *ast;
+	sdb_memstore_query_t *q;
+	int check, n = 0;
+
+	m_ast = sdb_parser_parse_conditional(type, query, -1, errbuf);
+	fail_unless(m_ast != NULL,
+			"sdb_parser_parse_conditional(%s, %s, -1) = NULL; expected: <ast> "
+			"(parser error: %s)", SDB_STORE_TYPE_TO_NAME(type), query,
+			sdb_strbuf_string(errbuf));
+	if (filter) {
+		f_ast = sdb_parser_parse_conditional(type, filter, -1, errbuf);
+		fail_unless(f_ast != NULL,
+				"sdb_parser_parse_conditional(%s, %s, -1) = NULL; "
+				"expected: <ast> (parser error: %s)",
+				SDB_STORE_TYPE_TO_NAME(type), filter,
+				sdb_strbuf_string(errbuf));
+	}
+
+	ast = sdb_ast_lookup_create(type, m_ast, f_ast);
+	q = sdb_memstore_query_prepare(ast);
+	sdb_object_deref(SDB_OBJ(ast));
+	fail_unless(q != NULL,
+			"sdb_memstore_query_prepare(LOOKUP %s MATCHING %s) = NULL; "
+			"expected: <query>", SDB_STORE_TYPE_TO_NAME(type), query);
+	fail_unless(q->plan != NULL,
+			"sdb_memstore_query_prepare(LOOKUP %s MATCHING %s) did not "
+			"use any index", SDB_STORE_TYPE_TO_NAME(type), query);
+
+	check = sdb_memstore_scan_indexed(store, type, q->plan,
+			q->matcher, q->filter, scan_cb, &n);
+	fail_unless(check == 0,
+			"sdb_memstore_scan_indexed(%s, matcher{%s}) = %d; expected: 0",
+			SDB_STORE_TYPE_TO_NAME(type), query, check);
+
+	sdb_object_deref(SDB_OBJ(q));
+	sdb_strbuf_destroy(errbuf);
+	return n;
+} /* lookup_indexed */
+
+START_TEST(test_scan_indexed)
+{
+	sdb_strbuf_t *errbuf = sdb_strbuf_create(64);
+	sdb_ast_node_t *m_ast, *f_ast = NULL, *ast;
+	sdb_memstore_query_t *q;
+	int check, n = 0;
+
+	check = sdb_memstore_index_attributes(store);
+	fail_unless(check == 0,
+			"sdb_memstore_index_attributes() = %d; expected: 0", check);
+
+	m_ast = sdb_parser_parse_conditional(SDB_HOST, scan_data[_i].query,
+			-1, errbuf);
+	if (scan_data[_i].filter)
+		f_ast = sdb_parser_parse_conditional(SDB_HOST, scan_data[_i].filter,
+				-1, errbuf);
+	ast = sdb_ast_lookup_create(SDB_HOST, m_ast, f_ast);
+	q = sdb_memstore_query_prepare(ast);
+	sdb_object_deref(SDB_OBJ(ast));
+	fail_unless(q != NULL,
+			"sdb_memstore_query_prepare(LOOKUP hosts MATCHING %s) = NULL; "
+			"expected: <query>", scan_data[_i].query);
+
+	/* the result has to be the same, no matter whether the index is used */
+	check = 1;
+	if (q->names)
+		check = sdb_memstore_scan_names(store, SDB_HOST, q->names,
+				q->matcher, q->filter, scan_cb, &n);
+	else if (q->plan)
+		check = sdb_memstore_scan_indexed(store, SDB_HOST, q->plan,
+				q->matcher, q->filter, scan_cb, &n);
+	if (check > 0)
+		check = sdb_memstore_scan(store, SDB_HOST, q->matcher, q->filter,
+				scan_cb, &n);
+	fail_unless(check == 0,
+			"scanning for %s returned %d; expected: 0",
+			scan_data[_i].query, check);
+	fail_unless(n == scan_data[_i].expected,
+			"%s scan (matcher{%s}, filter{%s}) found %d hosts; "
+			"expected: %d",
+			q->names ? "name" : q->plan ? "indexed" : "full",
+			scan_data[_i].query, scan_data[_i].filter, n,
+			scan_data[_i].expected);
+
+	sdb_object_deref(SDB_OBJ(q));
+	sdb_strbuf_destroy(errbuf);
+}
+END_TEST
+
+static int
+names_cb(sdb_memstore_obj_t *obj, sdb_memstore_matcher_t *filter,
+		void *user_data)
+{
+	sdb_strbuf_t *buf = user_data;
+
+	if (! sdb_memstore_matcher_matches(filter, obj, NULL))
+		return 0;
+
+	if (sdb_strbuf_len(buf))
+		sdb_strbuf_append(buf, " ");
+	if (obj->parent)
+		sdb_strbuf_append(buf, "%s.", SDB_OBJ(obj->parent)->name);
+	sdb_strbuf_append(buf, "%s", SDB_OBJ(obj)->name);
+	return 0;
+} /* names_cb */
+
+struct {
+	int type;
+	const char *query;
+	bool pushdown;
+	const char *expected;
+} scan_names_data[] = {
+	{ SDB_HOST, "name = 'b'", 1, "b" },
+	{ SDB_HOST, "name = 'B'", 1, "b" },
+	{ SDB_HOST, "'c' = name", 1, "c" },
+	{ SDB_HOST, "name = 'x'", 1, "" },
+	{ SDB_HOST, "name IN ['c', 'a', 'x', 'A']", 1, "a c" },
+	{ SDB_HOST, "name > 'a'", 1, "b c" },
+	{ SDB_HOST, "name >= 'b' AND name < 'c'", 1, "b" },
+	{ SDB_HOST, "name <= 'b'", 1, "a b" },
+	{ SDB_HOST, "'b' < name", 1, "c" },
+	{ SDB_HOST, "name > 'a' AND name IN ['a', 'c']", 1, "c" },
+	{ SDB_HOST, "name = 'a' OR name = 'c'", 1, "a c" },
+	{ SDB_HOST, "name = 'a' OR name > 'b'", 1, "a c" },
+	{ SDB_HOST, "name = 'a' AND attribute['k1'] = 'v1'", 1, "a" },
+	{ SDB_HOST, "name = 'c' AND attribute['k1'] = 'v1'", 1, "" },
+	{ SDB_HOST, "host.name = 'a'", 1, "a" },
+	{ SDB_HOST, "name = 'a' OR attribute['k1'] = 'v2'", 0, "a b" },
+	{ SDB_HOST, "NOT name = 'a'", 0, "b c" },
+	{ SDB_SERVICE, "host.name = 'b'", 1, "b.s1 b.s3" },
+	{ SDB_SERVICE, "host.name IN ['b', 'a'] AND name = 's1'", 1,
+		"a.s1 b.s1" },
+	{ SDB_SERVICE, "name = 'a'", 0, "" },
+	{ SDB_METRIC, "host.name >= 'b'", 1, "b.m1 b.m2" },
+	{ SDB_METRIC, "host.name < 'b' OR host.name = 'c'", 1, "a.m1" },
+};
+
+START_TEST(test_scan_names)
+{
+	sdb_strbuf_t *errbuf = sdb_strbuf_create(64);
+	sdb_strbuf_t *full = sdb_strbuf_create(64);
+	sdb_strbuf_t *names = sdb_strbuf_create(64);
+	int type = scan_names_data[_i].type;
+	const char *query = scan_names_data[_i].query;
+	sdb_ast_node_t *ast;
+	sdb_memstore_query_t *q;
+	int check;
+
+	ast = sdb_ast_lookup_create(type,
+			sdb_parser_parse_conditional(type, query, -1, errbuf), NULL);
+	q = sdb_memstore_query_prepare(ast);
+	sdb_object_deref(SDB_OBJ(ast));
+	fail_unless(q != NULL,
+			"sdb_memstore_query_prepare(LOOKUP %ss MATCHING %s) = NULL; "
+			"expected: <query> (parser error: %s)",
+			SDB_STORE_TYPE_TO_NAME(type), query, sdb_strbuf_string(errbuf));
+	fail_unless((q->names != NULL) == scan_names_data[_i].pushdown,
+			"sdb_memstore_query_prepare(LOOKUP %ss MATCHING %s) %s host "
+			"names; expected: %s", SDB_STORE_TYPE_TO_NAME(type), query,
+			q->names ? "looks up" : "does not look up",
+			scan_names_data[_i].pushdown ? "name lookup" : "full scan");
+
+	check = sdb_memstore_scan(store, type, q->matcher, q->filter,
+			names_cb, full);
+	fail_unless(check == 0,
+			"sdb_memstore_scan(%s, matcher{%s}) = %d; expected: 0",
+			SDB_STORE_TYPE_TO_NAME(type), query, check);
+	fail_unless(! strcmp(sdb_strbuf_string(full),
+				scan_names_data[_i].expected),
+			"sdb_memstore_scan(%s, matcher{%s}) found '%s'; expected: '%s'",
+			SDB_STORE_TYPE_TO_NAME(type), query, sdb_strbuf_string(full),
+			scan_names_data[_i].expected);
+
+	/* name lookups have to find the same objects in the same order */
+	if (q->names) {
+		check = sdb_memstore_scan_names(store, type, q->names,
+				q->matcher, q->filter, names_cb, names);
+		fail_unless(check == 0,
+				"sdb_memstore_scan_names(%s, matcher{%s}) = %d; "
+				"expected: 0", SDB_STORE_TYPE_TO_NAME(type), query, check);
+		fail_unless(! strcmp(sdb_strbuf_string(names),
+					sdb_strbuf_string(full)),
+				"sdb_memstore_scan_names(%s, matcher{%s}) found '%s'; "
+				"expected: '%s'", SDB_STORE_TYPE_TO_NAME(type), query,
+				sdb_strbuf_string(names), sdb_strbuf_string(full));
+	}
+
+	sdb_object_deref(SDB_OBJ(q));
+	sdb_strbuf_destroy(names);
+	sdb_strbuf_destroy(full);
+	sdb_strbuf_destroy(errbuf);
+}
+END_TEST
+
+START_TEST(test_scan_parallel)
+{
+	sdb_strbuf_t *errbuf = sdb_strbuf_create(64);
+	sdb_strbuf_t *serial = sdb_strbuf_create(1024);
+	sdb_strbuf_t *parallel = sdb_strbuf_create(1024);
+	int types[] = { SDB_HOST, SDB_SERVICE, SDB_METRIC };
+	sdb_memstore_matcher_t *m;
+	sdb_ast_node_t *ast;
+	size_t i;
+	int check;
+
+	/* enough hosts to be split into multiple partitions */
+	for (i = 0; i < 1000; ++i) {
+		char name[16];
+
+		snprintf(name, sizeof(name), "h%03zu", i);
+		sdb_memstore_host(store, name, 1, 0);
+		sdb_memstore_service(store, name, "s1", 1, 0);
+		if (i % 3)
+			sdb_memstore_metric(store, name, "m1", NULL, 1, 0);
+	}
+
+	ast = sdb_parser_parse_conditional(SDB_HOST, "name =~ '[02468]$'",
+			-1, errbuf);
+	m = sdb_memstore_query_prepare_matcher(ast);
+	sdb_object_deref(SDB_OBJ(ast));
+	fail_unless(m != NULL,
+			"sdb_memstore_query_prepare_matcher(name =~ '[02468]$') = NULL; "
+			"expected: <matcher>");
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(types); ++i) {
+		sdb_memstore_scan_threads(store, 1);
+		sdb_strbuf_clear(serial);
+		check = sdb_memstore_scan(store, types[i], m, NULL,
+				names_cb, serial);
+		fail_unless(check == 0,
+				"sdb_memstore_scan(%s) = %d; expected: 0",
+				SDB_STORE_TYPE_TO_NAME(types[i]), check);
+
+		check = sdb_memstore_scan_threads(store, 4);
+		fail_unless(check == 0,
+				"sdb_memstore_scan_threads(4) = %d; expected: 0", check);
+		sdb_strbuf_clear(parallel);
+		check = sdb_memstore_scan(store, types[i], m, NULL,
+				names_cb, parallel);
+		fail_unless(check == 0,
+				"parallel sdb_memstore_scan(%s) = %d; expected: 0",
+				SDB_STORE_TYPE_TO_NAME(types[i]), check);
+
+		/* parallel scans have to find the same objects in the same order */
+		fail_unless(sdb_strbuf_len(serial) > 0,
+				"sdb_memstore_scan(%s) did not find any objects",
+				SDB_STORE_TYPE_TO_NAME(types[i]));
+		fail_unless(! strcmp(sdb_strbuf_string(serial),
+					sdb_strbuf_string(parallel)),
+				"parallel sdb_memstore_scan(%s) found '%s'; expected: '%s'",
+				SDB_STORE_TYPE_TO_NAME(types[i]),
+				sdb_strbuf_string(parallel), sdb_strbuf_string(serial));
+	}
+
+	check = sdb_memstore_scan_threads(store, 0);
+	fail_unless(check < 0,
+			"sdb_memstore_scan_threads(0) = %d; expected: <0", check);
+
+	sdb_object_deref(SDB_OBJ(m));
+	sdb_strbuf_destroy(parallel);
+	sdb_strbuf_destroy(serial);
+	sdb_strbuf_destroy(errbuf);
+}
+END_TEST
+
+START_TEST(test_index_update)
+{
+	sdb_data_t v1 = { SDB_TYPE_STRING, { .string = "v1" } };
+	sdb_data_t v3 = { SDB_TYPE_STRING, { .string = "v3" } };
+	int check, n;
+
+	/* attributes stored before and after enabling the index are found */
+	check = sdb_memstore_service_attr(store, "a", "s1", "k1", &v1, 1, 0);
+	fail_unless(check == 0,
+			"sdb_memstore_service_attr(a, s1, k1, v1) = %d; expected: 0",
+			check);
+	check = sdb_memstore_index_attributes(store);
+	fail_unless(check == 0,
+			"sdb_memstore_index_attributes() = %d; expected: 0", check);
+	check = sdb_memstore_service_attr(store, "b", "s1", "k1", &v3, 1, 0);
+	fail_unless(check == 0,
+			"sdb_memstore_service_attr(b, s1, k1, v3) = %d; expected: 0",
+			check);
+
+	n = lookup_indexed(SDB_HOST, "attribute['k1'] = 'v1'", NULL);
+	fail_unless(n == 1, "LOOKUP hosts MATCHING attribute['k1'] = 'v1' "
+			"found %d hosts; expected: 1", n);
+	n = lookup_indexed(SDB_SERVICE, "attribute['k1'] IN ['v1', 'v3']", NULL);
+	fail_unless(n == 2, "LOOKUP services MATCHING attribute['k1'] IN "
+			"['v1', 'v3'] found %d services; expected: 2", n);
+	n = lookup_indexed(SDB_METRIC, "attribute['k1'] = 'v1'", NULL);
+	fail_unless(n == 0, "LOOKUP metrics MATCHING attribute['k1'] = 'v1' "
+			"found %d metrics; expected: 0", n);
+
+	/* changing a value moves the object to the new index entry */
+	check = sdb_memstore_attribute(store, "a", "k1", &v3, 2, 0);
+	fail_unless(check == 0,
+			"sdb_memstore_attribute(a, k1, v3) = %d; expected: 0", check);
+	n = lookup_indexed(SDB_HOST, "attribute['k1'] = 'v1'", NULL);
+	fail_unless(n == 0, "LOOKUP hosts MATCHING attribute['k1'] = 'v1' "
+			"found %d hosts after update; expected: 0", n);
+	n = lookup_indexed(SDB_HOST, "attribute['k1'] = 'v3'", NULL);
+	fail_unless(n == 1, "LOOKUP hosts MATCHING attribute['k1'] = 'v3' "
+			"found %d hosts after update; expected: 1", n);
+
+	/* expired attributes are removed from the index */
+	check = (int)sdb_memstore_expire(store, 100, /* factor = */ 0.0,
+			/* ttl = */ 50, /* max_hosts = */ 0);
+	fail_unless(check > 0,
+			"sdb_memstore_expire() = %d; expected: >0", check);
+	n = lookup_indexed(SDB_HOST, "attribute['k1'] IN ['v2', 'v3']", NULL);
+	fail_unless(n == 0, "LOOKUP hosts MATCHING attribute['k1'] IN "
+			"['v2', 'v3'] found %d hosts after expiry; expected: 0", n);
+	n = lookup_indexed(SDB_SERVICE, "attribute['k1'] = 'v1'", NULL);
+	fail_unless(n == 0, "LOOKUP services MATCHING attribute['k1'] = 'v1' "
+			"found %d services after expiry; expected: 0", n);
+}
+END_TEST
+
+struct {
+	int type;
+	const char *query;
+	int expected;
+} trigram_data[] = {
+	{ SDB_HOST,    "name =~ 'web-.*-prod'",          1 },
+	{ SDB_HOST,    "name =~ '^WEB'",                 2 },
+	{ SDB_HOST,    "name =~ 'web-0[0-9]'",           2 },
+	{ SDB_HOST,    "name =~ '(web|db)-01'",          2 },
+	{ SDB_HOST,    "name =~ 'prod|test'",            3 },
+	{ SDB_HOST,    "name =~ 'prod$' AND name =~ 'db'", 1 },
+	{ SDB_HOST,    "name =~ 'web-0?1'",              1 },
+	{ SDB_HOST,    "name =~ 'web-01\\.prod'",      0 },
+	{ SDB_HOST,    "name =~ 'xyz'",                  0 },
+	{ SDB_SERVICE, "name =~ 'http'",                 2 },
+	{ SDB_SERVICE, "name =~ 'https+'",               1 },
+	{ SDB_METRIC,  "name =~ 'load'",                 1 },
+	{ SDB_HOST,    "attribute['fqdn'] =~ '\\.example\\.com$'", 2 },
+	{ SDB_HOST,    "attribute['FQDN'] =~ 'DB-01'",   1 },
+};
+
+START_TEST(test_trigram)
+{
+	const char *hosts[] = { "web-01-prod", "web-02-test", "db-01-prod" };
+	const char *keys[] = { "fqdn" };
+	sdb_data_t fqdn = { SDB_TYPE_STRING, { .string = NULL } };
+	char buf[64];
+	int check, n;
+	size_t i;
+
+	check = sdb_memstore_index_trigrams(store, keys, 1);
+	fail_unless(check == 0,
+			"sdb_memstore_index_trigrams() = %d; expected: 0", check);
+
+	/* objects stored after enabling the index are included */
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(hosts); ++i) {
+		snprintf(buf, sizeof(buf), "%s.example.com", hosts[i]);
+		fqdn.data.string = buf;
+		sdb_memstore_host(store, hosts[i], 1, 0);
+		sdb_memstore_attribute(store, hosts[i], "fqdn", &fqdn, 1, 0);
+	}
+	sdb_memstore_service(store, "web-01-prod", "http", 1, 0);
+	sdb_memstore_service(store, "web-02-test", "https", 1, 0);
+	sdb_memstore_metric(store, "db-01-prod", "load", NULL, 1, 0);
+	/* the index only ever selects candidates */
+	fqdn.data.string = "localhost";
+	sdb_memstore_attribute(store, "web-01-prod", "fqdn", &fqdn, 2, 0);
+
+	n = lookup_indexed(trigram_data[_i].type, trigram_data[_i].query, NULL);
+	fail_unless(n == trigram_data[_i].expected,
+			"LOOKUP %ss MATCHING %s found %d objects; expected: %d",
+			SDB_STORE_TYPE_TO_NAME(trigram_data[_i].type),
+			trigram_data[_i].query, n, trigram_data[_i].expected);
+}
+END_TEST
+
+START_TEST(test_trigram_index_update)
+{
+	const char *queries[] = {
+		"name =~ 'a.b'", /* no trigrams */
+		"attribute['k1'] =~ 'v1.*'", /* attribute not indexed */
+	};
+	sdb_memstore_query_t *q;
+	sdb_ast_node_t *ast;
+	int check, n;
+	size_t i;
+
+	/* existing objects are included when enabling the index */
+	sdb_memstore_host(store, "web-01-prod", 1, 0);
+	check = sdb_memstore_index_trigrams(store, NULL, 0);
+	fail_unless(check == 0,
+			"sdb_memstore_index_trigrams() = %d; expected: 0", check);
+	n = lookup_indexed(SDB_HOST, "name =~ 'prod'", NULL);
+	fail_unless(n == 1, "LOOKUP hosts MATCHING name =~ 'prod' "
+			"found %d hosts; expected: 1", n);
+
+	/* expired objects are removed from the index */
+	check = (int)sdb_memstore_expire(store, 100, /* factor = */ 0.0,
+			/* ttl = */ 50, /* max_hosts = */ 0);
+	fail_unless(check > 0,
+			"sdb_memstore_expire() = %d; expected: >0", check);
+	sdb_memstore_host(store, "db-01-prod", 200, 0);
+	n = lookup_indexed(SDB_HOST, "name =~ 'prod'", NULL);
+	fail_unless(n == 1, "LOOKUP hosts MATCHING name =~ 'prod' "
+			"found %d hosts after expiry; expected: 1", n);
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(queries); ++i) {
+		sdb_strbuf_t *errbuf = sdb_strbuf_create(64);
+
+		ast = sdb_ast_lookup_create(SDB_HOST,
+				sdb_parser_parse_conditional(SDB_HOST, queries[i],
+					-1, errbuf), NULL);
+		q = sdb_memstore_query_prepare(ast);
+		sdb_object_deref(SDB_OBJ(ast));
+		fail_unless(q != NULL,
+				"sdb_memstore_query_prepare(LOOKUP hosts MATCHING %s) = "
+				"NULL; expected: <query>", queries[i]);
+
+		n = 0;
+		check = q->plan ? sdb_memstore_scan_indexed(store, SDB_HOST,
+				q->plan, q->matcher, q->filter, scan_cb, &n) : 1;
+		fail_unless(check > 0,
+				"LOOKUP hosts MATCHING %s used the trigram index (%d); "
+				"expected: full scan", queries[i], check);
+
+		sdb_object_deref(SDB_OBJ(q));
+		sdb_strbuf_destroy(errbuf);
+	}
+}
+END_TEST
+
 TEST_MAIN("core::store_lookup")
 {
 	TCase *tc = tcase_create("core");
@@ -680,6 +1171,13 @@ TEST_MAIN("core::store_lookup")
 	TC_ADD_LOOP_TEST(tc, cmp_attr);
 	TC_ADD_LOOP_TEST(tc, cmp_obj);
 	TC_ADD_LOOP_TEST(tc, scan);
+	tcase_add_loop_test(tc, test_scan_indexed,
+			0, SDB_STATIC_ARRAY_LEN(scan_data));
+	TC_ADD_LOOP_TEST(tc, scan_names);
+	tcase_add_test(tc, test_scan_parallel);
+	tcase_add_test(tc, test_index_update);
+	TC_ADD_LOOP_TEST(tc, trigram);
+	tcase_add_test(tc, test_trigram_index_update);
 	tcase_add_test(tc, test_store_match_op);
 	ADD_TCASE(tc);
 }
@@ -35,8 +35,17 @@
 #include "testutils.h"
 
 #include <check.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
 
 static sdb_memstore_t *store;
 
@@ -105,6 +114,8 @@ START_TEST(test_store_host)
 	} golden_data[] = {
 		{ "a", 1, 0 },
 		{ "a", 2, 0 },
+		{ "a", 1, 1 },
+		{ "a", 2, 1 },
 		{ "b", 1, 0 },
 	};
 
@@ -214,6 +225,7 @@ START_TEST(test_store_attr)
 		{ "m", "k",  "v1", 1,  0 },
 	};
 
+	sdb_memstore_obj_t *l, *m, *a1, *a2;
 	size_t i;
 
 	sdb_memstore_host(store, "l", 1, 0);
@@ -234,6 +246,53 @@ START_TEST(test_store_attr)
 				golden_data[i].host, golden_data[i].key, golden_data[i].value,
 				golden_data[i].last_update, status, golden_data[i].expected, 0);
 	}
+
+	/* equal string values are shared between objects */
+	l = sdb_memstore_get_host(store, "l");
+	m = sdb_memstore_get_host(store, "m");
+	fail_unless(l && m,
+			"sdb_memstore_get_host(l/m) = NULL; expected: <host>");
+	a1 = sdb_memstore_get_child(l, SDB_ATTRIBUTE, "k2");
+	a2 = sdb_memstore_get_child(m, SDB_ATTRIBUTE, "k");
+	fail_unless(a1 && a2,
+			"sdb_memstore_get_child(l.k2 / m.k) = NULL; "
+			"expected: <attribute>");
+	fail_unless(ATTR(a1)->value.data.string
+				== ATTR(a2)->value.data.string,
+			"attribute values l.k2 = %s (%p), m.k = %s (%p); "
+			"expected: shared string", ATTR(a1)->value.data.string,
+			ATTR(a1)->value.data.string, ATTR(a2)->value.data.string,
+			ATTR(a2)->value.data.string);
+	sdb_object_deref(SDB_OBJ(a1));
+	sdb_object_deref(SDB_OBJ(a2));
+
+	/* ... unless they are too long to be worth interning */
+	{
+		char long_value[256];
+		sdb_data_t datum = { SDB_TYPE_STRING, { .string = long_value } };
+
+		memset(long_value, 'x', sizeof(long_value) - 1);
+		long_value[sizeof(long_value) - 1] = '\0';
+		sdb_memstore_attribute(store, "l", "k3", &datum, 1, 0);
+		sdb_memstore_attribute(store, "m", "k3", &datum, 1, 0);
+	}
+	a1 = sdb_memstore_get_child(l, SDB_ATTRIBUTE, "k3");
+	a2 = sdb_memstore_get_child(m, SDB_ATTRIBUTE, "k3");
+	fail_unless(a1 && a2,
+			"sdb_memstore_get_child(l.k3 / m.k3) = NULL; "
+			"expected: <attribute>");
+	fail_unless((ATTR(a1)->value.data.string
+				!= ATTR(a2)->value.data.string)
+			&& (! strcmp(ATTR(a1)->value.data.string,
+					ATTR(a2)->value.data.string)),
+			"long attribute values l.k3 (%p), m.k3 (%p); "
+			"expected: equal, separate copies",
+			ATTR(a1)->value.data.string, ATTR(a2)->value.data.string);
+	sdb_object_deref(SDB_OBJ(a1));
+	sdb_object_deref(SDB_OBJ(a2));
+
+	sdb_object_deref(SDB_OBJ(l));
+	sdb_object_deref(SDB_OBJ(m));
 }
 END_TEST
 
@@ -409,6 +468,108 @@ START_TEST(test_store_service_attr)
 }
 END_TEST
 
+START_TEST(test_store_batch)
+{
+	sdb_store_batch_entry_t entries[8];
+	sdb_store_batch_t batch = { entries, 0 };
+	sdb_data_t value = { SDB_TYPE_INTEGER, { .integer = 42 } };
+
+	struct {
+		const char *host;
+		int type;
+		const char *name;
+		const char *attr;
+	} golden_objs[] = {
+		{ "h1", SDB_SERVICE, "s1", NULL },
+		{ "h1", SDB_SERVICE, "s1", "a1" },
+		{ "h1", SDB_SERVICE, "s2", NULL },
+		{ "h1", SDB_METRIC,  "m1", NULL },
+		{ "h2", SDB_ATTRIBUTE, "a1", NULL },
+	};
+
+	size_t i;
+	int status;
+
+	memset(entries, 0, sizeof(entries));
+	entries[0].type = SDB_HOST;
+	entries[0].obj.host.name = "h1";
+	entries[1].type = SDB_SERVICE;
+	entries[1].obj.service.hostname = "h1";
+	entries[1].obj.service.name = "s1";
+	entries[2].type = SDB_METRIC;
+	entries[2].obj.metric.hostname = "h1";
+	entries[2].obj.metric.name = "m1";
+	entries[3].type = SDB_ATTRIBUTE;
+	entries[3].obj.attribute.hostname = "h1";
+	entries[3].obj.attribute.parent_type = SDB_SERVICE;
+	entries[3].obj.attribute.parent = "s1";
+	entries[3].obj.attribute.key = "a1";
+	entries[3].obj.attribute.value = value;
+	entries[4].type = SDB_HOST;
+	entries[4].obj.host.name = "h2";
+	entries[5].type = SDB_ATTRIBUTE;
+	entries[5].obj.attribute.parent_type = SDB_HOST;
+	entries[5].obj.attribute.parent = "h2";
+	entries[5].obj.attribute.key = "a1";
+	entries[5].obj.attribute.value = value;
+	/* switch back to a previous host */
+	entries[6].type = SDB_SERVICE;
+	entries[6].obj.service.hostname = "H1";
+	entries[6].obj.service.name = "s2";
+	/* unknown host */
+	entries[7].type = SDB_SERVICE;
+	entries[7].obj.service.hostname = "h3";
+	entries[7].obj.service.name = "s1";
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(entries); ++i) {
+		if (entries[i].type == SDB_HOST)
+			entries[i].obj.host.last_update = 1;
+		else if (entries[i].type == SDB_SERVICE)
+			entries[i].obj.service.last_update = 1;
+		else if (entries[i].type == SDB_METRIC)
+			entries[i].obj.metric.last_update = 1;
+		else if (entries[i].type == SDB_ATTRIBUTE)
+			entries[i].obj.attribute.last_update = 1;
+	}
+
+	batch.entries_num = 7;
+	status = sdb_memstore_writer.store_batch(&batch, SDB_OBJ(store));
+	fail_unless(status == 0,
+			"store_batch(<7 new entries>) = %d; expected: 0", status);
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(golden_objs); ++i) {
+		sdb_memstore_obj_t *host, *obj;
+
+		host = sdb_memstore_get_host(store, golden_objs[i].host);
+		fail_unless(host != NULL,
+				"store_batch() did not store host '%s'", golden_objs[i].host);
+		obj = sdb_memstore_get_child(host,
+				golden_objs[i].type, golden_objs[i].name);
+		sdb_object_deref(SDB_OBJ(host));
+		if (golden_objs[i].attr) {
+			sdb_memstore_obj_t *tmp = obj;
+			obj = sdb_memstore_get_child(tmp,
+					SDB_ATTRIBUTE, golden_objs[i].attr);
+			sdb_object_deref(SDB_OBJ(tmp));
+		}
+		fail_unless(obj != NULL,
+				"store_batch() did not store %s '%s/%s' (attribute: %s)",
+				SDB_STORE_TYPE_TO_NAME(golden_objs[i].type),
+				golden_objs[i].host, golden_objs[i].name,
+				golden_objs[i].attr ? golden_objs[i].attr : "<none>");
+		sdb_object_deref(SDB_OBJ(obj));
+	}
+
+	status = sdb_memstore_writer.store_batch(&batch, SDB_OBJ(store));
+	fail_unless(status > 0,
+			"store_batch(<7 old entries>) = %d; expected: >0", status);
+
+	batch.entries_num = 8;
+	status = sdb_memstore_writer.store_batch(&batch, SDB_OBJ(store));
+	fail_unless(status < 0,
+			"store_batch(<entry of unknown host>) = %d; expected: <0", status);
+}
+END_TEST
+
 static struct {
 	const char *hostname;
 	const char *attr; /* optional */
@@ -524,6 +685,130 @@ START_TEST(test_get_field)
 END_TEST
 #undef OBJ_NAME
 
+static int
+match_backend(sdb_memstore_obj_t *obj, char *name, bool any)
+{
+	sdb_data_t datum = SDB_DATA_INIT;
+	sdb_memstore_expr_t *field, *value;
+	sdb_memstore_matcher_t *m, *cmp;
+	int status;
+
+	datum.type = SDB_TYPE_STRING;
+	datum.data.string = name;
+	field = sdb_memstore_expr_fieldvalue(SDB_FIELD_BACKEND);
+	value = sdb_memstore_expr_constvalue(&datum);
+	ck_assert(field && value);
+
+	if (any) {
+		cmp = sdb_memstore_eq_matcher(NULL, value);
+		ck_assert(cmp != NULL);
+		m = sdb_memstore_any_matcher(field, cmp);
+		sdb_object_deref(SDB_OBJ(cmp));
+	}
+	else
+		m = sdb_memstore_in_matcher(value, field);
+	ck_assert(m != NULL);
+	sdb_object_deref(SDB_OBJ(field));
+	sdb_object_deref(SDB_OBJ(value));
+
+	status = sdb_memstore_matcher_matches(m, obj, /* filter = */ NULL);
+	sdb_object_deref(SDB_OBJ(m));
+	return status;
+} /* match_backend */
+
+START_TEST(test_backends)
+{
+	const char *b1[] = { "b", "a" };
+	const char *b2[] = { "c", "a" };
+	sdb_store_host_t host = SDB_STORE_HOST_INIT;
+	sdb_memstore_obj_t *obj;
+	sdb_data_t value = SDB_DATA_INIT;
+	char value_str[64];
+	int a, b, c, check;
+
+	host.name = "h";
+	host.last_update = 1;
+	host.backends = b1;
+	host.backends_num = SDB_STATIC_ARRAY_LEN(b1);
+	check = sdb_memstore_writer.store_host(&host, SDB_OBJ(store));
+	fail_unless(check == 0,
+			"store_host(h, backends = [b, a]) = %d; expected: 0", check);
+	host.last_update = 2;
+	host.backends = b2;
+	check = sdb_memstore_writer.store_host(&host, SDB_OBJ(store));
+	fail_unless(check == 0,
+			"store_host(h, backends = [c, a]) = %d; expected: 0", check);
+
+	a = sdb_memstore_backend_id("a", /* create = */ 0);
+	b = sdb_memstore_backend_id("B", /* create = */ 0);
+	c = sdb_memstore_backend_id("c", /* create = */ 0);
+	fail_unless((a >= 0) && (b >= 0) && (c >= 0)
+			&& (a != b) && (a != c) && (b != c),
+			"sdb_memstore_backend_id(a, b, c) = %d, %d, %d; "
+			"expected: distinct IDs", a, b, c);
+	fail_unless(sdb_memstore_backend_id("unknown", /* create = */ 0) < 0,
+			"sdb_memstore_backend_id(unknown) = >=0; expected: <0");
+	fail_unless(! strcmp(sdb_memstore_backend_name(b), "b"),
+			"sdb_memstore_backend_name(%d) = %s; expected: b",
+			b, sdb_memstore_backend_name(b));
+
+	obj = sdb_memstore_get_host(store, "h");
+	ck_assert(obj != NULL);
+	fail_unless(sdb_memstore_backends_has(&obj->backends, a)
+			&& sdb_memstore_backends_has(&obj->backends, b)
+			&& sdb_memstore_backends_has(&obj->backends, c)
+			&& (! sdb_memstore_backends_has(&obj->backends, -1)),
+			"host h: backend set does not match [a, b, c]");
+
+	check = sdb_memstore_get_field(obj, SDB_FIELD_BACKEND, &value);
+	fail_unless(check == 0,
+			"sdb_memstore_get_field(h, backend) = %d; expected: 0", check);
+	sdb_data_format(&value, value_str, sizeof(value_str), 0);
+	fail_unless((value.type == (SDB_TYPE_ARRAY | SDB_TYPE_STRING))
+			&& (value.data.array.length == 3),
+			"sdb_memstore_get_field(h, backend) = %s; "
+			"expected: three backends", value_str);
+	sdb_data_free_datum(&value);
+
+	fail_unless(match_backend(obj, "a", 0) && match_backend(obj, "c", 1),
+			"backend matcher did not match host h");
+	fail_unless((! match_backend(obj, "unknown", 0))
+			&& (! match_backend(obj, "unknown", 1)),
+			"backend matcher matched unknown backend");
+	sdb_object_deref(SDB_OBJ(obj));
+
+	/* IDs are process-global, so other stores don't register them again */
+	{
+		sdb_memstore_t *other = sdb_memstore_create();
+		ck_assert(other != NULL);
+		host.last_update = 3;
+		check = sdb_memstore_writer.store_host(&host, SDB_OBJ(other));
+		fail_unless(check == 0,
+				"store_host(h, backends = [c, a]) in another store = %d; "
+				"expected: 0", check);
+		sdb_object_deref(SDB_OBJ(other));
+	}
+	fail_unless((sdb_memstore_backend_id("a", /* create = */ 0) == a)
+			&& (sdb_memstore_backend_id("c", /* create = */ 0) == c),
+			"backend IDs changed after using them in another store");
+
+	/* IDs larger than the inline bits */
+	for (check = 0; check < 100; ++check) {
+		backend_set_t set = BACKEND_SET_INIT;
+		backend_set_t copy = BACKEND_SET_INIT;
+		fail_unless(sdb_memstore_backends_add(&set, check) == 0,
+				"sdb_memstore_backends_add(%d) = <error>; expected: 0", check);
+		fail_unless(sdb_memstore_backends_copy(&copy, &set) == 0,
+				"sdb_memstore_backends_copy() = <error>; expected: 0");
+		fail_unless(sdb_memstore_backends_has(&copy, check)
+				&& (! sdb_memstore_backends_has(&copy, check + 1)),
+				"backend set with ID %d: membership mismatch", check);
+		sdb_memstore_backends_clear(&set);
+		sdb_memstore_backends_clear(&copy);
+	}
+}
+END_TEST
+
 START_TEST(test_get_child)
 {
 	struct {
@@ -626,17 +911,15 @@ START_TEST(test_get_child)
 }
 END_TEST
 
-/* TODO: move these tests into generic store tests */
-#if 0
 START_TEST(test_interval)
 {
 	sdb_memstore_obj_t *host;
 
 	/* 10 us interval */
-	sdb_memstore_host(store, "host", 10);
-	sdb_memstore_host(store, "host", 20);
-	sdb_memstore_host(store, "host", 30);
-	sdb_memstore_host(store, "host", 40);
+	sdb_memstore_host(store, "host", 10, 0);
+	sdb_memstore_host(store, "host", 20, 0);
+	sdb_memstore_host(store, "host", 30, 0);
+	sdb_memstore_host(store, "host", 40, 0);
 
 	host = sdb_memstore_get_host(store, "host");
 	fail_unless(host != NULL,
@@ -644,46 +927,48 @@ START_TEST(test_interval)
 
 	fail_unless(host->interval == 10,
 			"sdb_memstore_host() did not calculate interval correctly: "
-			"got: %"PRIsdbTIME"; expected: %"PRIsdbTIME, host->interval, 10);
+			"got: %"PRIsdbTIME"; expected: %"PRIsdbTIME,
+			host->interval, (sdb_time_t)10);
 
 	/* multiple updates for the same timestamp don't modify the interval */
-	sdb_memstore_host(store, "host", 40);
-	sdb_memstore_host(store, "host", 40);
-	sdb_memstore_host(store, "host", 40);
-	sdb_memstore_host(store, "host", 40);
+	sdb_memstore_host(store, "host", 40, 0);
+	sdb_memstore_host(store, "host", 40, 0);
+	sdb_memstore_host(store, "host", 40, 0);
+	sdb_memstore_host(store, "host", 40, 0);
 
 	fail_unless(host->interval == 10,
 			"sdb_memstore_host() changed interval when doing multiple updates "
 			"using the same timestamp; got: %"PRIsdbTIME"; "
-			"expected: %"PRIsdbTIME, host->interval, 10);
+			"expected: %"PRIsdbTIME, host->interval, (sdb_time_t)10);
 
 	/* multiple updates using an timestamp don't modify the interval */
-	sdb_memstore_host(store, "host", 20);
-	sdb_memstore_host(store, "host", 20);
-	sdb_memstore_host(store, "host", 20);
-	sdb_memstore_host(store, "host", 20);
+	sdb_memstore_host(store, "host", 20, 0);
+	sdb_memstore_host(store, "host", 20, 0);
+	sdb_memstore_host(store, "host", 20, 0);
+	sdb_memstore_host(store, "host", 20, 0);
 
 	fail_unless(host->interval == 10,
 			"sdb_memstore_host() changed interval when doing multiple updates "
 			"using an old timestamp; got: %"PRIsdbTIME"; expected: %"PRIsdbTIME,
-			host->interval, 10);
+			host->interval, (sdb_time_t)10);
 
 	/* new interval: 20 us */
-	sdb_memstore_host(store, "host", 60);
+	sdb_memstore_host(store, "host", 60, 0);
 	fail_unless(host->interval == 11,
 			"sdb_memstore_host() did not calculate interval correctly: "
-			"got: %"PRIsdbTIME"; expected: %"PRIsdbTIME, host->interval, 11);
+			"got: %"PRIsdbTIME"; expected: %"PRIsdbTIME,
+			host->interval, (sdb_time_t)11);
 
 	/* new interval: 40 us */
-	sdb_memstore_host(store, "host", 100);
+	sdb_memstore_host(store, "host", 100, 0);
 	fail_unless(host->interval == 13,
 			"sdb_memstore_host() did not calculate interval correctly: "
-			"got: %"PRIsdbTIME"; expected: %"PRIsdbTIME, host->interval, 11);
+			"got: %"PRIsdbTIME"; expected: %"PRIsdbTIME,
+			host->interval, (sdb_time_t)13);
 
 	sdb_object_deref(SDB_OBJ(host));
 }
 END_TEST
-#endif
 
 static int
 scan_count(sdb_memstore_obj_t *obj, sdb_memstore_matcher_t *filter, void *user_data)
@@ -776,6 +1061,621 @@ START_TEST(test_scan)
 }
 END_TEST
 
+START_TEST(test_expire)
+{
+	struct {
+		sdb_time_t now;
+		sdb_time_t ttl;
+		size_t max_hosts;
+		ssize_t expected;
+	} golden_data[] = {
+		/* h1.k1, h1.m2 */
+		{ 4, 2, 1, 2 },
+		/* h2.m1, h2.s1, h2.s2.k2 */
+		{ 4, 2, 1, 3 },
+		/* start over with h1 */
+		{ 4, 2, 1, 0 },
+		/* everything */
+		{ 100, 2, 0, 8 },
+	};
+	sdb_memstore_obj_t *obj, *child;
+	intptr_t n = 0;
+	ssize_t check;
+	size_t i;
+
+	populate();
+
+	check = sdb_memstore_expire(store, 100, 0.0, 0, 0);
+	fail_unless(check == 0,
+			"sdb_memstore_expire(<store>, factor=0, ttl=0) = %zd; "
+			"expected: 0", check);
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(golden_data); ++i) {
+		check = sdb_memstore_expire(store, golden_data[i].now, 0.0,
+				golden_data[i].ttl, golden_data[i].max_hosts);
+		fail_unless(check == golden_data[i].expected,
+				"sdb_memstore_expire(<store>, now=%"PRIsdbTIME", ttl=%"
+				PRIsdbTIME", max_hosts=%zu) = %zd; expected: %zd",
+				golden_data[i].now, golden_data[i].ttl,
+				golden_data[i].max_hosts, check, golden_data[i].expected);
+
+		if (i == 1) {
+			/* hosts with remaining children are kept */
+			obj = sdb_memstore_get_host(store, "h1");
+			fail_unless(obj != NULL,
+					"sdb_memstore_expire() removed host h1 which still has "
+					"children");
+			child = sdb_memstore_get_child(obj, SDB_ATTRIBUTE, "k1");
+			fail_unless(child == NULL,
+					"sdb_memstore_expire() did not remove attribute h1.k1");
+			sdb_object_deref(SDB_OBJ(obj));
+		}
+	}
+
+	check = sdb_memstore_scan(store, SDB_HOST, /* m, filter = */ NULL, NULL,
+			scan_count, &n);
+	fail_unless((check == 0) && (n == 0),
+			"sdb_memstore_expire() left %d hosts behind; expected: 0",
+			(int)n);
+
+	/* expire based on the update interval */
+	sdb_memstore_host(store, "h3", 10, 0);
+	sdb_memstore_host(store, "h3", 20, 0);
+	check = sdb_memstore_expire(store, 40, 3.0, 0, 0);
+	fail_unless(check == 0,
+			"sdb_memstore_expire(<store>, now=40, factor=3) = %zd; "
+			"expected: 0 (interval: 10)", check);
+	check = sdb_memstore_expire(store, 51, 3.0, 0, 0);
+	fail_unless(check == 1,
+			"sdb_memstore_expire(<store>, now=51, factor=3) = %zd; "
+			"expected: 1 (interval: 10)", check);
+	obj = sdb_memstore_get_host(store, "h3");
+	fail_unless(obj == NULL,
+			"sdb_memstore_expire() did not remove host h3");
+}
+END_TEST
+
+/* update the store while scanning it */
+static int
+scan_update(sdb_memstore_obj_t *obj, sdb_memstore_matcher_t *filter,
+		void *user_data)
+{
+	intptr_t *i = user_data;
+	sdb_memstore_obj_t *child;
+	sdb_data_t datum = SDB_DATA_INIT, value = SDB_DATA_INIT;
+	int check;
+
+	if (! sdb_memstore_matcher_matches(filter, obj, NULL))
+		return 0;
+
+	if (! strcmp(SDB_OBJ(obj)->name, "h1")) {
+		datum.type = SDB_TYPE_STRING;
+		datum.data.string = "new";
+		check = sdb_memstore_attribute(store, "h1", "k1", &datum, 10, 0);
+		fail_unless(check == 0,
+				"sdb_memstore_attribute(h1.k1) while scanning = %d; "
+				"expected: 0", check);
+		check = sdb_memstore_host(store, "h3", 10, 0);
+		fail_unless(check == 0,
+				"sdb_memstore_host(h3) while scanning = %d; expected: 0",
+				check);
+		/* removes everything but h1.k1 and h3 */
+		check = (int)sdb_memstore_expire(store, 10, 0.0, 5, 0);
+		fail_unless(check > 0,
+				"sdb_memstore_expire() while scanning = %d; expected: >0",
+				check);
+
+		/* the scan does not see any updates */
+		check = sdb_memstore_get_attr(obj, "k1", &value, NULL);
+		fail_unless((check == 0) && (value.type == SDB_TYPE_STRING)
+				&& (! strcmp(value.data.string, "v1")),
+				"sdb_memstore_get_attr(h1.k1) while scanning = %d; "
+				"expected: 0 (value: v1)", check);
+		sdb_data_free_datum(&value);
+	}
+	else {
+		/* expired objects remain accessible */
+		child = sdb_memstore_get_child(obj, SDB_SERVICE, "s2");
+		fail_unless(child != NULL,
+				"sdb_memstore_get_child(h2.s2) while scanning = NULL; "
+				"expected: <obj> (expired while scanning)");
+		sdb_object_deref(SDB_OBJ(child));
+	}
+
+	++(*i);
+	return 0;
+} /* scan_update */
+
+START_TEST(test_scan_update)
+{
+	sdb_memstore_obj_t *obj;
+	sdb_data_t datum = SDB_DATA_INIT;
+	intptr_t n = 0;
+	int check;
+
+	populate();
+
+	check = sdb_memstore_scan(store, SDB_HOST, /* m, filter = */ NULL, NULL,
+			scan_update, &n);
+	fail_unless((check == 0) && (n == 2),
+			"sdb_memstore_scan(HOST, update) = %d (%d hosts); "
+			"expected: 0 (2 hosts)", check, (int)n);
+
+	n = 0;
+	check = sdb_memstore_scan(store, SDB_HOST, /* m, filter = */ NULL, NULL,
+			scan_count, &n);
+	fail_unless((check == 0) && (n == 2),
+			"sdb_memstore_scan(HOST) after updates = %d (%d hosts); "
+			"expected: 0 (2 hosts)", check, (int)n);
+
+	obj = sdb_memstore_get_host(store, "h1");
+	fail_unless(obj != NULL,
+			"sdb_memstore_get_host(h1) = NULL; expected: <host>");
+	check = sdb_memstore_get_attr(obj, "k1", &datum, NULL);
+	fail_unless((check == 0) && (datum.type == SDB_TYPE_STRING)
+			&& (! strcmp(datum.data.string, "new")),
+			"sdb_memstore_get_attr(h1.k1) after scan = %d; "
+			"expected: 0 (value: new)", check);
+	sdb_data_free_datum(&datum);
+	sdb_object_deref(SDB_OBJ(obj));
+
+	obj = sdb_memstore_get_host(store, "h2");
+	fail_unless(obj == NULL,
+			"sdb_memstore_get_host(h2) = <host>; expected: NULL (expired)");
+}
+END_TEST
+
+/* hosts are copied at most once per pinned view, no matter how many
+ * updates they receive, and hosts which are not updated are never copied */
+START_TEST(test_view_copy)
+{
+	sdb_memstore_obj_t *h1, *h2, *old, *obj;
+	sdb_data_t datum = { SDB_TYPE_STRING, { .string = "new" } };
+	sdb_data_t value = SDB_DATA_INIT;
+	store_view_t *view;
+	int check, i;
+
+	populate();
+	h1 = sdb_memstore_get_host(store, "h1");
+	h2 = sdb_memstore_get_host(store, "h2");
+	ck_assert((h1 != NULL) && (h2 != NULL));
+
+	/* without any views, hosts are updated in place */
+	sdb_memstore_host(store, "h1", 5, 0);
+	obj = sdb_memstore_get_host(store, "h1");
+	fail_unless(obj == h1,
+			"sdb_memstore_host(h1) without views replaced the host; "
+			"expected: updated in place");
+	sdb_object_deref(SDB_OBJ(obj));
+
+	sdb_memstore_lock_all(store);
+	view = sdb_memstore_view_pin(store, /* hosts = */ 0);
+	sdb_memstore_unlock_all(store);
+	ck_assert(view != NULL);
+
+	sdb_memstore_attribute(store, "h1", "k1", &datum, 10, 0);
+	old = h1;
+	h1 = sdb_memstore_get_host(store, "h1");
+	fail_unless(h1 != old,
+			"sdb_memstore_attribute(h1.k1) while pinning a view updated the "
+			"host in place; expected: a copy");
+	for (i = 0; i < 100; ++i) {
+		char name[16];
+		snprintf(name, sizeof(name), "m%d", i);
+		sdb_memstore_metric(store, "h1", name, /* store */ NULL, 10 + i, 0);
+		sdb_memstore_attribute(store, "h1", name, &datum, 10 + i, 0);
+	}
+	obj = sdb_memstore_get_host(store, "h1");
+	fail_unless(obj == h1,
+			"repeated updates of h1 while pinning a view copied the host "
+			"again; expected: a single copy per view");
+	sdb_object_deref(SDB_OBJ(obj));
+
+	obj = sdb_memstore_get_host(store, "h2");
+	fail_unless(obj == h2,
+			"sdb_memstore_get_host(h2) returned a copy; expected: not "
+			"copied (not updated)");
+	sdb_object_deref(SDB_OBJ(obj));
+
+	check = sdb_memstore_get_attr(h1, "k1", &value, NULL);
+	fail_unless((check == 0) && (value.type == SDB_TYPE_STRING)
+			&& (! strcmp(value.data.string, "new")),
+			"sdb_memstore_get_attr(h1.k1) = %d; expected: 0 (value: new)",
+			check);
+	sdb_data_free_datum(&value);
+
+	/* the pinned version remains unchanged */
+	check = sdb_memstore_get_attr(old, "k1", &value, NULL);
+	fail_unless((check == 0) && (value.type == SDB_TYPE_STRING)
+			&& (! strcmp(value.data.string, "v1")),
+			"sdb_memstore_get_attr(<pinned h1>.k1) = %d; "
+			"expected: 0 (value: v1)", check);
+	sdb_data_free_datum(&value);
+	obj = sdb_memstore_get_child(old, SDB_METRIC, "m50");
+	fail_unless(obj == NULL,
+			"sdb_memstore_get_child(<pinned h1>.m50) = <obj>; "
+			"expected: NULL (stored after pinning the view)");
+	sdb_object_deref(SDB_OBJ(old));
+
+	sdb_memstore_view_release(store, view);
+
+	sdb_memstore_host(store, "h1", 200, 0);
+	obj = sdb_memstore_get_host(store, "h1");
+	fail_unless(obj == h1,
+			"sdb_memstore_host(h1) after releasing the view replaced the "
+			"host; expected: updated in place");
+	sdb_object_deref(SDB_OBJ(obj));
+
+	sdb_object_deref(SDB_OBJ(h1));
+	sdb_object_deref(SDB_OBJ(h2));
+}
+END_TEST
+
+/* readers share the newest view until the store actually changes */
+START_TEST(test_view_modified)
+{
+	sdb_data_t datum = { SDB_TYPE_STRING, { .string = "old" } };
+	store_view_t *view, *v;
+	int check;
+
+	populate();
+
+	sdb_memstore_lock_all(store);
+	view = sdb_memstore_view_pin(store, /* hosts = */ 1);
+	sdb_memstore_unlock_all(store);
+	ck_assert(view != NULL);
+
+	/* outdated updates are rejected */
+	check = sdb_memstore_host(store, "h1", 1, 0);
+	fail_unless(check > 0,
+			"sdb_memstore_host(h1, outdated) = %d; expected: >0", check);
+	check = sdb_memstore_attribute(store, "h1", "k1", &datum, 1, 0);
+	fail_unless(check > 0,
+			"sdb_memstore_attribute(h1.k1, outdated) = %d; expected: >0",
+			check);
+	check = sdb_memstore_service(store, "h2", "s2", 1, 0);
+	fail_unless(check > 0,
+			"sdb_memstore_service(h2.s2, outdated) = %d; expected: >0",
+			check);
+
+	v = sdb_memstore_view_try_pin(store, /* hosts = */ 1);
+	fail_unless(v == view,
+			"sdb_memstore_view_try_pin() after rejected updates = %p; "
+			"expected: %p (unmodified)", v, view);
+	sdb_memstore_view_release(store, v);
+
+	check = sdb_memstore_service(store, "h2", "s3", 10, 0);
+	fail_unless(check == 0,
+			"sdb_memstore_service(h2.s3) = %d; expected: 0", check);
+	v = sdb_memstore_view_try_pin(store, /* hosts = */ 1);
+	fail_unless(v == NULL,
+			"sdb_memstore_view_try_pin() after updating the store = %p; "
+			"expected: NULL (modified)", v);
+	sdb_memstore_view_release(store, v);
+
+	sdb_memstore_view_release(store, view);
+}
+END_TEST
+
+static void *
+store_hosts(void *arg)
+{
+	intptr_t n = (intptr_t)arg;
+	sdb_data_t datum = { SDB_TYPE_INTEGER, { .integer = 0 } };
+	char hostname[32], name[32];
+	int i;
+
+	for (i = 0; i < 100; ++i) {
+		snprintf(hostname, sizeof(hostname), "h%d-%d", (int)n, i % 10);
+		snprintf(name, sizeof(name), "m%d", i);
+		datum.data.integer = i;
+		sdb_memstore_host(store, hostname, i + 1, 0);
+		sdb_memstore_metric(store, hostname, name, NULL, i + 1, 0);
+		sdb_memstore_attribute(store, hostname, name, &datum, i + 1, 0);
+	}
+	return NULL;
+} /* store_hosts */
+
+static void *
+scan_hosts(void *arg)
+{
+	intptr_t *n = arg;
+	int i;
+
+	for (i = 0; i < 100; ++i)
+		sdb_memstore_scan(store, SDB_METRIC, /* m, filter = */ NULL, NULL,
+				scan_count, n);
+	return NULL;
+} /* scan_hosts */
+
+START_TEST(test_store_concurrent)
+{
+	pthread_t writers[4], reader;
+	intptr_t n = 0;
+	int check;
+	size_t i;
+
+	check = sdb_memstore_index_attributes(store);
+	fail_unless(check == 0,
+			"sdb_memstore_index_attributes() = %d; expected: 0", check);
+
+	fail_unless(pthread_create(&reader, NULL, scan_hosts, &n) == 0,
+			"INTERNAL ERROR: failed to create thread");
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(writers); ++i)
+		fail_unless(pthread_create(writers + i, NULL, store_hosts,
+					(void *)(intptr_t)i) == 0,
+				"INTERNAL ERROR: failed to create thread");
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(writers); ++i)
+		pthread_join(writers[i], NULL);
+	pthread_join(reader, NULL);
+
+	n = 0;
+	check = sdb_memstore_scan(store, SDB_METRIC, /* m, filter = */ NULL, NULL,
+			scan_count, &n);
+	fail_unless((check == 0) && (n == 400),
+			"sdb_memstore_scan(METRIC) after concurrent updates = %d "
+			"(%d metrics); expected: 0 (400 metrics)", check, (int)n);
+}
+END_TEST
+
+static int
+scan_tojson(sdb_memstore_obj_t *obj, sdb_memstore_matcher_t *filter,
+		void *user_data)
+{
+	return sdb_memstore_emit_full(obj, filter, &sdb_store_json_writer, user_data);
+} /* scan_tojson */
+
+static void
+store_tojson(sdb_memstore_t *s, sdb_strbuf_t *buf)
+{
+	sdb_store_json_formatter_t *f;
+	int check;
+
+	sdb_strbuf_clear(buf);
+	f = sdb_store_json_formatter(buf, SDB_HOST, SDB_WANT_ARRAY);
+	ck_assert(f != NULL);
+	check = sdb_memstore_scan(s, SDB_HOST, /* m, filter = */ NULL, NULL,
+			scan_tojson, f);
+	fail_unless(check == 0,
+			"sdb_memstore_scan(HOST, tojson) = %d; expected: 0", check);
+	sdb_store_json_finish(f);
+	sdb_object_deref(SDB_OBJ(f));
+} /* store_tojson */
+
+/* files created by tests are placed in a temporary directory which is
+ * removed, including its content, once all tests are done */
+static char tmpdir[PATH_MAX];
+
+static void
+files_init(void)
+{
+	const char *base = getenv("TMPDIR");
+
+	if ((! base) || (! *base))
+		base = "/tmp";
+	snprintf(tmpdir, sizeof(tmpdir), "%s/store_test.XXXXXX", base);
+	ck_assert(mkdtemp(tmpdir) != NULL);
+	init();
+} /* files_init */
+
+static void
+files_turndown(void)
+{
+	DIR *dir = opendir(tmpdir);
+	struct dirent *e;
+
+	while (dir && (e = readdir(dir))) {
+		char path[PATH_MAX];
+
+		if ((! strcmp(e->d_name, ".")) || (! strcmp(e->d_name, "..")))
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", tmpdir, e->d_name);
+		unlink(path);
+	}
+	if (dir)
+		closedir(dir);
+	rmdir(tmpdir);
+	turndown();
+} /* files_turndown */
+
+START_TEST(test_snapshot)
+{
+	char filename[PATH_MAX];
+	sdb_metric_store_t ms = { "type", "id", NULL, 3 };
+	sdb_strbuf_t *expected = sdb_strbuf_create(0);
+	sdb_strbuf_t *got = sdb_strbuf_create(0);
+	sdb_memstore_t *loaded;
+	int check;
+
+	snprintf(filename, sizeof(filename), "%s/snapshot", tmpdir);
+
+	populate();
+	sdb_memstore_metric(store, "h2", "m2", &ms, 3, 0);
+	sdb_memstore_host(store, "h3", 3, SECS_TO_SDB_TIME(10));
+
+	check = sdb_memstore_snapshot(store, filename);
+	fail_unless(check == 0,
+			"sdb_memstore_snapshot(<store>, %s) = %d; expected: 0",
+			filename, check);
+
+	loaded = sdb_memstore_create();
+	ck_assert(loaded != NULL);
+	check = sdb_memstore_load(loaded, filename);
+	fail_unless(check == 0,
+			"sdb_memstore_load(<empty store>, %s) = %d; expected: 0",
+			filename, check);
+
+	store_tojson(store, expected);
+	store_tojson(loaded, got);
+	fail_unless(! strcmp(sdb_strbuf_string(got), sdb_strbuf_string(expected)),
+			"sdb_memstore_load(<snapshot>) restored:\n%s\nexpected:\n%s",
+			sdb_strbuf_string(got), sdb_strbuf_string(expected));
+
+	/* loading into a store with the same (or newer) objects is a no-op */
+	check = sdb_memstore_load(loaded, filename);
+	fail_unless(check == 0,
+			"sdb_memstore_load(<populated store>, %s) = %d; expected: 0",
+			filename, check);
+	store_tojson(loaded, got);
+	fail_unless(! strcmp(sdb_strbuf_string(got), sdb_strbuf_string(expected)),
+			"sdb_memstore_load(<snapshot>) into populated store:\n%s\n"
+			"expected:\n%s", sdb_strbuf_string(got),
+			sdb_strbuf_string(expected));
+	sdb_object_deref(SDB_OBJ(loaded));
+
+	/* incomplete snapshots are rejected */
+	check = truncate(filename, 64);
+	ck_assert(check == 0);
+	loaded = sdb_memstore_create();
+	check = sdb_memstore_load(loaded, filename);
+	fail_unless(check < 0,
+			"sdb_memstore_load(<truncated snapshot>) = %d; expected: <0",
+			check);
+	fail_unless(sdb_avltree_size(loaded->hosts) == 0,
+			"sdb_memstore_load(<truncated snapshot>) stored %zu hosts; "
+			"expected: 0", sdb_avltree_size(loaded->hosts));
+	sdb_object_deref(SDB_OBJ(loaded));
+
+	unlink(filename);
+	check = sdb_memstore_load(store, filename);
+	fail_unless(check > 0,
+			"sdb_memstore_load(<missing file>) = %d; expected: >0", check);
+
+	sdb_strbuf_destroy(expected);
+	sdb_strbuf_destroy(got);
+}
+END_TEST
+
+START_TEST(test_wal)
+{
+	char filename[PATH_MAX];
+	char snapshot[PATH_MAX];
+	char oldname[PATH_MAX];
+	sdb_metric_store_t ms = { "type", "id", NULL, 3 };
+	sdb_store_host_t host = { "h1", 1, 0, NULL, 0 };
+	sdb_store_service_t svc = { "h1", "s1", 2, 0, NULL, 0 };
+	sdb_store_metric_t metric = { "h1", "m1", &ms, 1, 3, 0, NULL, 0 };
+	sdb_store_attribute_t attr = {
+		"h1", SDB_SERVICE, "s1", "k1", { SDB_TYPE_INTEGER, { .integer = 42 } },
+		4, 0, NULL, 0,
+	};
+	sdb_store_batch_entry_t entries[2];
+	sdb_store_batch_t batch = { entries, 2 };
+
+	sdb_strbuf_t *expected = sdb_strbuf_create(0);
+	sdb_strbuf_t *got = sdb_strbuf_create(0);
+	sdb_memstore_t *s1, *s2;
+	sdb_memstore_wal_t *wal;
+	struct stat st;
+	int fd, check;
+
+	snprintf(filename, sizeof(filename), "%s/wal", tmpdir);
+	snprintf(snapshot, sizeof(snapshot), "%s.snap", filename);
+	snprintf(oldname, sizeof(oldname), "%s.old", filename);
+
+	memset(entries, 0, sizeof(entries));
+	entries[0].type = SDB_HOST;
+	entries[0].obj.host.name = "h2";
+	entries[0].obj.host.last_update = 5;
+	entries[1].type = SDB_SERVICE;
+	entries[1].obj.service.hostname = "h2";
+	entries[1].obj.service.name = "s1";
+	entries[1].obj.service.last_update = 5;
+
+	s1 = sdb_memstore_create();
+	ck_assert(s1 != NULL);
+	wal = sdb_memstore_wal_create(s1, filename, /* batch_size = */ 1 << 20);
+	fail_unless(wal != NULL,
+			"sdb_memstore_wal_create(<store>, %s) = NULL; expected: <wal>",
+			filename);
+
+	ck_assert(sdb_memstore_wal_writer.store_host(&host, SDB_OBJ(wal)) == 0);
+	ck_assert(sdb_memstore_wal_writer.store_service(&svc, SDB_OBJ(wal)) == 0);
+	ck_assert(sdb_memstore_wal_writer.store_metric(&metric, SDB_OBJ(wal)) == 0);
+	ck_assert(sdb_memstore_wal_writer.store_attribute(&attr,
+				SDB_OBJ(wal)) == 0);
+	ck_assert(sdb_memstore_wal_writer.store_batch(&batch, SDB_OBJ(wal)) == 0);
+	/* outdated updates are not logged */
+	check = sdb_memstore_wal_writer.store_host(&host, SDB_OBJ(wal));
+	fail_unless(check > 0,
+			"wal_writer.store_host(<outdated host>) = %d; expected: >0",
+			check);
+
+	/* nothing has been written yet */
+	ck_assert(stat(filename, &st) == 0);
+	fail_unless(st.st_size == 9,
+			"write-ahead log size before sync = %zu; expected: 9 (header)",
+			(size_t)st.st_size);
+	check = sdb_memstore_wal_sync(wal);
+	fail_unless(check == 0,
+			"sdb_memstore_wal_sync() = %d; expected: 0", check);
+	ck_assert(stat(filename, &st) == 0);
+	fail_unless(st.st_size > 9,
+			"write-ahead log size after sync = %zu; expected: >9",
+			(size_t)st.st_size);
+	sdb_object_deref(SDB_OBJ(wal));
+
+	/* append an incomplete record */
+	fd = open(filename, O_WRONLY | O_APPEND);
+	ck_assert(fd >= 0);
+	ck_assert(write(fd, "\0\0\0\1\0\0", 6) == 6);
+	close(fd);
+
+	s2 = sdb_memstore_create();
+	ck_assert(s2 != NULL);
+	wal = sdb_memstore_wal_create(s2, filename, /* batch_size = */ 0);
+	fail_unless(wal != NULL,
+			"sdb_memstore_wal_create(<store>, %s) = NULL; expected: <wal>",
+			filename);
+
+	store_tojson(s1, expected);
+	store_tojson(s2, got);
+	fail_unless(! strcmp(sdb_strbuf_string(got), sdb_strbuf_string(expected)),
+			"sdb_memstore_wal_create() replayed:\n%s\nexpected:\n%s",
+			sdb_strbuf_string(got), sdb_strbuf_string(expected));
+
+	/* the incomplete record has been dropped and new records are readable
+	 * after a checkpoint */
+	host.name = "h3";
+	ck_assert(sdb_memstore_wal_writer.store_host(&host, SDB_OBJ(wal)) == 0);
+	ck_assert(sdb_memstore_writer.store_host(&host, SDB_OBJ(s1)) == 0);
+	check = sdb_memstore_wal_checkpoint(wal, snapshot);
+	fail_unless(check == 0,
+			"sdb_memstore_wal_checkpoint() = %d; expected: 0", check);
+	fail_unless(access(oldname, F_OK) != 0,
+			"sdb_memstore_wal_checkpoint() did not remove %s", oldname);
+	ck_assert(stat(filename, &st) == 0);
+	fail_unless(st.st_size == 9,
+			"write-ahead log size after checkpoint = %zu; "
+			"expected: 9 (header)", (size_t)st.st_size);
+	host.name = "h4";
+	ck_assert(sdb_memstore_wal_writer.store_host(&host, SDB_OBJ(wal)) == 0);
+	ck_assert(sdb_memstore_writer.store_host(&host, SDB_OBJ(s1)) == 0);
+	sdb_object_deref(SDB_OBJ(wal));
+	sdb_object_deref(SDB_OBJ(s2));
+
+	s2 = sdb_memstore_create();
+	ck_assert(s2 != NULL);
+	ck_assert(sdb_memstore_load(s2, snapshot) == 0);
+	wal = sdb_memstore_wal_create(s2, filename, /* batch_size = */ 0);
+	ck_assert(wal != NULL);
+
+	store_tojson(s1, expected);
+	store_tojson(s2, got);
+	fail_unless(! strcmp(sdb_strbuf_string(got), sdb_strbuf_string(expected)),
+			"snapshot + write-ahead log restored:\n%s\nexpected:\n%s",
+			sdb_strbuf_string(got), sdb_strbuf_string(expected));
+
+	sdb_object_deref(SDB_OBJ(wal));
+	sdb_object_deref(SDB_OBJ(s1));
+	sdb_object_deref(SDB_OBJ(s2));
+	unlink(filename);
+	unlink(snapshot);
+	sdb_strbuf_destroy(expected);
+	sdb_strbuf_destroy(got);
+}
+END_TEST
+
 TEST_MAIN("core::store")
 {
 	TCase *tc = tcase_create("core");
@@ -787,9 +1687,23 @@ TEST_MAIN("core::store")
 	tcase_add_test(tc, test_store_metric_attr);
 	tcase_add_test(tc, test_store_service);
 	tcase_add_test(tc, test_store_service_attr);
+	tcase_add_test(tc, test_store_batch);
 	TC_ADD_LOOP_TEST(tc, get_field);
+	tcase_add_test(tc, test_backends);
+	tcase_add_test(tc, test_interval);
 	tcase_add_test(tc, test_get_child);
 	tcase_add_test(tc, test_scan);
+	tcase_add_test(tc, test_expire);
+	tcase_add_test(tc, test_scan_update);
+	tcase_add_test(tc, test_view_copy);
+	tcase_add_test(tc, test_view_modified);
+	tcase_add_test(tc, test_store_concurrent);
+	ADD_TCASE(tc);
+
+	tc = tcase_create("files");
+	tcase_add_unchecked_fixture(tc, files_init, files_turndown);
+	tcase_add_test(tc, test_snapshot);
+	tcase_add_test(tc, test_wal);
 	ADD_TCASE(tc);
 }
 TEST_MAIN_END
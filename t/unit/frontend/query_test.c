@@ -264,6 +264,7 @@ mock_conn_destroy(sdb_conn_t *conn)
 	sdb_strbuf_destroy(conn->buf);
 	sdb_strbuf_destroy(conn->errbuf);
 	sdb_strbuf_destroy(MOCK_CONN(conn)->write_buf);
+	sdb_conn_statements_clear(conn);
 	free(conn);
 } /* mock_conn_destroy */
 
@@ -836,11 +837,350 @@ START_TEST(test_query)
 }
 END_TEST
 
+static struct {
+	const char *query;
+	uint32_t chunk_size;
+	uint32_t type;
+	const char *data;
+} query_chunked_data[] = {
+	/* the default chunk size exceeds the result */
+	{ "LIST hosts", 0, SDB_CONNECTION_LIST,
+		"["HOST_H1_LISTING","HOST_H2_LISTING"]" },
+	{ "LIST hosts", 1, SDB_CONNECTION_LIST,
+		"["HOST_H1_LISTING","HOST_H2_LISTING"]" },
+	{ "LIST hosts", 16, SDB_CONNECTION_LIST,
+		"["HOST_H1_LISTING","HOST_H2_LISTING"]" },
+	{ "LIST hosts", 4096, SDB_CONNECTION_LIST,
+		"["HOST_H1_LISTING","HOST_H2_LISTING"]" },
+	{ "FETCH host 'h1'", 7, SDB_CONNECTION_FETCH, HOST_H1 },
+	{ "LOOKUP hosts MATCHING name = 'h1'", 32, SDB_CONNECTION_LOOKUP,
+		HOST_H1_ARRAY },
+	{ "LOOKUP hosts MATCHING name = 'x'", 1, SDB_CONNECTION_LOOKUP, "[]" },
+};
+
+START_TEST(test_query_chunked)
+{
+	sdb_conn_t *conn = mock_conn_create();
+	uint32_t chunk_size = htonl(query_chunked_data[_i].chunk_size);
+	const char *query = query_chunked_data[_i].query;
+	sdb_strbuf_t *result = sdb_strbuf_create(64);
+
+	uint32_t code = SDB_CONNECTION_DATA_CHUNK;
+	const char *data;
+	size_t len, chunks = 0;
+	int check;
+
+	conn->cmd = SDB_CONNECTION_QUERY_CHUNKED;
+	conn->cmd_len = (uint32_t)(sizeof(chunk_size) + strlen(query));
+	sdb_strbuf_memcpy(conn->buf, &chunk_size, sizeof(chunk_size));
+	sdb_strbuf_append(conn->buf, "%s", query);
+
+	check = sdb_conn_query(conn);
+	fail_unless(check == 0,
+			"sdb_conn_query(QUERY_CHUNKED, %s) = %d; expected: 0 (err: %s)",
+			query, check, sdb_strbuf_string(conn->errbuf));
+
+	data = sdb_strbuf_string(MOCK_CONN(conn)->write_buf);
+	len = sdb_strbuf_len(MOCK_CONN(conn)->write_buf);
+
+	while (len && (code == SDB_CONNECTION_DATA_CHUNK)) {
+		uint32_t msg_len = 0, type = 0;
+		ssize_t tmp;
+
+		tmp = sdb_proto_unmarshal_header(data, len, &code, &msg_len);
+		ck_assert_msg(tmp == (ssize_t)(2 * sizeof(uint32_t)));
+		data += tmp;
+		len -= tmp;
+
+		fail_unless((code == SDB_CONNECTION_DATA_CHUNK)
+				|| (code == SDB_CONNECTION_DATA),
+				"sdb_conn_query(QUERY_CHUNKED, %s) returned <%u>; "
+				"expected: <%u> or <%u>", query, code,
+				SDB_CONNECTION_DATA_CHUNK, SDB_CONNECTION_DATA);
+		fail_unless((msg_len >= sizeof(type)) && (msg_len <= len),
+				"sdb_conn_query(QUERY_CHUNKED, %s) returned message of "
+				"invalid length %u", query, msg_len);
+		if (code == SDB_CONNECTION_DATA_CHUNK) {
+			fail_unless(query_chunked_data[_i].chunk_size
+					&& (msg_len == sizeof(type)
+						+ query_chunked_data[_i].chunk_size),
+					"sdb_conn_query(QUERY_CHUNKED, %s) returned chunk of "
+					"size %u; expected: %u", query,
+					msg_len - (uint32_t)sizeof(type),
+					query_chunked_data[_i].chunk_size);
+			++chunks;
+		}
+
+		sdb_proto_unmarshal_int32(data, len, &type);
+		fail_unless(type == query_chunked_data[_i].type,
+				"sdb_conn_query(QUERY_CHUNKED, %s) returned %s object; "
+				"expected: %s", query, SDB_CONN_MSGTYPE_TO_STRING((int)type),
+				SDB_CONN_MSGTYPE_TO_STRING((int)query_chunked_data[_i].type));
+
+		sdb_strbuf_memappend(result, data + sizeof(type),
+				msg_len - sizeof(type));
+		data += msg_len;
+		len -= msg_len;
+	}
+
+	fail_unless(code == SDB_CONNECTION_DATA,
+			"sdb_conn_query(QUERY_CHUNKED, %s) did not send final "
+			"DATA message", query);
+	fail_unless(len == 0,
+			"sdb_conn_query(QUERY_CHUNKED, %s) sent %zu bytes of "
+			"trailing data", query, len);
+	/* the final message may include more than one chunk's worth of data
+	 * written when finishing the result */
+	if (query_chunked_data[_i].chunk_size
+			&& (query_chunked_data[_i].chunk_size
+				< strlen(query_chunked_data[_i].data) / 2))
+		fail_unless(chunks > 0,
+				"sdb_conn_query(QUERY_CHUNKED, %s) did not send any chunks",
+				query);
+
+	fail_if_strneq(sdb_strbuf_string(result), query_chunked_data[_i].data,
+			sdb_strbuf_len(result) + 1,
+			"sdb_conn_query(QUERY_CHUNKED, %s) returned unexpected data",
+			query, sdb_strbuf_string(result), query_chunked_data[_i].data);
+
+	sdb_strbuf_destroy(result);
+	mock_conn_destroy(conn);
+}
+END_TEST
+
+/* send a command to the mock connection and return the code and message of
+ * the (last) reply; chunks are merged into the final message */
+static int
+mock_conn_cmd(sdb_conn_t *conn, uint32_t cmd, const char *msg, size_t len,
+		uint32_t *code, sdb_strbuf_t *reply)
+{
+	const char *data;
+	size_t data_len;
+	int check = -1;
+
+	sdb_strbuf_clear(MOCK_CONN(conn)->write_buf);
+	sdb_strbuf_clear(reply);
+	conn->cmd = cmd;
+	conn->cmd_len = (uint32_t)len;
+	sdb_strbuf_memcpy(conn->buf, msg, len);
+
+	if (cmd == SDB_CONNECTION_PREPARE)
+		check = sdb_conn_prepare(conn);
+	else if (cmd == SDB_CONNECTION_EXECUTE)
+		check = sdb_conn_execute(conn);
+	else if (cmd == SDB_CONNECTION_QUERY)
+		check = sdb_conn_query(conn);
+
+	data = sdb_strbuf_string(MOCK_CONN(conn)->write_buf);
+	data_len = sdb_strbuf_len(MOCK_CONN(conn)->write_buf);
+	*code = UINT32_MAX;
+	while (data_len) {
+		uint32_t msg_len = 0;
+		ssize_t tmp = sdb_proto_unmarshal_header(data, data_len,
+				code, &msg_len);
+		ck_assert(tmp == (ssize_t)(2 * sizeof(uint32_t)));
+		ck_assert(msg_len <= data_len - (size_t)tmp);
+		data += tmp;
+		data_len -= tmp;
+
+		/* strip the result type */
+		if (((*code == SDB_CONNECTION_DATA)
+					|| (*code == SDB_CONNECTION_DATA_CHUNK))
+				&& (msg_len >= sizeof(uint32_t)))
+			sdb_strbuf_memappend(reply, data + sizeof(uint32_t),
+					msg_len - sizeof(uint32_t));
+		else
+			sdb_strbuf_memappend(reply, data, msg_len);
+		data += msg_len;
+		data_len -= msg_len;
+	}
+	return check;
+} /* mock_conn_cmd */
+
+START_TEST(test_prepare_execute)
+{
+	sdb_conn_t *conn = mock_conn_create();
+	sdb_strbuf_t *reply = sdb_strbuf_create(64);
+	sdb_conn_query_cache_stats_t before, stats;
+	uint32_t code, id, exec[2];
+	int check;
+
+	/* the cache is shared between tests when not forking */
+	sdb_conn_query_cache_configure(SDB_CONN_QUERY_CACHE_SIZE_DEFAULT);
+	sdb_conn_query_cache_stats(&before);
+
+	check = mock_conn_cmd(conn, SDB_CONNECTION_PREPARE, "LIST hosts",
+			strlen("LIST hosts"), &code, reply);
+	fail_unless((check == 0) && (code == SDB_CONNECTION_OK)
+			&& (sdb_strbuf_len(reply) == sizeof(id)),
+			"PREPARE(LIST hosts) = %d, <%u>; expected: 0, <%u> "
+			"with a statement ID", check, code, SDB_CONNECTION_OK);
+	sdb_proto_unmarshal_int32(sdb_strbuf_string(reply), sizeof(id), &id);
+	fail_unless(id == 1, "PREPARE(LIST hosts) returned ID %u; expected: 1",
+			id);
+
+	/* whitespace and comments don't matter */
+	check = mock_conn_cmd(conn, SDB_CONNECTION_PREPARE,
+			"  LIST\thosts /* all */ -- hosts\n",
+			strlen("  LIST\thosts /* all */ -- hosts\n"), &code, reply);
+	sdb_proto_unmarshal_int32(sdb_strbuf_string(reply), sizeof(id), &id);
+	fail_unless((check == 0) && (id == 1),
+			"PREPARE(LIST hosts) (again) = %d, ID %u; expected: 0, ID 1",
+			check, id);
+
+	check = mock_conn_cmd(conn, SDB_CONNECTION_PREPARE, "FETCH host 'h1'",
+			strlen("FETCH host 'h1'"), &code, reply);
+	sdb_proto_unmarshal_int32(sdb_strbuf_string(reply), sizeof(id), &id);
+	fail_unless((check == 0) && (id == 2),
+			"PREPARE(FETCH host 'h1') = %d, ID %u; expected: 0, ID 2",
+			check, id);
+
+	check = mock_conn_cmd(conn, SDB_CONNECTION_PREPARE,
+			"LIST hosts; LIST hosts", strlen("LIST hosts; LIST hosts"),
+			&code, reply);
+	fail_unless(check < 0, "PREPARE(<multiple commands>) = %d; "
+			"expected: <0", check);
+
+	exec[0] = htonl(1);
+	check = mock_conn_cmd(conn, SDB_CONNECTION_EXECUTE,
+			(const char *)exec, sizeof(exec[0]), &code, reply);
+	fail_unless((check == 0) && (code == SDB_CONNECTION_DATA),
+			"EXECUTE(1) = %d, <%u>; expected: 0, <%u>",
+			check, code, SDB_CONNECTION_DATA);
+	fail_if_strneq(sdb_strbuf_string(reply),
+			"["HOST_H1_LISTING","HOST_H2_LISTING"]", 0,
+			"EXECUTE(1) returned unexpected data",
+			sdb_strbuf_string(reply),
+			"["HOST_H1_LISTING","HOST_H2_LISTING"]");
+
+	/* chunked execution */
+	exec[0] = htonl(2);
+	exec[1] = htonl(8);
+	check = mock_conn_cmd(conn, SDB_CONNECTION_EXECUTE,
+			(const char *)exec, sizeof(exec), &code, reply);
+	fail_unless((check == 0) && (code == SDB_CONNECTION_DATA),
+			"EXECUTE(2, 8) = %d, <%u>; expected: 0, <%u>",
+			check, code, SDB_CONNECTION_DATA);
+	fail_if_strneq(sdb_strbuf_string(reply), HOST_H1, 0,
+			"EXECUTE(2, 8) returned unexpected data",
+			sdb_strbuf_string(reply), HOST_H1);
+
+	exec[0] = htonl(3);
+	check = mock_conn_cmd(conn, SDB_CONNECTION_EXECUTE,
+			(const char *)exec, sizeof(exec[0]), &code, reply);
+	fail_unless(check < 0, "EXECUTE(3) = %d; expected: <0", check);
+
+	/* the query cache is used by plain queries as well */
+	check = mock_conn_cmd(conn, SDB_CONNECTION_QUERY, "LIST  hosts",
+			strlen("LIST  hosts"), &code, reply);
+	fail_unless((check == 0) && (code == SDB_CONNECTION_DATA),
+			"QUERY(LIST hosts) = %d, <%u>; expected: 0, <%u>",
+			check, code, SDB_CONNECTION_DATA);
+
+	sdb_conn_query_cache_stats(&stats);
+	stats.hits -= before.hits;
+	stats.misses -= before.misses;
+	fail_unless((stats.hits == 2) && (stats.misses == 3)
+			&& (stats.entries == 2),
+			"query cache stats: %"PRIu64" hits, %"PRIu64" misses, "
+			"%zu entries; expected: 2, 3, 2",
+			stats.hits, stats.misses, stats.entries);
+
+	sdb_conn_query_cache_configure(0);
+	sdb_strbuf_destroy(reply);
+	mock_conn_destroy(conn);
+}
+END_TEST
+
+static sdb_time_t
+host_last_update(sdb_memstore_t *store, const char *name)
+{
+	sdb_memstore_obj_t *host = sdb_memstore_get_host(store, name);
+	sdb_data_t datum = SDB_DATA_INIT;
+
+	fail_unless(host != NULL,
+			"sdb_memstore_get_host(%s) = NULL; expected: <host>", name);
+	sdb_memstore_get_field(host, SDB_FIELD_LAST_UPDATE, &datum);
+	sdb_object_deref(SDB_OBJ(host));
+	return datum.data.datetime;
+} /* host_last_update */
+
+START_TEST(test_store_timestamps)
+{
+	sdb_conn_t *conn = mock_conn_create();
+	sdb_strbuf_t *reply = sdb_strbuf_create(64);
+	sdb_memstore_t *store = sdb_memstore_create();
+	const char *query = "STORE host 'hT'";
+	sdb_time_t first, second;
+	uint32_t code, id;
+	int check;
+
+	/* the default timestamp of STORE commands is the time of execution */
+	ck_assert(sdb_plugin_register_writer("ts-writer",
+				&sdb_memstore_writer, SDB_OBJ(store)) == 0);
+	sdb_conn_query_cache_configure(SDB_CONN_QUERY_CACHE_SIZE_DEFAULT);
+
+	check = mock_conn_cmd(conn, SDB_CONNECTION_QUERY, query, strlen(query),
+			&code, reply);
+	fail_unless((check == 0) && (code == SDB_CONNECTION_OK),
+			"QUERY(%s) = %d, <%u>; expected: 0, <%u>",
+			query, check, code, SDB_CONNECTION_OK);
+	first = host_last_update(store, "hT");
+
+	sdb_sleep(1000000, NULL);
+	check = mock_conn_cmd(conn, SDB_CONNECTION_QUERY, query, strlen(query),
+			&code, reply);
+	fail_unless((check == 0) && (code == SDB_CONNECTION_OK),
+			"QUERY(%s) (again) = %d, <%u>; expected: 0, <%u>",
+			query, check, code, SDB_CONNECTION_OK);
+	second = host_last_update(store, "hT");
+	fail_unless(second > first,
+			"QUERY(%s) did not update the timestamp (%"PRIsdbTIME
+			" -> %"PRIsdbTIME")", query, first, second);
+
+	/* the same applies to prepared statements */
+	check = mock_conn_cmd(conn, SDB_CONNECTION_PREPARE, query, strlen(query),
+			&code, reply);
+	fail_unless((check == 0) && (code == SDB_CONNECTION_OK),
+			"PREPARE(%s) = %d, <%u>; expected: 0, <%u>",
+			query, check, code, SDB_CONNECTION_OK);
+	sdb_proto_unmarshal_int32(sdb_strbuf_string(reply), sizeof(id), &id);
+	id = htonl(id);
+
+	sdb_sleep(1000000, NULL);
+	check = mock_conn_cmd(conn, SDB_CONNECTION_EXECUTE, (const char *)&id,
+			sizeof(id), &code, reply);
+	fail_unless((check == 0) && (code == SDB_CONNECTION_OK),
+			"EXECUTE(%s) = %d, <%u>; expected: 0, <%u>",
+			query, check, code, SDB_CONNECTION_OK);
+	first = host_last_update(store, "hT");
+	fail_unless(first > second,
+			"EXECUTE(%s) did not update the timestamp (%"PRIsdbTIME
+			" -> %"PRIsdbTIME")", query, second, first);
+
+	sdb_sleep(1000000, NULL);
+	check = mock_conn_cmd(conn, SDB_CONNECTION_EXECUTE, (const char *)&id,
+			sizeof(id), &code, reply);
+	second = host_last_update(store, "hT");
+	fail_unless((check == 0) && (second > first),
+			"EXECUTE(%s) (again) = %d and did not update the timestamp "
+			"(%"PRIsdbTIME" -> %"PRIsdbTIME")", query, check, first, second);
+
+	sdb_conn_query_cache_configure(0);
+	sdb_object_deref(SDB_OBJ(store));
+	sdb_strbuf_destroy(reply);
+	mock_conn_destroy(conn);
+}
+END_TEST
+
 TEST_MAIN("frontend::query")
 {
 	TCase *tc = tcase_create("core");
 	tcase_add_checked_fixture(tc, populate, turndown);
 	TC_ADD_LOOP_TEST(tc, query);
+	TC_ADD_LOOP_TEST(tc, query_chunked);
+	tcase_add_test(tc, test_prepare_execute);
+	tcase_add_test(tc, test_store_timestamps);
 	ADD_TCASE(tc);
 }
 TEST_MAIN_END
@@ -33,6 +33,7 @@
 #include "testutils.h"
 
 #include <check.h>
+#include <stdio.h>
 
 static sdb_avltree_t *tree;
 
@@ -253,6 +254,173 @@ START_TEST(test_iter)
 }
 END_TEST
 
+START_TEST(test_remove)
+{
+	/* remove inner nodes, leafs and the root in an arbitrary order */
+	char *names[] = { "h", "a", "l", "e", "o", "i", "b", "n",
+		"f", "c", "m", "k", "d", "j", "g" };
+	size_t i;
+	int check;
+
+	populate();
+
+	check = sdb_avltree_remove(tree, "x");
+	fail_unless(check < 0,
+			"sdb_avltree_remove(<tree>, x) = %d; expected: <0", check);
+	check = sdb_avltree_remove(NULL, "a");
+	fail_unless(check < 0,
+			"sdb_avltree_remove(NULL, a) = %d; expected: <0", check);
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(names); ++i) {
+		sdb_object_t *obj;
+		size_t size;
+
+		check = sdb_avltree_remove(tree, names[i]);
+		fail_unless(check == 0,
+				"sdb_avltree_remove(<tree>, %s) = %d; expected: 0",
+				names[i], check);
+		fail_unless(sdb_avltree_valid(tree),
+				"sdb_avltree_remove(<tree>, %s) left behind invalid tree",
+				names[i]);
+
+		size = sdb_avltree_size(tree);
+		fail_unless(size == SDB_STATIC_ARRAY_LEN(names) - i - 1,
+				"sdb_avltree_size(<tree>) = %zu (after removing %s); "
+				"expected: %zu", size, names[i],
+				SDB_STATIC_ARRAY_LEN(names) - i - 1);
+
+		obj = sdb_avltree_lookup(tree, names[i]);
+		fail_unless(obj == NULL,
+				"sdb_avltree_lookup(<tree>, %s) = %p (after removing it); "
+				"expected: NULL", names[i], obj);
+
+		check = sdb_avltree_remove(tree, names[i]);
+		fail_unless(check < 0,
+				"sdb_avltree_remove(<tree>, %s) = %d (redo); expected: <0",
+				names[i], check);
+	}
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(test_data); ++i)
+		fail_unless(test_data[i].ref_cnt == 1,
+				"sdb_avltree_remove() left ref-cnt of %s at %d; "
+				"expected: 1", test_data[i].name, test_data[i].ref_cnt);
+}
+END_TEST
+
+START_TEST(test_iter_from)
+{
+	struct {
+		const char *name;
+		const char *expected;
+	} golden_data[] = {
+		{ NULL, "a" },
+		{ "a",  "a" },
+		{ "A",  "a" },
+		{ "dd", "e" },
+		{ "o",  "o" },
+		{ "p",  NULL },
+	};
+	size_t i;
+
+	populate();
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(golden_data); ++i) {
+		sdb_avltree_iter_t *iter;
+		sdb_object_t *obj;
+
+		iter = sdb_avltree_get_iter_from(tree, golden_data[i].name);
+		fail_unless(iter != NULL,
+				"sdb_avltree_get_iter_from(<tree>, %s) = NULL; "
+				"expected: <iter>", golden_data[i].name);
+
+		obj = sdb_avltree_iter_get_next(iter);
+		if (! golden_data[i].expected)
+			fail_unless(obj == NULL,
+					"sdb_avltree_get_iter_from(<tree>, %s) started at %s; "
+					"expected: <end>", golden_data[i].name, obj->name);
+		else
+			fail_unless(obj && (! strcmp(obj->name, golden_data[i].expected)),
+					"sdb_avltree_get_iter_from(<tree>, %s) started at %s; "
+					"expected: %s", golden_data[i].name,
+					obj ? obj->name : "<end>", golden_data[i].expected);
+		sdb_avltree_iter_destroy(iter);
+	}
+}
+END_TEST
+
+/* enough objects to require multiple levels of nodes */
+#define NUM_LARGE 2000
+
+START_TEST(test_large)
+{
+	static char names[NUM_LARGE][16];
+	static sdb_object_t objects[NUM_LARGE];
+
+	sdb_avltree_iter_t *iter;
+	size_t i, n;
+
+	for (i = 0; i < NUM_LARGE; ++i) {
+		sdb_object_t o = SDB_OBJECT_STATIC(NULL);
+
+		snprintf(names[i], sizeof(names[i]), "%sobj%04zu",
+				i % 2 ? "Long" : "", i);
+		o.name = names[i];
+		objects[i] = o;
+	}
+
+	/* insert in scrambled order */
+	for (i = 0; i < NUM_LARGE; ++i) {
+		size_t idx = (i * 7919) % NUM_LARGE;
+		int check = sdb_avltree_insert(tree, &objects[idx]);
+		fail_unless(check == 0,
+				"sdb_avltree_insert(<tree>, %s) = %d; expected: 0",
+				names[idx], check);
+		if (! (i % 97))
+			fail_unless(sdb_avltree_valid(tree),
+					"sdb_avltree_insert(<tree>, %s) left behind invalid tree",
+					names[idx]);
+	}
+	fail_unless(sdb_avltree_valid(tree),
+			"sdb_avltree_insert() left behind invalid tree");
+
+	iter = sdb_avltree_get_iter(tree);
+	n = 0;
+	while (sdb_avltree_iter_has_next(iter)) {
+		sdb_object_t *obj = sdb_avltree_iter_get_next(iter);
+		fail_unless(sdb_avltree_lookup(tree, obj->name) == obj,
+				"sdb_avltree_lookup(<tree>, %s) did not return the "
+				"object itself", obj->name);
+		sdb_object_deref(obj);
+		++n;
+	}
+	sdb_avltree_iter_destroy(iter);
+	fail_unless(n == NUM_LARGE,
+			"sdb_avltree_iter visited %zu objects; expected: %d",
+			n, NUM_LARGE);
+
+	/* remove in a different order */
+	for (i = 0; i < NUM_LARGE; ++i) {
+		size_t idx = (i * 104729) % NUM_LARGE;
+		int check = sdb_avltree_remove(tree, names[idx]);
+		fail_unless(check == 0,
+				"sdb_avltree_remove(<tree>, %s) = %d; expected: 0",
+				names[idx], check);
+		if (! (i % 97))
+			fail_unless(sdb_avltree_valid(tree),
+					"sdb_avltree_remove(<tree>, %s) left behind invalid tree",
+					names[idx]);
+		fail_unless(objects[idx].ref_cnt == 1,
+				"sdb_avltree_remove(<tree>, %s) left ref-cnt at %d; "
+				"expected: 1", names[idx], objects[idx].ref_cnt);
+	}
+	fail_unless(sdb_avltree_size(tree) == 0,
+			"sdb_avltree_size(<tree>) = %zu after removing all objects; "
+			"expected: 0", sdb_avltree_size(tree));
+	fail_unless(sdb_avltree_valid(tree),
+			"sdb_avltree_remove() left behind invalid tree");
+}
+END_TEST
+
 TEST_MAIN("utils::avltree")
 {
 	TCase *tc = tcase_create("core");
@@ -261,6 +429,9 @@ TEST_MAIN("utils::avltree")
 	tcase_add_test(tc, test_insert);
 	tcase_add_test(tc, test_lookup);
 	tcase_add_test(tc, test_iter);
+	tcase_add_test(tc, test_remove);
+	tcase_add_test(tc, test_iter_from);
+	tcase_add_test(tc, test_large);
 	ADD_TCASE(tc);
 }
 TEST_MAIN_END
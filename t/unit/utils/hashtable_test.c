@@ -0,0 +1,231 @@
+/*
+ * SysDB - t/unit/utils/hashtable_test.c
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#	include "config.h"
+#endif
+
+#include "utils/hashtable.h"
+#include "testutils.h"
+
+#include <check.h>
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+static sdb_hashtable_t *table;
+
+/* enough objects to require the table to grow a couple of times */
+#define NUM_OBJECTS 100
+static char names[NUM_OBJECTS][16];
+static sdb_object_t objects[NUM_OBJECTS];
+
+static void
+setup(void)
+{
+	size_t i;
+
+	table = sdb_hashtable_create();
+	fail_unless(table != NULL,
+			"sdb_hashtable_create() = NULL; expected hash table object");
+
+	for (i = 0; i < NUM_OBJECTS; ++i) {
+		sdb_object_t o = SDB_OBJECT_STATIC(NULL);
+
+		snprintf(names[i], sizeof(names[i]), "Obj%zu", i);
+		o.name = names[i];
+		objects[i] = o;
+	}
+} /* setup */
+
+static void
+teardown(void)
+{
+	sdb_hashtable_destroy(table);
+	table = NULL;
+} /* teardown */
+
+static void
+populate(void)
+{
+	size_t i;
+	for (i = 0; i < NUM_OBJECTS; ++i)
+		sdb_hashtable_insert(table, &objects[i]);
+} /* populate */
+
+START_TEST(test_null)
+{
+	sdb_object_t o = SDB_OBJECT_STATIC("obj");
+	sdb_object_t *obj;
+	int check;
+
+	/* all functions should work even when passed null values */
+	sdb_hashtable_destroy(NULL);
+	sdb_hashtable_clear(NULL);
+
+	check = sdb_hashtable_insert(NULL, &o);
+	fail_unless(check < 0,
+			"sdb_hashtable_insert(NULL, <obj>) = %d; expected: <0", check);
+	fail_unless(o.ref_cnt == 1,
+			"sdb_hashtable_insert(NULL, <obj>) incremented ref-cnt");
+	check = sdb_hashtable_insert(table, NULL);
+	fail_unless(check < 0,
+			"sdb_hashtable_insert(<table>, NULL) = %d; expected: <0", check);
+
+	check = sdb_hashtable_remove(NULL, "obj");
+	fail_unless(check < 0,
+			"sdb_hashtable_remove(NULL, obj) = %d; expected: <0", check);
+	check = sdb_hashtable_remove(table, "obj");
+	fail_unless(check < 0,
+			"sdb_hashtable_remove(<empty table>, obj) = %d; expected: <0",
+			check);
+
+	obj = sdb_hashtable_lookup(NULL, "obj");
+	fail_unless(obj == NULL,
+			"sdb_hashtable_lookup(NULL, obj) = %p; expected: NULL", obj);
+	obj = sdb_hashtable_lookup(table, "obj");
+	fail_unless(obj == NULL,
+			"sdb_hashtable_lookup(<empty table>, obj) = %p; expected: NULL",
+			obj);
+
+	check = (int)sdb_hashtable_size(NULL);
+	fail_unless(check == 0,
+			"sdb_hashtable_size(NULL) = %d; expected: 0", check);
+}
+END_TEST
+
+START_TEST(test_insert_lookup)
+{
+	size_t i;
+
+	for (i = 0; i < NUM_OBJECTS; ++i) {
+		int check = sdb_hashtable_insert(table, &objects[i]);
+		fail_unless(check == 0,
+				"sdb_hashtable_insert(<table>, %s) = %d; expected: 0",
+				names[i], check);
+		fail_unless(sdb_hashtable_size(table) == i + 1,
+				"sdb_hashtable_size(<table>) = %zu; expected: %zu",
+				sdb_hashtable_size(table), i + 1);
+	}
+
+	for (i = 0; i < NUM_OBJECTS; ++i) {
+		sdb_object_t dup = SDB_OBJECT_STATIC(NULL);
+		char upper[16];
+		sdb_object_t *obj;
+		int check;
+		size_t j;
+
+		for (j = 0; names[i][j]; ++j)
+			upper[j] = (char)toupper((int)names[i][j]);
+		upper[j] = '\0';
+
+		obj = sdb_hashtable_lookup(table, upper);
+		fail_unless(obj == &objects[i],
+				"sdb_hashtable_lookup(<table>, %s) = %p; expected: %p (%s)",
+				upper, obj, &objects[i], names[i]);
+		sdb_object_deref(obj);
+
+		/* names are compared ignoring case */
+		dup.name = upper;
+		check = sdb_hashtable_insert(table, &dup);
+		fail_unless(check < 0,
+				"sdb_hashtable_insert(<table>, %s) = %d (duplicate); "
+				"expected: <0", upper, check);
+	}
+
+	fail_unless(sdb_hashtable_lookup(table, "Obj") == NULL,
+			"sdb_hashtable_lookup(<table>, Obj) = <obj>; expected: NULL");
+
+	for (i = 0; i < NUM_OBJECTS; ++i)
+		fail_unless(objects[i].ref_cnt == 2,
+				"sdb_hashtable_insert() left ref-cnt of %s at %d; "
+				"expected: 2", names[i], objects[i].ref_cnt);
+	sdb_hashtable_clear(table);
+	for (i = 0; i < NUM_OBJECTS; ++i)
+		fail_unless(objects[i].ref_cnt == 1,
+				"sdb_hashtable_clear() left ref-cnt of %s at %d; "
+				"expected: 1", names[i], objects[i].ref_cnt);
+}
+END_TEST
+
+START_TEST(test_remove)
+{
+	size_t i;
+
+	populate();
+
+	/* remove all objects in scrambled order; all remaining objects have to
+	 * be found after each step */
+	for (i = 0; i < NUM_OBJECTS; ++i) {
+		size_t idx = (37 * i) % NUM_OBJECTS;
+		int check;
+		size_t j;
+
+		check = sdb_hashtable_remove(table, names[idx]);
+		fail_unless(check == 0,
+				"sdb_hashtable_remove(<table>, %s) = %d; expected: 0",
+				names[idx], check);
+		fail_unless(objects[idx].ref_cnt == 1,
+				"sdb_hashtable_remove(<table>, %s) left ref-cnt at %d; "
+				"expected: 1", names[idx], objects[idx].ref_cnt);
+
+		check = sdb_hashtable_remove(table, names[idx]);
+		fail_unless(check < 0,
+				"sdb_hashtable_remove(<table>, %s) = %d (redo); "
+				"expected: <0", names[idx], check);
+
+		for (j = 0; j < NUM_OBJECTS; ++j) {
+			sdb_object_t *obj = sdb_hashtable_lookup(table, names[j]);
+			bool removed = objects[j].ref_cnt == 1;
+
+			if (obj)
+				sdb_object_deref(obj);
+			fail_unless(removed ? obj == NULL : obj == &objects[j],
+					"sdb_hashtable_lookup(<table>, %s) = %p after removing "
+					"%s; expected: %p", names[j], obj, names[idx],
+					removed ? NULL : &objects[j]);
+		}
+	}
+
+	fail_unless(sdb_hashtable_size(table) == 0,
+			"sdb_hashtable_size(<table>) = %zu after removing all objects; "
+			"expected: 0", sdb_hashtable_size(table));
+}
+END_TEST
+
+TEST_MAIN("utils::hashtable")
+{
+	TCase *tc = tcase_create("core");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_null);
+	tcase_add_test(tc, test_insert_lookup);
+	tcase_add_test(tc, test_remove);
+	ADD_TCASE(tc);
+}
+TEST_MAIN_END
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
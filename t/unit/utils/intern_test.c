@@ -0,0 +1,183 @@
+/*
+ * SysDB - t/unit/utils/intern_test.c
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#	include "config.h"
+#endif
+
+#include "utils/intern.h"
+#include "testutils.h"
+
+#include <check.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+/* enough strings to require the table to grow a couple of times */
+#define NUM_STRINGS 5000
+
+START_TEST(test_null)
+{
+	fail_unless(sdb_intern(NULL) == NULL,
+			"sdb_intern(NULL) = <str>; expected: NULL");
+	/* this should not crash */
+	sdb_intern_release(NULL);
+}
+END_TEST
+
+START_TEST(test_intern)
+{
+	char buf[] = "intern-test";
+	char *s1, *s2, *s3;
+	size_t size = sdb_intern_size();
+
+	s1 = sdb_intern(buf);
+	fail_unless(s1 != NULL,
+			"sdb_intern(%s) = NULL; expected: <str>", buf);
+	fail_unless((s1 != buf) && (! strcmp(s1, buf)),
+			"sdb_intern(%s) = %s (%p); expected: a copy of %s", buf,
+			s1, s1, buf);
+	fail_unless(sdb_intern_size() == size + 1,
+			"sdb_intern_size() = %zu; expected: %zu",
+			sdb_intern_size(), size + 1);
+
+	/* equal strings share the same copy */
+	s2 = sdb_intern("intern-test");
+	fail_unless(s2 == s1,
+			"sdb_intern(intern-test) = %p; expected: %p (existing copy)",
+			s2, s1);
+	fail_unless(sdb_intern_size() == size + 1,
+			"sdb_intern_size() = %zu after interning a known string; "
+			"expected: %zu", sdb_intern_size(), size + 1);
+
+	/* ... but interning is case-sensitive */
+	s3 = sdb_intern("INTERN-TEST");
+	fail_unless((s3 != NULL) && (s3 != s1),
+			"sdb_intern(INTERN-TEST) = %p; expected: a new copy", s3);
+
+	sdb_intern_release(s3);
+	sdb_intern_release(s2);
+	fail_unless(sdb_intern_size() == size + 1,
+			"sdb_intern_size() = %zu while references remain; "
+			"expected: %zu", sdb_intern_size(), size + 1);
+	fail_unless(! strcmp(s1, buf),
+			"interned string changed to %s; expected: %s", s1, buf);
+	sdb_intern_release(s1);
+	fail_unless(sdb_intern_size() == size,
+			"sdb_intern_size() = %zu after releasing all references; "
+			"expected: %zu", sdb_intern_size(), size);
+}
+END_TEST
+
+static char *strings[NUM_STRINGS];
+
+START_TEST(test_many)
+{
+	size_t size = sdb_intern_size();
+	size_t i;
+
+	for (i = 0; i < NUM_STRINGS; ++i) {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "string%zu", i);
+		strings[i] = sdb_intern(buf);
+		fail_unless(strings[i] != NULL,
+				"sdb_intern(%s) = NULL; expected: <str>", buf);
+	}
+	fail_unless(sdb_intern_size() == size + NUM_STRINGS,
+			"sdb_intern_size() = %zu; expected: %zu",
+			sdb_intern_size(), size + NUM_STRINGS);
+
+	for (i = 0; i < NUM_STRINGS; ++i) {
+		char buf[32];
+		char *s;
+
+		snprintf(buf, sizeof(buf), "string%zu", i);
+		s = sdb_intern(buf);
+		fail_unless(s == strings[i],
+				"sdb_intern(%s) = %p; expected: %p", buf, s, strings[i]);
+		sdb_intern_release(s);
+		sdb_intern_release(strings[i]);
+	}
+	fail_unless(sdb_intern_size() == size,
+			"sdb_intern_size() = %zu after releasing all strings; "
+			"expected: %zu", sdb_intern_size(), size);
+}
+END_TEST
+
+static void *
+intern_loop(void __attribute__((unused)) *arg)
+{
+	size_t i;
+
+	for (i = 0; i < 100000; ++i) {
+		char buf[32];
+		char *s;
+
+		snprintf(buf, sizeof(buf), "shared%zu", i % 10);
+		s = sdb_intern(buf);
+		if ((! s) || strcmp(s, buf))
+			return s;
+		sdb_intern_release(s);
+	}
+	return NULL;
+} /* intern_loop */
+
+START_TEST(test_threads)
+{
+	pthread_t threads[4];
+	size_t size = sdb_intern_size();
+	size_t i;
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(threads); ++i)
+		fail_unless(pthread_create(threads + i, NULL, intern_loop, NULL) == 0,
+				"INTERNAL ERROR: failed to create thread");
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(threads); ++i) {
+		void *ret = NULL;
+		pthread_join(threads[i], &ret);
+		fail_unless(ret == NULL,
+				"concurrent sdb_intern() returned unexpected string %s",
+				(char *)ret);
+	}
+
+	fail_unless(sdb_intern_size() == size,
+			"sdb_intern_size() = %zu after concurrent interning; "
+			"expected: %zu", sdb_intern_size(), size);
+}
+END_TEST
+
+TEST_MAIN("utils::intern")
+{
+	TCase *tc = tcase_create("core");
+	tcase_add_test(tc, test_null);
+	tcase_add_test(tc, test_intern);
+	tcase_add_test(tc, test_many);
+	tcase_add_test(tc, test_threads);
+	ADD_TCASE(tc);
+}
+TEST_MAIN_END
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */
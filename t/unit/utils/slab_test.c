@@ -0,0 +1,184 @@
+/*
+ * SysDB - t/unit/utils/slab_test.c
+ * Copyright (C) 2015 Sebastian 'tokkee' Harl <sh@tokkee.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#	include "config.h"
+#endif
+
+#include "utils/slab.h"
+#include "testutils.h"
+
+#include <check.h>
+#include <stdint.h>
+#include <string.h>
+
+static sdb_slab_t *slab;
+
+/* enough chunks to fill a couple of pages */
+#define NUM_CHUNKS 10000
+static void *chunks[NUM_CHUNKS];
+
+static void
+setup(void)
+{
+	slab = sdb_slab_create();
+	fail_unless(slab != NULL,
+			"sdb_slab_create() = NULL; expected slab object");
+} /* setup */
+
+static void
+teardown(void)
+{
+	sdb_slab_destroy(slab);
+	slab = NULL;
+} /* teardown */
+
+START_TEST(test_null)
+{
+	size_t pages = 1, num = 1;
+
+	/* all functions should work even when passed null values */
+	sdb_slab_destroy(NULL);
+	sdb_slab_free(NULL);
+
+	fail_unless(sdb_slab_alloc(NULL, 16) == NULL,
+			"sdb_slab_alloc(NULL, 16) = <ptr>; expected: NULL");
+
+	sdb_slab_stats(NULL, &pages, &num);
+	fail_unless((pages == 0) && (num == 0),
+			"sdb_slab_stats(NULL) = %zu pages, %zu chunks; expected: 0, 0",
+			pages, num);
+	sdb_slab_stats(slab, NULL, NULL);
+}
+END_TEST
+
+START_TEST(test_alloc_free)
+{
+	size_t pages = 0, num = 0, max_pages;
+	size_t i;
+
+	for (i = 0; i < NUM_CHUNKS; ++i) {
+		size_t size = i % 100 + 1;
+
+		chunks[i] = sdb_slab_alloc(slab, size);
+		fail_unless(chunks[i] != NULL,
+				"sdb_slab_alloc(<slab>, %zu) = NULL; expected: <ptr>", size);
+		fail_unless(! ((uintptr_t)chunks[i] % 16),
+				"sdb_slab_alloc(<slab>, %zu) = %p; expected aligned pointer",
+				size, chunks[i]);
+		memset(chunks[i], (int)(i % 256), size);
+	}
+
+	sdb_slab_stats(slab, &pages, &num);
+	fail_unless(num == NUM_CHUNKS,
+			"sdb_slab_stats() = %zu chunks; expected: %d", num, NUM_CHUNKS);
+	fail_unless(pages > 1,
+			"sdb_slab_stats() = %zu pages; expected: >1", pages);
+	max_pages = pages;
+
+	/* chunks don't overlap */
+	for (i = 0; i < NUM_CHUNKS; ++i) {
+		size_t size = i % 100 + 1, j;
+		unsigned char *c = chunks[i];
+
+		for (j = 0; j < size; ++j)
+			fail_unless(c[j] == i % 256,
+					"chunk %zu byte %zu = %u; expected: %zu",
+					i, j, c[j], i % 256);
+	}
+
+	/* freed chunks are reused */
+	for (i = 0; i < NUM_CHUNKS; i += 2)
+		sdb_slab_free(chunks[i]);
+	for (i = 0; i < NUM_CHUNKS; i += 2) {
+		chunks[i] = sdb_slab_alloc(slab, i % 100 + 1);
+		fail_unless(chunks[i] != NULL,
+				"sdb_slab_alloc(<slab>, %zu) = NULL; expected: <ptr>",
+				i % 100 + 1);
+	}
+	sdb_slab_stats(slab, &pages, &num);
+	fail_unless(pages == max_pages,
+			"sdb_slab_stats() = %zu pages after reallocating freed chunks; "
+			"expected: %zu", pages, max_pages);
+
+	/* empty pages are released */
+	for (i = 0; i < NUM_CHUNKS; ++i)
+		sdb_slab_free(chunks[i]);
+	sdb_slab_stats(slab, &pages, &num);
+	fail_unless(num == 0,
+			"sdb_slab_stats() = %zu chunks after freeing all chunks; "
+			"expected: 0", num);
+	fail_unless(pages < max_pages,
+			"sdb_slab_stats() = %zu pages after freeing all chunks; "
+			"expected: <%zu", pages, max_pages);
+}
+END_TEST
+
+START_TEST(test_large)
+{
+	size_t sizes[] = { 1025, 4096, 100000 };
+	void *ptrs[SDB_STATIC_ARRAY_LEN(sizes)];
+	size_t pages = 0, num = 0;
+	size_t i;
+
+	for (i = 0; i < SDB_STATIC_ARRAY_LEN(sizes); ++i) {
+		ptrs[i] = sdb_slab_alloc(slab, sizes[i]);
+		fail_unless(ptrs[i] != NULL,
+				"sdb_slab_alloc(<slab>, %zu) = NULL; expected: <ptr>",
+				sizes[i]);
+		memset(ptrs[i], 0x42, sizes[i]);
+	}
+
+	sdb_slab_stats(slab, &pages, &num);
+	fail_unless((pages == SDB_STATIC_ARRAY_LEN(sizes))
+				&& (num == SDB_STATIC_ARRAY_LEN(sizes)),
+			"sdb_slab_stats() = %zu pages, %zu chunks; expected: %zu, %zu",
+			pages, num, SDB_STATIC_ARRAY_LEN(sizes),
+			SDB_STATIC_ARRAY_LEN(sizes));
+
+	sdb_slab_free(ptrs[1]);
+	sdb_slab_stats(slab, &pages, &num);
+	fail_unless(num == SDB_STATIC_ARRAY_LEN(sizes) - 1,
+			"sdb_slab_stats() = %zu chunks after free; expected: %zu",
+			num, SDB_STATIC_ARRAY_LEN(sizes) - 1);
+
+	/* the remaining chunks are released by sdb_slab_destroy() */
+}
+END_TEST
+
+TEST_MAIN("utils::slab")
+{
+	TCase *tc = tcase_create("core");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, test_null);
+	tcase_add_test(tc, test_alloc_free);
+	tcase_add_test(tc, test_large);
+	ADD_TCASE(tc);
+}
+TEST_MAIN_END
+
+/* vim: set tw=78 sw=4 ts=4 noexpandtab : */